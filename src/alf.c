@@ -4225,6 +4225,7 @@ static void alf_get_avai_aps_ids_luma(encoder_state_t * const state,
 
 
 static void alf_derive_stats_for_filtering(encoder_state_t * const state,
+  const int lcu_row,
   short alf_clipping_values[MAX_NUM_CHANNEL_TYPE][MAX_ALF_NUM_CLIPPING_VALUES])
 {
   alf_info_t *alf_info = state->tile->frame->alf_info;
@@ -4232,99 +4233,100 @@ static void alf_derive_stats_for_filtering(encoder_state_t * const state,
   bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
   bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
 
-  const int32_t num_ctus_in_pic = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
   const int alf_vb_luma_ctu_height = LCU_WIDTH;
   const int alf_vb_chma_ctu_height = (LCU_WIDTH >> ((chroma_fmt == UVG_CSP_420) ? 1 : 0));
   const int alf_vb_luma_pos = LCU_WIDTH - ALF_VB_POS_ABOVE_CTUROW_LUMA;
   const int alf_vb_chma_pos = (LCU_WIDTH >> ((chroma_fmt == UVG_CSP_420) ? 1 : 0)) - ALF_VB_POS_ABOVE_CTUROW_CHMA;
   int32_t pic_width = state->tile->frame->width;
   int32_t pic_height = state->tile->frame->height;
-  int ctu_rs_addr = 0;
+  int ctu_rs_addr = lcu_row * state->tile->frame->width_in_lcu;
 
   const int number_of_components = (chroma_fmt == UVG_CSP_400) ? 1 : MAX_NUM_COMPONENT;
 
-  // init CTU stats buffers
+  alf_covariance* alf_cov;
+  const int y_pos = lcu_row * LCU_WIDTH;
+  for (int x_pos = 0; x_pos < pic_width; x_pos += LCU_WIDTH)
   {
-    for (int ctu_idx = 0; ctu_idx < num_ctus_in_pic; ctu_idx++)
+    const int width = (x_pos + LCU_WIDTH > pic_width) ? (pic_width - x_pos) : LCU_WIDTH;
+    const int height = (y_pos + LCU_WIDTH > pic_height) ? (pic_height - y_pos) : LCU_WIDTH;
+    for (int comp_idx = 0; comp_idx < number_of_components; comp_idx++)
     {
-      for (int class_idx = 0; class_idx < MAX_NUM_ALF_CLASSES; class_idx++)
-      {
-        reset_alf_covariance(&state->tile->frame->alf_info->alf_covariance_y[(ctu_idx * MAX_NUM_ALF_CLASSES) + class_idx], MAX_ALF_NUM_CLIPPING_VALUES);
+      alf_cov = comp_idx == COMPONENT_Y ? alf_info->alf_covariance_y :
+        comp_idx == COMPONENT_Cb ? alf_info->alf_covariance_u :
+        comp_idx == COMPONENT_Cr ? alf_info->alf_covariance_v : NULL;
+
+      if (alf_cov == NULL) {
+        assert(0);
       }
-    }
 
-    for (int ctu_idx = 0; ctu_idx < num_ctus_in_pic; ctu_idx++)
-    {
-      reset_alf_covariance(&state->tile->frame->alf_info->alf_covariance_u[ctu_idx], MAX_ALF_NUM_CLIPPING_VALUES);
-      reset_alf_covariance(&state->tile->frame->alf_info->alf_covariance_v[ctu_idx], MAX_ALF_NUM_CLIPPING_VALUES);
+      const bool is_luma = comp_idx == COMPONENT_Y ? 1 : 0;
+      channel_type ch_type = is_luma ? CHANNEL_TYPE_LUMA : CHANNEL_TYPE_CHROMA;
+
+      int blk_w = is_luma ? width : width >> chroma_scale_x;
+      int blk_h = is_luma ? height : height >> chroma_scale_y;
+      int pos_x = is_luma ? x_pos : x_pos >> chroma_scale_x;
+      int pos_y = is_luma ? y_pos : y_pos >> chroma_scale_y;
+
+      int32_t org_stride = is_luma ? state->tile->frame->source->stride : state->tile->frame->source->stride >> chroma_scale_x;
+      int32_t rec_stride = is_luma ? state->tile->frame->rec->stride : state->tile->frame->rec->stride >> chroma_scale_x;
+
+      uvg_pixel *org = comp_idx ? (comp_idx - 1 ? &state->tile->frame->source->v[pos_x + pos_y * org_stride] : &state->tile->frame->source->u[pos_x + pos_y * org_stride]) : &state->tile->frame->source->y[pos_x + pos_y * org_stride];
+      uvg_pixel *rec = comp_idx ? (comp_idx - 1 ? &state->tile->frame->rec->v[pos_x + pos_y * rec_stride] : &state->tile->frame->rec->u[pos_x + pos_y * rec_stride]) : &state->tile->frame->rec->y[pos_x + pos_y * rec_stride];
+
+      const int num_classes = is_luma ? MAX_NUM_ALF_CLASSES : 1;
+      const int cov_index = ctu_rs_addr * num_classes;
+      for (int class_idx = 0; class_idx < num_classes; class_idx++)
+      {
+        reset_alf_covariance(&alf_cov[cov_index + class_idx], MAX_ALF_NUM_CLIPPING_VALUES);
+      }
+      uvg_alf_get_blk_stats(state, ch_type,
+        &alf_cov[cov_index],
+        comp_idx ? NULL : alf_info->classifier,
+        org, org_stride, rec, rec_stride, pos_x, pos_y, pos_x, pos_y, blk_w, blk_h,
+        (is_luma ? alf_vb_luma_ctu_height : alf_vb_chma_ctu_height),
+        (is_luma) ? alf_vb_luma_pos : alf_vb_chma_pos,
+        alf_clipping_values
+      );
     }
+    ctu_rs_addr++;
   }
+}
 
-  // init Frame stats buffers
-  const int number_of_channels = (chroma_fmt == UVG_CSP_400) ? 1 : MAX_NUM_CHANNEL_TYPE;
-  for (int channel_idx = 0; channel_idx < number_of_channels; channel_idx++)
+/**
+ * \brief Sum the statistics of all CTUs to the statistics of the frame.
+ *
+ * The CTUs are summed in raster order so that the result does not depend
+ * on the order the CTU statistics were collected in.
+ */
+static void alf_derive_frame_stats_for_filtering(encoder_state_t * const state)
+{
+  alf_info_t *alf_info = state->tile->frame->alf_info;
+  enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
+  const int32_t num_ctus_in_pic = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
+  const int number_of_components = (chroma_fmt == UVG_CSP_400) ? 1 : MAX_NUM_COMPONENT;
+
+  for (int class_idx = 0; class_idx < MAX_NUM_ALF_CLASSES; class_idx++)
   {
-    const channel_type channel_id = channel_idx;
-    const int num_classes = channel_id == CHANNEL_TYPE_LUMA ? MAX_NUM_ALF_CLASSES : 1;
-    for (int class_idx = 0; class_idx < num_classes; class_idx++)
-    {
-      reset_alf_covariance(&alf_info->alf_covariance_frame_luma[class_idx], MAX_ALF_NUM_CLIPPING_VALUES);
-    }
-    reset_alf_covariance(&alf_info->alf_covariance_frame_chroma[0], MAX_ALF_NUM_CLIPPING_VALUES);
+    reset_alf_covariance(&alf_info->alf_covariance_frame_luma[class_idx], MAX_ALF_NUM_CLIPPING_VALUES);
   }
+  reset_alf_covariance(&alf_info->alf_covariance_frame_chroma[0], MAX_ALF_NUM_CLIPPING_VALUES);
 
-  alf_covariance* alf_cov;
-  alf_covariance* alf_cov_frame;
-  for (int y_pos = 0; y_pos < pic_height; y_pos += LCU_WIDTH)
+  for (int ctu_idx = 0; ctu_idx < num_ctus_in_pic; ctu_idx++)
   {
-    for (int x_pos = 0; x_pos < pic_width; x_pos += LCU_WIDTH)
+    for (int comp_idx = 0; comp_idx < number_of_components; comp_idx++)
     {
-      const int width = (x_pos + LCU_WIDTH > pic_width) ? (pic_width - x_pos) : LCU_WIDTH;
-      const int height = (y_pos + LCU_WIDTH > pic_height) ? (pic_height - y_pos) : LCU_WIDTH;
-      for (int comp_idx = 0; comp_idx < number_of_components; comp_idx++)
-      {
-        alf_cov = comp_idx == COMPONENT_Y ? state->tile->frame->alf_info->alf_covariance_y :
-          comp_idx == COMPONENT_Cb ? state->tile->frame->alf_info->alf_covariance_u :
-          comp_idx == COMPONENT_Cr ? state->tile->frame->alf_info->alf_covariance_v : NULL;
-
-        if (alf_cov == NULL) {
-          assert(0);
-        }
+      const bool is_luma = comp_idx == COMPONENT_Y ? 1 : 0;
+      alf_covariance *alf_cov = comp_idx == COMPONENT_Y ? alf_info->alf_covariance_y :
+        comp_idx == COMPONENT_Cb ? alf_info->alf_covariance_u : alf_info->alf_covariance_v;
+      alf_covariance *alf_cov_frame = is_luma ? alf_info->alf_covariance_frame_luma : alf_info->alf_covariance_frame_chroma;
 
-        const bool is_luma = comp_idx == COMPONENT_Y ? 1 : 0;
-        channel_type ch_type = is_luma ? CHANNEL_TYPE_LUMA : CHANNEL_TYPE_CHROMA;
-        alf_cov_frame = is_luma ? alf_info->alf_covariance_frame_luma : alf_info->alf_covariance_frame_chroma;
-
-        int blk_w = is_luma ? width : width >> chroma_scale_x;
-        int blk_h = is_luma ? height : height >> chroma_scale_y;
-        int pos_x = is_luma ? x_pos : x_pos >> chroma_scale_x;
-        int pos_y = is_luma ? y_pos : y_pos >> chroma_scale_y;
-
-        int32_t org_stride = is_luma ? state->tile->frame->source->stride : state->tile->frame->source->stride >> chroma_scale_x;
-        int32_t rec_stride = is_luma ? state->tile->frame->rec->stride : state->tile->frame->rec->stride >> chroma_scale_x;
-
-        uvg_pixel *org = comp_idx ? (comp_idx - 1 ? &state->tile->frame->source->v[pos_x + pos_y * org_stride] : &state->tile->frame->source->u[pos_x + pos_y * org_stride]) : &state->tile->frame->source->y[pos_x + pos_y * org_stride];
-        uvg_pixel *rec = comp_idx ? (comp_idx - 1 ? &state->tile->frame->rec->v[pos_x + pos_y * rec_stride] : &state->tile->frame->rec->u[pos_x + pos_y * rec_stride]) : &state->tile->frame->rec->y[pos_x + pos_y * rec_stride];
-
-        const int num_classes = is_luma ? MAX_NUM_ALF_CLASSES : 1;
-        const int cov_index = ctu_rs_addr * num_classes;
-        uvg_alf_get_blk_stats(state, ch_type,
-          &alf_cov[cov_index],
-          comp_idx ? NULL : alf_info->classifier,
-          org, org_stride, rec, rec_stride, pos_x, pos_y, pos_x, pos_y, blk_w, blk_h,
-          (is_luma ? alf_vb_luma_ctu_height : alf_vb_chma_ctu_height),
-          (is_luma) ? alf_vb_luma_pos : alf_vb_chma_pos,
-          alf_clipping_values
+      const int num_classes = is_luma ? MAX_NUM_ALF_CLASSES : 1;
+      for (int class_idx = 0; class_idx < num_classes; class_idx++)
+      {
+        add_alf_cov(&alf_cov_frame[is_luma ? class_idx : 0],
+          &alf_cov[ctu_idx * num_classes + class_idx]
         );
-
-        for (int class_idx = 0; class_idx < num_classes; class_idx++)
-        {
-          add_alf_cov(&alf_cov_frame[is_luma ? class_idx : 0],
-            &alf_cov[cov_index + class_idx]
-          );
-        }
       }
-      ctu_rs_addr++;
     }
   }
 }
@@ -5029,7 +5031,13 @@ static void alf_encoder_ctb(encoder_state_t * const state,
 }
 
 
-static void alf_reconstruct(encoder_state_t * const state,
+/**
+ * \brief Prepare the ALF filtering of a frame.
+ *
+ * Reconstructs the filter coefficients and copies the unfiltered samples
+ * to a buffer the filtering reads from.
+ */
+static void alf_reconstruct_prepare(encoder_state_t * const state,
   array_variables *arr_vars)
 {
   if (!state->slice->alf->tile_group_alf_enabled_flag[COMPONENT_Y])
@@ -5040,22 +5048,11 @@ static void alf_reconstruct(encoder_state_t * const state,
   alf_reconstruct_coeff_aps(state, true, state->slice->alf->tile_group_alf_enabled_flag[COMPONENT_Cb] || state->slice->alf->tile_group_alf_enabled_flag[COMPONENT_Cr], false, arr_vars);
 
   alf_info_t *alf_info = state->tile->frame->alf_info;
-  bool **ctu_enable_flags = alf_info->ctu_enable_flag;
   enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
   bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
   bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
 
-  const int alf_vb_luma_ctu_height = LCU_WIDTH;
-  const int alf_vb_chma_ctu_height = (LCU_WIDTH >> ((chroma_fmt == UVG_CSP_420) ? 1 : 0));
-  const int alf_vb_luma_pos = LCU_WIDTH - ALF_VB_POS_ABOVE_CTUROW_LUMA;
-  const int alf_vb_chma_pos = (LCU_WIDTH >> ((chroma_fmt == UVG_CSP_420) ? 1 : 0)) - ALF_VB_POS_ABOVE_CTUROW_CHMA;
   const int luma_height = state->tile->frame->height;
-  const int luma_width = state->tile->frame->width;
-  const int max_cu_width = LCU_WIDTH;
-  const int max_cu_height = LCU_WIDTH;
-
-  int ctu_idx = 0;
-
   const int luma_stride = state->tile->frame->rec->stride;
   const int chroma_stride = luma_stride >> chroma_scale_x;
   const int chroma_height = luma_height >> chroma_scale_y;
@@ -5071,67 +5068,95 @@ static void alf_reconstruct(encoder_state_t * const state,
     sizeof(uvg_pixel) * chroma_stride * (chroma_height + chroma_padding * 2));
   memcpy(&alf_info->alf_tmp_v[index_chroma], &state->tile->frame->rec->v[index_chroma],
     sizeof(uvg_pixel) * chroma_stride * (chroma_height + chroma_padding * 2));
+}
 
-  for (int y_pos = 0; y_pos < luma_height; y_pos += max_cu_height)
+static void alf_reconstruct(encoder_state_t * const state,
+  array_variables *arr_vars,
+  const int lcu_row)
+{
+  if (!state->slice->alf->tile_group_alf_enabled_flag[COMPONENT_Y])
   {
-    for (int x_pos = 0; x_pos < luma_width; x_pos += max_cu_width)
-    {
+    return;
+  }
+
+  alf_info_t *alf_info = state->tile->frame->alf_info;
+  bool **ctu_enable_flags = alf_info->ctu_enable_flag;
+  enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
+  bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
+  bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
 
-      const int width = (x_pos + max_cu_width > luma_width) ? (luma_width - x_pos) : max_cu_width;
-      const int height = (y_pos + max_cu_height > luma_height) ? (luma_height - y_pos) : max_cu_height;
+  const int alf_vb_luma_ctu_height = LCU_WIDTH;
+  const int alf_vb_chma_ctu_height = (LCU_WIDTH >> ((chroma_fmt == UVG_CSP_420) ? 1 : 0));
+  const int alf_vb_luma_pos = LCU_WIDTH - ALF_VB_POS_ABOVE_CTUROW_LUMA;
+  const int alf_vb_chma_pos = (LCU_WIDTH >> ((chroma_fmt == UVG_CSP_420) ? 1 : 0)) - ALF_VB_POS_ABOVE_CTUROW_CHMA;
+  const int luma_height = state->tile->frame->height;
+  const int luma_width = state->tile->frame->width;
+  const int max_cu_width = LCU_WIDTH;
+  const int max_cu_height = LCU_WIDTH;
 
-      bool ctu_enable_flag = ctu_enable_flags[COMPONENT_Y][ctu_idx];
-      for (int comp_idx = 1; comp_idx < MAX_NUM_COMPONENT; comp_idx++)
-      {
-        ctu_enable_flag |= ctu_enable_flags[comp_idx][ctu_idx] > 0;
-      }
+  int ctu_idx = lcu_row * state->tile->frame->width_in_lcu;
 
+  const int luma_stride = state->tile->frame->rec->stride;
+  const int chroma_stride = luma_stride >> chroma_scale_x;
+
+  const int y_pos = lcu_row * max_cu_height;
+  for (int x_pos = 0; x_pos < luma_width; x_pos += max_cu_width)
+  {
+
+    const int width = (x_pos + max_cu_width > luma_width) ? (luma_width - x_pos) : max_cu_width;
+    const int height = (y_pos + max_cu_height > luma_height) ? (luma_height - y_pos) : max_cu_height;
+
+    bool ctu_enable_flag = ctu_enable_flags[COMPONENT_Y][ctu_idx];
+    for (int comp_idx = 1; comp_idx < MAX_NUM_COMPONENT; comp_idx++)
+    {
+      ctu_enable_flag |= ctu_enable_flags[comp_idx][ctu_idx] > 0;
+    }
+
+    {
+      if (ctu_enable_flags[COMPONENT_Y][ctu_idx])
       {
-        if (ctu_enable_flags[COMPONENT_Y][ctu_idx])
+        short filter_set_index = alf_info->alf_ctb_filter_index[ctu_idx];
+        short *coeff;
+        int16_t *clip;
+        if (filter_set_index >= ALF_NUM_FIXED_FILTER_SETS)
         {
-          short filter_set_index = alf_info->alf_ctb_filter_index[ctu_idx];
-          short *coeff;
-          int16_t *clip;
-          if (filter_set_index >= ALF_NUM_FIXED_FILTER_SETS)
-          {
-            coeff = arr_vars->coeff_aps_luma[filter_set_index - ALF_NUM_FIXED_FILTER_SETS];
-            clip = arr_vars->clipp_aps_luma[filter_set_index - ALF_NUM_FIXED_FILTER_SETS];
-          }
-          else
-          {
-            coeff = arr_vars->fixed_filter_set_coeff_dec[filter_set_index];
-            clip = arr_vars->clip_default;
-          }
-          uvg_alf_filter_7x7_blk(state,
-            alf_info->alf_tmp_y, state->tile->frame->rec->y,
-            luma_stride, luma_stride,
-            coeff, clip, arr_vars->clp_rngs.comp[COMPONENT_Y],
-            width, height, x_pos, y_pos, x_pos, y_pos,
-            alf_vb_luma_pos, alf_vb_luma_ctu_height);
+          coeff = arr_vars->coeff_aps_luma[filter_set_index - ALF_NUM_FIXED_FILTER_SETS];
+          clip = arr_vars->clipp_aps_luma[filter_set_index - ALF_NUM_FIXED_FILTER_SETS];
         }
-        for (int comp_idx = 1; comp_idx < MAX_NUM_COMPONENT; comp_idx++)
+        else
         {
-          alf_component_id comp_id = comp_idx;
+          coeff = arr_vars->fixed_filter_set_coeff_dec[filter_set_index];
+          clip = arr_vars->clip_default;
+        }
+        uvg_alf_filter_7x7_blk(state,
+          alf_info->alf_tmp_y, state->tile->frame->rec->y,
+          luma_stride, luma_stride,
+          coeff, clip, arr_vars->clp_rngs.comp[COMPONENT_Y],
+          width, height, x_pos, y_pos, x_pos, y_pos,
+          alf_vb_luma_pos, alf_vb_luma_ctu_height);
+      }
+      for (int comp_idx = 1; comp_idx < MAX_NUM_COMPONENT; comp_idx++)
+      {
+        alf_component_id comp_id = comp_idx;
 
-          if (ctu_enable_flags[comp_idx][ctu_idx])
-          {
-            uvg_pixel *dst_pixels = comp_id - 1 ? state->tile->frame->rec->v : state->tile->frame->rec->u;
-            const uvg_pixel *src_pixels = comp_id - 1 ? alf_info->alf_tmp_v : alf_info->alf_tmp_u;
-
-            const int alt_num = alf_info->ctu_alternative[comp_id][ctu_idx];
-            uvg_alf_filter_5x5_blk(state,
-              src_pixels, dst_pixels,
-              chroma_stride, chroma_stride,
-              arr_vars->chroma_coeff_final[alt_num], arr_vars->chroma_clipp_final[alt_num], arr_vars->clp_rngs.comp[comp_idx],
-              width >> chroma_scale_x, height >> chroma_scale_y,
-              x_pos >> chroma_scale_x, y_pos >> chroma_scale_y,
-              x_pos >> chroma_scale_x, y_pos >> chroma_scale_y,
-              alf_vb_chma_pos, alf_vb_chma_ctu_height);
-          }
+        if (ctu_enable_flags[comp_idx][ctu_idx])
+        {
+          uvg_pixel *dst_pixels = comp_id - 1 ? state->tile->frame->rec->v : state->tile->frame->rec->u;
+          const uvg_pixel *src_pixels = comp_id - 1 ? alf_info->alf_tmp_v : alf_info->alf_tmp_u;
+
+          const int alt_num = alf_info->ctu_alternative[comp_id][ctu_idx];
+          uvg_alf_filter_5x5_blk(state,
+            src_pixels, dst_pixels,
+            chroma_stride, chroma_stride,
+            arr_vars->chroma_coeff_final[alt_num], arr_vars->chroma_clipp_final[alt_num], arr_vars->clp_rngs.comp[comp_idx],
+            width >> chroma_scale_x, height >> chroma_scale_y,
+            x_pos >> chroma_scale_x, y_pos >> chroma_scale_y,
+            x_pos >> chroma_scale_x, y_pos >> chroma_scale_y,
+            alf_vb_chma_pos, alf_vb_chma_ctu_height);
         }
       }
-      ctu_idx++;
     }
+    ctu_idx++;
   }
 }
 
@@ -5143,37 +5168,12 @@ static void alf_derive_classification(encoder_state_t * const state,
   const int blk_dst_x,
   const int blk_dst_y)
 {
-  enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
-  bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
-  bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
-
   const int alf_vb_luma_ctu_height = LCU_WIDTH;
   const int alf_vb_luma_pos = LCU_WIDTH - ALF_VB_POS_ABOVE_CTUROW_LUMA;
-  int32_t pic_height = state->tile->frame->rec->height;
-  int32_t pic_width = state->tile->frame->rec->width;
 
   int max_height = y_pos + height;
   int max_width = x_pos + width;
 
-  adjust_pixels(state->tile->frame->rec->y, x_pos, pic_width, y_pos, pic_height, state->tile->frame->rec->stride,
-    pic_width, pic_height);
-  adjust_pixels_chroma(state->tile->frame->rec->u,
-    x_pos >> chroma_scale_x,
-    pic_width >> chroma_scale_x,
-    y_pos >> chroma_scale_y,
-    pic_height >> chroma_scale_y,
-    state->tile->frame->rec->stride >> chroma_scale_x,
-    pic_width >> chroma_scale_x,
-    pic_height >> chroma_scale_y);
-  adjust_pixels_chroma(state->tile->frame->rec->v,
-    x_pos >> chroma_scale_x,
-    pic_width >> chroma_scale_x,
-    y_pos >> chroma_scale_y,
-    pic_height >> chroma_scale_y,
-    state->tile->frame->rec->stride >> chroma_scale_x,
-    pic_width >> chroma_scale_x,
-    pic_height >> chroma_scale_y);
-
   for (int i = y_pos; i < max_height; i += CLASSIFICATION_BLK_SIZE)
   {
     int n_height = MIN(i + CLASSIFICATION_BLK_SIZE, max_height) - i;
@@ -5190,7 +5190,13 @@ static void alf_derive_classification(encoder_state_t * const state,
   }
 }
 
-void uvg_alf_enc_process(encoder_state_t *const state)
+/**
+ * \brief Prepare the ALF encoding of a frame.
+ *
+ * Allocates the statistics of the frame and sets the variables shared by
+ * the steps of the process.
+ */
+void uvg_alf_enc_init(encoder_state_t *const state)
 {
   alf_init_covariance(state->tile->frame, state->encoder_control->chroma_format);
   alf_info_t *alf_info = state->tile->frame->alf_info;
@@ -5212,57 +5218,34 @@ void uvg_alf_enc_process(encoder_state_t *const state)
     alf_info->aps_id_start = ALF_CTB_MAX_NUM_APS;
   }*/
 
-  alf_aps alf_param;
-  reset_alf_param(&alf_param);
-  cc_alf_filter_param *cc_filter_param = state->slice->alf->cc_filter_param;
-
 
-  enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
-  bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
-  bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
   int8_t uvg_bit_depth = state->encoder_control->bitdepth;
-  const uint32_t num_ctus_in_pic = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
   const int8_t input_bitdepth = state->encoder_control->bitdepth;
-  double lambda_chroma_weight = 0.0;
-
-  cabac_data_t ctx_start;
-  cabac_data_t ctx_start_cc_alf;
-  cabac_data_t *cabac_estimator = &alf_info->cabac_estimator;
-  memcpy(cabac_estimator, &state->cabac, sizeof(*cabac_estimator));
-  memcpy(&ctx_start, &state->cabac, sizeof(ctx_start));
-  memcpy(&ctx_start_cc_alf, cabac_estimator, sizeof(ctx_start_cc_alf));
-  cabac_estimator->only_count = 1;
-  ctx_start.only_count = 1;
-  ctx_start_cc_alf.only_count = 1;
 
-  // derive classification
-  const int luma_height = state->tile->frame->height;
-  const int luma_width = state->tile->frame->width;
-
-  array_variables arr_vars;
+  array_variables *arr_vars = &alf_info->arr_vars;
   bool init_values = false;
 
   if (!init_values)
   {
     assert(MAX_ALF_NUM_CLIPPING_VALUES > 0); //"g_alf_num_clipping_values[CHANNEL_TYPE_LUMA] must be at least one"
-    arr_vars.alf_clipping_values[CHANNEL_TYPE_LUMA][0] = 1 << input_bitdepth;
+    arr_vars->alf_clipping_values[CHANNEL_TYPE_LUMA][0] = 1 << input_bitdepth;
     int shift_luma = input_bitdepth - 8;
     for (int i = 1; i < MAX_ALF_NUM_CLIPPING_VALUES; ++i)
     {
-      arr_vars.alf_clipping_values[CHANNEL_TYPE_LUMA][i] = 1 << (7 - 2 * i + shift_luma);
+      arr_vars->alf_clipping_values[CHANNEL_TYPE_LUMA][i] = 1 << (7 - 2 * i + shift_luma);
     }
 
     assert(MAX_ALF_NUM_CLIPPING_VALUES > 0); //"g_alf_num_clipping_values[CHANNEL_TYPE_CHROMA] must be at least one"
-    arr_vars.alf_clipping_values[CHANNEL_TYPE_CHROMA][0] = 1 << input_bitdepth;
+    arr_vars->alf_clipping_values[CHANNEL_TYPE_CHROMA][0] = 1 << input_bitdepth;
     int shift_chroma = input_bitdepth - 8;
     for (int i = 1; i < MAX_ALF_NUM_CLIPPING_VALUES; ++i)
     {
-      arr_vars.alf_clipping_values[CHANNEL_TYPE_CHROMA][i] = 1 << (7 - 2 * i + shift_chroma);
+      arr_vars->alf_clipping_values[CHANNEL_TYPE_CHROMA][i] = 1 << (7 - 2 * i + shift_chroma);
     }
 
     for (int i = 0; i < MAX_NUM_ALF_LUMA_COEFF * MAX_NUM_ALF_CLASSES; i++)
     {
-      arr_vars.clip_default[i] = arr_vars.alf_clipping_values[CHANNEL_TYPE_LUMA][0];
+      arr_vars->clip_default[i] = arr_vars->alf_clipping_values[CHANNEL_TYPE_LUMA][0];
     }
 
     for (int filter_set_index = 0; filter_set_index < ALF_NUM_FIXED_FILTER_SETS; filter_set_index++)
@@ -5272,40 +5255,110 @@ void uvg_alf_enc_process(encoder_state_t *const state)
         int fixed_filter_idx = g_class_to_filter_mapping[filter_set_index][class_idx];
         for (int i = 0; i < MAX_NUM_ALF_LUMA_COEFF - 1; i++)
         {
-          arr_vars.fixed_filter_set_coeff_dec[filter_set_index][class_idx * MAX_NUM_ALF_LUMA_COEFF + i] = g_fixed_filter_set_coeff[fixed_filter_idx][i];
+          arr_vars->fixed_filter_set_coeff_dec[filter_set_index][class_idx * MAX_NUM_ALF_LUMA_COEFF + i] = g_fixed_filter_set_coeff[fixed_filter_idx][i];
         }
-        arr_vars.fixed_filter_set_coeff_dec[filter_set_index][class_idx * MAX_NUM_ALF_LUMA_COEFF + MAX_NUM_ALF_LUMA_COEFF - 1] = (1 << (input_bitdepth - 1));
+        arr_vars->fixed_filter_set_coeff_dec[filter_set_index][class_idx * MAX_NUM_ALF_LUMA_COEFF + MAX_NUM_ALF_LUMA_COEFF - 1] = (1 << (input_bitdepth - 1));
       }
     }
 
     //Default clp_rng
-    arr_vars.clp_rngs.comp[COMPONENT_Y].min = arr_vars.clp_rngs.comp[COMPONENT_Cb].min = arr_vars.clp_rngs.comp[COMPONENT_Cr].min = 0;
-    arr_vars.clp_rngs.comp[COMPONENT_Y].max = (1 << uvg_bit_depth) - 1;
-    arr_vars.clp_rngs.comp[COMPONENT_Y].bd = uvg_bit_depth;
-    arr_vars.clp_rngs.comp[COMPONENT_Y].n = 0;
-    arr_vars.clp_rngs.comp[COMPONENT_Cb].max = arr_vars.clp_rngs.comp[COMPONENT_Cr].max = (1 << uvg_bit_depth) - 1;
-    arr_vars.clp_rngs.comp[COMPONENT_Cb].bd = arr_vars.clp_rngs.comp[COMPONENT_Cr].bd = uvg_bit_depth;
-    arr_vars.clp_rngs.comp[COMPONENT_Cb].n = arr_vars.clp_rngs.comp[COMPONENT_Cr].n = 0;
-    arr_vars.clp_rngs.used = arr_vars.clp_rngs.chroma = false;
+    arr_vars->clp_rngs.comp[COMPONENT_Y].min = arr_vars->clp_rngs.comp[COMPONENT_Cb].min = arr_vars->clp_rngs.comp[COMPONENT_Cr].min = 0;
+    arr_vars->clp_rngs.comp[COMPONENT_Y].max = (1 << uvg_bit_depth) - 1;
+    arr_vars->clp_rngs.comp[COMPONENT_Y].bd = uvg_bit_depth;
+    arr_vars->clp_rngs.comp[COMPONENT_Y].n = 0;
+    arr_vars->clp_rngs.comp[COMPONENT_Cb].max = arr_vars->clp_rngs.comp[COMPONENT_Cr].max = (1 << uvg_bit_depth) - 1;
+    arr_vars->clp_rngs.comp[COMPONENT_Cb].bd = arr_vars->clp_rngs.comp[COMPONENT_Cr].bd = uvg_bit_depth;
+    arr_vars->clp_rngs.comp[COMPONENT_Cb].n = arr_vars->clp_rngs.comp[COMPONENT_Cr].n = 0;
+    arr_vars->clp_rngs.used = arr_vars->clp_rngs.chroma = false;
 
     init_values = true;
   }
+}
+
+/**
+ * \brief Pad the picture borders next to a row of LCUs.
+ *
+ * The samples of the row have to be final, so the row below has to be
+ * reconstructed too.
+ */
+void uvg_alf_enc_pad_lcu_row(encoder_state_t *const state, int lcu_row)
+{
+  enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
+  bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
+  bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
+
+  const uvg_picture *const rec = state->tile->frame->rec;
+  int32_t pic_height = rec->height;
+  int32_t pic_width = rec->width;
 
-  for (int y_pos = 0; y_pos < luma_height; y_pos += LCU_WIDTH)
+  const int y_start = lcu_row * LCU_WIDTH;
+  const int y_end = MIN(y_start + LCU_WIDTH, pic_height);
+
+  adjust_pixels(rec->y, 0, pic_width, y_start, y_end, rec->stride,
+    pic_width, pic_height);
+  adjust_pixels_chroma(rec->u,
+    0,
+    pic_width >> chroma_scale_x,
+    y_start >> chroma_scale_y,
+    y_end >> chroma_scale_y,
+    rec->stride >> chroma_scale_x,
+    pic_width >> chroma_scale_x,
+    pic_height >> chroma_scale_y);
+  adjust_pixels_chroma(rec->v,
+    0,
+    pic_width >> chroma_scale_x,
+    y_start >> chroma_scale_y,
+    y_end >> chroma_scale_y,
+    rec->stride >> chroma_scale_x,
+    pic_width >> chroma_scale_x,
+    pic_height >> chroma_scale_y);
+}
+
+/**
+ * \brief Classify the samples of a row of LCUs and collect the statistics
+ * of its CTUs.
+ *
+ * The filters read across the row boundaries, so the rows above and below
+ * have to be padded.
+ */
+void uvg_alf_enc_stats_lcu_row(encoder_state_t *const state, int lcu_row)
+{
+  const int luma_height = state->tile->frame->height;
+  const int luma_width = state->tile->frame->width;
+
+  const int y_pos = lcu_row * LCU_WIDTH;
+  for (int x_pos = 0; x_pos < luma_width; x_pos += LCU_WIDTH)
   {
-    for (int x_pos = 0; x_pos < luma_width; x_pos += LCU_WIDTH)
-    {
-      const int width = (x_pos + LCU_WIDTH > luma_width) ? (luma_width - x_pos) : LCU_WIDTH;
-      const int height = (y_pos + LCU_WIDTH > luma_height) ? (luma_height - y_pos) : LCU_WIDTH;
-      {
-        alf_derive_classification(state, width, height, x_pos, y_pos, x_pos, y_pos);
-      }
-    }
+    const int width = (x_pos + LCU_WIDTH > luma_width) ? (luma_width - x_pos) : LCU_WIDTH;
+    const int height = (y_pos + LCU_WIDTH > luma_height) ? (luma_height - y_pos) : LCU_WIDTH;
+    alf_derive_classification(state, width, height, x_pos, y_pos, x_pos, y_pos);
   }
 
+  alf_derive_stats_for_filtering(state, lcu_row, state->tile->frame->alf_info->arr_vars.alf_clipping_values);
+}
+
+/**
+ * \brief Derive the filters of a frame from the statistics of all CTUs.
+ */
+void uvg_alf_enc_derive(encoder_state_t *const state)
+{
+  alf_info_t *alf_info = state->tile->frame->alf_info;
+  array_variables *arr_vars = &alf_info->arr_vars;
+
+  alf_aps alf_param;
+  reset_alf_param(&alf_param);
+
+  const uint32_t num_ctus_in_pic = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
+  double lambda_chroma_weight = 0.0;
 
-  // get CTB stats for filtering 
-  alf_derive_stats_for_filtering(state, arr_vars.alf_clipping_values);
+  cabac_data_t ctx_start;
+  cabac_data_t *cabac_estimator = &alf_info->cabac_estimator;
+  memcpy(cabac_estimator, &state->cabac, sizeof(*cabac_estimator));
+  memcpy(&ctx_start, &state->cabac, sizeof(ctx_start));
+  cabac_estimator->only_count = 1;
+  ctx_start.only_count = 1;
+
+  alf_derive_frame_stats_for_filtering(state);
 
   for (uint32_t ctb_iIdx = 0; ctb_iIdx < num_ctus_in_pic; ctb_iIdx++)
   {
@@ -5321,7 +5374,7 @@ void uvg_alf_enc_process(encoder_state_t *const state)
   alf_encoder(state,
     &alf_param, CHANNEL_TYPE_LUMA,
     lambda_chroma_weight,
-    &arr_vars
+    arr_vars
   );
 
   // derive filter (chroma)
@@ -5329,7 +5382,7 @@ void uvg_alf_enc_process(encoder_state_t *const state)
     alf_encoder(state,
       &alf_param, CHANNEL_TYPE_CHROMA,
       lambda_chroma_weight,
-      &arr_vars
+      arr_vars
     );
   }
   // let alfEncoderCtb decide now
@@ -5339,7 +5392,7 @@ void uvg_alf_enc_process(encoder_state_t *const state)
 
   //m_CABACEstimator->getCtx() = AlfCtx(ctxStart);
   memcpy(cabac_estimator, &ctx_start, sizeof(*cabac_estimator));
-  alf_encoder_ctb(state, &alf_param, lambda_chroma_weight, &arr_vars);
+  alf_encoder_ctb(state, &alf_param, lambda_chroma_weight, arr_vars);
 
   //for (int s = 0; s < state.; s++) //numSliceSegments
   {
@@ -5355,13 +5408,45 @@ void uvg_alf_enc_process(encoder_state_t *const state)
     }
   }
 
-  alf_reconstruct(state, &arr_vars);
+  alf_reconstruct_prepare(state, arr_vars);
+}
 
+/**
+ * \brief Filter a row of LCUs with the derived filters.
+ */
+void uvg_alf_enc_filter_lcu_row(encoder_state_t *const state, int lcu_row)
+{
+  alf_reconstruct(state, &state->tile->frame->alf_info->arr_vars, lcu_row);
+}
+
+/**
+ * \brief Finish the ALF encoding of a frame after all rows are filtered.
+ *
+ * Derives and applies CC-ALF and frees the statistics of the frame.
+ */
+void uvg_alf_enc_finish(encoder_state_t *const state)
+{
   if (state->encoder_control->cfg.alf_type != UVG_ALF_FULL)
   {
+    alf_covariance_destroy(state->tile->frame);
     return;
   }
 
+  alf_info_t *alf_info = state->tile->frame->alf_info;
+  array_variables *arr_vars = &alf_info->arr_vars;
+  cc_alf_filter_param *cc_filter_param = state->slice->alf->cc_filter_param;
+
+  enum uvg_chroma_format chroma_fmt = state->encoder_control->chroma_format;
+  bool chroma_scale_x = (chroma_fmt == UVG_CSP_444) ? 0 : 1;
+  bool chroma_scale_y = (chroma_fmt != UVG_CSP_420) ? 0 : 1;
+  const uint32_t num_ctus_in_pic = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
+  const int luma_height = state->tile->frame->height;
+
+  cabac_data_t ctx_start_cc_alf;
+  cabac_data_t *cabac_estimator = &alf_info->cabac_estimator;
+  memcpy(&ctx_start_cc_alf, &state->cabac, sizeof(ctx_start_cc_alf));
+  ctx_start_cc_alf.only_count = 1;
+
   // Do not transmit CC ALF if it is unchanged
   if (state->slice->alf->tile_group_alf_enabled_flag[COMPONENT_Y])
   {
@@ -5426,11 +5511,11 @@ void uvg_alf_enc_process(encoder_state_t *const state)
   init_distortion_cc_alf(alf_info->alf_covariance_cc_alf, alf_info->ctb_distortion_unfilter, num_ctus_in_pic);
 
   memcpy(cabac_estimator, &ctx_start_cc_alf, sizeof(*cabac_estimator));
-  derive_cc_alf_filter(state, COMPONENT_Cb, org_yuv, rec_yuv, arr_vars.cc_reuse_aps_id);
+  derive_cc_alf_filter(state, COMPONENT_Cb, org_yuv, rec_yuv, arr_vars->cc_reuse_aps_id);
   memcpy(cabac_estimator, &ctx_start_cc_alf, sizeof(*cabac_estimator));
-  derive_cc_alf_filter(state, COMPONENT_Cr, org_yuv, rec_yuv, arr_vars.cc_reuse_aps_id);
+  derive_cc_alf_filter(state, COMPONENT_Cr, org_yuv, rec_yuv, arr_vars->cc_reuse_aps_id);
 
-  setup_cc_alf_aps(state, arr_vars.cc_reuse_aps_id);
+  setup_cc_alf_aps(state, arr_vars->cc_reuse_aps_id);
 
   for (alf_component_id comp_idx = 1; comp_idx < (state->encoder_control->chroma_format == UVG_CSP_400 ? 1 : MAX_NUM_COMPONENT); comp_idx++)
   {
@@ -5439,9 +5524,27 @@ void uvg_alf_enc_process(encoder_state_t *const state)
       uvg_pixel* rec_uv = comp_idx == COMPONENT_Cb ? rec_yuv->u : rec_yuv->v;
       const int luma_stride = rec_yuv->stride;
       apply_cc_alf_filter(state, comp_idx, rec_uv, alf_info->alf_tmp_y, luma_stride, alf_info->cc_alf_filter_control[comp_idx - 1],
-        cc_filter_param->cc_alf_coeff[comp_idx - 1], -1, &arr_vars);
+        cc_filter_param->cc_alf_coeff[comp_idx - 1], -1, arr_vars);
     }
   }
 
   alf_covariance_destroy(state->tile->frame);
-}
\ No newline at end of file
+}
+
+void uvg_alf_enc_process(encoder_state_t *const state)
+{
+  const int height_in_lcu = state->tile->frame->height_in_lcu;
+
+  uvg_alf_enc_init(state);
+  for (int lcu_row = 0; lcu_row < height_in_lcu; lcu_row++) {
+    uvg_alf_enc_pad_lcu_row(state, lcu_row);
+  }
+  for (int lcu_row = 0; lcu_row < height_in_lcu; lcu_row++) {
+    uvg_alf_enc_stats_lcu_row(state, lcu_row);
+  }
+  uvg_alf_enc_derive(state);
+  for (int lcu_row = 0; lcu_row < height_in_lcu; lcu_row++) {
+    uvg_alf_enc_filter_lcu_row(state, lcu_row);
+  }
+  uvg_alf_enc_finish(state);
+}
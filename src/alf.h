@@ -235,6 +235,30 @@ typedef struct alf_aps {
 
 } alf_aps;
 
+typedef struct array_variables {
+  short fixed_filter_set_coeff_dec[ALF_NUM_FIXED_FILTER_SETS][MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
+  short chroma_coeff_final[MAX_NUM_ALF_ALTERNATIVES_CHROMA][MAX_NUM_ALF_CHROMA_COEFF];
+  short coeff_final[MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
+  short coeff_aps_luma[ALF_CTB_MAX_NUM_APS][MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
+
+  int16_t chroma_clipp_final[MAX_NUM_ALF_ALTERNATIVES_CHROMA][MAX_NUM_ALF_CHROMA_COEFF];
+  int16_t clip_default[MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
+  int16_t clipp_final[MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
+  int16_t clipp_aps_luma[ALF_CTB_MAX_NUM_APS][MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
+
+  short filter_indices[MAX_NUM_ALF_CLASSES][MAX_NUM_ALF_CLASSES];
+
+  unsigned bits_new_filter[MAX_NUM_CHANNEL_TYPE];
+  short alf_clipping_values[MAX_NUM_CHANNEL_TYPE][MAX_ALF_NUM_CLIPPING_VALUES];
+  int cc_reuse_aps_id[2];
+
+  int filter_coeff_set[MAX_NUM_ALF_CLASSES][MAX_NUM_ALF_LUMA_COEFF];
+  int filter_clipp_set[MAX_NUM_ALF_CLASSES][MAX_NUM_ALF_LUMA_COEFF];
+
+  struct clp_rngs clp_rngs;
+
+} array_variables;
+
 typedef struct alf_info_t {
   cabac_data_t cabac_estimator;
 
@@ -278,6 +302,8 @@ typedef struct alf_info_t {
   alf_classifier **classifier;
   alf_aps alf_param_temp;
 
+  array_variables arr_vars; //Filter variables shared by the steps of the encoding process
+
 } alf_info_t;
 
 typedef struct param_set_map {
@@ -286,30 +312,6 @@ typedef struct param_set_map {
   struct alf_aps parameter_set;
 } param_set_map;
 
-typedef struct array_variables {
-  short fixed_filter_set_coeff_dec[ALF_NUM_FIXED_FILTER_SETS][MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
-  short chroma_coeff_final[MAX_NUM_ALF_ALTERNATIVES_CHROMA][MAX_NUM_ALF_CHROMA_COEFF];
-  short coeff_final[MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
-  short coeff_aps_luma[ALF_CTB_MAX_NUM_APS][MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
-
-  int16_t chroma_clipp_final[MAX_NUM_ALF_ALTERNATIVES_CHROMA][MAX_NUM_ALF_CHROMA_COEFF];
-  int16_t clip_default[MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
-  int16_t clipp_final[MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
-  int16_t clipp_aps_luma[ALF_CTB_MAX_NUM_APS][MAX_NUM_ALF_CLASSES * MAX_NUM_ALF_LUMA_COEFF];
-
-  short filter_indices[MAX_NUM_ALF_CLASSES][MAX_NUM_ALF_CLASSES];
-
-  unsigned bits_new_filter[MAX_NUM_CHANNEL_TYPE];
-  short alf_clipping_values[MAX_NUM_CHANNEL_TYPE][MAX_ALF_NUM_CLIPPING_VALUES];
-  int cc_reuse_aps_id[2];
-
-  int filter_coeff_set[MAX_NUM_ALF_CLASSES][MAX_NUM_ALF_LUMA_COEFF];
-  int filter_clipp_set[MAX_NUM_ALF_CLASSES][MAX_NUM_ALF_LUMA_COEFF];
-
-  struct clp_rngs clp_rngs;
-
-} array_variables;
-
 //inits aps parameter set in videoframe
 void uvg_set_aps_map(videoframe_t* frame, enum uvg_alf alf_type);
 
@@ -319,6 +321,20 @@ void uvg_reset_cc_alf_aps_param(cc_alf_filter_param *cc_alf);
 //starts alf encoding process
 void uvg_alf_enc_process(encoder_state_t *const state);
 
+//steps of the alf encoding process, in the order they have to be run
+//init allocates the statistics of the frame
+void uvg_alf_enc_init(encoder_state_t *const state);
+//pads the picture borders next to an lcu row, after the row is reconstructed
+void uvg_alf_enc_pad_lcu_row(encoder_state_t *const state, int lcu_row);
+//classifies an lcu row and collects its statistics, after the rows above and below are padded
+void uvg_alf_enc_stats_lcu_row(encoder_state_t *const state, int lcu_row);
+//derives the filters of the frame from the statistics of all lcu rows
+void uvg_alf_enc_derive(encoder_state_t *const state);
+//filters an lcu row with the derived filters
+void uvg_alf_enc_filter_lcu_row(encoder_state_t *const state, int lcu_row);
+//derives and applies cc-alf after all lcu rows are filtered and frees the statistics
+void uvg_alf_enc_finish(encoder_state_t *const state);
+
 //creates variables for alf_info_t structure in videoframe_t 
 void uvg_alf_create(videoframe_t *frame, enum uvg_chroma_format chroma_format);
 //frees allocated memory in alf_info_t structure
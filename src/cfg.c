@@ -222,6 +222,18 @@ int uvg_config_init(uvg_config *cfg)
 
   cfg->dual_tree = 0;
   cfg->intra_rough_search_levels = 2;
+
+  cfg->caller_runs = 1;
+  cfg->idle_spin = 100;
+  cfg->cpu_affinity = NULL;
+  cfg->cpu_affinity_count = 0;
+  cfg->numa = 0;
+  cfg->adaptive_owf = 0;
+  cfg->intra_frame_parallel = 0;
+  cfg->adaptive_tiles = 0;
+  cfg->parallel_layout = UVG_PARALLEL_LAYOUT_MANUAL;
+  cfg->parallel_cu_search = 0;
+  cfg->calc_ssim = 0;
   return 1;
 }
 
@@ -235,6 +247,7 @@ int uvg_config_destroy(uvg_config *cfg)
     FREE_POINTER(cfg->tiles_height_split);
     FREE_POINTER(cfg->slice_addresses_in_ts);
     FREE_POINTER(cfg->fastrd_learning_outdir_fn);
+    FREE_POINTER(cfg->cpu_affinity);
   }
   free(cfg);
 
@@ -330,6 +343,59 @@ static int parse_tiles_specification(const char* const arg, int32_t * const ntil
 
   return 1;
 }
+
+/**
+ * \brief Parse a list of CPUs such as "0-3,8,10-11".
+ */
+static int parse_cpu_list(const char* const arg, int32_t * const count, int32_t** const array) {
+  FREE_POINTER(*array);
+  *count = 0;
+
+  // Count the CPUs first to know how much memory is needed.
+  int32_t num_cpus = 0;
+  const char *current_arg = arg;
+  while (current_arg) {
+    int first, last, chars;
+    if (sscanf(current_arg, "%d-%d%n", &first, &last, &chars) != 2) {
+      if (sscanf(current_arg, "%d%n", &first, &chars) != 1) {
+        fprintf(stderr, "Could not parse CPU list \"%s\"!\n", arg);
+        return 0;
+      }
+      last = first;
+    }
+    if (first < 0 || last < first || (current_arg[chars] != ',' && current_arg[chars] != '\0')) {
+      fprintf(stderr, "Invalid CPU list \"%s\"!\n", arg);
+      return 0;
+    }
+    num_cpus += last - first + 1;
+
+    current_arg = strchr(current_arg, ',');
+    if (current_arg) ++current_arg;
+  }
+
+  *array = MALLOC(int32_t, num_cpus);
+  if (!*array) {
+    fprintf(stderr, "Could not allocate array for CPUs\n");
+    return 0;
+  }
+
+  current_arg = arg;
+  while (current_arg) {
+    int first, last;
+    if (sscanf(current_arg, "%d-%d", &first, &last) != 2) {
+      sscanf(current_arg, "%d", &first);
+      last = first;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      (*array)[(*count)++] = cpu;
+    }
+
+    current_arg = strchr(current_arg, ',');
+    if (current_arg) ++current_arg;
+  }
+
+  return 1;
+}
 /*
 static int parse_uint8(const char *numstr,uint8_t* number,int min, int max)
 {
@@ -575,6 +641,8 @@ int uvg_config_parse(uvg_config *cfg, const char *name, const char *value)
 
   static const char * const file_format_names[] = {"auto", "y4m", "yuv", NULL};
 
+  static const char * const parallel_layout_names[] = { "manual", "auto", NULL };
+
   static const char * const preset_values[11][25*2] = {
       {
         "ultrafast",
@@ -1217,6 +1285,8 @@ int uvg_config_parse(uvg_config *cfg, const char *name, const char *value)
     cfg->mv_rdo = atobool(value);
   else if OPT("psnr")
     cfg->calc_psnr = (bool)atobool(value);
+  else if OPT("ssim")
+    cfg->calc_ssim = (bool)atobool(value);
   else if OPT("hash")
   {
     int8_t hash;
@@ -1479,6 +1549,40 @@ int uvg_config_parse(uvg_config *cfg, const char *name, const char *value)
   else if OPT("intra-rough-granularity") {
     cfg->intra_rough_search_levels = atoi(value);
   }
+  else if OPT("caller-runs") {
+    cfg->caller_runs = atobool(value);
+  }
+  else if OPT("idle-spin") {
+    cfg->idle_spin = atoi(value);
+  }
+  else if OPT("cpu-affinity") {
+    return parse_cpu_list(value, &cfg->cpu_affinity_count, &cfg->cpu_affinity);
+  }
+  else if OPT("numa") {
+    cfg->numa = atobool(value);
+  }
+  else if OPT("adaptive-owf") {
+    cfg->adaptive_owf = atobool(value);
+  }
+  else if OPT("intra-frame-parallel") {
+    cfg->intra_frame_parallel = atobool(value);
+  }
+  else if OPT("adaptive-tiles") {
+    cfg->adaptive_tiles = atoi(value);
+  }
+  else if OPT("parallel-layout") {
+    int8_t parallel_layout = 0;
+    if (!parse_enum(value, parallel_layout_names, &parallel_layout)) {
+      fprintf(stderr, "Invalid parallel layout %s. Valid values include %s and %s\n", value,
+        parallel_layout_names[0],
+        parallel_layout_names[1]);
+      return 0;
+    }
+    cfg->parallel_layout = parallel_layout;
+  }
+  else if OPT("parallel-cu-search") {
+    cfg->parallel_cu_search = atoi(value);
+  }
   else {
     return 0;
   }
@@ -1692,6 +1796,45 @@ int uvg_config_validate(const uvg_config *const cfg)
     error = 1;
   }
 
+  if (cfg->idle_spin < 0) {
+    fprintf(stderr, "Input error: --idle-spin must be nonnegative\n");
+    error = 1;
+  }
+
+  if (cfg->intra_frame_parallel && cfg->intra_period != 1) {
+    fprintf(stderr, "Input error: --intra-frame-parallel requires --period 1\n");
+    error = 1;
+  }
+
+  if (cfg->adaptive_tiles < 0) {
+    fprintf(stderr, "Input error: --adaptive-tiles must be nonnegative\n");
+    error = 1;
+  }
+
+  if (cfg->adaptive_tiles > 0 && cfg->wpp &&
+      (cfg->tiles_width_count > 1 || cfg->tiles_height_count > 1)) {
+    fprintf(stderr, "Input error: --adaptive-tiles does not work with WPP\n");
+    error = 1;
+  }
+
+  // With --parallel-layout auto the tiles are selected later.
+  if (cfg->adaptive_tiles > 0 &&
+      cfg->parallel_layout != UVG_PARALLEL_LAYOUT_AUTO &&
+      cfg->tiles_width_count <= 1 && cfg->tiles_height_count <= 1) {
+    fprintf(stderr, "Input error: --adaptive-tiles requires more than one tile\n");
+    error = 1;
+  }
+
+  if (cfg->parallel_layout == UVG_PARALLEL_LAYOUT_AUTO && cfg->partial_coding.fullWidth > 0) {
+    fprintf(stderr, "Input error: --parallel-layout auto does not work with --partial-coding\n");
+    error = 1;
+  }
+
+  if (!WITHIN(cfg->parallel_cu_search, 0, MAX_DEPTH)) {
+    fprintf(stderr, "Input error: --parallel-cu-search must be in range [0..%d]\n", MAX_DEPTH);
+    error = 1;
+  }
+
   if (cfg->qp != CLIP_TO_QP(cfg->qp)) {
       fprintf(stderr, "Input error: --qp parameter out of range [0..51]\n");
       error = 1;
@@ -1798,6 +1941,28 @@ int uvg_config_validate(const uvg_config *const cfg)
     error = 1;
   }
 
+  if (cfg->partial_coding.fullWidth > 0 || cfg->partial_coding.fullHeight > 0) {
+    // The tiles of the full picture are given with --tiles.
+    if (cfg->partial_coding.fullWidth == 0 || cfg->partial_coding.fullHeight == 0) {
+      fprintf(stderr, "Input error: --partial-coding requires the size of the full picture.\n");
+      error = 1;
+    }
+    if (cfg->tiles_width_split || cfg->tiles_height_split) {
+      fprintf(stderr, "Input error: --partial-coding works only with uniform --tiles.\n");
+      error = 1;
+    }
+    // ALF and LMCS parameters would differ between the parts.
+    if (cfg->alf_type || cfg->lmcs_enable) {
+      fprintf(stderr, "Input error: --partial-coding does not work with --alf or --lmcs.\n");
+      error = 1;
+    }
+    // The parts are merged assuming one slice per tile.
+    if (cfg->slices & UVG_SLICES_WPP) {
+      fprintf(stderr, "Input error: --partial-coding works only with --slices none or tiles.\n");
+      error = 1;
+    }
+  }
+
   if ((cfg->scaling_list == UVG_SCALING_LIST_CUSTOM) && !cfg->cqmfile) {
     fprintf(stderr, "Input error: --scaling-list=custom does not work without --cqmfile=<FILE>.\n");
     error = 1;
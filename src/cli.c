@@ -95,6 +95,9 @@ static const struct option long_options[] = {
   { "tiles",              required_argument, NULL, 0 },
   { "tiles-width-split",  required_argument, NULL, 0 },
   { "tiles-height-split", required_argument, NULL, 0 },
+  { "adaptive-tiles",     required_argument, NULL, 0 },
+  { "parallel-layout",    required_argument, NULL, 0 },
+  { "parallel-cu-search", required_argument, NULL, 0 },
   { "wpp",                      no_argument, NULL, 0 },
   { "no-wpp",                   no_argument, NULL, 0 },
   { "owf",                required_argument, NULL, 0 },
@@ -115,6 +118,8 @@ static const struct option long_options[] = {
   { "no-mv-rdo",                no_argument, NULL, 0 },
   { "psnr",                     no_argument, NULL, 0 },
   { "no-psnr",                  no_argument, NULL, 0 },
+  { "ssim",                     no_argument, NULL, 0 },
+  { "no-ssim",                  no_argument, NULL, 0 },
   { "version",                  no_argument, NULL, 0 },
   { "help",                     no_argument, NULL, 0 },
   { "loop-input",               no_argument, NULL, 0 },
@@ -192,6 +197,20 @@ static const struct option long_options[] = {
   { "no-dual-tree",             no_argument, NULL, 0 },
   { "cabac-debug-file",   required_argument, NULL, 0 },
   { "intra-rough-granularity",required_argument, NULL, 0 },
+  { "caller-runs",              no_argument, NULL, 0 },
+  { "no-caller-runs",           no_argument, NULL, 0 },
+  { "idle-spin",          required_argument, NULL, 0 },
+  { "cpu-affinity",       required_argument, NULL, 0 },
+  { "numa",                     no_argument, NULL, 0 },
+  { "no-numa",                  no_argument, NULL, 0 },
+  { "adaptive-owf",             no_argument, NULL, 0 },
+  { "no-adaptive-owf",          no_argument, NULL, 0 },
+  { "intra-frame-parallel",     no_argument, NULL, 0 },
+  { "no-intra-frame-parallel",  no_argument, NULL, 0 },
+  { "segment-length",     required_argument, NULL, 0 },
+  { "segment-parallel",   required_argument, NULL, 0 },
+  { "segment-index",      required_argument, NULL, 0 },
+  { "segment-weights",    required_argument, NULL, 0 },
   {0, 0, 0, 0}
 };
 
@@ -259,6 +278,40 @@ static int detect_file_format(const char *file_name) {
  * \param argv  Argument list
  * \return      Pointer to the parsed options, or NULL on failure.
  */
+/**
+ * \brief Parse a comma-separated list of positive segment bitrate weights.
+ *
+ * \param opts   options to store the weights in
+ * \param value  list of weights
+ * \return       1 on success, 0 on failure
+ */
+static int parse_segment_weights(cmdline_opts_t *const opts, const char *value)
+{
+  int count = 1;
+  for (const char *c = value; *c; c++) {
+    if (*c == ',') count++;
+  }
+
+  FREE_POINTER(opts->segment_weights);
+  opts->segment_weight_count = 0;
+  opts->segment_weights = calloc(count, sizeof(double));
+  if (!opts->segment_weights) return 0;
+
+  const char *pos = value;
+  for (int i = 0; i < count; i++) {
+    char *end;
+    const double weight = strtod(pos, &end);
+    if (end == pos || weight <= 0.0 || (*end != ',' && *end != '\0')) {
+      fprintf(stderr, "Input error: invalid --segment-weights \"%s\"\n", value);
+      return 0;
+    }
+    opts->segment_weights[i] = weight;
+    pos = end + 1;
+  }
+  opts->segment_weight_count = count;
+  return 1;
+}
+
 cmdline_opts_t* cmdline_opts_parse(const uvg_api *const api, int argc, char *argv[])
 {
   int ok = 1;
@@ -274,6 +327,9 @@ cmdline_opts_t* cmdline_opts_parse(const uvg_api *const api, int argc, char *arg
     goto done;
   }
 
+  opts->segment_parallel = 2;
+  opts->segment_index = -1;
+
   // Parse command line options
   for (optind = 0;;) {
     int long_options_index = -1;
@@ -330,6 +386,17 @@ cmdline_opts_t* cmdline_opts_parse(const uvg_api *const api, int argc, char *arg
       goto done;
     } else if (!strcmp(name, "loop-input")) {
       opts->loop_input = true;
+    } else if (!strcmp(name, "segment-length")) {
+      opts->segment_length = atoi(optarg);
+    } else if (!strcmp(name, "segment-parallel")) {
+      opts->segment_parallel = atoi(optarg);
+    } else if (!strcmp(name, "segment-index")) {
+      opts->segment_index = atoi(optarg);
+    } else if (!strcmp(name, "segment-weights")) {
+      if (!parse_segment_weights(opts, optarg)) {
+        ok = 0;
+        goto done;
+      }
     } else if (!api->config_parse(opts->config, name, optarg)) {
       fprintf(stderr, "invalid argument: %s=%s\n", name, optarg);
       ok = 0;
@@ -358,6 +425,48 @@ cmdline_opts_t* cmdline_opts_parse(const uvg_api *const api, int argc, char *arg
     goto done;
   }
 
+  if (opts->segment_length < 0 || opts->segment_parallel < 1) {
+    fprintf(stderr, "Input error: --segment-length must be non-negative and "
+                    "--segment-parallel positive\n");
+    ok = 0;
+    goto done;
+  }
+
+  if (opts->segment_index >= 0 && opts->segment_length == 0) {
+    fprintf(stderr, "Input error: --segment-index requires --segment-length\n");
+    ok = 0;
+    goto done;
+  }
+
+  if (opts->segment_weights &&
+      (opts->segment_length == 0 || opts->config->target_bitrate == 0)) {
+    fprintf(stderr, "Input error: --segment-weights requires --segment-length "
+                    "and --bitrate\n");
+    ok = 0;
+    goto done;
+  }
+
+  if (opts->segment_length > 0 &&
+      (!strcmp(opts->input, "-") || opts->loop_input || opts->debug ||
+       opts->config->source_scan_type != UVG_INTERLACING_NONE)) {
+    // Each segment is read from the input file separately.
+    fprintf(stderr, "Input error: --segment-length requires a seekable "
+                    "progressive input and cannot be used with --loop-input "
+                    "or --debug\n");
+    ok = 0;
+    goto done;
+  }
+
+  if (opts->segment_length > 0 &&
+      (opts->config->roi.file_path || opts->config->cabac_debug_file_name)) {
+    // The segment encoders would share the files and read or write them
+    // from the start.
+    fprintf(stderr, "Input error: --segment-length cannot be used with --roi "
+                    "or --cabac-debug-file\n");
+    ok = 0;
+    goto done;
+  }
+
   // Check the file name for format
   if (opts->config->file_format == UVG_FORMAT_AUTO) {
     opts->config->file_format = detect_file_format(opts->input);
@@ -389,6 +498,7 @@ void cmdline_opts_free(const uvg_api *const api, cmdline_opts_t *opts)
     FREE_POINTER(opts->input);
     FREE_POINTER(opts->output);
     FREE_POINTER(opts->debug);
+    FREE_POINTER(opts->segment_weights);
     api->config_destroy(opts->config);
     opts->config = NULL;
   }
@@ -461,6 +571,7 @@ void print_help(void)
     "                                   - checksum: 18 bytes\n"
     "                                   - md5: 56 bytes\n"
     "      --(no-)psnr            : Calculate PSNR for frames. [enabled]\n"
+    "      --(no-)ssim            : Calculate SSIM for frames. [disabled]\n"
     "      --(no-)info            : Add encoder info SEI. [enabled]\n"
     "      --stats-file-prefix    : A prefix used for stats files that include\n"
     "                               bits, lambda, distortion, and qp for each ctu.\n"
@@ -699,6 +810,66 @@ void print_help(void)
     "      --owf <integer>        : Frame-level parallelism [auto]\n"
     "                                   - N: Process N+1 frames at a time.\n"
     "                                   - auto: Select automatically.\n"
+    "      --parallel-layout <string> : How to split the work between the\n"
+    "                               threads. [manual]\n"
+    "                                   - manual: Use --wpp, --tiles and --owf.\n"
+    "                                   - auto: Select WPP or a uniform tile\n"
+    "                                           grid and the number of frames\n"
+    "                                           in parallel from the resolution\n"
+    "                                           and --threads. A numeric --owf\n"
+    "                                           limits the frames in parallel.\n"
+    "      --parallel-cu-search <integer> :\n"
+    "                               Search the split of the largest CUs in\n"
+    "                               another thread while the CU itself is\n"
+    "                               searched, so that one CTU can use several\n"
+    "                               threads. Helps low resolutions with many\n"
+    "                               threads. Does not change the output. Not\n"
+    "                               used with CCLM. [0]\n"
+    "                                   - 0: Disabled.\n"
+    "                                   - N: Split CUs of depth below N.\n"
+    "      --(no-)adaptive-owf    : Adjust the number of frames processed at\n"
+    "                               a time to keep the threads busy, using\n"
+    "                               --owf as the maximum. [disabled]\n"
+    "      --(no-)intra-frame-parallel :\n"
+    "                               Encode each frame with one thread and as\n"
+    "                               many frames in parallel as --owf allows.\n"
+    "                               Requires --period 1. Disables WPP.\n"
+    "                               Without ALF the output does not depend on\n"
+    "                               the number of threads. [disabled]\n"
+    "      --segment-length <integer> :\n"
+    "                               Encode the input as independent segments\n"
+    "                               of this many frames, each starting with\n"
+    "                               an IDR frame, and write them out in\n"
+    "                               order. Each segment gets the --bitrate\n"
+    "                               budget for its own length unless\n"
+    "                               --segment-weights is set. [0]\n"
+    "                                   - 0: Disabled.\n"
+    "      --segment-parallel <integer> :\n"
+    "                               Number of segments encoded at the same\n"
+    "                               time with --segment-length. [2]\n"
+    "      --segment-index <integer> :\n"
+    "                               Encode only this segment of\n"
+    "                               --segment-length frames, counting from\n"
+    "                               --seek. Segments encoded in separate\n"
+    "                               processes can be joined with\n"
+    "                               tools/stitch-segments.py. [all]\n"
+    "      --segment-weights <list> :\n"
+    "                               Split the --bitrate budget between the\n"
+    "                               segments by a comma-separated list of\n"
+    "                               weights, e.g. 2,1,1. Segment i is encoded\n"
+    "                               at --bitrate times the weight i divided\n"
+    "                               by the average weight. The list repeats\n"
+    "                               for more segments. [none]\n"
+    "      --(no-)caller-runs     : Run encoding jobs also in the thread that\n"
+    "                               waits for the encoded frames. [enabled]\n"
+    "      --idle-spin <integer>  : How many times an idle thread checks for new\n"
+    "                               jobs before it goes to sleep. [100]\n"
+    "                                   - 0: Sleep immediately.\n"
+    "      --cpu-affinity <list>  : Pin the threads to the CPUs in the list in\n"
+    "                               order, e.g. 0-7,16-23. [none]\n"
+    "      --(no-)numa            : Run each parallel frame preferably on one\n"
+    "                               NUMA node and move its buffers there.\n"
+    "                               Linux only. [disabled]\n"
     "      --(no-)wpp             : Wavefront parallel processing. [enabled]\n"
     "                               Enabling tiles automatically disables WPP.\n"
     "                               To enable WPP with tiles, re-enable it after\n"
@@ -716,17 +887,27 @@ void print_help(void)
     "                                               row column pixel coordinates.\n"
     "                                   - u<int>: Number of tile rows of uniform\n"
     "                                             height.\n"
+    "      --adaptive-tiles <integer> :\n"
+    "                               Move the tile boundaries every N frames so\n"
+    "                               that the tiles take about equally many bits\n"
+    "                               in the frames from 2N to N frames back.\n"
+    "                               Sends a new PPS when the tiles change.\n"
+    "                               Requires more than one tile and does not\n"
+    "                               work with WPP. [0]\n"
+    "                                   - 0: Disabled.\n"
     "      --slices <string>      : Control how slices are used.\n"
     "                                   - tiles: Put tiles in independent slices.\n"
     "                                   - wpp: Put rows in dependent slices.\n"
     "                                   - tiles+wpp: Do both.\n"
-    "      --partial-coding <x-offset>!<y-offset>!<slice-width>!<slice-height>\n"
-    "                             : Encode partial frame.\n" 
-    "                               Parts must be merged to form a valid bitstream.\n"
-    "                               X and Y are CTU offsets.\n"
-    "                               Slice width and height must be divisible by CTU\n"
-    "                               in pixels unless it is the last CTU row/column.\n"
-    "                               This parameter is used by kvaShare.\n"
+    "      --partial-coding <x-offset>!<y-offset>!<full-width>!<full-height>\n"
+    "                             : Encode one tile of a larger picture. The\n"
+    "                               input is the tile, --tiles gives the uniform\n"
+    "                               tile grid of the full picture, and x-offset\n"
+    "                               and y-offset are the position of the tile in\n"
+    "                               CTUs. Parts must be merged with\n"
+    "                               tools/merge-tiles.py to form a valid\n"
+    "                               bitstream. Does not work with ALF, LMCS or\n"
+    "                               --slices wpp.\n"
     "\n"
     /* Word wrap to this width to stay under 80 characters (including ") *************/
     "Video Usability Information:\n"
@@ -755,9 +936,9 @@ void print_help(void)
 
 
 void print_frame_info(const uvg_frame_info *const info,
-                      const double frame_psnr[3],
                       const uint32_t bytes,
                       const bool print_psnr,
+                      const bool print_ssim,
                       const double avg_qp)
 {
   fprintf(stderr, "POC %4d QP %2d AVG QP %.1f (%c-frame) %10d bits",
@@ -769,7 +950,12 @@ void print_frame_info(const uvg_frame_info *const info,
 
   if (print_psnr) {
     fprintf(stderr, " PSNR Y %2.4f U %2.4f V %2.4f",
-            frame_psnr[0], frame_psnr[1], frame_psnr[2]);
+            info->psnr[0], info->psnr[1], info->psnr[2]);
+  }
+
+  if (print_ssim) {
+    fprintf(stderr, " SSIM Y %1.4f U %1.4f V %1.4f",
+            info->ssim[0], info->ssim[1], info->ssim[2]);
   }
 
   if (info->slice_type != UVG_SLICE_I) {
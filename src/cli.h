@@ -59,6 +59,16 @@ typedef struct cmdline_opts_t {
   bool version;
   /** \brief Whether to loop input */
   bool loop_input;
+  /** \brief Number of frames in each independently encoded segment */
+  int32_t segment_length;
+  /** \brief Number of segments encoded at the same time */
+  int32_t segment_parallel;
+  /** \brief Index of the only segment to encode, or -1 for all */
+  int32_t segment_index;
+  /** \brief Bitrate weights of consecutive segments, or NULL */
+  double *segment_weights;
+  /** \brief Number of segment weights */
+  int32_t segment_weight_count;
 } cmdline_opts_t;
 
 cmdline_opts_t* cmdline_opts_parse(const uvg_api *api, int argc, char *argv[]);
@@ -68,9 +78,9 @@ void print_usage(void);
 void print_version(bool);
 void print_help(void);
 void print_frame_info(const uvg_frame_info *const info,
-                      const double frame_psnr[3],
                       const uint32_t bytes,
                       const bool print_psnr,
+                      const bool print_ssim,
                       const double avg_qp);
 
 #endif
@@ -46,7 +46,7 @@
 #include <io.h>       /* _setmode() */
 #endif
 
-#include <math.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -98,62 +98,6 @@ static unsigned get_padding(unsigned width_or_height){
   }
 }
 
-/**
- * \brief Value that is printed instead of PSNR when SSE is zero.
- */
-static const double MAX_PSNR = 999.99;
-static const double MAX_SQUARED_ERROR = (double)PIXEL_MAX * (double)PIXEL_MAX;
-
-/**
- * \brief Calculates image PSNR value
- *
- * \param src   source picture
- * \param rec   reconstructed picture
- * \prama psnr  returns the PSNR
- */
-static void compute_psnr(const uvg_picture *const src,
-                         const uvg_picture *const rec,
-                         double psnr[3])
-{
-  assert(src->width  == rec->width);
-  assert(src->height == rec->height);
-
-  int32_t pixels = src->width * src->height;
-  int colors = rec->chroma_format == UVG_CSP_400 ? 1 : 3;
-  double sse[3] = { 0.0 };
-
-  for (int32_t c = 0; c < colors; ++c) {
-
-    uvg_pixel* src_ptr = src->data[c];
-    uvg_pixel* rec_ptr = rec->data[c];
-    int32_t width = src->width;
-    int32_t height = src->height;
-    int32_t stride = src->stride;
-    int32_t num_pixels = pixels;
-    if (c != COLOR_Y) {
-      width >>= 1;
-      height >>= 1;
-      stride >>= 1;
-      num_pixels >>= 2;
-    }
-    for (int32_t y = 0; y < height; ++y) {
-      for (int32_t x = 0; x < width; ++x) {
-        const int32_t error = src_ptr[x] - rec_ptr[x];
-        sse[c] += error * error;
-      }
-      src_ptr += stride;
-      rec_ptr += stride;
-    }
-
-    // Avoid division by zero
-    if (sse[c] == 0.0) {
-      psnr[c] = MAX_PSNR;
-    } else {
-      psnr[c] = 10.0 * log10(num_pixels * MAX_SQUARED_ERROR / sse[c]);
-    }
-  }
-}
-
 typedef struct {
   // Semaphores for synchronization.
   uvg_sem_t* available_input_slots;
@@ -166,6 +110,7 @@ typedef struct {
   const encoder_control_t *encoder;
   const uint8_t padding_x;
   const uint8_t padding_y;
+  uvg_picture_pool *input_pool;
 
   // Picture and thread status passed from input thread to main thread.
   uvg_picture *img_in;
@@ -207,10 +152,7 @@ static void* input_read_thread(void* in_args)
       goto done;
     }
 
-    enum uvg_chroma_format csp = UVG_FORMAT2CSP(args->opts->config->input_format);
-    frame_in = args->api->picture_alloc_csp(csp,
-                                            args->opts->config->width  + args->padding_x,
-                                            args->opts->config->height + args->padding_y);
+    frame_in = args->api->picture_pool_acquire(args->input_pool);
 
     if (!frame_in) {
       fprintf(stderr, "Failed to allocate image.\n");
@@ -420,6 +362,434 @@ static bool read_header(FILE* input, uvg_config* config) {
   return true;
 }
 
+/**
+ * \brief Encoded frame of a segment waiting to be written out.
+ */
+typedef struct {
+  uvg_data_chunk *chunks;
+  uint32_t len;
+  uvg_frame_info info;
+} segment_frame_t;
+
+/**
+ * \brief Result of encoding a segment.
+ */
+typedef struct {
+  segment_frame_t *frames;
+  int frame_count;
+  bool done;
+  bool failed;
+} segment_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+
+  // Signalled when a segment has been encoded or written out.
+  pthread_cond_t segment_done;
+
+  // Encoders sharing the pool are opened and closed one at a time.
+  pthread_mutex_t open_lock;
+
+  const uvg_api *api;
+  const cmdline_opts_t *opts;
+  uvg_thread_pool *pool;
+
+  // Index of the next segment to encode.
+  int next_segment;
+  // Index of the next segment to write out.
+  int next_write;
+  // Index of the first segment after the end of the input.
+  int end_segment;
+  // Set when encoding a segment fails.
+  bool failed;
+
+  // Encoded segments waiting to be written out. Segment i is in
+  // segments[i % max_pending].
+  segment_t *segments;
+  int max_pending;
+} segment_handler_args;
+
+/**
+ * \brief Encode one segment of the input with its own encoder.
+ *
+ * The segment starts with an IDR frame and does not refer to other
+ * segments.
+ *
+ * \param args     segment handler arguments
+ * \param index    index of the segment
+ * \param segment  returns the encoded frames
+ * \return         1 on success, 0 on failure
+ */
+static int encode_segment(segment_handler_args *args, int index, segment_t *segment)
+{
+  const uvg_api *const api = args->api;
+  const cmdline_opts_t *const opts = args->opts;
+  const int32_t length = opts->segment_length;
+
+  segment->frames = NULL;
+  segment->frame_count = 0;
+
+  int32_t frames = length;
+  if (opts->frames > 0) {
+    frames = MIN(length, opts->frames - index * length);
+  }
+  if (frames <= 0) return 1;
+
+  FILE *input = fopen(opts->input, "rb");
+  if (!input) {
+    fprintf(stderr, "Could not open input file for segment %d.\n", index);
+    return 0;
+  }
+
+  if (opts->config->file_format == UVG_FORMAT_Y4M) {
+    // Skip the stream header. It was already parsed by the main thread.
+    int c;
+    while ((c = getc(input)) != EOF && c != '\n');
+  }
+
+  if (!yuv_io_seek(input, opts->seek + index * length,
+                   opts->config->width, opts->config->height,
+                   opts->config->file_format) || feof(input)) {
+    // The input ends before this segment.
+    fclose(input);
+    return 1;
+  }
+
+  // Give the segment its share of the bitrate budget.
+  uvg_config cfg = *opts->config;
+  if (opts->segment_weights) {
+    double weight_sum = 0.0;
+    for (int i = 0; i < opts->segment_weight_count; i++) {
+      weight_sum += opts->segment_weights[i];
+    }
+    const double weight = opts->segment_weights[index % opts->segment_weight_count];
+    cfg.target_bitrate = (int32_t)(cfg.target_bitrate * weight *
+                                   opts->segment_weight_count / weight_sum + 0.5);
+  }
+
+  pthread_mutex_lock(&args->open_lock);
+  uvg_encoder *enc = api->encoder_open_with_pool(&cfg, args->pool);
+  pthread_mutex_unlock(&args->open_lock);
+  if (!enc) {
+    fprintf(stderr, "Failed to open encoder for segment %d.\n", index);
+    fclose(input);
+    return 0;
+  }
+  const encoder_control_t *const encoder = enc->control;
+  uvg_picture_pool *input_pool = NULL;
+
+  segment->frames = calloc(frames, sizeof(segment_frame_t));
+  if (!segment->frames) goto failed;
+
+  const uint8_t padding_x = get_padding(opts->config->width);
+  const uint8_t padding_y = get_padding(opts->config->height);
+  input_pool = api->picture_pool_alloc(UVG_FORMAT2CSP(opts->config->input_format),
+                                       opts->config->width + padding_x,
+                                       opts->config->height + padding_y);
+  if (!input_pool) goto failed;
+
+  int32_t frames_read = 0;
+  for (;;) {
+    uvg_picture *img_in = NULL;
+    if (frames_read < frames) {
+      img_in = api->picture_pool_acquire(input_pool);
+      if (!img_in) goto failed;
+      img_in->pts = frames_read;
+
+      if (yuv_io_read(input,
+                      opts->config->width,
+                      opts->config->height,
+                      encoder->cfg.input_bitdepth,
+                      encoder->bitdepth,
+                      img_in, opts->config->file_format)) {
+        frames_read++;
+      } else {
+        // End of input.
+        api->picture_free(img_in);
+        img_in = NULL;
+        frames = frames_read;
+      }
+    }
+
+    uvg_data_chunk *chunks_out = NULL;
+    uint32_t len_out = 0;
+    uvg_frame_info info_out;
+    if (!api->encoder_encode(enc, img_in, &chunks_out, &len_out,
+                             NULL, NULL, &info_out)) {
+      fprintf(stderr, "Failed to encode image.\n");
+      api->picture_free(img_in);
+      goto failed;
+    }
+    api->picture_free(img_in);
+
+    if (chunks_out == NULL && img_in == NULL) {
+      // No more input or output left.
+      break;
+    }
+
+    if (chunks_out != NULL) {
+      segment_frame_t *frame = &segment->frames[segment->frame_count++];
+      frame->chunks = chunks_out;
+      frame->len = len_out;
+      frame->info = info_out;
+    }
+  }
+
+  pthread_mutex_lock(&args->open_lock);
+  api->encoder_close(enc);
+  pthread_mutex_unlock(&args->open_lock);
+  api->picture_pool_free(input_pool);
+  fclose(input);
+  return 1;
+
+failed:
+  pthread_mutex_lock(&args->open_lock);
+  api->encoder_close(enc);
+  pthread_mutex_unlock(&args->open_lock);
+  api->picture_pool_free(input_pool);
+  fclose(input);
+  return 0;
+}
+
+/**
+ * \brief Free the frames of an encoded segment.
+ */
+static void free_segment(const uvg_api *api, segment_t *segment)
+{
+  for (int i = 0; i < segment->frame_count; i++) {
+    api->chunk_free(segment->frames[i].chunks);
+  }
+  FREE_POINTER(segment->frames);
+  segment->frame_count = 0;
+}
+
+/**
+ * \brief Encode segments in a thread until all of them have been started.
+ *
+ * \param in_args  pointer to segment_handler_args
+ */
+static void* segment_encode_thread(void* in_args)
+{
+  segment_handler_args *args = (segment_handler_args*)in_args;
+
+  for (;;) {
+    pthread_mutex_lock(&args->lock);
+    // Limit the number of encoded segments waiting to be written out.
+    while (!args->failed &&
+           args->next_segment < args->end_segment &&
+           args->next_segment - args->next_write >= args->max_pending) {
+      pthread_cond_wait(&args->segment_done, &args->lock);
+    }
+    if (args->failed || args->next_segment >= args->end_segment) {
+      pthread_mutex_unlock(&args->lock);
+      break;
+    }
+    const int index = args->next_segment++;
+    pthread_mutex_unlock(&args->lock);
+
+    segment_t segment;
+    const int ok = encode_segment(args, index, &segment);
+
+    pthread_mutex_lock(&args->lock);
+    if (!ok) {
+      args->failed = true;
+    } else if (segment.frame_count < args->opts->segment_length) {
+      // The input ends in this segment.
+      args->end_segment = MIN(args->end_segment,
+                              segment.frame_count > 0 ? index + 1 : index);
+    }
+    segment.done = true;
+    segment.failed = !ok;
+    args->segments[index % args->max_pending] = segment;
+    pthread_cond_broadcast(&args->segment_done);
+    pthread_mutex_unlock(&args->lock);
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Encode the input as independent segments in parallel.
+ *
+ * Each segment of opts->segment_length frames is encoded by its own
+ * encoder, starting with an IDR frame and with its own rate control.
+ * The bitrate of each segment is scaled by opts->segment_weights.
+ * The encoders share one thread pool. The segments are written out in
+ * order, so the output is a concatenation of closed GOP streams.
+ *
+ * If opts->segment_index is set, only that segment is encoded. The
+ * outputs of separate processes can then be joined with
+ * tools/stitch-segments.py.
+ *
+ * \param api     API
+ * \param opts    command line options
+ * \param output  output file
+ * \return        1 on success, 0 on failure
+ */
+static int encode_segments(const uvg_api *const api,
+                           const cmdline_opts_t *const opts,
+                           FILE *output)
+{
+  int ok = 1;
+  const int num_threads = opts->segment_index >= 0 ? 1 : opts->segment_parallel;
+  const int first_segment = MAX(opts->segment_index, 0);
+  pthread_t *threads = NULL;
+  int threads_started = 0;
+
+  segment_handler_args args = {
+    .api = api,
+    .opts = opts,
+    .pool = NULL,
+    .next_segment = first_segment,
+    .next_write = first_segment,
+    .end_segment = opts->segment_index >= 0 ? first_segment + 1 : INT_MAX,
+    .failed = false,
+    .segments = NULL,
+    .max_pending = 2 * num_threads,
+  };
+  pthread_mutex_init(&args.lock, NULL);
+  pthread_mutex_init(&args.open_lock, NULL);
+  pthread_cond_init(&args.segment_done, NULL);
+
+  UVG_CLOCK_T start_real_time, end_real_time;
+  clock_t start_cpu_time = clock();
+  UVG_GET_TIME(&start_real_time);
+
+  uint64_t bitstream_length = 0;
+  uint32_t frames_done = 0;
+  double psnr_sum[3] = { 0.0, 0.0, 0.0 };
+  double ssim_sum[3] = { 0.0, 0.0, 0.0 };
+  uint64_t qp_sum = 0;
+
+  args.pool = api->thread_pool_alloc(opts->config);
+  args.segments = calloc(args.max_pending, sizeof(segment_t));
+  threads = calloc(num_threads, sizeof(pthread_t));
+  if (!args.pool || !args.segments || !threads) {
+    fprintf(stderr, "Failed to allocate segment encoders.\n");
+    ok = 0;
+    goto done;
+  }
+
+  for (; threads_started < num_threads; threads_started++) {
+    if (pthread_create(&threads[threads_started], NULL, segment_encode_thread, &args) != 0) {
+      fprintf(stderr, "pthread_create failed!\n");
+      ok = 0;
+      goto done;
+    }
+  }
+
+  for (int index = first_segment;; index++) {
+    pthread_mutex_lock(&args.lock);
+    segment_t *slot = &args.segments[index % args.max_pending];
+    while (!slot->done && !args.failed && index < args.end_segment) {
+      pthread_cond_wait(&args.segment_done, &args.lock);
+    }
+    if (args.failed || index >= args.end_segment) {
+      ok = !args.failed;
+      pthread_mutex_unlock(&args.lock);
+      break;
+    }
+    segment_t segment = *slot;
+    slot->done = false;
+    slot->frames = NULL;
+    slot->frame_count = 0;
+    args.next_write++;
+    pthread_cond_broadcast(&args.segment_done);
+    pthread_mutex_unlock(&args.lock);
+
+    for (int i = 0; i < segment.frame_count && ok; i++) {
+      const segment_frame_t *frame = &segment.frames[i];
+      for (uvg_data_chunk *chunk = frame->chunks; chunk != NULL; chunk = chunk->next) {
+        if (fwrite(chunk->data, sizeof(uint8_t), chunk->len, output) != chunk->len) {
+          fprintf(stderr, "Failed to write data to file.\n");
+          ok = 0;
+          break;
+        }
+      }
+
+      bitstream_length += frame->len;
+      qp_sum           += frame->info.qp;
+      frames_done      += 1;
+      for (int c = 0; c < 3; c++) {
+        psnr_sum[c]    += frame->info.psnr[c];
+        ssim_sum[c]    += frame->info.ssim[c];
+      }
+
+      print_frame_info(&frame->info, frame->len, opts->config->calc_psnr,
+                       opts->config->calc_ssim, calc_avg_qp(qp_sum, frames_done));
+    }
+    fflush(output);
+    free_segment(api, &segment);
+
+    if (!ok) {
+      pthread_mutex_lock(&args.lock);
+      args.failed = true;
+      pthread_cond_broadcast(&args.segment_done);
+      pthread_mutex_unlock(&args.lock);
+      break;
+    }
+  }
+
+done:
+  if (!ok && threads_started > 0) {
+    pthread_mutex_lock(&args.lock);
+    args.failed = true;
+    pthread_cond_broadcast(&args.segment_done);
+    pthread_mutex_unlock(&args.lock);
+  }
+  for (int i = 0; i < threads_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (args.segments) {
+    for (int i = 0; i < args.max_pending; i++) {
+      free_segment(api, &args.segments[i]);
+    }
+  }
+  FREE_POINTER(args.segments);
+  FREE_POINTER(threads);
+  api->thread_pool_free(args.pool);
+  pthread_cond_destroy(&args.segment_done);
+  pthread_mutex_destroy(&args.open_lock);
+  pthread_mutex_destroy(&args.lock);
+
+  if (!ok) return 0;
+
+  UVG_GET_TIME(&end_real_time);
+
+  fprintf(stderr, " Processed %d frames in %d segments, %10llu bits",
+          frames_done,
+          args.next_write - first_segment,
+          (long long unsigned int)bitstream_length * 8);
+  if (opts->config->calc_psnr && frames_done > 0) {
+    fprintf(stderr, " AVG PSNR Y %2.4f U %2.4f V %2.4f",
+            psnr_sum[0] / frames_done,
+            psnr_sum[1] / frames_done,
+            psnr_sum[2] / frames_done);
+  }
+  if (opts->config->calc_ssim && frames_done > 0) {
+    fprintf(stderr, " AVG SSIM Y %1.4f U %1.4f V %1.4f",
+            ssim_sum[0] / frames_done,
+            ssim_sum[1] / frames_done,
+            ssim_sum[2] / frames_done);
+  }
+  fprintf(stderr, "\n");
+
+  const double encoding_time = (double)(clock() - start_cpu_time) / (double)CLOCKS_PER_SEC;
+  const double wall_time = UVG_CLOCK_T_DIFF(start_real_time, end_real_time);
+  const double sequence_t = (double)frames_done * opts->config->framerate_denom /
+                            opts->config->framerate_num;
+
+  fprintf(stderr, " Encoding time: %.3f s.\n", encoding_time);
+  fprintf(stderr, " Encoding wall time: %.3f s.\n", wall_time);
+  fprintf(stderr, " FPS: %.2f\n", (double)frames_done / wall_time);
+  fprintf(stderr, " Bitrate: %.3f Mbps\n", (double)(bitstream_length * 8) / sequence_t / (double)(1 << 20));
+  if (frames_done > 0) {
+    fprintf(stderr, " AVG QP: %.1f\n", calc_avg_qp(qp_sum, frames_done));
+  }
+
+  return 1;
+}
+
 /**
  * \brief Program main function.
  * \param argc Argument count from commandline
@@ -465,6 +835,9 @@ int main(int argc, char *argv[])
   uvg_sem_t *available_input_slots = NULL;
   uvg_sem_t *filled_input_slots = NULL;
 
+  // Input pictures returned by the encoder are reused for the next frames.
+  uvg_picture_pool *input_pool = NULL;
+
 #ifdef _WIN32
   // Stderr needs to be text mode to convert \n to \r\n in Windows.
   setmode( _fileno( stderr ), _O_TEXT );
@@ -530,6 +903,21 @@ int main(int argc, char *argv[])
     }
   }
 
+  if (opts->segment_length > 0) {
+    fprintf(stderr, "Input: %s, output: %s\n", opts->input, opts->output);
+    if (opts->segment_index >= 0) {
+      fprintf(stderr, "  Segment %d of %d frames\n",
+              opts->segment_index, opts->segment_length);
+    } else {
+      fprintf(stderr, "  Segments of %d frames, %d at a time\n",
+              opts->segment_length, opts->segment_parallel);
+    }
+    if (!encode_segments(api, opts, output)) {
+      goto exit_failure;
+    }
+    goto done;
+  }
+
   enc = api->encoder_open(opts->config);
   if (!enc) {
     fprintf(stderr, "Failed to open encoder.\n");
@@ -561,6 +949,7 @@ int main(int argc, char *argv[])
     uint64_t bitstream_length = 0;
     uint32_t frames_done = 0;
     double psnr_sum[3] = { 0.0, 0.0, 0.0 };
+    double ssim_sum[3] = { 0.0, 0.0, 0.0 };
     uint64_t qp_sum = 0;
 
     // how many bits have been written this second? used for checking if framerate exceeds level's limits
@@ -574,6 +963,14 @@ int main(int argc, char *argv[])
 
     pthread_t input_thread;
 
+    input_pool = api->picture_pool_alloc(UVG_FORMAT2CSP(opts->config->input_format),
+                                         opts->config->width  + padding_x,
+                                         opts->config->height + padding_y);
+    if (!input_pool) {
+      fprintf(stderr, "Failed to allocate picture pool.\n");
+      goto exit_failure;
+    }
+
     available_input_slots = calloc(1, sizeof(uvg_sem_t));
     filled_input_slots    = calloc(1, sizeof(uvg_sem_t));
     uvg_sem_init(available_input_slots, 0);
@@ -590,6 +987,7 @@ int main(int argc, char *argv[])
       .encoder = encoder,
       .padding_x = padding_x,
       .padding_y = padding_y,
+      .input_pool = input_pool,
 
       .img_in = NULL,
       .retval = RETVAL_RUNNING,
@@ -627,15 +1025,14 @@ int main(int argc, char *argv[])
 
       uvg_data_chunk* chunks_out = NULL;
       uvg_picture *img_rec = NULL;
-      uvg_picture *img_src = NULL;
       uint32_t len_out = 0;
       uvg_frame_info info_out;
       if (!api->encoder_encode(enc,
                                cur_in_img,
                                &chunks_out,
                                &len_out,
-                               &img_rec,
-                               &img_src,
+                               recout ? &img_rec : NULL,
+                               NULL,
                                &info_out)) {
         fprintf(stderr, "Failed to encode image.\n");
         api->picture_free(cur_in_img);
@@ -700,12 +1097,11 @@ int main(int argc, char *argv[])
         }
 
         // Compute and print stats.
-
-        double frame_psnr[3] = { 0.0, 0.0, 0.0 };
-        if (encoder->cfg.calc_psnr && encoder->cfg.source_scan_type == UVG_INTERLACING_NONE) {
-          // Do not compute PSNR for interlaced frames, because img_rec does not contain
-          // the deinterlaced frame yet.
-          compute_psnr(img_src, img_rec, frame_psnr);
+        if (encoder->cfg.source_scan_type != UVG_INTERLACING_NONE) {
+          // Do not report PSNR or SSIM for interlaced frames, because they
+          // are calculated for the last field only.
+          memset(info_out.psnr, 0, sizeof(info_out.psnr));
+          memset(info_out.ssim, 0, sizeof(info_out.ssim));
         }
 
         if (recout) {
@@ -732,18 +1128,18 @@ int main(int argc, char *argv[])
         qp_sum      += info_out.qp;
         frames_done += 1;
 
-        psnr_sum[0] += frame_psnr[0];
-        psnr_sum[1] += frame_psnr[1];
-        psnr_sum[2] += frame_psnr[2];
+        for (int c = 0; c < 3; c++) {
+          psnr_sum[c] += info_out.psnr[c];
+          ssim_sum[c] += info_out.ssim[c];
+        }
 
-        print_frame_info(&info_out, frame_psnr, len_out, encoder->cfg.calc_psnr,
-                         calc_avg_qp(qp_sum, frames_done));
+        print_frame_info(&info_out, len_out, encoder->cfg.calc_psnr,
+                         encoder->cfg.calc_ssim, calc_avg_qp(qp_sum, frames_done));
       }
 
       api->picture_free(cur_in_img);
       api->chunk_free(chunks_out);
       api->picture_free(img_rec);
-      api->picture_free(img_src);
     }
 
     UVG_GET_TIME(&encoding_end_real_time);
@@ -763,6 +1159,12 @@ int main(int argc, char *argv[])
               psnr_sum[1] / frames_done,
               psnr_sum[2] / frames_done);
     }
+    if (encoder->cfg.calc_ssim && frames_done > 0) {
+      fprintf(stderr, " AVG SSIM Y %1.4f U %1.4f V %1.4f",
+              ssim_sum[0] / frames_done,
+              ssim_sum[1] / frames_done,
+              ssim_sum[2] / frames_done);
+    }
     fprintf(stderr, "\n");
     fprintf(stderr, " Total CPU time: %.3f s.\n", ((float)(clock() - start_time)) / CLOCKS_PER_SEC);
 
@@ -799,6 +1201,15 @@ int main(int argc, char *argv[])
 
       fprintf(stderr, " Bitrate: %.3f Mbps\n",          bitrate_mbps);
       fprintf(stderr, " AVG QP: %.1f\n",                avg_qp);
+
+      if (enc->setup_stats.frames > 0) {
+        const double setup_time = enc->setup_stats.prepare_time + enc->setup_stats.start_time;
+        fprintf(stderr, " Frame setup time: %.3f s (%.3f ms per frame, prepare %.3f ms, start %.3f ms)\n",
+                setup_time,
+                1000.0 * setup_time / enc->setup_stats.frames,
+                1000.0 * enc->setup_stats.prepare_time / enc->setup_stats.frames,
+                1000.0 * enc->setup_stats.start_time / enc->setup_stats.frames);
+      }
     }
     pthread_join(input_thread, NULL);
   }
@@ -817,6 +1228,7 @@ done:
 
   // deallocate structures
   if (enc) api->encoder_close(enc);
+  api->picture_pool_free(input_pool);
   if (opts) cmdline_opts_free(api, opts);
 
   // close files
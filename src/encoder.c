@@ -39,12 +39,116 @@
 
 #include "cfg.h"
 #include "gop.h"
+#include "image.h"
+#include "rate_control.h"
 #include "rdo.h"
 #include "strategyselector.h"
 #include "uvg_math.h"
 #include "fast_coeff_cost.h"
 
 static int encoder_control_init_gop_layer_weights(encoder_control_t * const);
+static int encoder_control_init_partial_coding(encoder_control_t * const);
+
+/**
+ * \brief Derive tile boundaries and the tile scan from the tile sizes.
+ *
+ * Fills tiles_col_bd, tiles_row_bd, tiles_ctb_addr_rs_to_ts,
+ * tiles_ctb_addr_ts_to_rs and tiles_tile_id from tiles_col_width and
+ * tiles_row_height.
+ */
+static void encoder_control_derive_tile_scan(encoder_control_t * const encoder)
+{
+  const int num_ctbs = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
+
+  //Temporary pointers to allow encoder fields to be const
+  const int32_t *const tiles_col_width = encoder->tiles_col_width;
+  const int32_t *const tiles_row_height = encoder->tiles_row_height;
+  int32_t *const tiles_col_bd = (int32_t*)encoder->tiles_col_bd;
+  int32_t *const tiles_row_bd = (int32_t*)encoder->tiles_row_bd;
+  int32_t *const tiles_ctb_addr_rs_to_ts = (int32_t*)encoder->tiles_ctb_addr_rs_to_ts;
+  int32_t *const tiles_ctb_addr_ts_to_rs = (int32_t*)encoder->tiles_ctb_addr_ts_to_rs;
+  int32_t *const tiles_tile_id = (int32_t*)encoder->tiles_tile_id;
+
+  //(6-5) in ITU-T Rec. H.265 (04/2013)
+  tiles_col_bd[0] = 0;
+  for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
+    tiles_col_bd[i+1] = tiles_col_bd[i] + tiles_col_width[i];
+  }
+
+  //(6-6) in ITU-T Rec. H.265 (04/2013)
+  tiles_row_bd[0] = 0;
+  for (int i = 0; i < encoder->cfg.tiles_height_count; ++i) {
+    tiles_row_bd[i+1] = tiles_row_bd[i] + tiles_row_height[i];
+  }
+
+  //(6-7) in ITU-T Rec. H.265 (04/2013)
+  //j == ctbAddrRs
+  for (int j = 0; j < num_ctbs; ++j) {
+    int tileX = 0, tileY = 0;
+    int tbX = j % encoder->in.width_in_lcu;
+    int tbY = j / encoder->in.width_in_lcu;
+
+    for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
+      if (tbX >= tiles_col_bd[i]) tileX = i;
+    }
+
+    for (int i = 0; i < encoder->cfg.tiles_height_count; ++i) {
+      if (tbY >= tiles_row_bd[i]) tileY = i;
+    }
+
+    tiles_ctb_addr_rs_to_ts[j] = 0;
+    for (int i = 0; i < tileX; ++i) {
+      tiles_ctb_addr_rs_to_ts[j] += tiles_row_height[tileY] * tiles_col_width[i];
+    }
+    for (int i = 0; i < tileY; ++i) {
+      tiles_ctb_addr_rs_to_ts[j] += encoder->in.width_in_lcu * tiles_row_height[i];
+    }
+    tiles_ctb_addr_rs_to_ts[j] += (tbY - tiles_row_bd[tileY]) * tiles_col_width[tileX] +
+                                   tbX - tiles_col_bd[tileX];
+  }
+
+  //(6-8) in ITU-T Rec. H.265 (04/2013)
+  //Make reverse map from tile scan to raster scan
+  for (int j = 0; j < num_ctbs; ++j) {
+    tiles_ctb_addr_ts_to_rs[tiles_ctb_addr_rs_to_ts[j]] = j;
+  }
+
+  //(6-9) in ITU-T Rec. H.265 (04/2013)
+  int tileIdx = 0;
+  for (int j = 0; j < encoder->cfg.tiles_height_count; ++j) {
+    for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
+      for (int y = tiles_row_bd[j]; y < tiles_row_bd[j+1]; ++y) {
+        for (int x = tiles_col_bd[i]; x < tiles_col_bd[i+1]; ++x) {
+          tiles_tile_id[tiles_ctb_addr_rs_to_ts[y * encoder->in.width_in_lcu + x]] = tileIdx;
+        }
+      }
+      ++tileIdx;
+    }
+  }
+}
+
+/**
+ * \brief Set the address of a single independent slice per tile.
+ */
+static void encoder_control_derive_tile_slices(encoder_control_t * const encoder)
+{
+  int *const slice_addresses_in_ts = (int*)encoder->slice_addresses_in_ts;
+  const int32_t *const tiles_col_bd = encoder->tiles_col_bd;
+  const int32_t *const tiles_row_bd = encoder->tiles_row_bd;
+  const int32_t *const tiles_ctb_addr_rs_to_ts = encoder->tiles_ctb_addr_rs_to_ts;
+
+  int slice_id = 0;
+  for (int tile_row = 0; tile_row < encoder->cfg.tiles_height_count; ++tile_row) {
+    for (int tile_col = 0; tile_col < encoder->cfg.tiles_width_count; ++tile_col) {
+      int x = tiles_col_bd[tile_col];
+      int y = tiles_row_bd[tile_row];
+      int rs = y * encoder->in.width_in_lcu + x;
+      int ts = tiles_ctb_addr_rs_to_ts[rs];
+      slice_addresses_in_ts[slice_id] = ts;
+      slice_id += 1;
+    }
+  }
+}
 
 static unsigned cfg_num_threads(void)
 {
@@ -66,7 +170,12 @@ static int get_max_parallelism(const encoder_control_t *const encoder)
 
   int parallelism = 0;
 
-  if (encoder->cfg.intra_period == 1) {
+  if (encoder->cfg.intra_frame_parallel) {
+    // Each frame is a single job and the frames do not depend on each
+    // other.
+    parallelism = par_frames;
+
+  } else if (encoder->cfg.intra_period == 1) {
     int threads_per_frame;
     if (encoder->cfg.wpp) {
       // Usually limited by width because starting to code a CTU requires
@@ -123,10 +232,89 @@ static int get_max_parallelism(const encoder_control_t *const encoder)
     }
   }
 
+  if (!encoder->cfg.intra_frame_parallel) {
+    // Each CU depth searched in parallel can keep one more thread busy
+    // for every CTU.
+    parallelism *= 1 + encoder->cfg.parallel_cu_search;
+  }
+
   return parallelism;
 }
 
 
+/**
+ * \brief Select WPP or tiles, the tile grid and OWF for the threads.
+ *
+ * Each layout is evaluated with get_max_parallelism with more and more
+ * frames in parallel until more frames do not help or the latency limit
+ * given by --owf is reached. The layout with the highest parallelism, up
+ * to the number of threads, is selected. Ties go to WPP, then to fewer
+ * and squarer tiles, since tiles cost bits, and then to fewer frames.
+ */
+static void encoder_control_select_parallel_layout(encoder_control_t *const encoder,
+                                                   const int max_threads)
+{
+  uvg_config *const cfg = &encoder->cfg;
+  const int width_lcu  = CEILDIV(cfg->width, LCU_WIDTH);
+  const int height_lcu = CEILDIV(cfg->height, LCU_WIDTH);
+  const int max_owf = cfg->owf;
+
+  int best_tiles_x = 1;
+  int best_tiles_y = 1;
+  int best_owf = 0;
+  int best_parallelism = 0;
+  int best_shape = 0;
+
+  for (int tiles_y = 1; tiles_y <= MIN(height_lcu, MAX_TILES_PER_DIM - 1); ++tiles_y) {
+    for (int tiles_x = 1; tiles_x <= MIN(width_lcu, MAX_TILES_PER_DIM - 1); ++tiles_x) {
+      const int num_tiles = tiles_x * tiles_y;
+      if (num_tiles > MAX(max_threads, 1) && num_tiles > 1) continue;
+
+      cfg->wpp = num_tiles == 1;
+      cfg->tiles_width_count = tiles_x;
+      cfg->tiles_height_count = tiles_y;
+
+      int parallelism = 0;
+      int owf = 0;
+      for (cfg->owf = 0; max_owf < 0 || cfg->owf <= max_owf; cfg->owf++) {
+        const int p = MIN(get_max_parallelism(encoder), max_threads);
+        if (p <= parallelism) break;
+        parallelism = p;
+        owf = cfg->owf;
+        if (p >= max_threads) break;
+      }
+
+      // Difference between the width and height of a tile in CTUs.
+      const int shape = abs(width_lcu / tiles_x - height_lcu / tiles_y);
+      const int best_num_tiles = best_tiles_x * best_tiles_y;
+      if (parallelism > best_parallelism ||
+          (parallelism == best_parallelism &&
+           (num_tiles < best_num_tiles ||
+            (num_tiles == best_num_tiles && shape < best_shape) ||
+            (num_tiles == best_num_tiles && shape == best_shape && owf < best_owf))))
+      {
+        best_tiles_x = tiles_x;
+        best_tiles_y = tiles_y;
+        best_owf = owf;
+        best_parallelism = parallelism;
+        best_shape = shape;
+      }
+    }
+  }
+
+  cfg->wpp = best_tiles_x * best_tiles_y == 1;
+  cfg->tiles_width_count = best_tiles_x;
+  cfg->tiles_height_count = best_tiles_y;
+  // Without a latency limit the OWF is selected as with --owf auto.
+  cfg->owf = max_owf < 0 ? -1 : best_owf;
+
+  if (!cfg->wpp && cfg->tmvp_enable) {
+    cfg->tmvp_enable = false;
+    fprintf(stderr, "Disabling TMVP because tiles are used.\n");
+  }
+}
+
+
 /**
  * \brief Update ROI QPs for 360 video with equirectangular projection.
  *
@@ -179,13 +367,47 @@ static int8_t* derive_chroma_QP_mapping_table(const uvg_config* const cfg, int i
 }
 
 
+/**
+ * \brief Create a threadqueue with the threading options of a configuration.
+ *
+ * The number of threads can later be raised up to the number of logical
+ * CPUs with uvg_threadqueue_set_thread_count.
+ *
+ * \param cfg       encoder configuration
+ * \param threads   number of worker threads, or -1 for one for each
+ *                  logical CPU
+ * \return          threadqueue or NULL on failure
+ */
+threadqueue_queue_t * uvg_encoder_threadqueue_init(const uvg_config *const cfg, int threads)
+{
+  if (threads < 0) {
+    threads = cfg_num_threads();
+  }
+
+  threadqueue_queue_t *threadqueue = uvg_threadqueue_init(threads,
+                                                          MAX(threads, (int)cfg_num_threads()),
+                                                          cfg->caller_runs,
+                                                          cfg->idle_spin,
+                                                          cfg->cpu_affinity,
+                                                          cfg->cpu_affinity_count,
+                                                          cfg->numa);
+  if (!threadqueue) {
+    fprintf(stderr, "Could not initialize threadqueue.\n");
+  }
+  return threadqueue;
+}
+
+
 /**
  * \brief Allocate and initialize an encoder control structure.
  *
- * \param cfg   encoder configuration
- * \return      initialized encoder control or NULL on failure
+ * \param cfg           encoder configuration
+ * \param threadqueue   threadqueue shared with other encoders, or NULL to
+ *                      create one for this encoder
+ * \return              initialized encoder control or NULL on failure
  */
-encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
+encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg,
+                                            threadqueue_queue_t *threadqueue)
 {
   encoder_control_t *encoder = NULL;
 
@@ -213,6 +435,7 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
   encoder->cfg.tiles_height_split = NULL;
   encoder->cfg.slice_addresses_in_ts = NULL;
   encoder->cfg.fast_coeff_table_fn = NULL;
+  encoder->cfg.cpu_affinity = NULL;
 
   if (encoder->cfg.gop_len > 0) {
     if (encoder->cfg.gop_lowdelay) {
@@ -235,17 +458,46 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
     encoder->cfg.intra_qp_offset = 0;
   }
 
+  // Frames encoded as single jobs have no use for wavefronts.
+  if (encoder->cfg.intra_frame_parallel) {
+    encoder->cfg.wpp = 0;
+  }
+
+  if (encoder->cfg.partial_coding.fullWidth > 0) {
+    // The tiles are those of the full picture. The encoded part is one
+    // of them, so it is encoded without tiles. Motion vectors and TMVP
+    // may not use samples of the other tiles.
+    encoder->partial.enabled = true;
+    encoder->partial.tiles_x = encoder->cfg.tiles_width_count;
+    encoder->partial.tiles_y = encoder->cfg.tiles_height_count;
+    encoder->cfg.tiles_width_count = 1;
+    encoder->cfg.tiles_height_count = 1;
+    encoder->cfg.mv_constraint = UVG_MV_CONSTRAIN_FRAME_AND_TILE_MARGIN;
+    encoder->cfg.tmvp_enable = 0;
+  }
+
   encoder->poc_lsb_bits = MAX(4, uvg_math_ceil_log2(encoder->cfg.gop_len * 2 + 1));
 
   encoder->max_inter_ref_lcu.right = 1;
   encoder->max_inter_ref_lcu.down  = 1;
 
+  if (threadqueue) {
+    // The threads of the shared threadqueue are available to this encoder.
+    encoder->cfg.threads = uvg_threadqueue_thread_count(threadqueue);
+  }
+
   int max_threads = encoder->cfg.threads;
   if (max_threads < 0) {
     max_threads = cfg_num_threads();
   }
   max_threads = MAX(1, max_threads);
 
+  const bool select_layout = encoder->cfg.parallel_layout == UVG_PARALLEL_LAYOUT_AUTO &&
+                             !encoder->cfg.intra_frame_parallel;
+  if (select_layout) {
+    encoder_control_select_parallel_layout(encoder, max_threads);
+  }
+
   // Need to set owf before initializing threadqueue.
   if (encoder->cfg.owf < 0) {
     int best_parallelism = 0;
@@ -286,10 +538,29 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
     }
   }
 
-  encoder->threadqueue = uvg_threadqueue_init(encoder->cfg.threads);
-  if (!encoder->threadqueue) {
-    fprintf(stderr, "Could not initialize threadqueue.\n");
-    goto init_failed;
+  if (select_layout) {
+    // Report the prediction for the final OWF.
+    const int parallelism = MIN(get_max_parallelism(encoder), max_threads);
+    if (encoder->cfg.wpp) {
+      fprintf(stderr, "--parallel-layout=auto selected WPP, "
+              "predicted parallelism %d with --owf=%d.\n",
+              parallelism, encoder->cfg.owf);
+    } else {
+      fprintf(stderr, "--parallel-layout=auto selected %dx%d tiles, "
+              "predicted parallelism %d with --owf=%d.\n",
+              encoder->cfg.tiles_width_count, encoder->cfg.tiles_height_count,
+              parallelism, encoder->cfg.owf);
+    }
+  }
+
+  if (threadqueue) {
+    encoder->threadqueue = threadqueue;
+    encoder->threadqueue_shared = true;
+  } else {
+    encoder->threadqueue = uvg_encoder_threadqueue_init(cfg, encoder->cfg.threads);
+    if (!encoder->threadqueue) {
+      goto init_failed;
+    }
   }
 
   encoder->bitdepth = UVG_BIT_DEPTH;
@@ -367,6 +638,37 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
 
   uvg_encoder_control_input_init(encoder, encoder->cfg.width, encoder->cfg.height);
 
+  if (encoder->partial.enabled && !encoder_control_init_partial_coding(encoder)) {
+    goto init_failed;
+  }
+
+  {
+    // Reserve the search and bitstream jobs of every LCU in the frames that
+    // can be in flight at the same time, along with their dependencies, so
+    // that creating the jobs does not allocate memory during encoding.
+    const int num_lcus = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
+    const int num_frames = encoder->cfg.owf + 2;
+    if (!uvg_threadqueue_reserve(encoder->threadqueue,
+                                 2 * num_lcus * num_frames,
+                                 4 * num_lcus * num_frames)) {
+      goto init_failed;
+    }
+  }
+
+  encoder->rc_data = uvg_alloc_rc_data(encoder);
+  if (!encoder->rc_data) {
+    fprintf(stderr, "Could not allocate rate control data.\n");
+    goto init_failed;
+  }
+
+  encoder->picture_pool = uvg_picture_pool_alloc(encoder->chroma_format,
+                                                 encoder->in.width,
+                                                 encoder->in.height);
+  if (!encoder->picture_pool) {
+    fprintf(stderr, "Could not allocate picture pool.\n");
+    goto init_failed;
+  }
+
   if (encoder->cfg.framerate_num != 0) {
     double framerate = encoder->cfg.framerate_num / (double)encoder->cfg.framerate_denom;
     encoder->target_avg_bppic = encoder->cfg.target_bitrate / framerate;
@@ -405,6 +707,11 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
     //Will be (perhaps) changed later
     encoder->tiles_uniform_spacing_flag = 1;
 
+    // An automatically selected tile grid is uniform.
+    const bool auto_layout = encoder->cfg.parallel_layout == UVG_PARALLEL_LAYOUT_AUTO;
+    const int32_t *const tiles_width_split = auto_layout ? NULL : cfg->tiles_width_split;
+    const int32_t *const tiles_height_split = auto_layout ? NULL : cfg->tiles_height_split;
+
     encoder->tiles_col_width = tiles_col_width =
       MALLOC(int32_t, encoder->cfg.tiles_width_count);
     encoder->tiles_row_height = tiles_row_height =
@@ -433,7 +740,7 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
     }
 
     //(6-3) and (6-4) in ITU-T Rec. H.265 (04/2013)
-    if (!cfg->tiles_width_split) {
+    if (!tiles_width_split) {
       for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
         tiles_col_width[i] =
           (i+1) * encoder->in.width_in_lcu / encoder->cfg.tiles_width_count -
@@ -443,15 +750,15 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
       int32_t last_pos_in_px = 0;
       tiles_col_width[encoder->cfg.tiles_width_count - 1] = encoder->in.width_in_lcu;
       for (int i = 0; i < encoder->cfg.tiles_width_count - 1; ++i) {
-        int32_t column_width_in_lcu = (cfg->tiles_width_split[i] - last_pos_in_px) / LCU_WIDTH;
-        last_pos_in_px = cfg->tiles_width_split[i];
+        int32_t column_width_in_lcu = (tiles_width_split[i] - last_pos_in_px) / LCU_WIDTH;
+        last_pos_in_px = tiles_width_split[i];
         tiles_col_width[i] = column_width_in_lcu;
         tiles_col_width[encoder->cfg.tiles_width_count - 1] -= column_width_in_lcu;
       }
       encoder->tiles_uniform_spacing_flag = 0;
     }
 
-    if (!cfg->tiles_height_split) {
+    if (!tiles_height_split) {
       for (int i = 0; i < encoder->cfg.tiles_height_count; ++i) {
         tiles_row_height[i] = ((i+1) * encoder->in.height_in_lcu) / encoder->cfg.tiles_height_count -
                                    i * encoder->in.height_in_lcu / encoder->cfg.tiles_height_count;
@@ -460,70 +767,15 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
       int32_t last_pos_in_px = 0;
       tiles_row_height[encoder->cfg.tiles_height_count - 1] = encoder->in.height_in_lcu;
       for (int i = 0; i < encoder->cfg.tiles_height_count - 1; ++i) {
-        int32_t row_height_in_lcu = (cfg->tiles_height_split[i] - last_pos_in_px) / LCU_WIDTH;
-        last_pos_in_px = cfg->tiles_height_split[i];
+        int32_t row_height_in_lcu = (tiles_height_split[i] - last_pos_in_px) / LCU_WIDTH;
+        last_pos_in_px = tiles_height_split[i];
         tiles_row_height[i] = row_height_in_lcu;
         tiles_row_height[encoder->cfg.tiles_height_count - 1] -= row_height_in_lcu;
       }
       encoder->tiles_uniform_spacing_flag = 0;
     }
 
-    //(6-5) in ITU-T Rec. H.265 (04/2013)
-    tiles_col_bd[0] = 0;
-    for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
-      tiles_col_bd[i+1] = tiles_col_bd[i] + tiles_col_width[i];
-    }
-
-    //(6-6) in ITU-T Rec. H.265 (04/2013)
-    tiles_row_bd[0] = 0;
-    for (int i = 0; i < encoder->cfg.tiles_height_count; ++i) {
-      tiles_row_bd[i+1] = tiles_row_bd[i] + tiles_row_height[i];
-    }
-
-    //(6-7) in ITU-T Rec. H.265 (04/2013)
-    //j == ctbAddrRs
-    for (int j = 0; j < num_ctbs; ++j) {
-      int tileX = 0, tileY = 0;
-      int tbX = j % encoder->in.width_in_lcu;
-      int tbY = j / encoder->in.width_in_lcu;
-
-      for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
-        if (tbX >= tiles_col_bd[i]) tileX = i;
-      }
-
-      for (int i = 0; i < encoder->cfg.tiles_height_count; ++i) {
-        if (tbY >= tiles_row_bd[i]) tileY = i;
-      }
-
-      tiles_ctb_addr_rs_to_ts[j] = 0;
-      for (int i = 0; i < tileX; ++i) {
-        tiles_ctb_addr_rs_to_ts[j] += tiles_row_height[tileY] * tiles_col_width[i];
-      }
-      for (int i = 0; i < tileY; ++i) {
-        tiles_ctb_addr_rs_to_ts[j] += encoder->in.width_in_lcu * tiles_row_height[i];
-      }
-      tiles_ctb_addr_rs_to_ts[j] += (tbY - tiles_row_bd[tileY]) * tiles_col_width[tileX] +
-                                     tbX - tiles_col_bd[tileX];
-    }
-
-    //(6-8) in ITU-T Rec. H.265 (04/2013)
-    //Make reverse map from tile scan to raster scan
-    for (int j = 0; j < num_ctbs; ++j) {
-      tiles_ctb_addr_ts_to_rs[tiles_ctb_addr_rs_to_ts[j]] = j;
-    }
-
-    //(6-9) in ITU-T Rec. H.265 (04/2013)
-    int tileIdx = 0;
-    for (int j = 0; j < encoder->cfg.tiles_height_count; ++j) {
-      for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
-        for (int y = tiles_row_bd[j]; y < tiles_row_bd[j+1]; ++y) {
-          for (int x = tiles_col_bd[i]; x < tiles_col_bd[i+1]; ++x) {
-            tiles_tile_id[tiles_ctb_addr_rs_to_ts[y * encoder->in.width_in_lcu + x]] = tileIdx;
-          }
-        }
-        ++tileIdx;
-      }
-    }
+    encoder_control_derive_tile_scan(encoder);
 
     if (encoder->cfg.slices & UVG_SLICES_WPP) {
       // Each WPP row will be put into a dependent slice.
@@ -538,17 +790,8 @@ encoder_control_t* uvg_encoder_control_init(const uvg_config *const cfg)
       encoder->slice_count = encoder->cfg.tiles_width_count * encoder->cfg.tiles_height_count;
       encoder->slice_addresses_in_ts = slice_addresses_in_ts = MALLOC(int, encoder->slice_count);
 
-      int slice_id = 0;
-      for (int tile_row = 0; tile_row < encoder->cfg.tiles_height_count; ++tile_row) {
-        for (int tile_col = 0; tile_col < encoder->cfg.tiles_width_count; ++tile_col) {
-          int x = tiles_col_bd[tile_col];
-          int y = tiles_row_bd[tile_row];
-          int rs = y * encoder->in.width_in_lcu + x;
-          int ts = tiles_ctb_addr_rs_to_ts[rs];
-          slice_addresses_in_ts[slice_id] = ts;
-          slice_id += 1;
-        }
-      }
+      if (!slice_addresses_in_ts) goto init_failed;
+      encoder_control_derive_tile_slices(encoder);
 
     } else {
       int *slice_addresses_in_ts;
@@ -683,14 +926,27 @@ void uvg_encoder_control_free(encoder_control_t *const encoder)
 
   FREE_POINTER(encoder->tiles_tile_id);
 
+  FREE_POINTER(encoder->partial.col_width);
+  FREE_POINTER(encoder->partial.row_height);
+
   FREE_POINTER(encoder->cfg.roi.file_path);
 
   FREE_POINTER(encoder->cfg.cabac_debug_file_name);
 
   uvg_scalinglist_destroy(&encoder->scaling_list);
 
-  uvg_threadqueue_free(encoder->threadqueue);
+  if (!encoder->threadqueue_shared) {
+    uvg_threadqueue_free(encoder->threadqueue);
+  }
   encoder->threadqueue = NULL;
+
+  if (encoder->rc_data) {
+    uvg_free_rc_data(encoder->rc_data);
+    encoder->rc_data = NULL;
+  }
+
+  uvg_picture_pool_free(encoder->picture_pool);
+  encoder->picture_pool = NULL;
   for (int i = 0; i < encoder->cfg.num_used_table; i++) {
     if (encoder->qp_map[i]) FREE_POINTER(encoder->qp_map[i]);
   }
@@ -708,6 +964,93 @@ void uvg_encoder_control_free(encoder_control_t *const encoder)
   free(encoder);
 }
 
+/**
+ * \brief Split lines into tiles of about equal cost.
+ *
+ * \param line_cost  cost of each CTU column or row
+ * \param lines      number of CTU columns or rows
+ * \param tiles      number of tiles
+ * \param sizes      returns the size of each tile in CTUs
+ */
+static void balance_tile_sizes(const uint64_t *line_cost, int lines, int tiles, int32_t *sizes)
+{
+  uint64_t total = 0;
+  for (int i = 0; i < lines; ++i) total += line_cost[i];
+
+  int start = 0;
+  uint64_t cost_before = 0;
+  for (int t = 0; t < tiles - 1; ++t) {
+    const uint64_t target = total * (t + 1) / tiles;
+    // Leave at least one line for each of the remaining tiles.
+    const int last_end = lines - (tiles - t - 1);
+    int end = start + 1;
+    uint64_t cost = cost_before + line_cost[start];
+    while (end < last_end && cost + line_cost[end] / 2 < target) {
+      cost += line_cost[end];
+      ++end;
+    }
+    sizes[t] = end - start;
+    start = end;
+    cost_before = cost;
+  }
+  sizes[tiles - 1] = lines - start;
+}
+
+/**
+ * \brief Move tile boundaries so that the tiles have about equal cost.
+ *
+ * Column widths are balanced by the cost of each CTU column and row
+ * heights by the cost of each CTU row. The number of tiles does not
+ * change. Frames already started keep the child states and tile sizes
+ * they were started with.
+ *
+ * \param ctu_cost  cost of each CTU in raster scan order
+ * \return 1 if the tile sizes changed, 0 otherwise
+ */
+int uvg_encoder_control_balance_tiles(encoder_control_t * const encoder, const uint64_t *ctu_cost)
+{
+  const int width_in_lcu = encoder->in.width_in_lcu;
+  const int height_in_lcu = encoder->in.height_in_lcu;
+  const int tiles_x = encoder->cfg.tiles_width_count;
+  const int tiles_y = encoder->cfg.tiles_height_count;
+
+  uint64_t *col_cost = calloc(width_in_lcu, sizeof(uint64_t));
+  uint64_t *row_cost = calloc(height_in_lcu, sizeof(uint64_t));
+  int32_t *col_width = MALLOC(int32_t, tiles_x);
+  int32_t *row_height = MALLOC(int32_t, tiles_y);
+  int changed = 0;
+  if (!col_cost || !row_cost || !col_width || !row_height) goto done;
+
+  for (int y = 0; y < height_in_lcu; ++y) {
+    for (int x = 0; x < width_in_lcu; ++x) {
+      col_cost[x] += ctu_cost[y * width_in_lcu + x];
+      row_cost[y] += ctu_cost[y * width_in_lcu + x];
+    }
+  }
+  balance_tile_sizes(col_cost, width_in_lcu, tiles_x, col_width);
+  balance_tile_sizes(row_cost, height_in_lcu, tiles_y, row_height);
+
+  changed = memcmp(col_width, encoder->tiles_col_width, sizeof(int32_t) * tiles_x) ||
+            memcmp(row_height, encoder->tiles_row_height, sizeof(int32_t) * tiles_y);
+  if (changed) {
+    memcpy((int32_t*)encoder->tiles_col_width, col_width, sizeof(int32_t) * tiles_x);
+    memcpy((int32_t*)encoder->tiles_row_height, row_height, sizeof(int32_t) * tiles_y);
+    encoder->tiles_uniform_spacing_flag = 0;
+
+    encoder_control_derive_tile_scan(encoder);
+    if (encoder->cfg.slices & UVG_SLICES_TILES) {
+      encoder_control_derive_tile_slices(encoder);
+    }
+  }
+
+done:
+  FREE_POINTER(col_cost);
+  FREE_POINTER(row_cost);
+  FREE_POINTER(col_width);
+  FREE_POINTER(row_height);
+  return changed;
+}
+
 void uvg_encoder_control_input_init(encoder_control_t * const encoder,
                         const int32_t width, int32_t height)
 {
@@ -875,3 +1218,73 @@ static int encoder_control_init_gop_layer_weights(encoder_control_t * const enco
 
   return 1;
 }
+
+/**
+ * \brief Initialize the layout of the full picture for partial coding.
+ * \return 1 on success, 0 on failure.
+ *
+ * The full picture is split into a uniform grid of tiles, and
+ * partial_coding.startCTU_x and startCTU_y select the tile that is
+ * encoded. The input picture must be exactly that tile.
+ */
+static int encoder_control_init_partial_coding(encoder_control_t * const encoder)
+{
+  const uvg_config *const cfg = &encoder->cfg;
+  const int32_t tiles_x = encoder->partial.tiles_x;
+  const int32_t tiles_y = encoder->partial.tiles_y;
+
+  encoder->partial.real_width = cfg->partial_coding.fullWidth;
+  encoder->partial.real_height = cfg->partial_coding.fullHeight;
+  encoder->partial.width = CEILDIV(encoder->partial.real_width, CONF_WINDOW_PAD_IN_PIXELS) * CONF_WINDOW_PAD_IN_PIXELS;
+  encoder->partial.height = CEILDIV(encoder->partial.real_height, CONF_WINDOW_PAD_IN_PIXELS) * CONF_WINDOW_PAD_IN_PIXELS;
+
+  const int32_t width_in_lcu = CEILDIV(encoder->partial.real_width, LCU_WIDTH);
+  const int32_t height_in_lcu = CEILDIV(encoder->partial.real_height, LCU_WIDTH);
+  if (tiles_x > width_in_lcu || tiles_y > height_in_lcu) {
+    fprintf(stderr, "Too many tiles for the full picture in partial coding.\n");
+    return 0;
+  }
+
+  int32_t *col_width = MALLOC(int32_t, tiles_x);
+  int32_t *row_height = MALLOC(int32_t, tiles_y);
+  encoder->partial.col_width = col_width;
+  encoder->partial.row_height = row_height;
+  if (!col_width || !row_height) return 0;
+
+  int32_t tile_x = -1;
+  int32_t tile_y = -1;
+  int32_t col_bd = 0;
+  for (int i = 0; i < tiles_x; ++i) {
+    col_width[i] = (i + 1) * width_in_lcu / tiles_x - i * width_in_lcu / tiles_x;
+    if (col_bd == cfg->partial_coding.startCTU_x) tile_x = i;
+    col_bd += col_width[i];
+  }
+  int32_t row_bd = 0;
+  for (int i = 0; i < tiles_y; ++i) {
+    row_height[i] = (i + 1) * height_in_lcu / tiles_y - i * height_in_lcu / tiles_y;
+    if (row_bd == cfg->partial_coding.startCTU_y) tile_y = i;
+    row_bd += row_height[i];
+  }
+
+  if (tile_x < 0 || tile_y < 0) {
+    fprintf(stderr, "Partial coding must start at a tile of the full picture.\n");
+    return 0;
+  }
+
+  // Tiles other than the last ones consist of whole LCUs.
+  const int32_t start_x = cfg->partial_coding.startCTU_x * LCU_WIDTH;
+  const int32_t start_y = cfg->partial_coding.startCTU_y * LCU_WIDTH;
+  const int32_t tile_width = tile_x == tiles_x - 1 ?
+    encoder->partial.real_width - start_x : col_width[tile_x] * LCU_WIDTH;
+  const int32_t tile_height = tile_y == tiles_y - 1 ?
+    encoder->partial.real_height - start_y : row_height[tile_y] * LCU_WIDTH;
+  if (encoder->in.real_width != tile_width || encoder->in.real_height != tile_height) {
+    fprintf(stderr, "Input size %dx%d does not match the tile size %dx%d in partial coding.\n",
+            encoder->in.real_width, encoder->in.real_height, tile_width, tile_height);
+    return 0;
+  }
+
+  encoder->partial.slice_index = tile_y * tiles_x + tile_x;
+
+  return 1;
+}
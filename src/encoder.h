@@ -119,8 +119,31 @@ typedef struct encoder_control_t
   int slice_count;
   const int* slice_addresses_in_ts;
 
+  //! Layout of the full picture when encoding one tile of it (partial_coding).
+  struct {
+    bool enabled;
+    int32_t width;        /*!< \brief padded width of the full picture */
+    int32_t height;       /*!< \brief padded height of the full picture */
+    int32_t real_width;   /*!< \brief real width of the full picture */
+    int32_t real_height;  /*!< \brief real height of the full picture */
+    int32_t tiles_x;      /*!< \brief number of tile columns */
+    int32_t tiles_y;      /*!< \brief number of tile rows */
+    const int32_t *col_width;  /*!< \brief tile column widths in LCUs */
+    const int32_t *row_height; /*!< \brief tile row heights in LCUs */
+    int32_t slice_index;  /*!< \brief index of the encoded tile and its slice */
+  } partial;
+
   threadqueue_queue_t *threadqueue;
 
+  //! Whether threadqueue is shared with other encoders and owned by a uvg_thread_pool.
+  bool threadqueue_shared;
+
+  //! Rate control data of the encoder.
+  struct uvg_rc_data *rc_data;
+
+  //! Pictures of the size of the input frame kept for reuse.
+  uvg_picture_pool *picture_pool;
+
   //! Target average bits per picture.
   double target_avg_bppic;
 
@@ -155,8 +178,11 @@ typedef struct encoder_control_t
 
 } encoder_control_t;
 
-encoder_control_t* uvg_encoder_control_init(const uvg_config *cfg);
+threadqueue_queue_t * uvg_encoder_threadqueue_init(const uvg_config *cfg, int threads);
+
+encoder_control_t* uvg_encoder_control_init(const uvg_config *cfg, threadqueue_queue_t *threadqueue);
 void uvg_encoder_control_free(encoder_control_t *encoder);
+int uvg_encoder_control_balance_tiles(encoder_control_t *encoder, const uint64_t *ctu_cost);
 
 void uvg_encoder_control_input_init(encoder_control_t *encoder, int32_t width, int32_t height);
 #endif
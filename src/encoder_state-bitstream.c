@@ -482,10 +482,16 @@ static void encoder_state_write_bitstream_seq_parameter_set(bitstream_t* stream,
   WRITE_U(stream, 0, 1, "ref_pic_resampling_enabled_flag");
 
 
-  WRITE_UE(stream, encoder->in.width, "pic_width_max_in_luma_samples");
-  WRITE_UE(stream, encoder->in.height, "pic_height_max_in_luma_samples");
+  // With partial coding, the parameter sets are those of the full picture.
+  const int32_t width = encoder->partial.enabled ? encoder->partial.width : encoder->in.width;
+  const int32_t height = encoder->partial.enabled ? encoder->partial.height : encoder->in.height;
+  const int32_t real_width = encoder->partial.enabled ? encoder->partial.real_width : encoder->in.real_width;
+  const int32_t real_height = encoder->partial.enabled ? encoder->partial.real_height : encoder->in.real_height;
 
-  bool use_conformance_window = encoder->in.width != encoder->in.real_width || encoder->in.height != encoder->in.real_height;
+  WRITE_UE(stream, width, "pic_width_max_in_luma_samples");
+  WRITE_UE(stream, height, "pic_height_max_in_luma_samples");
+
+  bool use_conformance_window = width != real_width || height != real_height;
 
   WRITE_U(stream, use_conformance_window, 1, "conformance_window_flag");
   if (use_conformance_window) {
@@ -493,12 +499,12 @@ static void encoder_state_write_bitstream_seq_parameter_set(bitstream_t* stream,
     // the number of luma samples is not a multiple of 2. Options are to either
     // hide one line or show an extra line of non-video. Neither seems like a
     // very good option, so let's not even try.
-    assert(!(encoder->in.width % 2));
+    assert(!(width % 2));
     WRITE_UE(stream, 0, "conf_win_left_offset");
-    WRITE_UE(stream, (encoder->in.width - encoder->in.real_width) >> 1,
+    WRITE_UE(stream, (width - real_width) >> 1,
       "conf_win_right_offset");
     WRITE_UE(stream, 0, "conf_win_top_offset");
-    WRITE_UE(stream, (encoder->in.height - encoder->in.real_height) >> 1,
+    WRITE_UE(stream, (height - real_height) >> 1,
       "conf_win_bottom_offset");
   }
 
@@ -757,8 +763,10 @@ static void encoder_state_write_bitstream_pic_parameter_set(bitstream_t* stream,
 
   WRITE_U(stream, 0, 1, "mixed_nalu_types_in_pic_flag");
 
-  WRITE_UE(stream, encoder->in.width, "pic_width_in_luma_samples");
-  WRITE_UE(stream, encoder->in.height, "pic_height_in_luma_samples");
+  WRITE_UE(stream, encoder->partial.enabled ? encoder->partial.width : encoder->in.width,
+           "pic_width_in_luma_samples");
+  WRITE_UE(stream, encoder->partial.enabled ? encoder->partial.height : encoder->in.height,
+           "pic_height_in_luma_samples");
 
   bool use_conformance_window = false; //Signalled only in SPS
 
@@ -778,29 +786,58 @@ static void encoder_state_write_bitstream_pic_parameter_set(bitstream_t* stream,
   }
   WRITE_U(stream, 0, 1, "scaling_window_flag");
   WRITE_U(stream, 0, 1, "output_flag_present_flag");
-  WRITE_U(stream, encoder->tiles_enable ? 0 : 1, 1, "pps_no_pic_partition_flag");
+  const bool partitioned = encoder->tiles_enable || encoder->partial.enabled;
+  WRITE_U(stream, partitioned ? 0 : 1, 1, "pps_no_pic_partition_flag");
   WRITE_U(stream, 0, 1, "subpic_id_mapping_in_pps_flag");
 
-  if (encoder->tiles_enable) {
+  if (partitioned) {
+    // With partial coding, each tile of the full picture is a slice.
+    const int32_t tiles_x = encoder->partial.enabled ? encoder->partial.tiles_x : encoder->cfg.tiles_width_count;
+    const int32_t tiles_y = encoder->partial.enabled ? encoder->partial.tiles_y : encoder->cfg.tiles_height_count;
+    const int32_t *col_width = encoder->partial.enabled ? encoder->partial.col_width :
+                               state->frame->tile_col_width ? state->frame->tile_col_width :
+                               encoder->tiles_col_width;
+    const int32_t *row_height = encoder->partial.enabled ? encoder->partial.row_height :
+                                state->frame->tile_row_height ? state->frame->tile_row_height :
+                                encoder->tiles_row_height;
 
     WRITE_U(stream, uvg_math_floor_log2(LCU_WIDTH) - 5,  2, "pps_log2_ctu_size_minus5");
 
-    WRITE_UE(stream, encoder->cfg.tiles_width_count - 1, "pps_num_exp_tile_columns_minus1");
-    WRITE_UE(stream, encoder->cfg.tiles_height_count - 1, "pps_num_exp_tile_rows_minus1");
+    WRITE_UE(stream, tiles_x - 1, "pps_num_exp_tile_columns_minus1");
+    WRITE_UE(stream, tiles_y - 1, "pps_num_exp_tile_rows_minus1");
 
     int i;
-    for (i = 0; i < encoder->cfg.tiles_width_count; ++i) {
-      WRITE_UE(stream, encoder->tiles_col_width[i] - 1, "pps_tile_column_width_minus1[i]");
+    for (i = 0; i < tiles_x; ++i) {
+      WRITE_UE(stream, col_width[i] - 1, "pps_tile_column_width_minus1[i]");
     }
-    for (i = 0; i < encoder->cfg.tiles_height_count; ++i) {
-      WRITE_UE(stream, encoder->tiles_row_height[i] - 1, "pps_tile_row_height_minus1[i]");
+    for (i = 0; i < tiles_y; ++i) {
+      WRITE_UE(stream, row_height[i] - 1, "pps_tile_row_height_minus1[i]");
     }
 
-    if (encoder->cfg.tiles_width_count * encoder->cfg.tiles_height_count > 1) 
+    if (tiles_x * tiles_y > 1) 
     {
       WRITE_U(stream, 0, 1, "pps_loop_filter_across_tiles_enabled_flag");
       WRITE_U(stream, 1, 1, "pps_rect_slice_flag");
-      WRITE_U(stream, 1, 1, "pps_single_slice_per_subpic_flag");
+      WRITE_U(stream, encoder->partial.enabled ? 0 : 1, 1, "pps_single_slice_per_subpic_flag");
+
+      if (encoder->partial.enabled) {
+        const int num_slices = tiles_x * tiles_y;
+        WRITE_UE(stream, num_slices - 1, "pps_num_slices_in_pic_minus1");
+        if (num_slices - 1 > 1) {
+          WRITE_U(stream, 0, 1, "pps_tile_idx_delta_present_flag");
+        }
+        for (i = 0; i < num_slices - 1; ++i) {
+          if (i % tiles_x != tiles_x - 1) {
+            WRITE_UE(stream, 0, "pps_slice_width_in_tiles_minus1[i]");
+          }
+          if (i / tiles_x != tiles_y - 1 && i % tiles_x == 0) {
+            WRITE_UE(stream, 0, "pps_slice_height_in_tiles_minus1[i]");
+          }
+          if (row_height[i / tiles_x] > 1) {
+            WRITE_UE(stream, 0, "pps_num_exp_slices_in_tile[i]");
+          }
+        }
+      }
 
       WRITE_U(stream, 0, 1, "pps_loop_filter_across_slices_enabled_flag");
     }
@@ -1274,9 +1311,17 @@ void uvg_encoder_state_write_bitstream_slice_header(
   //WRITE_U(stream, first_slice_segment_in_pic, 1, "first_slice_segment_in_pic_flag");
   */
 
-  WRITE_U(stream, 1, 1, "picture_header_in_slice_header_flag");
+  // With partial coding, the picture header is in its own NAL unit, shared
+  // by the slices of all the tiles of the full picture.
+  WRITE_U(stream, !encoder->partial.enabled, 1, "picture_header_in_slice_header_flag");
 
-  uvg_encoder_state_write_bitstream_picture_header(stream, state); 
+  if (!encoder->partial.enabled) {
+    uvg_encoder_state_write_bitstream_picture_header(stream, state);
+  } else if (encoder->partial.tiles_x * encoder->partial.tiles_y > 1) {
+    WRITE_U(stream, encoder->partial.slice_index,
+            uvg_math_ceil_log2(encoder->partial.tiles_x * encoder->partial.tiles_y),
+            "sh_slice_address");
+  }
 
   if (state->frame->pictype != UVG_NAL_IDR_W_RADL
     && state->frame->pictype != UVG_NAL_IDR_N_LP) {
@@ -1419,15 +1464,19 @@ void uvg_encoder_state_write_bitstream_slice_header(
 
 /**
  * \brief Add a checksum SEI message to the bitstream.
+ *
+ * The hash has been calculated by the jobs of the LCU rows.
+ *
  * \param encoder The encoder.
  * \returns Void
  */
 static void add_checksum(encoder_state_t * const state)
 {
   bitstream_t * const stream = &state->stream;
-  const videoframe_t * const frame = state->tile->frame;
   unsigned char checksum[3][SEI_HASH_MAX_LENGTH];
 
+  assert(state->stats_rows);
+
   uvg_nal_write(stream, UVG_NAL_SUFFIX_SEI_NUT, 0, 0);
 
   WRITE_U(stream, 132, 8, "sei_type");
@@ -1437,17 +1486,16 @@ static void add_checksum(encoder_state_t * const state)
   switch (state->encoder_control->cfg.hash)
   {
   case UVG_HASH_CHECKSUM:
-    uvg_image_checksum(frame->rec, checksum, state->encoder_control->bitdepth);
-
     WRITE_U(stream, 2 + num_colors * 4, 8, "size");
     WRITE_U(stream, 2, 8, "hash_type");  // 2 = checksum
     WRITE_U(stream, num_colors==1, 1, "dph_sei_single_component_flag");
     WRITE_U(stream, 0, 7, "dph_sei_reserved_zero_7bits");
 
     for (int i = 0; i < num_colors; ++i) {
-      uint32_t checksum_val = (
-        (checksum[i][0] << 24) + (checksum[i][1] << 16) +
-        (checksum[i][2] << 8) + (checksum[i][3]));
+      uint32_t checksum_val = 0;
+      for (int row = 0; row < state->stats_row_count; ++row) {
+        checksum_val += state->stats_rows[row].checksum[i];
+      }
       WRITE_U(stream, checksum_val, 32, "picture_checksum");
       CHECKPOINT("checksum[%d] = %u", i, checksum_val);
     }
@@ -1455,7 +1503,9 @@ static void add_checksum(encoder_state_t * const state)
     break;
 
   case UVG_HASH_MD5:
-    uvg_image_md5(frame->rec, checksum, state->encoder_control->bitdepth);
+    for (int i = 0; i < num_colors; ++i) {
+      uvg_md5_final(checksum[i], &state->stats_md5[i]);
+    }
 
     WRITE_U(stream, 2 + num_colors * 16, 8, "size");
     WRITE_U(stream, 0, 8, "hash_type");  // 0 = md5
@@ -1486,6 +1536,14 @@ static void encoder_state_write_slice_header(
   encoder_state_t * state,
   bool independent)
 {
+  if (state->encoder_control->partial.enabled) {
+    uvg_nal_write(stream, UVG_NAL_PH_NUT, (state->frame->pictype==UVG_NAL_STSA)?1:0, state->frame->first_nal);
+    state->frame->first_nal = false;
+
+    uvg_encoder_state_write_bitstream_picture_header(stream, state);
+    uvg_bitstream_add_rbsp_trailing_bits(stream);
+  }
+
   uvg_nal_write(stream, state->frame->pictype, (state->frame->pictype==UVG_NAL_STSA)?1:0, state->frame->first_nal);
   state->frame->first_nal = false;
 
@@ -1533,7 +1591,12 @@ static void encoder_state_write_bitstream_main(encoder_state_t * const state)
   if (encoder_state_must_write_vps(state)) {
     state->frame->first_nal = false;
     uvg_encoder_state_write_parameter_sets(&state->stream, state);
+  } else if (state->frame->new_tile_layout) {
+    state->frame->first_nal = false;
+    uvg_nal_write(stream, UVG_NAL_PPS_NUT, 0, 1);
+    encoder_state_write_bitstream_pic_parameter_set(stream, state);
   }
+  state->frame->new_tile_layout = false;
 
   // Send uvg266 version information only in the first frame.
   if (state->frame->num == 0 && encoder->cfg.add_encoder_info) {
@@ -1568,7 +1631,8 @@ static void encoder_state_write_bitstream_main(encoder_state_t * const state)
 
   encoder_state_write_bitstream_children(state);
 
-  if (state->encoder_control->cfg.hash != UVG_HASH_NONE) {
+  // The hash of a part would not match the decoded full picture.
+  if (state->encoder_control->cfg.hash != UVG_HASH_NONE && !encoder->partial.enabled) {
     // Calculate checksum
     add_checksum(state);
   }
@@ -60,6 +60,9 @@ static int encoder_state_config_frame_init(encoder_state_t * const state) {
   }
   state->frame->ref_list = REF_PIC_LIST_0;
   state->frame->num = 0;
+  state->frame->numa_node = -1;
+  state->frame->schedule_order = 0;
+  state->frame->new_tile_layout = false;
   state->frame->poc = 0;
   state->frame->total_bits_coded = 0;
   state->frame->cur_frame_bits_coded = 0;
@@ -92,9 +95,18 @@ static int encoder_state_config_frame_init(encoder_state_t * const state) {
     return 0;
   }
 
-  pthread_mutex_init(&state->frame->rc_lock, NULL);
 
-  state->frame->new_ratecontrol = uvg_get_rc_data(NULL);
+  // The tile sizes of the encoder control change while earlier frames are
+  // still being written.
+  if (encoder->cfg.adaptive_tiles > 0 && encoder->tiles_enable) {
+    state->frame->tile_col_width = MALLOC(int32_t, encoder->cfg.tiles_width_count);
+    state->frame->tile_row_height = MALLOC(int32_t, encoder->cfg.tiles_height_count);
+    if (!state->frame->tile_col_width || !state->frame->tile_row_height) {
+      return 0;
+    }
+  }
+
+  state->frame->new_ratecontrol = encoder->rc_data;
 
   return 1;
 }
@@ -102,13 +114,14 @@ static int encoder_state_config_frame_init(encoder_state_t * const state) {
 static void encoder_state_config_frame_finalize(encoder_state_t * const state) {
   if (state->frame == NULL) return;
 
-  pthread_mutex_destroy(&state->frame->rc_lock);
   if (state->frame->c_para) FREE_POINTER(state->frame->c_para);
   if (state->frame->k_para) FREE_POINTER(state->frame->k_para);
 
   uvg_image_list_destroy(state->frame->ref);
   FREE_POINTER(state->frame->lcu_stats);
   FREE_POINTER(state->frame->aq_offsets);
+  FREE_POINTER(state->frame->tile_col_width);
+  FREE_POINTER(state->frame->tile_row_height);
 
 }
 
@@ -162,9 +175,11 @@ static int encoder_state_config_tile_init(encoder_state_t * const state,
     int num_jobs = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
     state->tile->wf_jobs = MALLOC(threadqueue_job_t*, num_jobs);
     state->tile->wf_recon_jobs = MALLOC(threadqueue_job_t*, num_jobs);
+    state->tile->wf_filter_jobs = MALLOC(threadqueue_job_t*, num_jobs);
     for (int i = 0; i < num_jobs; ++i) {
       state->tile->wf_jobs[i] = NULL;
       state->tile->wf_recon_jobs[i] = NULL;
+      state->tile->wf_filter_jobs[i] = NULL;
     }
     if (!state->tile->wf_jobs) {
       printf("Error allocating wf_jobs array!\n");
@@ -173,8 +188,17 @@ static int encoder_state_config_tile_init(encoder_state_t * const state,
   } else {
     state->tile->wf_jobs = NULL;
     state->tile->wf_recon_jobs = NULL;
+    state->tile->wf_filter_jobs = NULL;
   }
   state->tile->id = encoder->tiles_tile_id[state->tile->lcu_offset_in_ts];
+
+  // At most every LCU of the tile holds a coefficient buffer at a time.
+  state->tile->coeff_pool = MALLOC(lcu_coeff_t*, state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu);
+  state->tile->coeff_pool_count = 0;
+  if (!state->tile->coeff_pool || pthread_mutex_init(&state->tile->coeff_pool_lock, NULL) != 0) {
+    printf("Error allocating coeff_pool array!\n");
+    return 0;
+  }
   return 1;
 }
 
@@ -191,6 +215,7 @@ static void encoder_state_config_tile_finalize(encoder_state_t * const state) {
     for (int i = 0; i < num_jobs; ++i) {
       uvg_threadqueue_free_job(&state->tile->wf_jobs[i]);
       uvg_threadqueue_free_job(&state->tile->wf_recon_jobs[i]);
+      uvg_threadqueue_free_job(&state->tile->wf_filter_jobs[i]);
     }
   }
 
@@ -201,6 +226,14 @@ static void encoder_state_config_tile_finalize(encoder_state_t * const state) {
   state->tile->frame = NULL;
   FREE_POINTER(state->tile->wf_jobs);
   FREE_POINTER(state->tile->wf_recon_jobs);
+  FREE_POINTER(state->tile->wf_filter_jobs);
+
+  for (int i = 0; i < state->tile->coeff_pool_count; ++i) {
+    FREE_POINTER(state->tile->coeff_pool[i]);
+  }
+  FREE_POINTER(state->tile->coeff_pool);
+  state->tile->coeff_pool_count = 0;
+  pthread_mutex_destroy(&state->tile->coeff_pool_lock);
 }
 
 static int encoder_state_config_slice_init(encoder_state_t * const state,
@@ -299,6 +332,303 @@ static int encoder_state_main_finalize(encoder_state_t* const state) {
   return 1;
 }
 
+/**
+ * \brief Create the sub-encoders (slices, tiles and wavefront rows) of a state.
+ *
+ * \param child_state  state whose children are created
+ * \return 1 on success, 0 on failure
+ */
+static int encoder_state_init_children(encoder_state_t * const child_state) {
+  const encoder_control_t * const encoder = child_state->encoder_control;
+  uint32_t child_count = 0;
+  //We first check the type of this element.
+  //If it's a MAIN, it can allow both slices or tiles as child
+  //If it's a TILE, it can allow slices as child, if its parent is not a slice, or wavefront rows if there is no other children
+  //If it's a SLICE, it can allow tiles as child, if its parent is not a tile, or wavefront rows if there is no other children
+  //If it's a WAVEFRONT_ROW, it doesn't allow any children
+  int children_allow_wavefront_row = 0;
+  int children_allow_slice = 0;
+  int children_allow_tile = 0;
+  int range_start;
+  
+  // First index of this encoder state in tile scan order.
+  int start_in_ts;
+  // Index of the first LCU after this state in tile scan order.
+  int end_in_ts;
+  
+  switch(child_state->type) {
+    case ENCODER_STATE_TYPE_MAIN:
+      children_allow_slice = 1;
+      children_allow_tile = 1;
+      start_in_ts = 0;
+      end_in_ts = child_state->tile->frame->width_in_lcu * child_state->tile->frame->height_in_lcu;
+      break;
+    case ENCODER_STATE_TYPE_SLICE:
+      assert(child_state->parent);
+      if (child_state->parent->type != ENCODER_STATE_TYPE_TILE) children_allow_tile = 1;
+      start_in_ts = child_state->slice->start_in_ts;
+      end_in_ts = child_state->slice->end_in_ts + 1;
+      int num_wpp_rows = (end_in_ts - start_in_ts) / child_state->tile->frame->width_in_lcu;
+      children_allow_wavefront_row = encoder->cfg.wpp && num_wpp_rows > 1;
+      break;
+    case ENCODER_STATE_TYPE_TILE:
+      assert(child_state->parent);
+      if (child_state->parent->type != ENCODER_STATE_TYPE_SLICE) children_allow_slice = 1;
+      children_allow_wavefront_row =
+        encoder->cfg.wpp && child_state->tile->frame->height_in_lcu > 1;
+      start_in_ts = child_state->tile->lcu_offset_in_ts;
+      end_in_ts = child_state->tile->lcu_offset_in_ts + child_state->tile->frame->width_in_lcu * child_state->tile->frame->height_in_lcu;
+      break;
+    case ENCODER_STATE_TYPE_WAVEFRONT_ROW:
+      //GCC tries to be too clever...
+      start_in_ts = -1;
+      end_in_ts = -1;
+      break;
+    default:
+      fprintf(stderr, "Invalid encoder_state->type %d!\n", child_state->type);
+      assert(0);
+      return 0;
+  }
+  
+  range_start = start_in_ts;
+  //printf("%c-%p: start_in_ts=%d, end_in_ts=%d\n",child_state->type, child_state, start_in_ts, end_in_ts);
+  while (range_start < end_in_ts && (children_allow_slice || children_allow_tile)) {
+    encoder_state_t *new_child = NULL;
+    int range_end_slice = range_start; //Will be incremented to get the range of the "thing"
+    int range_end_tile = range_start; //Will be incremented to get the range of the "thing"
+    
+    int tile_allowed = uvg_lcu_at_tile_start(encoder, range_start) && children_allow_tile;
+    int slice_allowed = uvg_lcu_at_slice_start(encoder, range_start) && children_allow_slice;
+    
+    //Find the smallest structure following the cursor
+    if (slice_allowed) {
+      while(!uvg_lcu_at_slice_end(encoder, range_end_slice)) {
+        ++range_end_slice;
+      }
+    }
+    
+    if (tile_allowed) {
+      while(!uvg_lcu_at_tile_end(encoder, range_end_tile)) {
+        ++range_end_tile;
+      }
+    }
+    
+    //printf("range_start=%d, range_end_slice=%d, range_end_tile=%d, tile_allowed=%d, slice_allowed=%d end_in_ts=%d\n",range_start,range_end_slice,range_end_tile,tile_allowed,slice_allowed,end_in_ts);
+    
+    if ((!tile_allowed || (range_end_slice >= range_end_tile)) && !new_child && slice_allowed) {
+      //Create a slice
+      new_child = &child_state->children[child_count];
+      new_child->encoder_control = encoder;
+      new_child->type  = ENCODER_STATE_TYPE_SLICE;
+      new_child->frame = child_state->frame;
+      new_child->tile  = child_state->tile;
+      new_child->wfrow = child_state->wfrow;
+      new_child->slice = MALLOC(encoder_state_config_slice_t, 1);
+      if (!new_child->slice || !encoder_state_config_slice_init(new_child, range_start, range_end_slice)) {
+        fprintf(stderr, "Could not initialize encoder_state->slice!\n");
+        return 0;
+      }
+    }
+    
+    if ((!slice_allowed || (range_end_slice < range_end_tile)) && !new_child && tile_allowed) {
+      //Create a tile
+      int tile_id = encoder->tiles_tile_id[range_start];
+      int tile_x = tile_id % encoder->cfg.tiles_width_count;
+      int tile_y = tile_id / encoder->cfg.tiles_width_count;
+      
+      int lcu_offset_x = encoder->tiles_col_bd[tile_x];
+      int lcu_offset_y = encoder->tiles_row_bd[tile_y];
+      int width_in_lcu = encoder->tiles_col_bd[tile_x+1]-encoder->tiles_col_bd[tile_x];
+      int height_in_lcu = encoder->tiles_row_bd[tile_y+1]-encoder->tiles_row_bd[tile_y];
+      int width = MIN(width_in_lcu * LCU_WIDTH, encoder->in.width - lcu_offset_x * LCU_WIDTH);
+      int height = MIN(height_in_lcu * LCU_WIDTH, encoder->in.height - lcu_offset_y * LCU_WIDTH);
+      
+      new_child = &child_state->children[child_count];
+      new_child->encoder_control = encoder;
+      new_child->type  = ENCODER_STATE_TYPE_TILE;
+      new_child->frame = child_state->frame;
+      new_child->tile  = MALLOC(encoder_state_config_tile_t, 1);
+      new_child->slice = child_state->slice;
+      new_child->wfrow = child_state->wfrow;
+      
+      if (!new_child->tile || !encoder_state_config_tile_init(new_child, lcu_offset_x, lcu_offset_y, width, height, width_in_lcu, height_in_lcu)) {
+        fprintf(stderr, "Could not initialize encoder_state->tile!\n");
+        return 0;
+      }
+    }
+    
+    if (new_child) {
+      child_state->children = realloc(child_state->children, sizeof(encoder_state_t) * (2+child_count));
+      if (!child_state->children) {
+        fprintf(stderr, "Failed to allocate memory for children...\n");
+        return 0;
+      }
+
+      child_state->children[1 + child_count].encoder_control = NULL;
+
+      //Fix children parent (since we changed the address), except for the last one which is not ready yet
+      {
+        uint32_t i, j;
+        for (i = 0; child_state->children[i].encoder_control && i < child_count; ++i) {
+          for (j = 0; child_state->children[i].children[j].encoder_control; ++j) {
+            child_state->children[i].children[j].parent = &child_state->children[i];
+          }
+          for (j = 0; j < child_state->children[i].lcu_order_count; ++j) {
+            child_state->children[i].lcu_order[j].encoder_state = &child_state->children[i];
+          }
+          child_state->children[i].cabac.stream = &child_state->children[i].stream;
+        }
+      }
+      
+      if (!uvg_encoder_state_init(&child_state->children[child_count], child_state)) {
+        fprintf(stderr, "Unable to init child...\n");
+        return 0;
+      }
+      child_count += 1;
+    }
+    
+    range_start = MAX(range_end_slice, range_end_tile) + 1;
+  }
+  
+  //We create wavefronts only if we have no children
+  if (children_allow_wavefront_row && child_count == 0) {
+    int first_row = encoder->tiles_ctb_addr_ts_to_rs[start_in_ts] / encoder->in.width_in_lcu;
+    int last_row = encoder->tiles_ctb_addr_ts_to_rs[start_in_ts] / encoder->in.width_in_lcu;
+    int num_rows;
+    int i;
+    
+    assert(!(children_allow_slice || children_allow_tile));
+    assert(child_count == 0);
+    
+    for (i=start_in_ts; i<end_in_ts; ++i) {
+      const int row = encoder->tiles_ctb_addr_ts_to_rs[i] / encoder->in.width_in_lcu;
+      if (row < first_row) first_row = row;
+      if (row > last_row) last_row = row;
+    }
+    
+    num_rows = last_row - first_row + 1;
+    
+    //When entropy_coding_sync_enabled_flag is equal to 1 and the first coding tree block in a slice is not the first coding
+    //tree block of a row of coding tree blocks in a tile, it is a requirement of bitstream conformance that the last coding tree
+    //block in the slice shall belong to the same row of coding tree blocks as the first coding tree block in the slice.
+    
+    if (encoder->tiles_ctb_addr_ts_to_rs[start_in_ts] % encoder->in.width_in_lcu != child_state->tile->lcu_offset_x) {
+      if (num_rows > 1) {
+        fprintf(stderr, "Invalid: first CTB in slice %d is not at the tile %d edge, and the slice spans on more than one row.\n", child_state->slice->id, child_state->tile->id);
+        return 0;
+      }
+    }
+    
+    //FIXME Do the same kind of check if we implement slice segments
+  
+    child_count = num_rows;
+    child_state->children = realloc(child_state->children, sizeof(encoder_state_t) * (num_rows + 1));
+    child_state->children[num_rows].encoder_control = NULL;
+    
+    for (i=0; i < num_rows; ++i) {
+      encoder_state_t *new_child = &child_state->children[i];
+      
+      new_child->encoder_control = encoder;
+      new_child->type  = ENCODER_STATE_TYPE_WAVEFRONT_ROW;
+      new_child->frame = child_state->frame;
+      new_child->tile  = child_state->tile;
+      new_child->slice = child_state->slice;
+      new_child->wfrow = MALLOC(encoder_state_config_wfrow_t, 1);
+      
+      if (!new_child->wfrow || !encoder_state_config_wfrow_init(new_child, i)) {
+        fprintf(stderr, "Could not initialize encoder_state->wfrow!\n");
+        return 0;
+      }
+      
+      if (!uvg_encoder_state_init(new_child, child_state)) {
+        fprintf(stderr, "Unable to init child...\n");
+        return 0;
+      }
+    }
+  }
+  
+  child_state->is_leaf = (child_count == 0);
+  //This node is a leaf, compute LCU-order
+  if (child_state->is_leaf) {
+    //All LCU computations are relative to the tile
+    //Remark: this could be optimized, but since it's run only once, it's better to do it in a understandable way.
+    
+    //By default, the full tile
+    int lcu_id;
+    int lcu_start = 0;
+    //End is the element AFTER the end (iterate < lcu_end)
+    int lcu_end = child_state->tile->frame->width_in_lcu * child_state->tile->frame->height_in_lcu;
+    
+    //Restrict to the current slice if needed
+    lcu_start = MAX(lcu_start, child_state->slice->start_in_ts - child_state->tile->lcu_offset_in_ts);
+    lcu_end = MIN(lcu_end, child_state->slice->end_in_ts - child_state->tile->lcu_offset_in_ts + 1);
+    
+    //Restrict to the current wavefront row if needed
+    if (child_state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
+      lcu_start = MAX(lcu_start, (child_state->wfrow->lcu_offset_y) * child_state->tile->frame->width_in_lcu);
+      lcu_end = MIN(lcu_end, (child_state->wfrow->lcu_offset_y + 1) * child_state->tile->frame->width_in_lcu);
+    }
+    
+    child_state->lcu_order_count = lcu_end - lcu_start;
+    child_state->lcu_order = MALLOC(lcu_order_element_t, child_state->lcu_order_count);
+    assert(child_state->lcu_order);
+    
+    for (uint32_t i = 0; i < child_state->lcu_order_count; ++i) {
+      lcu_id = lcu_start + i;
+      child_state->lcu_order[i].encoder_state = child_state;
+      child_state->lcu_order[i].id = lcu_id;
+      child_state->lcu_order[i].index = i;
+      child_state->lcu_order[i].position.x = lcu_id % child_state->tile->frame->width_in_lcu;
+      child_state->lcu_order[i].position.y = lcu_id / child_state->tile->frame->width_in_lcu;
+      child_state->lcu_order[i].position_px.x = child_state->lcu_order[i].position.x * LCU_WIDTH;
+      child_state->lcu_order[i].position_px.y = child_state->lcu_order[i].position.y * LCU_WIDTH;
+      child_state->lcu_order[i].size.x = MIN(LCU_WIDTH, encoder->in.width - (child_state->tile->lcu_offset_x * LCU_WIDTH + child_state->lcu_order[i].position_px.x));
+      child_state->lcu_order[i].size.y = MIN(LCU_WIDTH, encoder->in.height - (child_state->tile->lcu_offset_y * LCU_WIDTH + child_state->lcu_order[i].position_px.y));
+      child_state->lcu_order[i].first_row = uvg_lcu_in_first_row(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
+      child_state->lcu_order[i].last_row = uvg_lcu_in_last_row(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
+      child_state->lcu_order[i].first_column = uvg_lcu_in_first_column(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
+      child_state->lcu_order[i].last_column = uvg_lcu_in_last_column(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
+      
+      child_state->lcu_order[i].above = NULL;
+      child_state->lcu_order[i].below = NULL;
+      child_state->lcu_order[i].left = NULL;
+      child_state->lcu_order[i].right = NULL;
+      
+      if (!child_state->lcu_order[i].first_row) {
+        //Find LCU above
+        if (child_state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
+          uint32_t j;
+          //For all previous wavefront rows
+          for (j=0; &child_state->parent->children[j] != child_state && child_state->parent->children[j].encoder_control; ++j) {
+            if (child_state->parent->children[j].wfrow->lcu_offset_y == child_state->wfrow->lcu_offset_y - 1) {
+              uint32_t k;
+              for (k=0; k < child_state->parent->children[j].lcu_order_count; ++k) {
+                if (child_state->parent->children[j].lcu_order[k].position.x == child_state->lcu_order[i].position.x) {
+                  assert(child_state->parent->children[j].lcu_order[k].position.y == child_state->lcu_order[i].position.y - 1);
+                  child_state->lcu_order[i].above = &child_state->parent->children[j].lcu_order[k];
+                }
+              }
+            }
+          }
+        } else {
+          child_state->lcu_order[i].above = &child_state->lcu_order[i-child_state->tile->frame->width_in_lcu];
+        }
+        assert(child_state->lcu_order[i].above);
+        child_state->lcu_order[i].above->below = &child_state->lcu_order[i];
+      }
+      if (!child_state->lcu_order[i].first_column) {
+        child_state->lcu_order[i].left = &child_state->lcu_order[i-1];
+        assert(child_state->lcu_order[i].left->position.x == child_state->lcu_order[i].position.x - 1);
+        child_state->lcu_order[i].left->right = &child_state->lcu_order[i];
+      }
+    }
+  } else {
+    child_state->lcu_order_count = 0;
+    child_state->lcu_order = NULL;
+  }
+  return 1;
+}
+
 int uvg_encoder_state_init(encoder_state_t * const child_state, encoder_state_t * const parent_state) {
   //We require that, if parent_state is NULL:
   //child_state->encoder_control is set
@@ -317,6 +647,11 @@ int uvg_encoder_state_init(encoder_state_t * const child_state, encoder_state_t
   child_state->tqj_bitstream_written = NULL;
   child_state->tqj_recon_done = NULL;
   child_state->tqj_alf_process = NULL;
+  child_state->tqj_alf_derive = NULL;
+  child_state->alf_rows = NULL;
+  child_state->alf_row_count = 0;
+  child_state->stats_rows = NULL;
+  child_state->stats_row_count = 0;
   
   if (!parent_state) {
     const encoder_control_t * const encoder = child_state->encoder_control;
@@ -359,298 +694,13 @@ int uvg_encoder_state_init(encoder_state_t * const child_state, encoder_state_t
   // Set CABAC output bitstream
   child_state->cabac.stream = &child_state->stream;
   
-  //Create sub-encoders
-  {
-    const encoder_control_t * const encoder = child_state->encoder_control;
-    uint32_t child_count = 0;
-    //We first check the type of this element.
-    //If it's a MAIN, it can allow both slices or tiles as child
-    //If it's a TILE, it can allow slices as child, if its parent is not a slice, or wavefront rows if there is no other children
-    //If it's a SLICE, it can allow tiles as child, if its parent is not a tile, or wavefront rows if there is no other children
-    //If it's a WAVEFRONT_ROW, it doesn't allow any children
-    int children_allow_wavefront_row = 0;
-    int children_allow_slice = 0;
-    int children_allow_tile = 0;
-    int range_start;
-    
-    // First index of this encoder state in tile scan order.
-    int start_in_ts;
-    // Index of the first LCU after this state in tile scan order.
-    int end_in_ts;
-    
-    switch(child_state->type) {
-      case ENCODER_STATE_TYPE_MAIN:
-        children_allow_slice = 1;
-        children_allow_tile = 1;
-        start_in_ts = 0;
-        end_in_ts = child_state->tile->frame->width_in_lcu * child_state->tile->frame->height_in_lcu;
-
-        encoder_state_main_init(child_state);
-
-        break;
-      case ENCODER_STATE_TYPE_SLICE:
-        assert(child_state->parent);
-        if (child_state->parent->type != ENCODER_STATE_TYPE_TILE) children_allow_tile = 1;
-        start_in_ts = child_state->slice->start_in_ts;
-        end_in_ts = child_state->slice->end_in_ts + 1;
-        int num_wpp_rows = (end_in_ts - start_in_ts) / child_state->tile->frame->width_in_lcu;
-        children_allow_wavefront_row = encoder->cfg.wpp && num_wpp_rows > 1;
-        break;
-      case ENCODER_STATE_TYPE_TILE:
-        assert(child_state->parent);
-        if (child_state->parent->type != ENCODER_STATE_TYPE_SLICE) children_allow_slice = 1;
-        children_allow_wavefront_row =
-          encoder->cfg.wpp && child_state->tile->frame->height_in_lcu > 1;
-        start_in_ts = child_state->tile->lcu_offset_in_ts;
-        end_in_ts = child_state->tile->lcu_offset_in_ts + child_state->tile->frame->width_in_lcu * child_state->tile->frame->height_in_lcu;
-        break;
-      case ENCODER_STATE_TYPE_WAVEFRONT_ROW:
-        //GCC tries to be too clever...
-        start_in_ts = -1;
-        end_in_ts = -1;
-        break;
-      default:
-        fprintf(stderr, "Invalid encoder_state->type %d!\n", child_state->type);
-        assert(0);
-        return 0;
-    }
-    
-    range_start = start_in_ts;
-    //printf("%c-%p: start_in_ts=%d, end_in_ts=%d\n",child_state->type, child_state, start_in_ts, end_in_ts);
-    while (range_start < end_in_ts && (children_allow_slice || children_allow_tile)) {
-      encoder_state_t *new_child = NULL;
-      int range_end_slice = range_start; //Will be incremented to get the range of the "thing"
-      int range_end_tile = range_start; //Will be incremented to get the range of the "thing"
-      
-      int tile_allowed = uvg_lcu_at_tile_start(encoder, range_start) && children_allow_tile;
-      int slice_allowed = uvg_lcu_at_slice_start(encoder, range_start) && children_allow_slice;
-      
-      //Find the smallest structure following the cursor
-      if (slice_allowed) {
-        while(!uvg_lcu_at_slice_end(encoder, range_end_slice)) {
-          ++range_end_slice;
-        }
-      }
-      
-      if (tile_allowed) {
-        while(!uvg_lcu_at_tile_end(encoder, range_end_tile)) {
-          ++range_end_tile;
-        }
-      }
-      
-      //printf("range_start=%d, range_end_slice=%d, range_end_tile=%d, tile_allowed=%d, slice_allowed=%d end_in_ts=%d\n",range_start,range_end_slice,range_end_tile,tile_allowed,slice_allowed,end_in_ts);
-      
-      if ((!tile_allowed || (range_end_slice >= range_end_tile)) && !new_child && slice_allowed) {
-        //Create a slice
-        new_child = &child_state->children[child_count];
-        new_child->encoder_control = encoder;
-        new_child->type  = ENCODER_STATE_TYPE_SLICE;
-        new_child->frame = child_state->frame;
-        new_child->tile  = child_state->tile;
-        new_child->wfrow = child_state->wfrow;
-        new_child->slice = MALLOC(encoder_state_config_slice_t, 1);
-        if (!new_child->slice || !encoder_state_config_slice_init(new_child, range_start, range_end_slice)) {
-          fprintf(stderr, "Could not initialize encoder_state->slice!\n");
-          return 0;
-        }
-      }
-      
-      if ((!slice_allowed || (range_end_slice < range_end_tile)) && !new_child && tile_allowed) {
-        //Create a tile
-        int tile_id = encoder->tiles_tile_id[range_start];
-        int tile_x = tile_id % encoder->cfg.tiles_width_count;
-        int tile_y = tile_id / encoder->cfg.tiles_width_count;
-        
-        int lcu_offset_x = encoder->tiles_col_bd[tile_x];
-        int lcu_offset_y = encoder->tiles_row_bd[tile_y];
-        int width_in_lcu = encoder->tiles_col_bd[tile_x+1]-encoder->tiles_col_bd[tile_x];
-        int height_in_lcu = encoder->tiles_row_bd[tile_y+1]-encoder->tiles_row_bd[tile_y];
-        int width = MIN(width_in_lcu * LCU_WIDTH, encoder->in.width - lcu_offset_x * LCU_WIDTH);
-        int height = MIN(height_in_lcu * LCU_WIDTH, encoder->in.height - lcu_offset_y * LCU_WIDTH);
-        
-        new_child = &child_state->children[child_count];
-        new_child->encoder_control = encoder;
-        new_child->type  = ENCODER_STATE_TYPE_TILE;
-        new_child->frame = child_state->frame;
-        new_child->tile  = MALLOC(encoder_state_config_tile_t, 1);
-        new_child->slice = child_state->slice;
-        new_child->wfrow = child_state->wfrow;
-        
-        if (!new_child->tile || !encoder_state_config_tile_init(new_child, lcu_offset_x, lcu_offset_y, width, height, width_in_lcu, height_in_lcu)) {
-          fprintf(stderr, "Could not initialize encoder_state->tile!\n");
-          return 0;
-        }
-      }
-      
-      if (new_child) {
-        child_state->children = realloc(child_state->children, sizeof(encoder_state_t) * (2+child_count));
-        if (!child_state->children) {
-          fprintf(stderr, "Failed to allocate memory for children...\n");
-          return 0;
-        }
-
-        child_state->children[1 + child_count].encoder_control = NULL;
+  if (child_state->type == ENCODER_STATE_TYPE_MAIN) {
+    encoder_state_main_init(child_state);
+  }
 
-        //Fix children parent (since we changed the address), except for the last one which is not ready yet
-        {
-          uint32_t i, j;
-          for (i = 0; child_state->children[i].encoder_control && i < child_count; ++i) {
-            for (j = 0; child_state->children[i].children[j].encoder_control; ++j) {
-              child_state->children[i].children[j].parent = &child_state->children[i];
-            }
-            for (j = 0; j < child_state->children[i].lcu_order_count; ++j) {
-              child_state->children[i].lcu_order[j].encoder_state = &child_state->children[i];
-            }
-            child_state->children[i].cabac.stream = &child_state->children[i].stream;
-          }
-        }
-        
-        if (!uvg_encoder_state_init(&child_state->children[child_count], child_state)) {
-          fprintf(stderr, "Unable to init child...\n");
-          return 0;
-        }
-        child_count += 1;
-      }
-      
-      range_start = MAX(range_end_slice, range_end_tile) + 1;
-    }
-    
-    //We create wavefronts only if we have no children
-    if (children_allow_wavefront_row && child_count == 0) {
-      int first_row = encoder->tiles_ctb_addr_ts_to_rs[start_in_ts] / encoder->in.width_in_lcu;
-      int last_row = encoder->tiles_ctb_addr_ts_to_rs[start_in_ts] / encoder->in.width_in_lcu;
-      int num_rows;
-      int i;
-      
-      assert(!(children_allow_slice || children_allow_tile));
-      assert(child_count == 0);
-      
-      for (i=start_in_ts; i<end_in_ts; ++i) {
-        const int row = encoder->tiles_ctb_addr_ts_to_rs[i] / encoder->in.width_in_lcu;
-        if (row < first_row) first_row = row;
-        if (row > last_row) last_row = row;
-      }
-      
-      num_rows = last_row - first_row + 1;
-      
-      //When entropy_coding_sync_enabled_flag is equal to 1 and the first coding tree block in a slice is not the first coding
-      //tree block of a row of coding tree blocks in a tile, it is a requirement of bitstream conformance that the last coding tree
-      //block in the slice shall belong to the same row of coding tree blocks as the first coding tree block in the slice.
-      
-      if (encoder->tiles_ctb_addr_ts_to_rs[start_in_ts] % encoder->in.width_in_lcu != child_state->tile->lcu_offset_x) {
-        if (num_rows > 1) {
-          fprintf(stderr, "Invalid: first CTB in slice %d is not at the tile %d edge, and the slice spans on more than one row.\n", child_state->slice->id, child_state->tile->id);
-          return 0;
-        }
-      }
-      
-      //FIXME Do the same kind of check if we implement slice segments
-    
-      child_count = num_rows;
-      child_state->children = realloc(child_state->children, sizeof(encoder_state_t) * (num_rows + 1));
-      child_state->children[num_rows].encoder_control = NULL;
-      
-      for (i=0; i < num_rows; ++i) {
-        encoder_state_t *new_child = &child_state->children[i];
-        
-        new_child->encoder_control = encoder;
-        new_child->type  = ENCODER_STATE_TYPE_WAVEFRONT_ROW;
-        new_child->frame = child_state->frame;
-        new_child->tile  = child_state->tile;
-        new_child->slice = child_state->slice;
-        new_child->wfrow = MALLOC(encoder_state_config_wfrow_t, 1);
-        
-        if (!new_child->wfrow || !encoder_state_config_wfrow_init(new_child, i)) {
-          fprintf(stderr, "Could not initialize encoder_state->wfrow!\n");
-          return 0;
-        }
-        
-        if (!uvg_encoder_state_init(new_child, child_state)) {
-          fprintf(stderr, "Unable to init child...\n");
-          return 0;
-        }
-      }
-    }
-    
-    child_state->is_leaf = (child_count == 0);
-    //This node is a leaf, compute LCU-order
-    if (child_state->is_leaf) {
-      //All LCU computations are relative to the tile
-      //Remark: this could be optimized, but since it's run only once, it's better to do it in a understandable way.
-      
-      //By default, the full tile
-      int lcu_id;
-      int lcu_start = 0;
-      //End is the element AFTER the end (iterate < lcu_end)
-      int lcu_end = child_state->tile->frame->width_in_lcu * child_state->tile->frame->height_in_lcu;
-      
-      //Restrict to the current slice if needed
-      lcu_start = MAX(lcu_start, child_state->slice->start_in_ts - child_state->tile->lcu_offset_in_ts);
-      lcu_end = MIN(lcu_end, child_state->slice->end_in_ts - child_state->tile->lcu_offset_in_ts + 1);
-      
-      //Restrict to the current wavefront row if needed
-      if (child_state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
-        lcu_start = MAX(lcu_start, (child_state->wfrow->lcu_offset_y) * child_state->tile->frame->width_in_lcu);
-        lcu_end = MIN(lcu_end, (child_state->wfrow->lcu_offset_y + 1) * child_state->tile->frame->width_in_lcu);
-      }
-      
-      child_state->lcu_order_count = lcu_end - lcu_start;
-      child_state->lcu_order = MALLOC(lcu_order_element_t, child_state->lcu_order_count);
-      assert(child_state->lcu_order);
-      
-      for (uint32_t i = 0; i < child_state->lcu_order_count; ++i) {
-        lcu_id = lcu_start + i;
-        child_state->lcu_order[i].encoder_state = child_state;
-        child_state->lcu_order[i].id = lcu_id;
-        child_state->lcu_order[i].index = i;
-        child_state->lcu_order[i].position.x = lcu_id % child_state->tile->frame->width_in_lcu;
-        child_state->lcu_order[i].position.y = lcu_id / child_state->tile->frame->width_in_lcu;
-        child_state->lcu_order[i].position_px.x = child_state->lcu_order[i].position.x * LCU_WIDTH;
-        child_state->lcu_order[i].position_px.y = child_state->lcu_order[i].position.y * LCU_WIDTH;
-        child_state->lcu_order[i].size.x = MIN(LCU_WIDTH, encoder->in.width - (child_state->tile->lcu_offset_x * LCU_WIDTH + child_state->lcu_order[i].position_px.x));
-        child_state->lcu_order[i].size.y = MIN(LCU_WIDTH, encoder->in.height - (child_state->tile->lcu_offset_y * LCU_WIDTH + child_state->lcu_order[i].position_px.y));
-        child_state->lcu_order[i].first_row = uvg_lcu_in_first_row(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
-        child_state->lcu_order[i].last_row = uvg_lcu_in_last_row(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
-        child_state->lcu_order[i].first_column = uvg_lcu_in_first_column(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
-        child_state->lcu_order[i].last_column = uvg_lcu_in_last_column(child_state, child_state->tile->lcu_offset_in_ts + lcu_id);
-        
-        child_state->lcu_order[i].above = NULL;
-        child_state->lcu_order[i].below = NULL;
-        child_state->lcu_order[i].left = NULL;
-        child_state->lcu_order[i].right = NULL;
-        
-        if (!child_state->lcu_order[i].first_row) {
-          //Find LCU above
-          if (child_state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
-            uint32_t j;
-            //For all previous wavefront rows
-            for (j=0; &child_state->parent->children[j] != child_state && child_state->parent->children[j].encoder_control; ++j) {
-              if (child_state->parent->children[j].wfrow->lcu_offset_y == child_state->wfrow->lcu_offset_y - 1) {
-                uint32_t k;
-                for (k=0; k < child_state->parent->children[j].lcu_order_count; ++k) {
-                  if (child_state->parent->children[j].lcu_order[k].position.x == child_state->lcu_order[i].position.x) {
-                    assert(child_state->parent->children[j].lcu_order[k].position.y == child_state->lcu_order[i].position.y - 1);
-                    child_state->lcu_order[i].above = &child_state->parent->children[j].lcu_order[k];
-                  }
-                }
-              }
-            }
-          } else {
-            child_state->lcu_order[i].above = &child_state->lcu_order[i-child_state->tile->frame->width_in_lcu];
-          }
-          assert(child_state->lcu_order[i].above);
-          child_state->lcu_order[i].above->below = &child_state->lcu_order[i];
-        }
-        if (!child_state->lcu_order[i].first_column) {
-          child_state->lcu_order[i].left = &child_state->lcu_order[i-1];
-          assert(child_state->lcu_order[i].left->position.x == child_state->lcu_order[i].position.x - 1);
-          child_state->lcu_order[i].left->right = &child_state->lcu_order[i];
-        }
-      }
-    } else {
-      child_state->lcu_order_count = 0;
-      child_state->lcu_order = NULL;
-    }
+  //Create sub-encoders
+  if (!encoder_state_init_children(child_state)) {
+    return 0;
   }
   
   //Validate the structure
@@ -729,6 +779,31 @@ void uvg_encoder_state_finalize(encoder_state_t * const state) {
   if (state->encoder_control->cfg.alf_type && state->encoder_control->cfg.wpp) {
     encoder_state_t* parent = state;
     while (parent->parent) parent = parent->parent;
-    uvg_threadqueue_free_job(&parent->tqj_alf_process);
+    uvg_encoder_state_free_alf_jobs(parent);
   }
+  uvg_encoder_state_free_stats_jobs(state);
+}
+
+/**
+ * \brief Recreate the sub-encoders of a state.
+ *
+ * Used when the tile layout in the encoder control changes. No jobs of the
+ * state or its children may be running.
+ *
+ * \param state  state whose children are recreated
+ * \return 1 on success, 0 on failure
+ */
+int uvg_encoder_state_rebuild_children(encoder_state_t * const state) {
+  for (int i = 0; state->children[i].encoder_control; ++i) {
+    uvg_encoder_state_finalize(&state->children[i]);
+  }
+  FREE_POINTER(state->children);
+  FREE_POINTER(state->lcu_order);
+  state->lcu_order_count = 0;
+
+  state->children = MALLOC(encoder_state_t, 1);
+  if (!state->children) return 0;
+  state->children[0].encoder_control = NULL;
+
+  return encoder_state_init_children(state);
 }
@@ -51,6 +51,7 @@
 #include "search.h"
 #include "tables.h"
 #include "threadqueue.h"
+#include "threads.h"
 #include "alf.h"
 #include "reshape.h"
 
@@ -638,7 +639,10 @@ static void set_joint_cb_cr_modes(encoder_state_t* state, uvg_picture* pic)
 {
   bool              sgnFlag = true;
 
-  if (state->encoder_control->chroma_format != UVG_CSP_400)
+  // With partial coding, the sign is in the picture header shared by all
+  // the parts, so it cannot depend on the content of one part.
+  if (state->encoder_control->chroma_format != UVG_CSP_400 &&
+      !state->encoder_control->partial.enabled)
   {
     const int       x1 = pic->width / 2 - 1;
     const int       y1 = pic->height / 2 - 1;
@@ -667,12 +671,180 @@ static void set_joint_cb_cr_modes(encoder_state_t* state, uvg_picture* pic)
 
 static void encoder_state_worker_encode_lcu_bitstream(void* opaque);
 
+/**
+ * \brief Whether the in-loop filtering of the LCUs trails the search in
+ * separate jobs.
+ *
+ * Only wavefront rows that are encoded in parallel use separate filter jobs.
+ * Without SAO the whole deblocking is deferred. With SAO the SAO parameters
+ * are needed in the bitstream of the LCU and they are searched from the
+ * deblocked pixels, so only the SAO reconstruction is deferred.
+ */
+static bool encoder_state_lcu_filter_trails(const encoder_state_t *const state)
+{
+  const uvg_config *const cfg = &state->encoder_control->cfg;
+  return state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW &&
+         state->parent->children[1].encoder_control &&
+         (cfg->deblock_enable || cfg->sao_type);
+}
+
+/**
+ * \brief Job that does the in-loop filtering deferred by the search of an LCU.
+ */
+static void encoder_state_worker_filter_lcu(void * opaque)
+{
+  lcu_order_element_t * const lcu = opaque;
+  encoder_state_t *state = lcu->encoder_state;
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  if (encoder->cfg.sao_type) {
+    encoder_sao_reconstruct(state, lcu);
+  } else {
+    uvg_filter_deblock_lcu(state, lcu->position_px.x, lcu->position_px.y);
+  }
+}
+
+// Check if lcu is edge lcu. Return false if frame dimensions are 64 divisible
+static bool edge_lcu(int id, int lcus_x, int lcus_y, bool xdiv64, bool ydiv64)
+{
+  if (xdiv64 && ydiv64) {
+    return false;
+  }
+  int last_row_first_id = (lcus_y - 1) * lcus_x;
+  if ((id % lcus_x == lcus_x - 1 && !xdiv64) || (id >= last_row_first_id && !ydiv64)) {
+    return true;
+  }
+  else {
+    return false;
+  }
+}
+
+
+/**
+ * \brief Calculate the variance adaptive quantization offset of an LCU.
+ *
+ * D * (log(LCU pixel variance) - log(frame pixel variance))
+ */
+static void encoder_state_calc_aq_offset(const encoder_state_t * const state,
+                                         const lcu_order_element_t * const lcu)
+{
+  const encoder_state_t *main_state = state;
+  while (main_state->parent) main_state = main_state->parent;
+
+  const encoder_control_t * const encoder = state->encoder_control;
+  const uvg_picture * const source = main_state->tile->frame->source;
+  const bool has_chroma = encoder->chroma_format != UVG_CSP_400;
+  double d = encoder->cfg.vaq * 0.1; // Empirically decided constant. Affects delta-QP strength
+
+  unsigned x_lim = encoder->in.width_in_lcu;
+  unsigned y_lim = encoder->in.height_in_lcu;
+  const uint32_t x = lcu->position.x + state->tile->lcu_offset_x;
+  const uint32_t y = lcu->position.y + state->tile->lcu_offset_y;
+  const unsigned id = x + y * x_lim;
+
+  uvg_pixel tmp[LCU_LUMA_SIZE];
+  int pxl_x = x * LCU_WIDTH;
+  int pxl_y = y * LCU_WIDTH;
+  int x_max = MIN(pxl_x + LCU_WIDTH, source->width) - pxl_x;
+  int y_max = MIN(pxl_y + LCU_WIDTH, source->height) - pxl_y;
+
+  bool xdiv64 = false;
+  bool ydiv64 = false;
+  if (source->width % 64 == 0) xdiv64 = true;
+  if (source->height % 64 == 0) ydiv64 = true;
+
+  // Luma variance
+  if (!edge_lcu(id, x_lim, y_lim, xdiv64, ydiv64)) {
+    uvg_pixels_blit(&source->y[pxl_x + pxl_y * source->stride], tmp,
+      x_max, y_max, source->stride, LCU_WIDTH);
+  } else {
+    // Extend edge pixels for edge lcus
+    for (int y = 0; y < LCU_WIDTH; y++) {
+      for (int x = 0; x < LCU_WIDTH; x++) {
+        int src_y = CLIP(0, source->height - 1, pxl_y + y);
+        int src_x = CLIP(0, source->width - 1, pxl_x + x);
+        tmp[y * LCU_WIDTH + x] = source->y[src_y * source->stride + src_x];
+      }
+    }
+  }
+
+  double lcu_var = uvg_pixel_var(tmp, LCU_LUMA_SIZE);
+
+  if (has_chroma) {
+    // Add chroma variance if not monochrome
+    int32_t c_stride = source->stride >> 1;
+    uvg_pixel chromau_tmp[LCU_CHROMA_SIZE];
+    uvg_pixel chromav_tmp[LCU_CHROMA_SIZE];
+    int lcu_chroma_width = LCU_WIDTH >> 1;
+    int c_pxl_x = x * lcu_chroma_width;
+    int c_pxl_y = y * lcu_chroma_width;
+    int c_x_max = MIN(c_pxl_x + lcu_chroma_width, source->width >> 1) - c_pxl_x;
+    int c_y_max = MIN(c_pxl_y + lcu_chroma_width, source->height >> 1) - c_pxl_y;
+
+    if (!edge_lcu(id, x_lim, y_lim, xdiv64, ydiv64)) {
+      uvg_pixels_blit(&source->u[c_pxl_x + c_pxl_y * c_stride], chromau_tmp, c_x_max, c_y_max, c_stride, lcu_chroma_width);
+      uvg_pixels_blit(&source->v[c_pxl_x + c_pxl_y * c_stride], chromav_tmp, c_x_max, c_y_max, c_stride, lcu_chroma_width);
+    }
+    else {
+      for (int y = 0; y < lcu_chroma_width; y++) {
+        for (int x = 0; x < lcu_chroma_width; x++) {
+          int src_y = CLIP(0, (source->height >> 1) - 1, c_pxl_y + y);
+          int src_x = CLIP(0, (source->width >> 1) - 1, c_pxl_x + x);
+          chromau_tmp[y * lcu_chroma_width + x] = source->u[src_y * c_stride + src_x];
+          chromav_tmp[y * lcu_chroma_width + x] = source->v[src_y * c_stride + src_x];
+        }
+      }
+    }
+    lcu_var += uvg_pixel_var(chromau_tmp, LCU_CHROMA_SIZE);
+    lcu_var += uvg_pixel_var(chromav_tmp, LCU_CHROMA_SIZE);
+  }
+
+  state->frame->aq_offsets[id] = d * (log(lcu_var) - log(state->frame->aq_frame_var));
+}
+
+/**
+ * \brief Take a coefficient buffer for an LCU from the pool of the tile.
+ *
+ * The contents of a reused buffer are those of an earlier LCU. Search
+ * overwrites y, u and v completely and joint_uv whenever JCCR is enabled,
+ * so only a newly allocated buffer is cleared.
+ */
+static lcu_coeff_t * encoder_state_coeff_acquire(encoder_state_config_tile_t *tile)
+{
+  lcu_coeff_t *coeff = NULL;
+  pthread_mutex_lock(&tile->coeff_pool_lock);
+  if (tile->coeff_pool_count > 0) {
+    coeff = tile->coeff_pool[--tile->coeff_pool_count];
+  }
+  pthread_mutex_unlock(&tile->coeff_pool_lock);
+
+  if (!coeff) {
+    coeff = calloc(1, sizeof(lcu_coeff_t));
+  }
+  return coeff;
+}
+
+/**
+ * \brief Return a coefficient buffer to the pool of the tile.
+ */
+static void encoder_state_coeff_release(encoder_state_config_tile_t *tile,
+                                        lcu_coeff_t *coeff)
+{
+  pthread_mutex_lock(&tile->coeff_pool_lock);
+  tile->coeff_pool[tile->coeff_pool_count++] = coeff;
+  pthread_mutex_unlock(&tile->coeff_pool_lock);
+}
+
 static void encoder_state_worker_encode_lcu_search(void * opaque)
 {
   lcu_order_element_t * const lcu = opaque;
   encoder_state_t *state = lcu->encoder_state;
   const encoder_control_t * const encoder = state->encoder_control;
 
+  if (encoder->cfg.vaq) {
+    encoder_state_calc_aq_offset(state, lcu);
+  }
+
   switch (encoder->cfg.rc_algorithm) {
   case UVG_NO_RC:
   case UVG_LAMBDA:
@@ -685,7 +857,7 @@ static void encoder_state_worker_encode_lcu_search(void * opaque)
     assert(0);
   }
 
-  lcu->coeff = calloc(1, sizeof(lcu_coeff_t));
+  lcu->coeff = encoder_state_coeff_acquire(state->tile);
 
   const uint32_t ctu_row = (lcu->position_px.y >> LOG2_LCU_WIDTH);
   const uint32_t ctu_row_mul_five = ctu_row * MAX_NUM_HMVP_CANDS;
@@ -724,7 +896,9 @@ static void encoder_state_worker_encode_lcu_search(void * opaque)
     }
   }
 
-  if (encoder->cfg.deblock_enable) {
+  const bool filter_trails = encoder_state_lcu_filter_trails(state);
+
+  if (encoder->cfg.deblock_enable && (!filter_trails || encoder->cfg.sao_type)) {
     uvg_filter_deblock_lcu(state, lcu->position_px.x, lcu->position_px.y);
   }
 
@@ -736,7 +910,9 @@ static void encoder_state_worker_encode_lcu_search(void * opaque)
       state->tile->hor_buf_before_sao,
       state->tile->ver_buf_before_sao);
     uvg_sao_search_lcu(state, lcu->position.x, lcu->position.y);
-    encoder_sao_reconstruct(state, lcu);
+    if (!filter_trails) {
+      encoder_sao_reconstruct(state, lcu);
+    }
   }
 
   // Do simulated bitstream writing to update the cabac contexts
@@ -775,7 +951,7 @@ static void encoder_state_worker_encode_lcu_bitstream(void * opaque)
 
   if (!state->cabac.only_count) {
     // Coeffs are not needed anymore.
-    free(lcu->coeff);
+    encoder_state_coeff_release(state->tile, lcu->coeff);
     lcu->coeff = NULL;
   }
 
@@ -821,16 +997,8 @@ static void encoder_state_worker_encode_lcu_bitstream(void * opaque)
   state->cabac.update = 0;
 
 
-  pthread_mutex_lock(&state->frame->rc_lock);
   const uint32_t bits = (const uint32_t)(uvg_bitstream_tell(&state->stream) - existing_bits);
-  state->frame->cur_frame_bits_coded += bits;
-  // This variable is used differently by intra and inter frames and shouldn't
-  // be touched in intra frames here
-  state->frame->remaining_weight -= !state->frame->is_irap ?
-    uvg_get_lcu_stats(state, lcu->position.x, lcu->position.y)->original_weight :
-    0;
-  pthread_mutex_unlock(&state->frame->rc_lock);
-  uvg_get_lcu_stats(state, lcu->position.x, lcu->position.y)->bits = bits;
+  uvg_update_after_lcu(state, lcu->position, bits);
 
   uint8_t not_skip = false;
   for (int y = 0; y < 64 && !not_skip; y += 8) {
@@ -871,16 +1039,174 @@ static void encoder_state_init_children_after_simulation(encoder_state_t* const
 
 void uvg_alf_enc_process_job(void* opaque) {
   encoder_state_t* const state = (encoder_state_t* const)opaque;
-  
-  uvg_alf_enc_process(state);
 
   encoder_state_t* parent = state;
   while (parent->parent) parent = parent->parent;
 
+  // With jobs for each LCU row only the last step is left.
+  if (parent->alf_rows) {
+    uvg_alf_enc_finish(state);
+  } else {
+    uvg_alf_enc_process(state);
+  }
+
   // If ALF was used the bitstream coding was simulated in search, reset the cabac/stream
   encoder_state_init_children_after_simulation(parent);
 }
 
+static void encoder_state_worker_alf_pad(void *opaque)
+{
+  const alf_row_jobs_t *const row = opaque;
+  uvg_alf_enc_pad_lcu_row(row->encoder_state, row->lcu_row);
+}
+
+static void encoder_state_worker_alf_stats(void *opaque)
+{
+  const alf_row_jobs_t *const row = opaque;
+  uvg_alf_enc_stats_lcu_row(row->encoder_state, row->lcu_row);
+}
+
+static void encoder_state_worker_alf_derive(void *opaque)
+{
+  uvg_alf_enc_derive((encoder_state_t *)opaque);
+}
+
+static void encoder_state_worker_alf_filter(void *opaque)
+{
+  const alf_row_jobs_t *const row = opaque;
+  uvg_alf_enc_filter_lcu_row(row->encoder_state, row->lcu_row);
+}
+
+/**
+ * \brief Free the ALF jobs of a frame.
+ */
+void uvg_encoder_state_free_alf_jobs(encoder_state_t *state)
+{
+  uvg_threadqueue_free_job(&state->tqj_alf_process);
+  uvg_threadqueue_free_job(&state->tqj_alf_derive);
+  for (int i = 0; i < state->alf_row_count; ++i) {
+    uvg_threadqueue_free_job(&state->alf_rows[i].pad);
+    uvg_threadqueue_free_job(&state->alf_rows[i].stats);
+    uvg_threadqueue_free_job(&state->alf_rows[i].filter);
+  }
+  FREE_POINTER(state->alf_rows);
+  state->alf_row_count = 0;
+}
+
+/**
+ * \brief Whether the hash of the reconstruction is written for the frame.
+ */
+static bool encoder_state_needs_hash(const encoder_state_t *const state)
+{
+  // The hash of a part would not match the decoded full picture.
+  return state->encoder_control->cfg.hash != UVG_HASH_NONE &&
+         !state->encoder_control->partial.enabled;
+}
+
+/**
+ * \brief Whether the PSNR, SSIM and hash jobs of the LCU rows wait for the
+ * rows only, instead of the whole frame.
+ *
+ * This is the case when the frame is one tile of wavefronts, except with
+ * full ALF, because CC-ALF modifies the chroma after all rows are filtered.
+ * With a slice for each row, the rows are encoded in jobs of their own and
+ * their dependencies could not be added before the jobs are submitted.
+ */
+static bool encoder_state_stats_follow_rows(const encoder_state_t *const state)
+{
+  const encoder_control_t *const encoder = state->encoder_control;
+  return encoder->cfg.wpp &&
+         !encoder->tiles_enable &&
+         !(encoder->cfg.slices & UVG_SLICES_WPP) &&
+         !encoder->cfg.intra_frame_parallel &&
+         encoder->cfg.alf_type != UVG_ALF_FULL;
+}
+
+static void encoder_state_worker_frame_stats(void *opaque)
+{
+  frame_stats_row_t *const row = opaque;
+  encoder_state_t *const state = row->encoder_state;
+  const encoder_control_t *const encoder = state->encoder_control;
+  const videoframe_t *const frame = state->tile->frame;
+
+  const int y_begin = row->lcu_row * LCU_WIDTH;
+  const int y_end = MIN(y_begin + LCU_WIDTH, frame->rec->height);
+
+  if (encoder->cfg.calc_psnr || encoder->cfg.calc_ssim) {
+    uvg_image_calc_quality_rows(frame->source, frame->rec, y_begin, y_end,
+                                row->sse,
+                                encoder->cfg.calc_ssim ? row->ssim : NULL,
+                                row->ssim_blocks);
+  }
+
+  if (encoder_state_needs_hash(state)) {
+    if (encoder->cfg.hash == UVG_HASH_CHECKSUM) {
+      uvg_image_checksum_rows(frame->rec, y_begin, y_end, row->checksum, encoder->bitdepth);
+    } else {
+      // The jobs of an MD5 hash run in order.
+      uvg_image_md5_rows(frame->rec, y_begin, y_end, state->stats_md5, encoder->bitdepth);
+    }
+  }
+}
+
+/**
+ * \brief Free the PSNR, SSIM and hash jobs of a frame.
+ */
+void uvg_encoder_state_free_stats_jobs(encoder_state_t *state)
+{
+  for (int i = 0; i < state->stats_row_count; ++i) {
+    uvg_threadqueue_free_job(&state->stats_rows[i].job);
+  }
+  FREE_POINTER(state->stats_rows);
+  state->stats_row_count = 0;
+}
+
+/**
+ * \brief Scheduling priority for the jobs of a frame.
+ *
+ * Jobs of older frames run first because they gate the output and the
+ * reference pictures of the following frames. Frames are ordered by the
+ * time they were started, so when several encoders share the threadqueue
+ * each of them gets its turn. Within a frame, LCUs on an earlier wavefront
+ * diagonal run first.
+ *
+ * \param lcu   LCU of the job or NULL for jobs covering the whole frame
+ */
+static int64_t encoder_state_job_priority(const encoder_state_t * const state,
+                                          const lcu_order_element_t * const lcu)
+{
+  int64_t priority = -state->frame->schedule_order * ((int64_t)1 << 32);
+  if (lcu) {
+    priority -= state->tile->lcu_offset_x + lcu->position.x +
+                state->tile->lcu_offset_y + lcu->position.y + 1;
+  }
+  return priority;
+}
+
+/**
+ * \brief Set the scheduling priority and the preferred NUMA node of a job
+ * of a frame.
+ *
+ * \param lcu   LCU of the job or NULL for jobs covering the whole frame
+ */
+static void encoder_state_schedule_job(const encoder_state_t * const state,
+                                       threadqueue_job_t * const job,
+                                       const lcu_order_element_t * const lcu)
+{
+  uvg_threadqueue_job_set_priority(job, encoder_state_job_priority(state, lcu));
+  uvg_threadqueue_job_set_node(job, state->frame->numa_node);
+}
+
+/**
+ * \brief Return the job after which the reconstruction of an LCU is final.
+ */
+static threadqueue_job_t *encoder_state_lcu_recon_job(const encoder_state_t *const state,
+                                                      int lcu_id)
+{
+  threadqueue_job_t *const filter_job = state->tile->wf_filter_jobs[lcu_id];
+  return filter_job ? filter_job : state->tile->wf_recon_jobs[lcu_id];
+}
+
 static void encoder_state_encode_leaf(encoder_state_t * const state)
 {
   const encoder_control_t * const encoder = state->encoder_control;
@@ -957,20 +1283,35 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
       ref_state = state->previous_encoder_state;
     }
 
+    const bool filter_trails = encoder_state_lcu_filter_trails(state);
+
     for (uint32_t i = 0; i < state->lcu_order_count; ++i) {
       const lcu_order_element_t * const lcu = &state->lcu_order[i];
 
       uvg_threadqueue_free_job(&state->tile->wf_jobs[lcu->id]);
       uvg_threadqueue_free_job(&state->tile->wf_recon_jobs[lcu->id]);
-      state->tile->wf_jobs[lcu->id] = uvg_threadqueue_job_create(encoder_state_worker_encode_lcu_bitstream, (void*)lcu);
+      uvg_threadqueue_free_job(&state->tile->wf_filter_jobs[lcu->id]);
+      state->tile->wf_jobs[lcu->id] = uvg_threadqueue_job_create(state->encoder_control->threadqueue, encoder_state_worker_encode_lcu_bitstream, (void*)lcu);
       threadqueue_job_t **bitstream_job = &state->tile->wf_jobs[lcu->id];
 
       // Use a separate job for bitstream writing, first process search and recon
-      state->tile->wf_recon_jobs[lcu->id] = uvg_threadqueue_job_create(encoder_state_worker_encode_lcu_search, (void*)lcu);
+      state->tile->wf_recon_jobs[lcu->id] = uvg_threadqueue_job_create(state->encoder_control->threadqueue, encoder_state_worker_encode_lcu_search, (void*)lcu);
       threadqueue_job_t **job = &state->tile->wf_recon_jobs[lcu->id];
 
+      // The in-loop filtering of the LCU trails the search. It has to wait
+      // for the filtering of the LCUs on the left and on the top, since the
+      // filters of neighbouring LCUs overlap.
+      threadqueue_job_t **filter_job = NULL;
+      if (filter_trails) {
+        state->tile->wf_filter_jobs[lcu->id] = uvg_threadqueue_job_create(state->encoder_control->threadqueue, encoder_state_worker_filter_lcu, (void*)lcu);
+        filter_job = &state->tile->wf_filter_jobs[lcu->id];
+      }
+
       // If job object was returned, add dependancies and allow it to run.
       if (job[0]) {
+        encoder_state_schedule_job(state, job[0], lcu);
+        encoder_state_schedule_job(state, bitstream_job[0], lcu);
+
         // Add inter frame dependancies when ecoding more than one frame at
         // once. The added dependancy is for the first LCU of each wavefront
         // row to depend on the reconstruction status of the row below in the
@@ -988,11 +1329,11 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
           for (int i = 0; dep_lcu->right && i < ctrl->max_inter_ref_lcu.right + 1; i++) {
             dep_lcu = dep_lcu->right;
           }
-          uvg_threadqueue_job_dep_add(job[0], ref_state->tile->wf_recon_jobs[dep_lcu->id]);
+          uvg_threadqueue_job_dep_add(job[0], encoder_state_lcu_recon_job(ref_state, dep_lcu->id));
 
           //TODO: Preparation for the lock free implementation of the new rc
           if (ref_state->frame->slicetype == UVG_SLICE_I && ref_state->frame->num != 0 && state->encoder_control->cfg.owf > 1 && true) {
-            uvg_threadqueue_job_dep_add(job[0], ref_state->previous_encoder_state->tile->wf_recon_jobs[dep_lcu->id]);
+            uvg_threadqueue_job_dep_add(job[0], encoder_state_lcu_recon_job(ref_state->previous_encoder_state, dep_lcu->id));
           }
 
           // Very spesific bug that happens when owf length is longer than the
@@ -1007,7 +1348,7 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
             while (ref_state->frame->poc != state->frame->poc - state->encoder_control->cfg.gop_len){
               ref_state = ref_state->previous_encoder_state;
             }
-            uvg_threadqueue_job_dep_add(job[0], ref_state->tile->wf_recon_jobs[dep_lcu->id]);
+            uvg_threadqueue_job_dep_add(job[0], encoder_state_lcu_recon_job(ref_state, dep_lcu->id));
           }
         }
         
@@ -1029,7 +1370,20 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
           uvg_threadqueue_submit(state->encoder_control->threadqueue, job[0]);
 
           uvg_threadqueue_job_dep_add(state->tile->wf_jobs[lcu->id], parent->tqj_alf_process);
-          uvg_threadqueue_job_dep_add(parent->tqj_alf_process, state->tile->wf_recon_jobs[lcu->id]);
+          uvg_threadqueue_job_dep_add(parent->tqj_alf_process, filter_job ? filter_job[0] : job[0]);
+
+          // The samples of an LCU row are final when the row below is
+          // reconstructed, so the last LCU of a row releases the ALF of
+          // the row and the row above.
+          if (parent->alf_rows && i + 1 == state->lcu_order_count &&
+              parent->alf_rows[0].encoder_state->tile == state->tile) {
+            const int row = lcu->position.y;
+            threadqueue_job_t *const row_done = filter_job ? filter_job[0] : job[0];
+            uvg_threadqueue_job_dep_add(parent->alf_rows[row].pad, row_done);
+            if (row > 0) {
+              uvg_threadqueue_job_dep_add(parent->alf_rows[row - 1].pad, row_done);
+            }
+          }
         } else {
 
           // Add local WPP dependancy to the LCU on the left.
@@ -1044,15 +1398,48 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
           uvg_threadqueue_submit(state->encoder_control->threadqueue, job[0]);
 
           uvg_threadqueue_job_dep_add(state->tile->wf_jobs[lcu->id], state->tile->wf_recon_jobs[lcu->id]);
+
+          // The samples of an LCU row are final when the row below is
+          // reconstructed, so the last LCU of a row releases the PSNR,
+          // SSIM and hash of the row and the row above.
+          encoder_state_t *parent = state;
+          while (parent->parent) parent = parent->parent;
+          if (parent->stats_rows && !lcu->right && encoder_state_stats_follow_rows(parent)) {
+            const int row = lcu->position.y;
+            threadqueue_job_t *const row_done = filter_job ? filter_job[0] : job[0];
+            uvg_threadqueue_job_dep_add(parent->stats_rows[row].job, row_done);
+            if (row > 0) {
+              uvg_threadqueue_job_dep_add(parent->stats_rows[row - 1].job, row_done);
+            }
+          }
         }
 
         uvg_threadqueue_submit(state->encoder_control->threadqueue, state->tile->wf_jobs[lcu->id]);
 
+        if (filter_job) {
+          encoder_state_schedule_job(state, filter_job[0], lcu);
+          uvg_threadqueue_job_dep_add(filter_job[0], job[0]);
+          if (lcu->left) {
+            uvg_threadqueue_job_dep_add(filter_job[0], filter_job[-1]);
+          }
+          if (lcu->above) {
+            uvg_threadqueue_job_dep_add(filter_job[0], filter_job[-state->tile->frame->width_in_lcu]);
+          }
+          // Without ALF the last filter job of the row marks the row done,
+          // so it also waits for the bitstream. With ALF the bitstream
+          // already waits for the filtering.
+          const bool row_done = i + 1 == state->lcu_order_count && !cfg->alf_type;
+          if (row_done) {
+            uvg_threadqueue_job_dep_add(filter_job[0], state->tile->wf_jobs[lcu->id]);
+          }
+          uvg_threadqueue_submit(state->encoder_control->threadqueue, filter_job[0]);
+        }
+
         // The wavefront row is done when the last LCU in the row is done.
         if (i + 1 == state->lcu_order_count) {
           assert(!state->tqj_recon_done);
-          state->tqj_recon_done =
-            uvg_threadqueue_copy_ref(state->tile->wf_jobs[lcu->id]);
+          state->tqj_recon_done = uvg_threadqueue_copy_ref(
+            filter_job && !cfg->alf_type ? filter_job[0] : state->tile->wf_jobs[lcu->id]);
         }
       }
     }
@@ -1189,6 +1576,10 @@ static void encoder_state_encode(encoder_state_t * const main_state) {
         node_is_the_last_split_in_tree &&
         encoder_state_tree_is_a_chain(&main_state->children[i]);
     }
+    // Frames encoded as single jobs encode their tiles in the same job.
+    node_is_the_last_split_in_tree = node_is_the_last_split_in_tree &&
+                                     !main_state->encoder_control->cfg.intra_frame_parallel;
+
     //If it's the latest split point
     if (node_is_the_last_split_in_tree) {
       for (int i = 0; main_state->children[i].encoder_control; ++i) {
@@ -1196,7 +1587,8 @@ static void encoder_state_encode(encoder_state_t * const main_state) {
         if (main_state->children[i].type != ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
           uvg_threadqueue_free_job(&main_state->children[i].tqj_recon_done);
           main_state->children[i].tqj_recon_done =
-            uvg_threadqueue_job_create(encoder_state_worker_encode_children, &main_state->children[i]);
+            uvg_threadqueue_job_create(main_state->encoder_control->threadqueue, encoder_state_worker_encode_children, &main_state->children[i]);
+          encoder_state_schedule_job(main_state, main_state->children[i].tqj_recon_done, NULL);
           if (main_state->children[i].previous_encoder_state != &main_state->children[i] &&
               main_state->children[i].previous_encoder_state->tqj_recon_done &&
               !main_state->children[i].frame->is_irap)
@@ -1397,6 +1789,90 @@ static void encoder_state_remove_refs(encoder_state_t *state) {
   assert(state->frame->ref->used_size <= target_ref_num);
 }
 
+/**
+ * \brief Move a picture allocated for the frame to the NUMA node of the
+ * frame.
+ */
+static void encoder_state_bind_picture(const encoder_state_t * const state,
+                                       const uvg_picture * const pic)
+{
+  if (state->frame->numa_node < 0) return;
+
+  const size_t luma_size = (size_t)pic->stride * (pic->height + FRAME_PADDING_LUMA);
+  const size_t chroma_sizes[] = { 0, luma_size / 4, luma_size / 2, luma_size };
+  const size_t size = luma_size + 2 * chroma_sizes[pic->chroma_format];
+
+  uvg_threadqueue_bind_memory(state->encoder_control->threadqueue,
+                              pic->fulldata_buf,
+                              size * sizeof(uvg_pixel),
+                              state->frame->numa_node);
+}
+
+/**
+ * \brief Move a CU array allocated for the frame to the NUMA node of the
+ * frame.
+ */
+static void encoder_state_bind_cu_array(const encoder_state_t * const state,
+                                        const cu_array_t * const cua)
+{
+  if (state->frame->numa_node < 0) return;
+
+  const size_t size = (size_t)(cua->width / SCU_WIDTH) * (cua->height / SCU_WIDTH);
+
+  uvg_threadqueue_bind_memory(state->encoder_control->threadqueue,
+                              cua->data,
+                              size * sizeof(cu_info_t),
+                              state->frame->numa_node);
+}
+
+/**
+ * \brief Allocate a picture of the size of the frame or take the one kept
+ * from the previous frame.
+ *
+ * New pictures of the input size come from the picture pool of the encoder
+ * so that pictures dropped from the reference lists are reused.
+ */
+static uvg_picture *encoder_state_alloc_picture(const encoder_state_t * const state,
+                                                uvg_picture **spare,
+                                                const uvg_picture * const frame)
+{
+  uvg_picture *pic = *spare;
+  *spare = NULL;
+  if (pic && pic->width == frame->width && pic->height == frame->height) {
+    return pic;
+  }
+  uvg_image_free(pic);
+
+  const encoder_control_t * const encoder = state->encoder_control;
+  if (frame->width == encoder->in.width && frame->height == encoder->in.height) {
+    pic = uvg_picture_pool_acquire(encoder->picture_pool);
+  } else {
+    pic = uvg_image_alloc(encoder->chroma_format, frame->width, frame->height);
+  }
+  encoder_state_bind_picture(state, pic);
+  return pic;
+}
+
+/**
+ * \brief Drop a picture of the previous frame.
+ *
+ * The picture is kept for the next frame if this was the last reference to
+ * it. Pictures still used as references or held by the application are
+ * released as usual.
+ */
+static void encoder_state_release_picture(uvg_picture **pic, uvg_picture **spare)
+{
+  if (*pic && !*spare &&
+      (*pic)->base_image == *pic &&
+      UVG_ATOMIC_LOAD(&(*pic)->refcount) == 1)
+  {
+    *spare = *pic;
+  } else {
+    uvg_image_free(*pic);
+  }
+  *pic = NULL;
+}
+
 static void encoder_set_source_picture(encoder_state_t * const state, uvg_picture* frame)
 {
   assert(!state->tile->frame->source);
@@ -1413,15 +1889,15 @@ static void encoder_set_source_picture(encoder_state_t * const state, uvg_pictur
     // In lossless mode, the reconstruction is equal to the source frame.
     state->tile->frame->rec = uvg_image_copy_ref(frame);
   } else {
-    state->tile->frame->rec = uvg_image_alloc(state->encoder_control->chroma_format, frame->width, frame->height);
+    state->tile->frame->rec = encoder_state_alloc_picture(state, &state->tile->frame->spare.rec, frame);
     state->tile->frame->rec->dts = frame->dts;
     state->tile->frame->rec->pts = frame->pts;
   }
   state->tile->frame->rec_lmcs = state->tile->frame->rec;
 
   if (state->encoder_control->cfg.lmcs_enable) {
-    state->tile->frame->rec_lmcs = uvg_image_alloc(state->encoder_control->chroma_format, frame->width, frame->height);
-    state->tile->frame->source_lmcs = uvg_image_alloc(state->encoder_control->chroma_format, frame->width, frame->height);
+    state->tile->frame->rec_lmcs = encoder_state_alloc_picture(state, &state->tile->frame->spare.rec_lmcs, frame);
+    state->tile->frame->source_lmcs = encoder_state_alloc_picture(state, &state->tile->frame->spare.source_lmcs, frame);
   }
   uvg_videoframe_set_poc(state->tile->frame, state->frame->poc);
 }
@@ -1466,22 +1942,6 @@ static void normalize_lcu_weights(encoder_state_t * const state)
   }
 }
 
-// Check if lcu is edge lcu. Return false if frame dimensions are 64 divisible
-static bool edge_lcu(int id, int lcus_x, int lcus_y, bool xdiv64, bool ydiv64)
-{
-  if (xdiv64 && ydiv64) {
-    return false;
-  }
-  int last_row_first_id = (lcus_y - 1) * lcus_x;
-  if ((id % lcus_x == lcus_x - 1 && !xdiv64) || (id >= last_row_first_id && !ydiv64)) {
-    return true;
-  }
-  else {
-    return false;
-  }
-}
-
-
 /**
  * \brief Return weight for 360 degree ERP video
  *
@@ -1641,6 +2101,7 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, uvg_pict
       state->tile->frame->width,
       state->tile->frame->height
   );
+  encoder_state_bind_cu_array(state, state->tile->frame->cu_array);
 
   if (!state->encoder_control->tiles_enable) {
     memset(state->tile->frame->hmvp_size, 0, sizeof(uint8_t) * state->tile->frame->height_in_lcu);
@@ -1663,10 +2124,9 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, uvg_pict
 
   // Variance adaptive quantization
   if (cfg->vaq) {
+    // Calculate frame pixel variance. The offsets of the LCUs are
+    // calculated by the jobs searching them.
     const bool has_chroma = state->encoder_control->chroma_format != UVG_CSP_400;
-    double d = cfg->vaq * 0.1; // Empirically decided constant. Affects delta-QP strength
-    
-    // Calculate frame pixel variance
     uint32_t len = state->tile->frame->width * state->tile->frame->height;
     uint32_t c_len = len / 4;
     double frame_var = uvg_pixel_var(state->tile->frame->source->y, len);
@@ -1674,78 +2134,8 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, uvg_pict
       frame_var += uvg_pixel_var(state->tile->frame->source->u, c_len);
       frame_var += uvg_pixel_var(state->tile->frame->source->v, c_len);
     }
-
-    // Loop through LCUs
-    // For each LCU calculate: D * (log(LCU pixel variance) - log(frame pixel variance))
-    unsigned x_lim = state->tile->frame->width_in_lcu;
-    unsigned y_lim = state->tile->frame->height_in_lcu;
-    
-    unsigned id = 0;
-    for (uint32_t y = 0; y < y_lim; ++y) {
-      for (uint32_t x = 0; x < x_lim; ++x) {
-        uvg_pixel tmp[LCU_LUMA_SIZE];
-        int pxl_x = x * LCU_WIDTH;
-        int pxl_y = y * LCU_WIDTH;
-        int x_max = MIN(pxl_x + LCU_WIDTH, frame->width) - pxl_x;
-        int y_max = MIN(pxl_y + LCU_WIDTH, frame->height) - pxl_y;
-        
-        bool xdiv64 = false;
-        bool ydiv64 = false;
-        if (frame->width % 64 == 0) xdiv64 = true;
-        if (frame->height % 64 == 0) ydiv64 = true;
-
-        // Luma variance
-        if (!edge_lcu(id, x_lim, y_lim, xdiv64, ydiv64)) {
-          uvg_pixels_blit(&state->tile->frame->source->y[pxl_x + pxl_y * state->tile->frame->source->stride], tmp,
-            x_max, y_max, state->tile->frame->source->stride, LCU_WIDTH);
-        } else {
-          // Extend edge pixels for edge lcus
-          for (int y = 0; y < LCU_WIDTH; y++) {
-            for (int x = 0; x < LCU_WIDTH; x++) {
-              int src_y = CLIP(0, frame->height - 1, pxl_y + y);
-              int src_x = CLIP(0, frame->width - 1, pxl_x + x);
-              tmp[y * LCU_WIDTH + x] = state->tile->frame->source->y[src_y * state->tile->frame->source->stride + src_x];
-            }
-          }
-        }
-        
-        double lcu_var = uvg_pixel_var(tmp, LCU_LUMA_SIZE);
-
-        if (has_chroma) {
-          // Add chroma variance if not monochrome
-          int32_t c_stride = state->tile->frame->source->stride >> 1;
-          uvg_pixel chromau_tmp[LCU_CHROMA_SIZE];
-          uvg_pixel chromav_tmp[LCU_CHROMA_SIZE];
-          int lcu_chroma_width = LCU_WIDTH >> 1;
-          int c_pxl_x = x * lcu_chroma_width;
-          int c_pxl_y = y * lcu_chroma_width;
-          int c_x_max = MIN(c_pxl_x + lcu_chroma_width, frame->width >> 1) - c_pxl_x;
-          int c_y_max = MIN(c_pxl_y + lcu_chroma_width, frame->height >> 1) - c_pxl_y;
-
-          if (!edge_lcu(id, x_lim, y_lim, xdiv64, ydiv64)) {
-            uvg_pixels_blit(&state->tile->frame->source->u[c_pxl_x + c_pxl_y * c_stride], chromau_tmp, c_x_max, c_y_max, c_stride, lcu_chroma_width);
-            uvg_pixels_blit(&state->tile->frame->source->v[c_pxl_x + c_pxl_y * c_stride], chromav_tmp, c_x_max, c_y_max, c_stride, lcu_chroma_width);
-          }
-          else {
-            for (int y = 0; y < lcu_chroma_width; y++) {
-              for (int x = 0; x < lcu_chroma_width; x++) {
-                int src_y = CLIP(0, (frame->height >> 1) - 1, c_pxl_y + y);
-                int src_x = CLIP(0, (frame->width >> 1) - 1, c_pxl_x + x);
-                chromau_tmp[y * lcu_chroma_width + x] = state->tile->frame->source->u[src_y * c_stride + src_x];
-                chromav_tmp[y * lcu_chroma_width + x] = state->tile->frame->source->v[src_y * c_stride + src_x];
-              }
-            }
-          }
-          lcu_var += uvg_pixel_var(chromau_tmp, LCU_CHROMA_SIZE);
-          lcu_var += uvg_pixel_var(chromav_tmp, LCU_CHROMA_SIZE);
-        }
-                
-        state->frame->aq_offsets[id] = d * (log(lcu_var) - log(frame_var));
-        id++; 
-      }
-    }
+    state->frame->aq_frame_var = frame_var;
   }
-  // Variance adaptive quantization - END
 
   if (cfg->target_bitrate > 0 || frame->roi.roi_array || cfg->set_qp_in_cu || cfg->vaq) {
     state->frame->max_qp_delta_depth = 0;
@@ -1917,6 +2307,123 @@ static void _encode_one_frame_add_bitstream_deps(const encoder_state_t * const s
 }
 
 
+/**
+ * \brief Encode a whole frame in one job.
+ */
+static void encoder_state_worker_encode_frame(void *opaque)
+{
+  encoder_state_encode((encoder_state_t *)opaque);
+}
+
+
+/**
+ * \brief Create the ALF jobs of a frame encoded with wavefronts.
+ *
+ * The padding, statistics and filtering of each LCU row run in jobs of
+ * their own, so that ALF of the first rows overlaps with the search of
+ * the last rows. Only the filter derivation and CC-ALF run in single jobs.
+ * The padding of a row waits for the reconstruction of the row and the
+ * row below, which is added in encoder_state_encode_leaf. The jobs are
+ * submitted after the frame has been encoded, because the ALF buffers of
+ * the sub states are set up only then.
+ */
+static void encoder_state_create_alf_jobs(encoder_state_t * const state)
+{
+  threadqueue_queue_t *const threadqueue = state->encoder_control->threadqueue;
+
+  encoder_state_t *alf_state = state;
+  while (alf_state->lcu_order == NULL) alf_state = &alf_state->children[0];
+
+  uvg_encoder_state_free_alf_jobs(state);
+
+  state->tqj_alf_process = uvg_threadqueue_job_create(threadqueue, uvg_alf_enc_process_job, alf_state);
+  encoder_state_schedule_job(state, state->tqj_alf_process, NULL);
+
+  // A single row is not encoded in parallel and its ALF is done in one job.
+  const int rows = alf_state->tile->frame->height_in_lcu;
+  if (rows < 2) return;
+
+  state->tqj_alf_derive = uvg_threadqueue_job_create(threadqueue, encoder_state_worker_alf_derive, alf_state);
+  encoder_state_schedule_job(state, state->tqj_alf_derive, NULL);
+
+  state->alf_rows = MALLOC(alf_row_jobs_t, rows);
+  state->alf_row_count = rows;
+  for (int i = 0; i < rows; ++i) {
+    alf_row_jobs_t *const row = &state->alf_rows[i];
+    row->encoder_state = alf_state;
+    row->lcu_row = i;
+    row->pad = uvg_threadqueue_job_create(threadqueue, encoder_state_worker_alf_pad, row);
+    row->stats = uvg_threadqueue_job_create(threadqueue, encoder_state_worker_alf_stats, row);
+    row->filter = uvg_threadqueue_job_create(threadqueue, encoder_state_worker_alf_filter, row);
+    encoder_state_schedule_job(state, row->pad, NULL);
+    encoder_state_schedule_job(state, row->stats, NULL);
+    encoder_state_schedule_job(state, row->filter, NULL);
+  }
+
+  for (int i = 0; i < rows; ++i) {
+    alf_row_jobs_t *const row = &state->alf_rows[i];
+    // The classification and the statistics read the rows above and below.
+    if (i > 0) {
+      uvg_threadqueue_job_dep_add(row->stats, state->alf_rows[i - 1].pad);
+    }
+    uvg_threadqueue_job_dep_add(row->stats, row->pad);
+    if (i + 1 < rows) {
+      uvg_threadqueue_job_dep_add(row->stats, state->alf_rows[i + 1].pad);
+    }
+    uvg_threadqueue_job_dep_add(state->tqj_alf_derive, row->stats);
+    uvg_threadqueue_job_dep_add(row->filter, state->tqj_alf_derive);
+    uvg_threadqueue_job_dep_add(state->tqj_alf_process, row->filter);
+  }
+}
+
+/**
+ * \brief Create the PSNR, SSIM and hash jobs of a frame.
+ *
+ * Each LCU row has a job that calculates the metrics and the hash of the
+ * row as soon as its reconstruction is final, so that they are ready when
+ * the bitstream of the frame is written. The rows of an MD5 hash are added
+ * in order. When the jobs follow the rows, they wait for the ALF of the row
+ * or, without ALF, for the reconstruction of the row and the row below,
+ * which is added in encoder_state_encode_leaf. Otherwise they wait for the
+ * whole frame, which is added in uvg_encode_one_frame.
+ */
+static void encoder_state_create_stats_jobs(encoder_state_t * const state)
+{
+  const encoder_control_t *const encoder = state->encoder_control;
+  threadqueue_queue_t *const threadqueue = encoder->threadqueue;
+
+  uvg_encoder_state_free_stats_jobs(state);
+
+  const bool md5 = encoder_state_needs_hash(state) && encoder->cfg.hash == UVG_HASH_MD5;
+  if (!encoder->cfg.calc_psnr && !encoder->cfg.calc_ssim && !encoder_state_needs_hash(state)) {
+    return;
+  }
+
+  if (md5) {
+    for (int c = 0; c < 3; ++c) {
+      uvg_md5_init(&state->stats_md5[c]);
+    }
+  }
+
+  const int rows = state->tile->frame->height_in_lcu;
+  state->stats_rows = calloc(rows, sizeof(frame_stats_row_t));
+  state->stats_row_count = rows;
+  for (int i = 0; i < rows; ++i) {
+    frame_stats_row_t *const row = &state->stats_rows[i];
+    row->encoder_state = state;
+    row->lcu_row = i;
+    row->job = uvg_threadqueue_job_create(threadqueue, encoder_state_worker_frame_stats, row);
+    encoder_state_schedule_job(state, row->job, NULL);
+
+    if (md5 && i > 0) {
+      uvg_threadqueue_job_dep_add(row->job, state->stats_rows[i - 1].job);
+    }
+    if (encoder_state_stats_follow_rows(state) && encoder->cfg.alf_type) {
+      uvg_threadqueue_job_dep_add(row->job, state->alf_rows ? state->alf_rows[i].filter : state->tqj_alf_process);
+    }
+  }
+}
+
 void uvg_encode_one_frame(encoder_state_t * const state, uvg_picture* frame)
 {
 #if UVG_DEBUG_PRINT_CABAC == 1
@@ -1928,26 +2435,57 @@ void uvg_encode_one_frame(encoder_state_t * const state, uvg_picture* frame)
 
   encoder_state_init_new_frame(state, frame);
   if(state->encoder_control->cfg.jccr) set_joint_cb_cr_modes(state, frame);
+
+  state->frame->schedule_order = uvg_threadqueue_next_sequence(state->encoder_control->threadqueue);
   
   // Create a separate job for ALF done after everything else, and only then do final bitstream writing (for ALF parameters)
   if (state->encoder_control->cfg.alf_type && state->encoder_control->cfg.wpp) {
-    uvg_threadqueue_free_job(&state->tqj_alf_process);
-    encoder_state_t* child_state = state;
-    while (child_state->lcu_order == NULL) child_state = &child_state->children[0];
-    state->tqj_alf_process = uvg_threadqueue_job_create(uvg_alf_enc_process_job, child_state);
+    encoder_state_create_alf_jobs(state);
+  }
+  encoder_state_create_stats_jobs(state);
+
+  if (state->encoder_control->cfg.intra_frame_parallel) {
+    // All-intra frames do not depend on each other so each of them is
+    // encoded by a single job and as many frames as there are encoder
+    // states run in parallel.
+    assert(!state->tqj_recon_done);
+    state->tqj_recon_done = uvg_threadqueue_job_create(state->encoder_control->threadqueue, encoder_state_worker_encode_frame, state);
+    encoder_state_schedule_job(state, state->tqj_recon_done, NULL);
+    uvg_threadqueue_submit(state->encoder_control->threadqueue, state->tqj_recon_done);
+  } else {
+    encoder_state_encode(state);
   }
 
-  encoder_state_encode(state);
-
   threadqueue_job_t *job =
-    uvg_threadqueue_job_create(uvg_encoder_state_worker_write_bitstream, state);
+    uvg_threadqueue_job_create(state->encoder_control->threadqueue, uvg_encoder_state_worker_write_bitstream, state);
+  encoder_state_schedule_job(state, job, NULL);
 
 
   if (state->encoder_control->cfg.alf_type && state->encoder_control->cfg.wpp) {
-    uvg_threadqueue_submit(state->encoder_control->threadqueue, state->tqj_alf_process);    
+    threadqueue_queue_t *const threadqueue = state->encoder_control->threadqueue;
+    if (state->alf_rows) {
+      uvg_alf_enc_init(state->alf_rows[0].encoder_state);
+    }
+    for (int i = 0; i < state->alf_row_count; ++i) {
+      uvg_threadqueue_submit(threadqueue, state->alf_rows[i].pad);
+      uvg_threadqueue_submit(threadqueue, state->alf_rows[i].stats);
+      uvg_threadqueue_submit(threadqueue, state->alf_rows[i].filter);
+    }
+    if (state->tqj_alf_derive) {
+      uvg_threadqueue_submit(threadqueue, state->tqj_alf_derive);
+    }
+    uvg_threadqueue_submit(threadqueue, state->tqj_alf_process);
   }
 
   _encode_one_frame_add_bitstream_deps(state, job);
+  for (int i = 0; i < state->stats_row_count; ++i) {
+    threadqueue_job_t *const row_job = state->stats_rows[i].job;
+    if (!encoder_state_stats_follow_rows(state)) {
+      _encode_one_frame_add_bitstream_deps(state, row_job);
+    }
+    uvg_threadqueue_submit(state->encoder_control->threadqueue, row_job);
+    uvg_threadqueue_job_dep_add(job, row_job);
+  }
   if (state->previous_encoder_state != state && state->previous_encoder_state->tqj_bitstream_written) {
     //We need to depend on previous bitstream generation
     uvg_threadqueue_job_dep_add(job, state->previous_encoder_state->tqj_bitstream_written);
@@ -1963,8 +2501,9 @@ void uvg_encode_one_frame(encoder_state_t * const state, uvg_picture* frame)
  * Prepare the encoder state for encoding the next frame.
  *
  * - Add the previous reconstructed picture as a reference, if needed.
- * - Free the previous reconstructed and source pictures.
- * - Create a new cu array, if needed.
+ * - Free the previous source picture and cu array.
+ * - Free the previous reconstructed pictures or keep them for the next
+ *   frame if nothing else refers to them.
  * - Update frame count and POC.
  */
 void uvg_encoder_prepare(encoder_state_t *state)
@@ -1991,14 +2530,6 @@ void uvg_encoder_prepare(encoder_state_t *state)
   encoder_state_t *prev_state = state->previous_encoder_state;
 
   if (state->previous_encoder_state != state) {
-    uvg_cu_array_free(&state->tile->frame->cu_array);
-    if (state->tile->frame->chroma_cu_array) {
-      uvg_cu_array_free(&state->tile->frame->chroma_cu_array);
-    }
-    unsigned width  = state->tile->frame->width_in_lcu  * LCU_WIDTH;
-    unsigned height = state->tile->frame->height_in_lcu * LCU_WIDTH;
-    state->tile->frame->cu_array = uvg_cu_array_alloc(width, height);
-
     uvg_image_list_copy_contents(state->frame->ref, prev_state->frame->ref);
     uvg_encoder_create_ref_lists(state);
   }
@@ -2016,29 +2547,28 @@ void uvg_encoder_prepare(encoder_state_t *state)
                    prev_state->tile->frame->cu_array,
                    prev_state->frame->poc,
                    prev_state->frame->ref_LX);
-    uvg_cu_array_free(&state->tile->frame->cu_array);
-    if (state->tile->frame->chroma_cu_array) {
-      uvg_cu_array_free(&state->tile->frame->chroma_cu_array);
-    }
-    unsigned height = state->tile->frame->height_in_lcu * LCU_WIDTH;
-    unsigned width  = state->tile->frame->width_in_lcu  * LCU_WIDTH;
-    state->tile->frame->cu_array = uvg_cu_array_alloc(width, height);
   }
 
+  videoframe_t *const frame = state->tile->frame;
   if (state->encoder_control->cfg.lmcs_enable) {
-    uvg_image_free(state->tile->frame->source_lmcs);
-    state->tile->frame->source_lmcs = NULL;
-
-    uvg_image_free(state->tile->frame->rec_lmcs);
-    state->tile->frame->rec_lmcs = NULL;
+    encoder_state_release_picture(&frame->source_lmcs, &frame->spare.source_lmcs);
+    encoder_state_release_picture(&frame->rec_lmcs, &frame->spare.rec_lmcs);
   }
 
   // Remove source and reconstructed picture.
-  uvg_image_free(state->tile->frame->source);
-  state->tile->frame->source = NULL;
+  uvg_image_free(frame->source);
+  frame->source = NULL;
 
-  uvg_image_free(state->tile->frame->rec);
-  state->tile->frame->rec = NULL;
+  if (encoder->cfg.lossless) {
+    // The reconstruction is the source picture.
+    uvg_image_free(frame->rec);
+    frame->rec = NULL;
+  } else {
+    encoder_state_release_picture(&frame->rec, &frame->spare.rec);
+  }
+  // Without LMCS, these pointed to the source and reconstruction.
+  frame->source_lmcs = NULL;
+  frame->rec_lmcs = NULL;
 
   uvg_cu_array_free(&state->tile->frame->cu_array);
   if (state->tile->frame->chroma_cu_array) {
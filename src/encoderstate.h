@@ -42,6 +42,7 @@
 #include "cabac.h"
 #include "cu.h"
 #include "encoder.h"
+#include "extras/libmd5.h"
 #include "global.h" // IWYU pragma: keep
 #include "image.h"
 #include "imagelist.h"
@@ -135,7 +136,8 @@ typedef struct encoder_state_config_frame_t {
   //! Number of bits written in the current GOP.
   uint64_t cur_gop_bits_coded;
 
-  //! Number of bits written in the current frame.
+  //! Number of bits written in the current frame. Updated atomically by
+  //! the LCU jobs.
   uint64_t cur_frame_bits_coded;
 
   //! Number of bits targeted for the current GOP.
@@ -168,8 +170,6 @@ typedef struct encoder_state_config_frame_t {
    */
   lcu_stats_t *lcu_stats;
 
-  pthread_mutex_t rc_lock;
-
   struct uvg_rc_data *new_ratecontrol;
 
   struct encoder_state_t const *previous_layer_state;
@@ -179,6 +179,11 @@ typedef struct encoder_state_config_frame_t {
   */
   double *aq_offsets;
 
+  /**
+  * \brief Pixel variance of the frame used for the adaptive QP offsets.
+  */
+  double aq_frame_var;
+
   int8_t max_qp_delta_depth;
 
   /**
@@ -186,9 +191,28 @@ typedef struct encoder_state_config_frame_t {
    */
   bool first_nal;
   double icost;
+
+  /**
+   * \brief Weight of the LCUs not coded yet.
+   *
+   * Updated atomically by the LCU jobs.
+   */
   double remaining_weight;
+
+  /**
+   * \brief Intra bits left for the LCUs not coded yet.
+   *
+   * Updated atomically by the LCU jobs.
+   */
   double i_bits_left;
 
+  /**
+   * \brief Intra model parameters of the rate control taken at the start
+   * of the frame.
+   */
+  double intra_alpha;
+  double intra_beta;
+
   double *c_para;
   double *k_para;
 
@@ -197,6 +221,19 @@ typedef struct encoder_state_config_frame_t {
   uint8_t* hmvp_size; //!< \brief HMVP LUT size
   bool jccr_sign; 
 
+  //! \brief Preferred NUMA node for the jobs and buffers of the frame, or -1
+  int numa_node;
+
+  //! \brief Order of the frame among the frames of all encoders sharing the threadqueue
+  int64_t schedule_order;
+
+  //! \brief Whether the tile layout changed and a new PPS must be sent
+  bool new_tile_layout;
+
+  //! \brief Tile sizes of the frame with --adaptive-tiles, or NULL
+  int32_t *tile_col_width;
+  int32_t *tile_row_height;
+
 } encoder_state_config_frame_t;
 
 typedef struct encoder_state_config_tile_t {
@@ -238,6 +275,14 @@ typedef struct encoder_state_config_tile_t {
   //Jobs for each individual LCU of a wavefront row.
   threadqueue_job_t **wf_jobs;
   threadqueue_job_t **wf_recon_jobs;
+  //Jobs for the in-loop filtering that trails the search of each LCU.
+  threadqueue_job_t **wf_filter_jobs;
+
+  //Coefficient buffers of LCUs whose bitstream has been written. They are
+  //reused for the LCUs of the following frames encoded with this state.
+  pthread_mutex_t coeff_pool_lock;
+  lcu_coeff_t **coeff_pool;
+  int coeff_pool_count;
 
 } encoder_state_config_tile_t;
 
@@ -300,6 +345,30 @@ typedef struct lcu_order_element {
   struct lcu_order_element *right;
 } lcu_order_element_t;
 
+/**
+ * \brief ALF jobs of a row of LCUs.
+ */
+typedef struct alf_row_jobs_t {
+  struct encoder_state_t *encoder_state;
+  int lcu_row;
+  threadqueue_job_t *pad;    //Picture borders next to the row are padded
+  threadqueue_job_t *stats;  //Statistics of the row are collected
+  threadqueue_job_t *filter; //Row is filtered
+} alf_row_jobs_t;
+
+/**
+ * \brief Quality metrics and hash of the reconstruction of a row of LCUs.
+ */
+typedef struct frame_stats_row_t {
+  struct encoder_state_t *encoder_state;
+  int lcu_row;
+  threadqueue_job_t *job;  //Metrics and hash of the row are calculated
+  uint64_t sse[3];         //Sum of squared errors of each color
+  double ssim[3];          //Sum of the SSIM of the 8x8 blocks of each color
+  uint32_t ssim_blocks[3]; //Number of 8x8 blocks of each color
+  uint32_t checksum[3];    //Checksum of the row, when the checksum hash is used
+} frame_stats_row_t;
+
 typedef struct encoder_state_t {
   const encoder_control_t *encoder_control;
   encoder_state_type type;
@@ -358,6 +427,12 @@ typedef struct encoder_state_t {
   threadqueue_job_t * tqj_recon_done; //Reconstruction is done
   threadqueue_job_t * tqj_bitstream_written; //Bitstream is written
   threadqueue_job_t*  tqj_alf_process; //ALF processed for the slice
+  threadqueue_job_t*  tqj_alf_derive; //ALF filters derived for the slice
+  alf_row_jobs_t *alf_rows; //ALF jobs of each LCU row, NULL if ALF is done in one job
+  int alf_row_count;
+  frame_stats_row_t *stats_rows; //PSNR, SSIM and hash jobs of each LCU row, NULL if none are needed
+  int stats_row_count;
+  context_md5_t stats_md5[3]; //MD5 of the reconstruction, updated by the row jobs in order
 
   //Constraint structure  
   void * constraint;
@@ -369,6 +444,9 @@ void uvg_encode_one_frame(encoder_state_t * const state, uvg_picture* frame);
 
 void uvg_encoder_prepare(encoder_state_t *state);
 
+void uvg_encoder_state_free_alf_jobs(encoder_state_t *state);
+void uvg_encoder_state_free_stats_jobs(encoder_state_t *state);
+
 
 int uvg_encoder_state_match_children_of_previous_frame(encoder_state_t * const state);
 
@@ -355,7 +355,11 @@ static bool is_on_8x8_grid(int x, int y, edge_dir dir)
 static int8_t get_qp_y_pred(const encoder_state_t* state, int x, int y, edge_dir dir)
 {
   if (state->frame->max_qp_delta_depth < 0) {
-    return state->qp;
+    // The QP is constant within an LCU. The rightmost 8 pixels of horizontal
+    // edges are filtered along with the LCU on the right.
+    const videoframe_t *const frame = state->tile->frame;
+    const int lcu_x = dir == EDGE_HOR ? MIN(x + 8, frame->width - 1) : x;
+    return uvg_cu_array_at_const(frame->cu_array, lcu_x, y)->qp;
   }
 
   int32_t qp_p;
@@ -623,7 +627,7 @@ static INLINE void get_max_filter_length(uint8_t *filt_len_P, uint8_t *filt_len_
   const int x_mul = dir == EDGE_HOR ? 0 : 1;
   const int y_mul = dir == EDGE_HOR ? 1 : 0;
   const int pos = dir == EDGE_HOR ? y : x;
-  const int len = EDGE_HOR ? state->tile->frame->height : state->tile->frame->width;
+  const int len = dir == EDGE_HOR ? state->tile->frame->height : state->tile->frame->width;
   //const bool transform_edge = is_tu_boundary(state, x, y, dir);
   bool transform_edge_4x4[2] = { false, false };
   bool transform_edge_8x8[2] = { false, false };
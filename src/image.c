@@ -110,9 +110,180 @@ uvg_picture * uvg_image_alloc(enum uvg_chroma_format chroma_format, const int32_
   im->roi.width = 0;
   im->roi.height = 0;
 
+  im->pool = NULL;
+
+  return im;
+}
+
+/**
+ * \brief Pictures of one size kept for reuse.
+ *
+ * The pool holds a reference for its owner and one for every picture it
+ * has allocated, so that pictures still in use when the owner frees the
+ * pool can be returned to it.
+ */
+struct uvg_picture_pool {
+  pthread_mutex_t lock;
+
+  enum uvg_chroma_format chroma_format;
+  int32_t width;
+  int32_t height;
+
+  //! Pictures available for reuse.
+  uvg_picture **pictures;
+  int32_t num_pictures;
+  //! Size of pictures, at least the number of pictures allocated.
+  int32_t capacity;
+
+  //! Number of references to the pool.
+  int32_t refcount;
+  //! Whether the owner has freed the pool.
+  bool closed;
+};
+
+static void picture_pool_unref(uvg_picture_pool *const pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  const int32_t refcount = --pool->refcount;
+  pthread_mutex_unlock(&pool->lock);
+  if (refcount > 0) return;
+
+  pthread_mutex_destroy(&pool->lock);
+  FREE_POINTER(pool->pictures);
+  free(pool);
+}
+
+/**
+ * \brief Allocate a pool of pictures.
+ * \return pool pointer or NULL on failure
+ */
+uvg_picture_pool *uvg_picture_pool_alloc(enum uvg_chroma_format chroma_format,
+                                         const int32_t width,
+                                         const int32_t height)
+{
+  uvg_picture_pool *pool = calloc(1, sizeof(uvg_picture_pool));
+  if (!pool) return NULL;
+
+  if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+    free(pool);
+    return NULL;
+  }
+
+  pool->chroma_format = chroma_format;
+  pool->width = width;
+  pool->height = height;
+  pool->refcount = 1;
+
+  return pool;
+}
+
+/**
+ * \brief Free a pool of pictures.
+ *
+ * Free the pictures kept in the pool. Pictures still in use are freed
+ * when their last reference is freed.
+ *
+ * \param pool pool to free
+ */
+void uvg_picture_pool_free(uvg_picture_pool *const pool)
+{
+  if (pool == NULL) return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->closed = true;
+  uvg_picture **pictures = pool->pictures;
+  const int32_t num_pictures = pool->num_pictures;
+  pool->pictures = NULL;
+  pool->num_pictures = 0;
+  pool->capacity = 0;
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int32_t i = 0; i < num_pictures; ++i) {
+    pictures[i]->pool = NULL;
+    pictures[i]->refcount = 1;
+    uvg_image_free(pictures[i]);
+    picture_pool_unref(pool);
+  }
+  FREE_POINTER(pictures);
+
+  picture_pool_unref(pool);
+}
+
+/**
+ * \brief Take a picture from a pool.
+ *
+ * Return a picture kept in the pool or allocate a new one. The picture is
+ * returned to the pool when its last reference is freed with
+ * uvg_image_free.
+ *
+ * \param pool pool to take the picture from
+ * \return image pointer or NULL on failure
+ */
+uvg_picture *uvg_picture_pool_acquire(uvg_picture_pool *const pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  if (pool->num_pictures > 0) {
+    uvg_picture *im = pool->pictures[--pool->num_pictures];
+    pthread_mutex_unlock(&pool->lock);
+
+    im->refcount = 1;
+    im->pts = 0;
+    im->dts = 0;
+    im->interlacing = UVG_INTERLACING_NONE;
+    return im;
+  }
+
+  // Make room for returning every picture allocated by the pool so that
+  // returning a picture never has to allocate.
+  const int32_t num_allocated = pool->refcount;
+  if (num_allocated > pool->capacity) {
+    const int32_t capacity = MAX(2 * pool->capacity, 4);
+    uvg_picture **pictures = realloc(pool->pictures, capacity * sizeof(uvg_picture*));
+    if (!pictures) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    pool->pictures = pictures;
+    pool->capacity = capacity;
+  }
+  pool->refcount++;
+  pthread_mutex_unlock(&pool->lock);
+
+  uvg_picture *im = uvg_image_alloc(pool->chroma_format, pool->width, pool->height);
+  if (!im) {
+    picture_pool_unref(pool);
+    return NULL;
+  }
+  im->pool = pool;
   return im;
 }
 
+/**
+ * \brief Return a picture whose last reference was freed to its pool.
+ */
+static void picture_pool_return(uvg_picture *const im)
+{
+  uvg_picture_pool *const pool = im->pool;
+
+  if (im->roi.roi_array) FREE_POINTER(im->roi.roi_array);
+  im->roi.width = 0;
+  im->roi.height = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  if (!pool->closed) {
+    pool->pictures[pool->num_pictures++] = im;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  // The owner has freed the pool so free the picture instead.
+  im->pool = NULL;
+  im->refcount = 1;
+  uvg_image_free(im);
+  picture_pool_unref(pool);
+}
+
 /**
  * \brief Free an image.
  *
@@ -134,6 +305,10 @@ void uvg_image_free(uvg_picture *const im)
   if (im->base_image != im) {
     // Free our reference to the base image.
     uvg_image_free(im->base_image);
+  } else if (im->pool) {
+    // Keep the picture for reuse.
+    picture_pool_return(im);
+    return;
   } else {
     free(im->fulldata_buf);
     if (im->roi.roi_array) FREE_POINTER(im->roi.roi_array);
@@ -199,6 +374,8 @@ uvg_picture *uvg_image_make_subimage(uvg_picture *const orig_image,
 
   im->roi = orig_image->roi;
 
+  im->pool = NULL;
+
   return im;
 }
 
@@ -552,6 +729,51 @@ unsigned uvg_image_calc_satd(const uvg_picture *pic,
 }
 
 
+/**
+ * \brief Calculate the SSE and the SSIM of rows of a picture.
+ *
+ * The chroma rows are the ones covered by the luma rows. The SSIM is summed
+ * over 8x8 blocks within the rows, so that the sums of the row ranges of a
+ * picture add up to the sums of the whole picture.
+ *
+ * \param pic          original picture
+ * \param rec          reconstructed picture
+ * \param y_begin      first luma row
+ * \param y_end        luma row after the last row
+ * \param sse          returns the sum of squared errors of each color
+ * \param ssim         returns the sum of the SSIM of the blocks of each color,
+ *                     or NULL if SSIM is not needed
+ * \param ssim_blocks  returns the number of the blocks of each color
+ */
+void uvg_image_calc_quality_rows(const uvg_picture *pic,
+                                 const uvg_picture *rec,
+                                 int y_begin,
+                                 int y_end,
+                                 uint64_t sse[3],
+                                 double ssim[3],
+                                 uint32_t ssim_blocks[3])
+{
+  assert(pic->width == rec->width);
+  assert(pic->height == rec->height);
+
+  const int colors = pic->chroma_format == UVG_CSP_400 ? 1 : 3;
+
+  for (int c = 0; c < colors; ++c) {
+    const int shift = c == COLOR_Y ? 0 : 1;
+    const int width = pic->width >> shift;
+    const int height = (y_end >> shift) - (y_begin >> shift);
+    const uvg_pixel *const pic_data = &pic->data[c][(y_begin >> shift) * (pic->stride >> shift)];
+    const uvg_pixel *const rec_data = &rec->data[c][(y_begin >> shift) * (rec->stride >> shift)];
+
+    sse[c] = uvg_pixels_calc_ssd_rect(pic_data, rec_data, pic->stride >> shift, rec->stride >> shift, width, height);
+    if (ssim) {
+      ssim[c] = uvg_pixels_calc_ssim_rect(pic_data, rec_data, pic->stride >> shift, rec->stride >> shift, width, height);
+      ssim_blocks[c] = (width / 8) * (height / 8);
+    }
+  }
+}
+
+
 
 
 /**
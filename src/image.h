@@ -83,6 +83,12 @@ void uvg_image_free(uvg_picture *im);
 
 uvg_picture *uvg_image_copy_ref(uvg_picture *im);
 
+uvg_picture_pool *uvg_picture_pool_alloc(enum uvg_chroma_format chroma_format,
+                                         const int32_t width,
+                                         const int32_t height);
+void uvg_picture_pool_free(uvg_picture_pool *pool);
+uvg_picture *uvg_picture_pool_acquire(uvg_picture_pool *pool);
+
 uvg_picture *uvg_image_make_subimage(uvg_picture *const orig_image,
                              const unsigned x_offset,
                              const unsigned y_offset,
@@ -114,6 +120,14 @@ unsigned uvg_image_calc_satd(const uvg_picture *pic,
                              int block_width,
                              int block_height);
 
+void uvg_image_calc_quality_rows(const uvg_picture *pic,
+                                 const uvg_picture *rec,
+                                 int y_begin,
+                                 int y_end,
+                                 uint64_t sse[3],
+                                 double ssim[3],
+                                 uint32_t ssim_blocks[3]);
+
 
 void uvg_pixels_blit(const uvg_pixel* orig, uvg_pixel *dst,
                          unsigned width, unsigned height,
@@ -83,35 +83,49 @@ void uvg_nal_write(bitstream_t * const bitstream, const uint8_t nal_type,
 }
 
 /*!
- \brief Calculate checksums for all colors of the picture.
+ \brief Calculate checksums for rows of all colors of the picture.
+
+ The checksums of the row ranges of a picture add up to the checksums of
+ the whole picture.
+
  \param im The image that checksum is calculated for.
+ \param y_begin First luma row to include.
+ \param y_end Luma row after the last row to include.
  \param checksum_out Result of the calculation.
  \returns Void
 */
-void uvg_image_checksum(const uvg_picture *im, unsigned char checksum_out[][SEI_HASH_MAX_LENGTH], const uint8_t bitdepth)
+void uvg_image_checksum_rows(const uvg_picture *im, const int y_begin, const int y_end,
+                             uint32_t checksum_out[3], const uint8_t bitdepth)
 {
-  uvg_array_checksum(im->y, im->height, im->width, im->stride, checksum_out[0], bitdepth);
+  checksum_out[0] = uvg_array_checksum(im->y, y_begin, y_end, im->width, im->stride, bitdepth);
 
   /* The number of chroma pixels is half that of luma. */
   if (im->chroma_format != UVG_CSP_400) {
-    uvg_array_checksum(im->u, im->height >> 1, im->width >> 1, im->stride >> 1, checksum_out[1], bitdepth);
-    uvg_array_checksum(im->v, im->height >> 1, im->width >> 1, im->stride >> 1, checksum_out[2], bitdepth);
+    checksum_out[1] = uvg_array_checksum(im->u, y_begin >> 1, y_end >> 1, im->width >> 1, im->stride >> 1, bitdepth);
+    checksum_out[2] = uvg_array_checksum(im->v, y_begin >> 1, y_end >> 1, im->width >> 1, im->stride >> 1, bitdepth);
   }
 }
 
 /*!
-\brief Calculate md5 for all colors of the picture.
+\brief Add rows of all colors of the picture to md5 hashes.
+
+The rows of the picture must be added in order, starting from a context
+initialized with uvg_md5_init.
+
 \param im The image that md5 is calculated for.
-\param checksum_out Result of the calculation.
+\param y_begin First luma row to include.
+\param y_end Luma row after the last row to include.
+\param md5_ctx MD5 contexts of the colors.
 \returns Void
 */
-void uvg_image_md5(const uvg_picture *im, unsigned char checksum_out[][SEI_HASH_MAX_LENGTH], const uint8_t bitdepth)
+void uvg_image_md5_rows(const uvg_picture *im, const int y_begin, const int y_end,
+                        context_md5_t md5_ctx[3], const uint8_t bitdepth)
 {
-  uvg_array_md5(im->y, im->height, im->width, im->stride, checksum_out[0], bitdepth);
+  uvg_array_md5(&md5_ctx[0], im->y, y_begin, y_end, im->width, im->stride, bitdepth);
 
   /* The number of chroma pixels is half that of luma. */
   if (im->chroma_format != UVG_CSP_400) {
-    uvg_array_md5(im->u, im->height >> 1, im->width >> 1, im->stride >> 1, checksum_out[1], bitdepth);
-    uvg_array_md5(im->v, im->height >> 1, im->width >> 1, im->stride >> 1, checksum_out[2], bitdepth);
+    uvg_array_md5(&md5_ctx[1], im->u, y_begin >> 1, y_end >> 1, im->width >> 1, im->stride >> 1, bitdepth);
+    uvg_array_md5(&md5_ctx[2], im->v, y_begin >> 1, y_end >> 1, im->width >> 1, im->stride >> 1, bitdepth);
   }
 }
@@ -39,6 +39,7 @@
  */
 
 #include "bitstream.h"
+#include "extras/libmd5.h"
 #include "global.h" // IWYU pragma: keep
 #include "uvg266.h"
 
@@ -49,11 +50,10 @@
 // FUNCTIONS
 void uvg_nal_write(bitstream_t * const bitstream, const uint8_t nal_type,
                const uint8_t temporal_id, const int long_start_code);
-void uvg_image_checksum(const uvg_picture *im,
-                      unsigned char checksum_out[][SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
-void uvg_image_md5(const uvg_picture *im,
-                   unsigned char checksum_out[][SEI_HASH_MAX_LENGTH],
-                   const uint8_t bitdepth);
+void uvg_image_checksum_rows(const uvg_picture *im, int y_begin, int y_end,
+                             uint32_t checksum_out[3], const uint8_t bitdepth);
+void uvg_image_md5_rows(const uvg_picture *im, int y_begin, int y_end,
+                        context_md5_t md5_ctx[3], const uint8_t bitdepth);
 
 
 
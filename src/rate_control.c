@@ -33,24 +33,19 @@
 #include "rate_control.h"
 
 #include <math.h>
+#include <string.h>
 
 #include "encoder.h"
 #include "uvg266.h"
 #include "pthread.h"
+#include "threads.h"
 
 
 static const int MIN_SMOOTHING_WINDOW = 40;
-static int smoothing_window = 40;
 static const double MIN_LAMBDA    = 0.1;
 static const double MAX_LAMBDA    = 10000;
 #define BETA1 1.2517
 
-static uvg_rc_data *data;
-
-static FILE *dist_file;
-static FILE *bits_file;
-static FILE *qp_file;
-static FILE *lambda_file;
 
 /**
  * \brief Clip lambda value to a valid range.
@@ -60,10 +55,42 @@ static double clip_lambda(double lambda) {
   return CLIP(MIN_LAMBDA, MAX_LAMBDA, lambda);
 }
 
-uvg_rc_data * uvg_get_rc_data(const encoder_control_t * const encoder) {
-  if (data != NULL || encoder == NULL) return data;
+/**
+ * \brief Read a double shared by the LCU jobs of a frame.
+ */
+static double atomic_load_double(const double *ptr)
+{
+  const int64_t bits = UVG_ATOMIC_LOAD64(ptr);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * \brief Add to a double shared by the LCU jobs of a frame.
+ *
+ * \return the previous value
+ */
+static double atomic_add_double(double *ptr, double delta)
+{
+  int64_t old_bits, new_bits;
+  double old_value, new_value;
+  do {
+    old_bits = UVG_ATOMIC_LOAD64(ptr);
+    memcpy(&old_value, &old_bits, sizeof(old_value));
+    new_value = old_value + delta;
+    memcpy(&new_bits, &new_value, sizeof(new_bits));
+  } while (!UVG_ATOMIC_CAS64(ptr, old_bits, new_bits));
+  return old_value;
+}
 
-  data = calloc(1, sizeof(uvg_rc_data));
+/**
+ * \brief Allocate the rate control data of an encoder.
+ *
+ * \return the data, or NULL on failure
+ */
+uvg_rc_data * uvg_alloc_rc_data(const encoder_control_t * const encoder) {
+  uvg_rc_data *data = calloc(1, sizeof(uvg_rc_data));
 
   if (data == NULL) return NULL;
   if (pthread_mutex_init(&data->ck_frame_lock, NULL) != 0) return NULL;
@@ -104,21 +131,23 @@ uvg_rc_data * uvg_get_rc_data(const encoder_control_t * const encoder) {
 
   data->intra_alpha = 6.7542000000000000;
   data->intra_beta = 1.7860000000000000;
+
+  data->smoothing_window = MIN_SMOOTHING_WINDOW;
   if(encoder->cfg.stats_file_prefix) {
     char buff[128];
     sprintf(buff, "%sbits.txt", encoder->cfg.stats_file_prefix);
-    bits_file = fopen(buff, "w");
+    data->bits_file = fopen(buff, "w");
     sprintf(buff, "%sdist.txt", encoder->cfg.stats_file_prefix);
-    dist_file = fopen(buff, "w");
+    data->dist_file = fopen(buff, "w");
     sprintf(buff, "%sqp.txt", encoder->cfg.stats_file_prefix);
-    qp_file = fopen(buff, "w");
+    data->qp_file = fopen(buff, "w");
     sprintf(buff, "%slambda.txt", encoder->cfg.stats_file_prefix);
-    lambda_file = fopen(buff, "w");
+    data->lambda_file = fopen(buff, "w");
   }
   return data;
 }
 
-void uvg_free_rc_data() {
+void uvg_free_rc_data(uvg_rc_data *data) {
   if (data == NULL) return;
 
   pthread_mutex_destroy(&data->ck_frame_lock);
@@ -134,6 +163,10 @@ void uvg_free_rc_data() {
     if (data->c_para[i]) FREE_POINTER(data->c_para[i]);
     if (data->k_para[i]) FREE_POINTER(data->k_para[i]);
   }
+  if (data->dist_file) fclose(data->dist_file);
+  if (data->bits_file) fclose(data->bits_file);
+  if (data->qp_file) fclose(data->qp_file);
+  if (data->lambda_file) fclose(data->lambda_file);
   FREE_POINTER(data);
 }
 
@@ -172,6 +205,7 @@ static void update_parameters(uint32_t bits,
 static double gop_allocate_bits(encoder_state_t * const state)
 {
   const encoder_control_t * const encoder = state->encoder_control;
+  uvg_rc_data * const rc_data = state->frame->new_ratecontrol;
 
   // At this point, total_bits_coded of the current state contains the
   // number of bits written encoder->owf frames before the current frame.
@@ -189,16 +223,16 @@ static double gop_allocate_bits(encoder_state_t * const state)
     bits_coded -= state->frame->cur_gop_bits_coded;
   }
 
-  smoothing_window = MAX(MIN_SMOOTHING_WINDOW, smoothing_window - encoder->cfg.gop_len / 2);
+  rc_data->smoothing_window = MAX(MIN_SMOOTHING_WINDOW, rc_data->smoothing_window - encoder->cfg.gop_len / 2);
   double gop_target_bits = -1;
 
-  while( gop_target_bits < 0 && smoothing_window < 150) {
+  while( gop_target_bits < 0 && rc_data->smoothing_window < 150) {
     // Equation 12 from https://doi.org/10.1109/TIP.2014.2336550
     gop_target_bits =
-      (encoder->target_avg_bppic * (pictures_coded + smoothing_window) - bits_coded)
-      * MAX(1, encoder->cfg.gop_len) / smoothing_window;
+      (encoder->target_avg_bppic * (pictures_coded + rc_data->smoothing_window) - bits_coded)
+      * MAX(1, encoder->cfg.gop_len) / rc_data->smoothing_window;
     if(gop_target_bits < 0) {
-      smoothing_window += 10;
+      rc_data->smoothing_window += 10;
     }
   }
   // Allocate at least 200 bits for each GOP like HM does.
@@ -498,9 +532,10 @@ void uvg_estimate_pic_lambda(encoder_state_t * const state) {
   double alpha;
   double beta;
   if(state->frame->is_irap && encoder->cfg.intra_bit_allocation) {
+    // The LCUs of the frame use the same parameters.
     pthread_mutex_lock(&state->frame->new_ratecontrol->intra_lock);
-    alpha = state->frame->new_ratecontrol->intra_alpha;
-    beta = state->frame->new_ratecontrol->intra_beta;
+    alpha = state->frame->intra_alpha = state->frame->new_ratecontrol->intra_alpha;
+    beta = state->frame->intra_beta = state->frame->new_ratecontrol->intra_beta;
     pthread_mutex_unlock(&state->frame->new_ratecontrol->intra_lock);
   }
   else if(state->frame->poc == 0) {
@@ -610,13 +645,14 @@ static double get_ctu_bits(encoder_state_t * const state, vector2d_t pos) {
       int window = MIN(4, cus_left);
       double mad = uvg_get_lcu_stats(state, pos.x, pos.y)->i_cost;
 
-      pthread_mutex_lock(&state->frame->rc_lock);
-      double bits_left = state->frame->cur_pic_target_bits - state->frame->cur_frame_bits_coded;
-      double weighted_bits_left = (bits_left * window + (bits_left - state->frame->i_bits_left)*cus_left) / window;
-      avg_bits = (int32_t)(mad * weighted_bits_left / state->frame->remaining_weight);
-      state->frame->remaining_weight -= mad;
-      state->frame->i_bits_left -= state->frame->cur_pic_target_bits * mad / state->frame->icost;
-      pthread_mutex_unlock(&state->frame->rc_lock);
+      // The LCUs of a row are allocated in order, but other rows may take
+      // their share at the same time.
+      const double remaining_weight = atomic_add_double(&state->frame->remaining_weight, -mad);
+      const double i_bits_left = atomic_add_double(&state->frame->i_bits_left,
+                                                   -state->frame->cur_pic_target_bits * mad / state->frame->icost);
+      double bits_left = state->frame->cur_pic_target_bits - (uint64_t)UVG_ATOMIC_LOAD64(&state->frame->cur_frame_bits_coded);
+      double weighted_bits_left = (bits_left * window + (bits_left - i_bits_left)*cus_left) / window;
+      avg_bits = (int32_t)(mad * weighted_bits_left / remaining_weight);
     }
     else {
       avg_bits = (int32_t)(state->frame->cur_pic_target_bits * ((double)state->frame->lcu_stats[index].pixels /
@@ -638,10 +674,9 @@ static double get_ctu_bits(encoder_state_t * const state, vector2d_t pos) {
       target_bits += (int32_t)state->frame->lcu_stats[i].weight;
     }
 
-    pthread_mutex_lock(&state->frame->rc_lock);
-    total_weight = state->frame->remaining_weight;
-    target_bits = (int32_t)MAX(target_bits + state->frame->cur_pic_target_bits - state->frame->cur_frame_bits_coded - (int)total_weight, 10);
-    pthread_mutex_unlock(&state->frame->rc_lock);
+    total_weight = atomic_load_double(&state->frame->remaining_weight);
+    const uint64_t bits_coded = UVG_ATOMIC_LOAD64(&state->frame->cur_frame_bits_coded);
+    target_bits = (int32_t)MAX(target_bits + state->frame->cur_pic_target_bits - bits_coded - (int)total_weight, 10);
 
     //just similar with the process at frame level, details can refer to the function uvg_estimate_pic_lambda
     do {
@@ -703,10 +738,8 @@ static double qp_to_lambda(encoder_state_t* const state, int qp)
   double alpha;
   double beta;
   if (state->frame->is_irap && encoder->cfg.intra_bit_allocation) {
-    pthread_mutex_lock(&state->frame->new_ratecontrol->intra_lock);
-    alpha = state->frame->new_ratecontrol->intra_alpha;
-    beta = state->frame->new_ratecontrol->intra_beta;
-    pthread_mutex_unlock(&state->frame->new_ratecontrol->intra_lock);
+    alpha = state->frame->intra_alpha;
+    beta = state->frame->intra_beta;
   }
   else if(state->frame->num == 0) {
     alpha = state->frame->rc_alpha;
@@ -812,7 +845,7 @@ static double qp_to_lambda(encoder_state_t* const state, int qp)
       pos.x + state->tile->lcu_offset_x,
       pos.y + state->tile->lcu_offset_y
     };
-    int32_t id = lcu.x + lcu.y * state->tile->frame->width_in_lcu;
+    int32_t id = lcu.x + lcu.y * encoder->in.width_in_lcu;
     int32_t aq_offset = (int32_t)round(state->frame->aq_offsets[id]);
     state->qp += aq_offset;
     // Maximum delta QP is clipped according to ITU T-REC-H.265 specification chapter 7.4.9.10 Transform unit semantics
@@ -888,6 +921,31 @@ static void update_ck(encoder_state_t * const state, int ctu_index, int layer)
 }
 
 
+/**
+ * \brief Account the bits of a coded LCU to the frame.
+ *
+ * Called by the bitstream jobs of the LCUs, which may finish in any order.
+ * The totals of the frame are updated atomically and read by the LCUs
+ * allocating their bits.
+ *
+ * \param state the encoder state coding the LCU
+ * \param pos   location of the LCU as number of LCUs from top left
+ * \param bits  number of bits written for the LCU
+ */
+void uvg_update_after_lcu(encoder_state_t * const state, vector2d_t pos, uint32_t bits)
+{
+  lcu_stats_t *lcu = uvg_get_lcu_stats(state, pos.x, pos.y);
+
+  UVG_ATOMIC_ADD64(&state->frame->cur_frame_bits_coded, bits);
+  // This variable is used differently by intra and inter frames and shouldn't
+  // be touched in intra frames here
+  if (!state->frame->is_irap) {
+    atomic_add_double(&state->frame->remaining_weight, -lcu->original_weight);
+  }
+  lcu->bits = bits;
+}
+
+
 static int calc_poc(encoder_state_t * const state) {
   const encoder_control_t * const encoder = state->encoder_control;
   if((encoder->cfg.open_gop && !encoder->cfg.gop_lowdelay) || !encoder->cfg.intra_period) {
@@ -905,6 +963,7 @@ static int calc_poc(encoder_state_t * const state) {
 
 
 void uvg_update_after_picture(encoder_state_t * const state) {
+  uvg_rc_data * const rc_data = state->frame->new_ratecontrol;
   double total_distortion = 0;
   double lambda = 0;
   int32_t pixels = (state->encoder_control->in.width * state->encoder_control->in.height);
@@ -927,10 +986,10 @@ void uvg_update_after_picture(encoder_state_t * const state) {
 
   if (encoder->cfg.stats_file_prefix) {
     int poc = calc_poc(state);
-    fprintf(dist_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
-    fprintf(bits_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
-    fprintf(qp_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
-    fprintf(lambda_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
+    fprintf(rc_data->dist_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
+    fprintf(rc_data->bits_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
+    fprintf(rc_data->qp_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
+    fprintf(rc_data->lambda_file, "%d %d %d\n", poc, encoder->in.width_in_lcu, encoder->in.height_in_lcu);
   }
 
   for(int y_ctu = 0; y_ctu < state->encoder_control->in.height_in_lcu; y_ctu++) {
@@ -948,17 +1007,17 @@ void uvg_update_after_picture(encoder_state_t * const state) {
       total_distortion += (double)ctu_distortion / ctu->pixels;
       lambda += ctu->lambda / (state->encoder_control->in.width_in_lcu * state->encoder_control->in.height_in_lcu);
       if(encoder->cfg.stats_file_prefix) {
-        fprintf(dist_file, "%f ", ctu->distortion);
-        fprintf(bits_file, "%d ", ctu->bits);
-        fprintf(qp_file, "%d ", ctu->adjust_qp ? ctu->adjust_qp : ctu->qp);
-        fprintf(lambda_file, "%f ", ctu->adjust_lambda ? ctu->adjust_lambda : ctu->lambda);
+        fprintf(rc_data->dist_file, "%f ", ctu->distortion);
+        fprintf(rc_data->bits_file, "%d ", ctu->bits);
+        fprintf(rc_data->qp_file, "%d ", ctu->adjust_qp ? ctu->adjust_qp : ctu->qp);
+        fprintf(rc_data->lambda_file, "%f ", ctu->adjust_lambda ? ctu->adjust_lambda : ctu->lambda);
       }
     }
     if (encoder->cfg.stats_file_prefix) {
-      fprintf(dist_file, "\n");
-      fprintf(bits_file, "\n");
-      fprintf(qp_file, "\n");
-      fprintf(lambda_file, "\n");
+      fprintf(rc_data->dist_file, "\n");
+      fprintf(rc_data->bits_file, "\n");
+      fprintf(rc_data->qp_file, "\n");
+      fprintf(rc_data->lambda_file, "\n");
     }
   }
 
@@ -1162,7 +1221,7 @@ void uvg_set_lcu_lambda_and_qp(encoder_state_t * const state,
       pos.x + state->tile->lcu_offset_x,
       pos.y + state->tile->lcu_offset_y
     };
-    int32_t id = lcu_pos.x + lcu_pos.y * state->tile->frame->width_in_lcu;
+    int32_t id = lcu_pos.x + lcu_pos.y * ctrl->in.width_in_lcu;
     int32_t aq_offset = (int32_t)round(state->frame->aq_offsets[id]);
     state->qp += aq_offset;    
     // Maximum delta QP is clipped according to ITU T-REC-H.265 specification chapter 7.4.9.10 Transform unit semantics
@@ -62,10 +62,18 @@ typedef struct uvg_rc_data {
   pthread_mutex_t ck_frame_lock;
   pthread_mutex_t lambda_lock;
   pthread_mutex_t intra_lock;
+
+  int smoothing_window;
+
+  // Per-CTU statistics written with --stats-file-prefix, or NULL.
+  FILE *dist_file;
+  FILE *bits_file;
+  FILE *qp_file;
+  FILE *lambda_file;
 } uvg_rc_data;
 
-uvg_rc_data * uvg_get_rc_data(const encoder_control_t * const encoder);
-void uvg_free_rc_data();
+uvg_rc_data * uvg_alloc_rc_data(const encoder_control_t * const encoder);
+void uvg_free_rc_data(uvg_rc_data *data);
 
 void uvg_set_picture_lambda_and_qp(encoder_state_t * const state);
 
@@ -73,6 +81,7 @@ void uvg_set_lcu_lambda_and_qp(encoder_state_t * const state,
                                vector2d_t pos);
 
 void uvg_set_ctu_qp_lambda(encoder_state_t * const state, vector2d_t pos);
+void uvg_update_after_lcu(encoder_state_t * const state, vector2d_t pos, uint32_t bits);
 void uvg_update_after_picture(encoder_state_t * const state);
 void uvg_estimate_pic_lambda(encoder_state_t * const state);
 
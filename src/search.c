@@ -33,6 +33,7 @@
 #include "search.h"
 
 #include <limits.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "cabac.h"
@@ -46,6 +47,7 @@
 #include "search_inter.h"
 #include "search_intra.h"
 #include "threadqueue.h"
+#include "threads.h"
 #include "transform.h"
 #include "videoframe.h"
 #include "strategies/strategies-picture.h"
@@ -767,16 +769,246 @@ void uvg_sort_keys_by_cost(unit_stats_map_t *__restrict map)
 }
 
 
+static double search_cu(
+  encoder_state_t* const state,
+  int x,
+  int y,
+  int depth,
+  lcu_t* work_tree,
+  enum uvg_tree_type
+  tree_type);
+
+
+/**
+ * Search of the four sub-CUs of a CU in a job of its own.
+ *
+ * The job gets copies of the encoder state, the lower levels of the work
+ * tree and the HMVP table, so it can run while the unsplit CU is searched
+ * in the calling thread. The copies are taken in the state in which the
+ * split would be searched after the unsplit CU, so the result is the same
+ * as with a single thread.
+ */
+typedef struct split_search_t {
+  encoder_state_t state;
+  encoder_state_config_tile_t tile;
+  videoframe_t frame;
+  lcu_t work_tree[MAX_PU_DEPTH + 1];
+
+  int x;
+  int y;
+  int depth;
+  enum uvg_tree_type tree_type;
+
+  //! Cost of the split flag and all of the four sub-CUs.
+  double cost;
+
+  //! Incremented by the threads that try to run the search.
+  int32_t claimed;
+  //! Set when the result is not needed, to stop the search early.
+  int32_t cancelled;
+  //! References by the job and the thread that created it.
+  int32_t refcount;
+  bool done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  threadqueue_job_t *job;
+} split_search_t;
+
+
+static void split_search_release(split_search_t *split)
+{
+  if (UVG_ATOMIC_DEC(&split->refcount) == 0) {
+    FREE_POINTER(split->frame.hmvp_lut);
+    FREE_POINTER(split->frame.hmvp_size);
+    pthread_mutex_destroy(&split->lock);
+    pthread_cond_destroy(&split->cond);
+    free(split);
+  }
+}
+
+
+static void split_search_run(split_search_t *split)
+{
+  const int half_cu = LCU_WIDTH >> (split->depth + 1);
+  const int x = split->x;
+  const int y = split->y;
+  for (int i = 0; i < 4 && !UVG_ATOMIC_LOAD(&split->cancelled); ++i) {
+    split->cost += search_cu(&split->state,
+                             x + (i & 1) * half_cu,
+                             y + (i >> 1) * half_cu,
+                             split->depth + 1,
+                             split->work_tree,
+                             split->tree_type);
+  }
+}
+
+
+static void split_search_worker(void *opaque)
+{
+  split_search_t *split = opaque;
+  if (UVG_ATOMIC_INC(&split->claimed) == 1) {
+    split_search_run(split);
+    pthread_mutex_lock(&split->lock);
+    split->done = true;
+    pthread_cond_signal(&split->cond);
+    pthread_mutex_unlock(&split->lock);
+  }
+  split_search_release(split);
+}
+
+
+/**
+ * Start the search of the sub-CUs in a job.
+ *
+ * Must be called before the unsplit CU is searched, since the sub-CUs
+ * start from the same CABAC state and lower levels of the work tree.
+ *
+ * \return the search, or NULL if it could not be started
+ */
+static split_search_t *split_search_start(encoder_state_t *const state,
+                                          int x, int y, int depth,
+                                          lcu_t *work_tree,
+                                          enum uvg_tree_type tree_type)
+{
+  split_search_t *split = malloc(sizeof(split_search_t));
+  if (!split) return NULL;
+
+  const videoframe_t *const frame = state->tile->frame;
+  const int ctu_row = y >> LOG2_LCU_WIDTH;
+
+  // The jobs of the state are set by the thread creating them while the
+  // LCUs are searched. The search does not need them.
+  const size_t jobs_begin = offsetof(encoder_state_t, tqj_recon_done);
+  const size_t jobs_end = offsetof(encoder_state_t, constraint);
+  memcpy(&split->state, state, jobs_begin);
+  memset((char *)&split->state + jobs_begin, 0, jobs_end - jobs_begin);
+  memcpy((char *)&split->state + jobs_end, (const char *)state + jobs_end,
+         sizeof(encoder_state_t) - jobs_end);
+  // The coefficient buffer pool of the tile is used by other threads. The
+  // search does not need it.
+  const size_t pool_begin = offsetof(encoder_state_config_tile_t, coeff_pool_lock);
+  memcpy(&split->tile, state->tile, pool_begin);
+  memset((char *)&split->tile + pool_begin, 0, sizeof(encoder_state_config_tile_t) - pool_begin);
+  split->frame = *frame;
+  split->state.tile = &split->tile;
+  split->tile.frame = &split->frame;
+
+  // The sub-CUs add their motion to the HMVP table while the unsplit CU
+  // reads it.
+  split->frame.hmvp_lut = MALLOC(cu_info_t, (ctu_row + 1) * MAX_NUM_HMVP_CANDS);
+  split->frame.hmvp_size = MALLOC(uint8_t, ctu_row + 1);
+  if (!split->frame.hmvp_lut || !split->frame.hmvp_size) {
+    FREE_POINTER(split->frame.hmvp_lut);
+    FREE_POINTER(split->frame.hmvp_size);
+    free(split);
+    return NULL;
+  }
+  memcpy(&split->frame.hmvp_lut[ctu_row * MAX_NUM_HMVP_CANDS],
+         &frame->hmvp_lut[ctu_row * MAX_NUM_HMVP_CANDS],
+         sizeof(cu_info_t) * MAX_NUM_HMVP_CANDS);
+  split->frame.hmvp_size[ctu_row] = frame->hmvp_size[ctu_row];
+
+  for (int d = depth + 1; d <= MAX_PU_DEPTH; ++d) {
+    split->work_tree[d] = work_tree[d];
+  }
+
+  const int x_local = SUB_SCU(x);
+  const int y_local = SUB_SCU(y);
+  const lcu_t *const lcu = &work_tree[depth];
+  double split_bits = 0;
+  split->state.search_cabac.update = 1;
+  uvg_write_split_flag(
+    &split->state,
+    &split->state.search_cabac,
+    x ? LCU_GET_CU_AT_PX(lcu, x_local - 1, y_local) : NULL,
+    y ? LCU_GET_CU_AT_PX(lcu, x_local, y_local - 1) : NULL,
+    1,
+    depth,
+    LCU_WIDTH >> depth,
+    x,
+    y,
+    tree_type,
+    &split_bits);
+  split->state.search_cabac.update = 0;
+
+  split->x = x;
+  split->y = y;
+  split->depth = depth;
+  split->tree_type = tree_type;
+  split->cost = 0.0;
+  split->cost += split_bits * state->lambda;
+  split->claimed = 0;
+  split->cancelled = 0;
+  split->refcount = 2;
+  split->done = false;
+  pthread_mutex_init(&split->lock, NULL);
+  pthread_cond_init(&split->cond, NULL);
+
+  threadqueue_queue_t *const threadqueue = state->encoder_control->threadqueue;
+  split->job = uvg_threadqueue_job_create(threadqueue, split_search_worker, split);
+  // The calling thread blocks on the search if it has been started by
+  // another thread, so run it before anything else.
+  uvg_threadqueue_job_set_priority(split->job, INT64_MAX);
+  uvg_threadqueue_job_set_node(split->job, state->frame->numa_node);
+  uvg_threadqueue_submit(threadqueue, split->job);
+
+  return split;
+}
+
+
 /**
- * Search every mode from 0 to MAX_PU_DEPTH and return cost of best mode.
- * - The recursion is started at depth 0 and goes in Z-order to MAX_PU_DEPTH.
- * - Data structure work_tree is maintained such that the neighbouring SCUs
- *   and pixels to the left and up of current CU are the final CUs decided
- *   via the search. This is done by copying the relevant data to all
- *   relevant levels whenever a decision is made whether to split or not.
- * - All the final data for the LCU gets eventually copied to depth 0, which
- *   will be the final output of the recursion.
+ * Finish the search of the sub-CUs and free it.
+ *
+ * If the sub-CUs are used, the results are taken as if they had been
+ * searched in the calling thread. The search is run here if no other
+ * thread has started it yet. Otherwise the calling thread waits for it.
+ *
+ * \param use  whether the sub-CUs would have been searched at this point
+ * \return cost of the split flag and the sub-CUs
  */
+static double split_search_finish(split_search_t *split,
+                                  encoder_state_t *const state,
+                                  lcu_t *work_tree,
+                                  bool use)
+{
+  if (!use) {
+    UVG_ATOMIC_STORE(&split->cancelled, 1);
+  }
+
+  if (UVG_ATOMIC_INC(&split->claimed) == 1) {
+    if (use) split_search_run(split);
+  } else {
+    pthread_mutex_lock(&split->lock);
+    while (!split->done) {
+      pthread_cond_wait(&split->cond, &split->lock);
+    }
+    pthread_mutex_unlock(&split->lock);
+  }
+
+  const double cost = split->cost;
+
+  if (use) {
+    const int ctu_row = split->y >> LOG2_LCU_WIDTH;
+    videoframe_t *const frame = state->tile->frame;
+
+    memcpy(&state->search_cabac, &split->state.search_cabac, sizeof(state->search_cabac));
+    state->must_code_qp_delta |= split->state.must_code_qp_delta;
+    memcpy(&frame->hmvp_lut[ctu_row * MAX_NUM_HMVP_CANDS],
+           &split->frame.hmvp_lut[ctu_row * MAX_NUM_HMVP_CANDS],
+           sizeof(cu_info_t) * MAX_NUM_HMVP_CANDS);
+    frame->hmvp_size[ctu_row] = split->frame.hmvp_size[ctu_row];
+    for (int d = split->depth + 1; d <= MAX_PU_DEPTH; ++d) {
+      work_tree[d] = split->work_tree[d];
+    }
+  }
+
+  uvg_threadqueue_free_job(&split->job);
+  split_search_release(split);
+
+  return cost;
+}
+
+
 static double search_cu(
   encoder_state_t* const state,
   int x,
@@ -861,6 +1093,26 @@ static double search_cu(
   cur_cu->lfnst_idx = 0;
   cur_cu->joint_cb_cr = 0;
 
+  const bool split_allowed =
+    (depth < pu_depth_intra.max && !(state->encoder_control->cfg.force_inter&& state->frame->slicetype != UVG_SLICE_I)) ||
+    (state->frame->slicetype != UVG_SLICE_I &&
+      depth < pu_depth_inter.max);
+
+  // Search the split in another thread while the unsplit CU is searched.
+  // CCLM would need a copy of the downsampled luma of the whole frame.
+  split_search_t *split_search = NULL;
+  if (depth < ctrl->cfg.parallel_cu_search &&
+      depth < MAX_DEPTH &&
+      ctrl->cfg.threads > 0 &&
+      tree_type == UVG_BOTH_T &&
+      !ctrl->cfg.cclm &&
+      !ctrl->cabac_debug_file &&
+      split_allowed &&
+      x + luma_width <= frame_width && y + luma_width <= frame_height)
+  {
+    split_search = split_search_start(state, x, y, depth, work_tree, tree_type);
+  }
+
   // If the CU is completely inside the frame at this depth, search for
   // prediction modes at this depth.
   if ( x + luma_width <= frame_width && y + luma_width <= frame_height)
@@ -1135,10 +1387,7 @@ static double search_cu(
   bool can_split_cu =
     // If the CU is partially outside the frame, we need to split it even
     // if pu_depth_intra and pu_depth_inter would not permit it.
-    cur_cu->type == CU_NOTSET ||
-    (depth < pu_depth_intra.max && !(state->encoder_control->cfg.force_inter&& state->frame->slicetype != UVG_SLICE_I)) ||
-    (state->frame->slicetype != UVG_SLICE_I &&
-      depth < pu_depth_inter.max);
+    cur_cu->type == CU_NOTSET || split_allowed;
 
   if(state->encoder_control->cabac_debug_file) {
     fprintf(state->encoder_control->cabac_debug_file, "S %4d %4d %d %d", x, y, depth, tree_type);
@@ -1200,7 +1449,20 @@ static double search_cu(
     // might not give any better results but takes more time to do.
     // It is ok to interrupt the search as soon as it is known that
     // the split costs at least as much as not splitting.
-    if (cur_cu->type == CU_NOTSET || cbf || state->encoder_control->cfg.cu_split_termination == UVG_CU_SPLIT_TERMINATION_OFF) {
+    const bool search_split = cur_cu->type == CU_NOTSET || cbf || state->encoder_control->cfg.cu_split_termination == UVG_CU_SPLIT_TERMINATION_OFF;
+    if (split_search) {
+      // The sub-CUs searched in the other thread are used only if they
+      // would have been searched here. The other thread does not stop
+      // when the split gets more expensive than the unsplit CU, but the
+      // costs are not negative so the decision is the same.
+      const bool use_split = search_split && split_cost < cost;
+      const double sub_cost = split_search_finish(split_search, state, work_tree, use_split);
+      if (use_split) {
+        split_cost = sub_cost;
+      } else if (!search_split) {
+        split_cost = INT_MAX;
+      }
+    } else if (search_split) {
       if (split_cost < cost) split_cost += search_cu(state, x,           y,           depth + 1, work_tree, tree_type);
       if (split_cost < cost) split_cost += search_cu(state, x + half_cu, y,           depth + 1, work_tree, tree_type);
       if (split_cost < cost) split_cost += search_cu(state, x,           y + half_cu, depth + 1, work_tree, tree_type);
@@ -1493,7 +1755,9 @@ void uvg_search_lcu(encoder_state_t * const state, const int x, const int y, con
   // Initialize the same starting state to every depth. The search process
   // will use these as temporary storage for predictions before making
   // a decision on which to use, and they get updated during the search
-  // process.
+  // process. Each depth is a full copy, because the search reads the
+  // neighbouring CUs, reconstruction and coefficients directly from the
+  // lcu_t of its own depth.
   lcu_t work_tree[MAX_PU_DEPTH + 1];
   init_lcu_t(state, x, y, &work_tree[0], hor_buf, ver_buf);
   for (int depth = 1; depth <= MAX_PU_DEPTH; ++depth) {
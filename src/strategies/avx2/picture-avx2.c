@@ -789,6 +789,86 @@ static unsigned pixels_calc_ssd_avx2(const uint8_t *const ref, const uint8_t *co
   }
 }
 
+static uint64_t pixels_calc_ssd_rect_avx2(const uint8_t *const ref, const uint8_t *const rec,
+                                          const int ref_stride, const int rec_stride,
+                                          const int width, const int height)
+{
+  uint64_t ssd = 0;
+
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *const ref_row = &ref[y * ref_stride];
+    const uint8_t *const rec_row = &rec[y * rec_stride];
+
+    // A lane gains at most 2 * 255^2 per 16 samples, so the 32-bit sums
+    // of a row do not overflow.
+    __m256i ssd_part = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+      const __m256i ref_epi16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)&ref_row[x]));
+      const __m256i rec_epi16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)&rec_row[x]));
+      const __m256i diff = _mm256_sub_epi16(ref_epi16, rec_epi16);
+      ssd_part = _mm256_add_epi32(ssd_part, _mm256_madd_epi16(diff, diff));
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(ssd_part), _mm256_extracti128_si256(ssd_part, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(0, 1, 0, 1)));
+    uint32_t row_ssd = _mm_cvtsi128_si32(sum);
+
+    for (; x < width; ++x) {
+      const int diff = ref_row[x] - rec_row[x];
+      row_ssd += diff * diff;
+    }
+    ssd += row_ssd;
+  }
+
+  return ssd;
+}
+
+static double pixels_calc_ssim_rect_avx2(const uint8_t *const ref, const uint8_t *const rec,
+                                         const int ref_stride, const int rec_stride,
+                                         const int width, const int height)
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+  double ssim = 0.0;
+
+  for (int y = 0; y + 8 <= height; y += 8) {
+    for (int x = 0; x + 8 <= width; x += 8) {
+      __m256i sum1 = _mm256_setzero_si256();
+      __m256i sum2 = _mm256_setzero_si256();
+      __m256i sum_sq = _mm256_setzero_si256();
+      __m256i sum12 = _mm256_setzero_si256();
+
+      // Two rows of the block at a time.
+      for (int i = 0; i < 8; i += 2) {
+        const uint8_t *const ref_row = &ref[x + (y + i) * ref_stride];
+        const uint8_t *const rec_row = &rec[x + (y + i) * rec_stride];
+        const __m256i a = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)ref_row),
+                                                                  _mm_loadl_epi64((const __m128i *)(ref_row + ref_stride))));
+        const __m256i b = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)rec_row),
+                                                                  _mm_loadl_epi64((const __m128i *)(rec_row + rec_stride))));
+        sum1 = _mm256_add_epi16(sum1, a);
+        sum2 = _mm256_add_epi16(sum2, b);
+        sum_sq = _mm256_add_epi32(sum_sq, _mm256_add_epi32(_mm256_madd_epi16(a, a), _mm256_madd_epi16(b, b)));
+        sum12 = _mm256_add_epi32(sum12, _mm256_madd_epi16(a, b));
+      }
+
+      // Reduce the four sums to the four lanes of one register.
+      const __m256i sums = _mm256_hadd_epi32(
+        _mm256_hadd_epi32(_mm256_madd_epi16(sum1, ones), _mm256_madd_epi16(sum2, ones)),
+        _mm256_hadd_epi32(sum_sq, sum12));
+      const __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+
+      ssim += uvg_ssim_8x8_from_sums(_mm_cvtsi128_si32(sum),
+                                     _mm_extract_epi32(sum, 1),
+                                     _mm_extract_epi32(sum, 2),
+                                     _mm_extract_epi32(sum, 3));
+    }
+  }
+
+  return ssim;
+}
+
 static INLINE void scatter_ymm_4x8_8bit(uvg_pixel * dst, __m256i ymm, unsigned dst_stride)
 {
   __m128i ymm_lo = _mm256_castsi256_si128(ymm);
@@ -1824,6 +1904,8 @@ int uvg_strategy_register_picture_avx2(void* opaque, uint8_t bitdepth)
     success &= uvg_strategyselector_register(opaque, "satd_any_size_quad", "avx2", 40, &satd_any_size_quad_avx2);
 
     success &= uvg_strategyselector_register(opaque, "pixels_calc_ssd", "avx2", 40, &pixels_calc_ssd_avx2);
+    success &= uvg_strategyselector_register(opaque, "pixels_calc_ssd_rect", "avx2", 40, &pixels_calc_ssd_rect_avx2);
+    success &= uvg_strategyselector_register(opaque, "pixels_calc_ssim_rect", "avx2", 40, &pixels_calc_ssim_rect_avx2);
     success &= uvg_strategyselector_register(opaque, "bipred_average", "avx2", 40, &bipred_average_avx2);
     success &= uvg_strategyselector_register(opaque, "get_optimized_sad", "avx2", 40, &get_optimized_sad_avx2);
     success &= uvg_strategyselector_register(opaque, "ver_sad", "avx2", 40, &ver_sad_avx2);
@@ -38,43 +38,35 @@
 #include "strategyselector.h"
 
 
-static void array_md5_generic(const uvg_pixel* data,
-                              const int height, const int width,
-                              const int stride,
-                              unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth)
+static void array_md5_generic(context_md5_t *md5_ctx,
+                              const uvg_pixel* data,
+                              const int y_begin, const int y_end,
+                              const int width, const int stride,
+                              const uint8_t bitdepth)
 {
-  assert(SEI_HASH_MAX_LENGTH >= 16);
-
-  context_md5_t md5_ctx;
-  uvg_md5_init(&md5_ctx);
-  
   uint32_t N = 32;
   uint32_t width_modN = width % N;
   uint32_t width_less_modN = width - width_modN;
 
-  for (uint32_t y = 0; y < (uint32_t)height; y++)
+  for (uint32_t y = y_begin; y < (uint32_t)y_end; y++)
   {
     for (uint32_t x = 0; x < width_less_modN; x += N)
     {      
-      uvg_md5_update(&md5_ctx, (const unsigned char*)&data[y * stride + x], N);
+      uvg_md5_update(md5_ctx, (const unsigned char*)&data[y * stride + x], N);
     }
     /* mop up any of the remaining line */
-    uvg_md5_update(&md5_ctx, (const unsigned char*)&data[y * stride + width_less_modN], width_modN);
+    uvg_md5_update(md5_ctx, (const unsigned char*)&data[y * stride + width_less_modN], width_modN);
   }
-
-  uvg_md5_final(checksum_out, &md5_ctx);
 }
 
-static void array_checksum_generic(const uvg_pixel* data,
-                                   const int height, const int width,
-                                   const int stride,
-                                   unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth) {
+static uint32_t array_checksum_generic(const uvg_pixel* data,
+                                       const int y_begin, const int y_end,
+                                       const int width, const int stride,
+                                       const uint8_t bitdepth) {
   int x, y;
-  int checksum = 0;
-  
-  assert(SEI_HASH_MAX_LENGTH >= 4);
+  uint32_t checksum = 0;
   
-  for (y = 0; y < height; ++y) {
+  for (y = y_begin; y < y_end; ++y) {
     for (x = 0; x < width; ++x) {
       const uint8_t mask = (uint8_t)((x & 0xff) ^ (y & 0xff) ^ (x >> 8) ^ (y >> 8));
       checksum += (data[(y * stride) + x] & 0xff) ^ mask;
@@ -84,45 +76,27 @@ static void array_checksum_generic(const uvg_pixel* data,
     }
   }
 
-  // Unpack uint into byte-array.
-  checksum_out[0] = (checksum >> 24) & 0xff;
-  checksum_out[1] = (checksum >> 16) & 0xff;
-  checksum_out[2] = (checksum >> 8) & 0xff;
-  checksum_out[3] = (checksum) & 0xff;
+  return checksum;
 }
 
-static void array_checksum_generic4(const uvg_pixel* data,
-                                   const int height, const int width,
-                                   const int stride,
-                                   unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth) {
+static uint32_t array_checksum_generic4(const uvg_pixel* data,
+                                        const int y_begin, const int y_end,
+                                        const int width, const int stride,
+                                        const uint8_t bitdepth) {
   uint32_t checksum = 0;
   int y, x, xp;
-  
-  static uint8_t ckmap_initialized = 0;
-  static uint32_t ckmap[64*256];
 
   //TODO: add 10-bit support
   if(bitdepth != 8) {
-    array_checksum_generic(data, height, width, stride,checksum_out, bitdepth);
-    return;
+    return array_checksum_generic(data, y_begin, y_end, width, stride, bitdepth);
   }
-  if (!ckmap_initialized) {
-    uint8_t * const ckmap_uint8 = (uint8_t*)&ckmap;
-    int x, y;
-    for (y = 0; y < 256; ++y) {
-      for (x = 0; x < 256; ++x) {
-        ckmap_uint8[y*256+x] = x^y;
-      }
-    }
-    ckmap_initialized = 1;
-  }
-
-  assert(SEI_HASH_MAX_LENGTH >= 4);
 
-  for (y = 0; y < height; ++y) {
+  for (y = y_begin; y < y_end; ++y) {
     for (xp = 0; xp < width/4; ++xp) {
       const int x = xp * 4;
-      const uint32_t mask = ckmap[(xp&63)+64*(y&255)] ^ (((x >> 8) ^ (y >> 8)) * 0x1010101);
+      // x is a multiple of four, so the low bits of the masks are the
+      // offsets of the bytes.
+      const uint32_t mask = (((x ^ y ^ (x >> 8) ^ (y >> 8)) & 0xff) * 0x1010101) ^ 0x3020100;
       const uint32_t cksumbytes = (*((uint32_t*)(&data[(y * stride) + x]))) ^ mask;
       checksum += ((cksumbytes >> 24) & 0xff) + ((cksumbytes >> 16) & 0xff) + ((cksumbytes >> 8) & 0xff) + (cksumbytes & 0xff);
     }
@@ -132,45 +106,27 @@ static void array_checksum_generic4(const uvg_pixel* data,
     }
   }
 
-  // Unpack uint into byte-array.
-  checksum_out[0] = (checksum >> 24) & 0xff;
-  checksum_out[1] = (checksum >> 16) & 0xff;
-  checksum_out[2] = (checksum >> 8) & 0xff;
-  checksum_out[3] = (checksum) & 0xff;
+  return checksum;
 }
 
-static void array_checksum_generic8(const uvg_pixel* data,
-                                   const int height, const int width,
-                                   const int stride,
-                                   unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth) {
+static uint32_t array_checksum_generic8(const uvg_pixel* data,
+                                        const int y_begin, const int y_end,
+                                        const int width, const int stride,
+                                        const uint8_t bitdepth) {
   uint32_t checksum = 0;
   int y, x, xp;
   
-  static uint8_t ckmap_initialized = 0;
-  static uint64_t ckmap[32*256];
-  
   //TODO: add 10-bit support
   if(bitdepth != 8) {
-    array_checksum_generic(data, height, width, stride,checksum_out, bitdepth);
-    return;
+    return array_checksum_generic(data, y_begin, y_end, width, stride, bitdepth);
   }
-  if (!ckmap_initialized) {
-    uint8_t * const ckmap_uint8 = (uint8_t*)&ckmap;
-    int x, y;
-    for (y = 0; y < 256; ++y) {
-      for (x = 0; x < 256; ++x) {
-        ckmap_uint8[y*256+x] = x^y;
-      }
-    }
-    ckmap_initialized = 1;
-  }
-
-  assert(SEI_HASH_MAX_LENGTH >= 4);
 
-  for (y = 0; y < height; ++y) {
+  for (y = y_begin; y < y_end; ++y) {
     for (xp = 0; xp < width/8; ++xp) {
       const int x = xp * 8;
-      const uint64_t mask = ckmap[(xp&31)+32*(y&255)] ^ ((uint64_t)((x >> 8) ^ (y >> 8)) * 0x101010101010101);
+      // x is a multiple of eight, so the low bits of the masks are the
+      // offsets of the bytes.
+      const uint64_t mask = ((uint64_t)((x ^ y ^ (x >> 8) ^ (y >> 8)) & 0xff) * 0x101010101010101) ^ 0x706050403020100;
       const uint64_t cksumbytes = (*((uint64_t*)(&data[(y * stride) + x]))) ^ mask;
       checksum += ((cksumbytes >> 56) & 0xff) + ((cksumbytes >> 48) & 0xff) + ((cksumbytes >> 40) & 0xff) + ((cksumbytes >> 32) & 0xff) + ((cksumbytes >> 24) & 0xff) + ((cksumbytes >> 16) & 0xff) + ((cksumbytes >> 8) & 0xff) + (cksumbytes & 0xff);
     }
@@ -180,11 +136,7 @@ static void array_checksum_generic8(const uvg_pixel* data,
     }
   }
 
-  // Unpack uint into byte-array.
-  checksum_out[0] = (checksum >> 24) & 0xff;
-  checksum_out[1] = (checksum >> 16) & 0xff;
-  checksum_out[2] = (checksum >> 8) & 0xff;
-  checksum_out[3] = (checksum) & 0xff;
+  return checksum;
 }
 
 int uvg_strategy_register_nal_generic(void* opaque, uint8_t bitdepth) {
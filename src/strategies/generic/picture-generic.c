@@ -554,6 +554,80 @@ static unsigned pixels_calc_ssd_generic(const uvg_pixel *const ref, const uvg_pi
   return ssd >> (2*(UVG_BIT_DEPTH-8));
 }
 
+/**
+ * \brief Calculate the sum of squared differences of a rectangle.
+ *
+ * Unlike pixels_calc_ssd, the result is not scaled to 8-bit precision.
+ */
+static uint64_t pixels_calc_ssd_rect_generic(const uvg_pixel *const ref, const uvg_pixel *const rec,
+                                             const int ref_stride, const int rec_stride,
+                                             const int width, const int height)
+{
+  uint64_t ssd = 0;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const int diff = ref[x + y * ref_stride] - rec[x + y * rec_stride];
+      ssd += diff * diff;
+    }
+  }
+
+  return ssd;
+}
+
+/**
+ * \brief Calculate the SSIM of an 8x8 block from the sums of its samples.
+ *
+ * \param s1   sum of the samples of the first block
+ * \param s2   sum of the samples of the second block
+ * \param ss   sum of the squared samples of both blocks
+ * \param s12  sum of the products of the samples of the blocks
+ */
+double uvg_ssim_8x8_from_sums(int32_t s1, int32_t s2, int32_t ss, int32_t s12)
+{
+  const double c1 = (0.01 * PIXEL_MAX) * (0.01 * PIXEL_MAX);
+  const double c2 = (0.03 * PIXEL_MAX) * (0.03 * PIXEL_MAX);
+  const double mean1 = s1 / 64.0;
+  const double mean2 = s2 / 64.0;
+  const double var_sum = ss / 64.0 - mean1 * mean1 - mean2 * mean2;
+  const double covar = s12 / 64.0 - mean1 * mean2;
+
+  return (2.0 * mean1 * mean2 + c1) * (2.0 * covar + c2) /
+         ((mean1 * mean1 + mean2 * mean2 + c1) * (var_sum + c2));
+}
+
+/**
+ * \brief Calculate the sum of the SSIM of the 8x8 blocks of a rectangle.
+ *
+ * Blocks do not overlap. Columns and rows that do not fill a whole block
+ * are left out.
+ */
+static double pixels_calc_ssim_rect_generic(const uvg_pixel *const ref, const uvg_pixel *const rec,
+                                            const int ref_stride, const int rec_stride,
+                                            const int width, const int height)
+{
+  double ssim = 0.0;
+
+  for (int y = 0; y + 8 <= height; y += 8) {
+    for (int x = 0; x + 8 <= width; x += 8) {
+      int32_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+      for (int j = 0; j < 8; ++j) {
+        for (int i = 0; i < 8; ++i) {
+          const int32_t a = ref[x + i + (y + j) * ref_stride];
+          const int32_t b = rec[x + i + (y + j) * rec_stride];
+          s1 += a;
+          s2 += b;
+          ss += a * a + b * b;
+          s12 += a * b;
+        }
+      }
+      ssim += uvg_ssim_8x8_from_sums(s1, s2, ss, s12);
+    }
+  }
+
+  return ssim;
+}
+
 static void bipred_average_px_px(uvg_pixel *dst,
   uvg_pixel *px_L0,
   uvg_pixel *px_L1,
@@ -826,6 +900,8 @@ int uvg_strategy_register_picture_generic(void* opaque, uint8_t bitdepth)
   success &= uvg_strategyselector_register(opaque, "satd_any_size_quad", "generic", 0, &satd_any_size_quad_generic);
 
   success &= uvg_strategyselector_register(opaque, "pixels_calc_ssd", "generic", 0, &pixels_calc_ssd_generic);
+  success &= uvg_strategyselector_register(opaque, "pixels_calc_ssd_rect", "generic", 0, &pixels_calc_ssd_rect_generic);
+  success &= uvg_strategyselector_register(opaque, "pixels_calc_ssim_rect", "generic", 0, &pixels_calc_ssim_rect_generic);
   success &= uvg_strategyselector_register(opaque, "bipred_average", "generic", 0, &bipred_average_generic);
 
   success &= uvg_strategyselector_register(opaque, "get_optimized_sad", "generic", 0, &get_optimized_sad_generic);
@@ -62,6 +62,8 @@ void uvg_satd_4x4_subblock_quad_generic(const uvg_pixel *preds[4],
                                         const int orig_stride,
                                         unsigned costs[4]);
 
+double uvg_ssim_8x8_from_sums(int32_t s1, int32_t s2, int32_t ss, int32_t s12);
+
 
 
 #endif //STRATEGIES_PICTURE_GENERIC_H_
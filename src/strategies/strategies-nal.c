@@ -35,14 +35,8 @@
 #include "strategies/generic/nal-generic.h"
 
 
-void (*uvg_array_checksum)(const uvg_pixel* data,
-                       const int height, const int width,
-                       const int stride,
-                       unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
-void (*uvg_array_md5)(const uvg_pixel* data,
-                      const int height, const int width,
-                      const int stride,
-                      unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
+array_checksum_func uvg_array_checksum;
+array_md5_func uvg_array_md5;
 
 
 int uvg_strategy_register_nal(void* opaque, uint8_t bitdepth) {
@@ -38,6 +38,7 @@
  * Interface for hash functions.
  */
 
+#include "extras/libmd5.h"
 #include "global.h" // IWYU pragma: keep
 #include "uvg266.h"
 #include "nal.h"
@@ -45,18 +46,44 @@
 
 //Function pointer to uvg_array_checksum
 /**
- * \brief Calculate checksum for one color of the picture.
+ * \brief Calculate checksum for rows of one color of the picture.
+ *
+ * The checksums of the row ranges of a picture add up to the checksum of
+ * the whole picture.
+ *
  * \param data Beginning of the pixel data for the picture.
- * \param height Height of the picture.
+ * \param y_begin First row to include.
+ * \param y_end Row after the last row to include.
  * \param width Width of the picture.
  * \param stride Width of one row in the pixel array.
+ * \returns The checksum of the rows.
  */
-typedef void (*array_checksum_func)(const uvg_pixel* data,
-                                    const int height, const int width,
-                                    const int stride,
-                                    unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
+typedef uint32_t (*array_checksum_func)(const uvg_pixel* data,
+                                        const int y_begin, const int y_end,
+                                        const int width, const int stride,
+                                        const uint8_t bitdepth);
+
+//Function pointer to uvg_array_md5
+/**
+ * \brief Add rows of one color of the picture to an MD5 hash.
+ *
+ * The rows of the picture must be added in order.
+ *
+ * \param md5_ctx MD5 context of the color.
+ * \param data Beginning of the pixel data for the picture.
+ * \param y_begin First row to include.
+ * \param y_end Row after the last row to include.
+ * \param width Width of the picture.
+ * \param stride Width of one row in the pixel array.
+ */
+typedef void (*array_md5_func)(context_md5_t *md5_ctx,
+                               const uvg_pixel* data,
+                               const int y_begin, const int y_end,
+                               const int width, const int stride,
+                               const uint8_t bitdepth);
+
 extern array_checksum_func uvg_array_checksum;
-extern array_checksum_func uvg_array_md5;
+extern array_md5_func uvg_array_md5;
 
 
 int uvg_strategy_register_nal(void* opaque, uint8_t bitdepth);
@@ -71,6 +71,8 @@ cost_pixel_any_size_func * uvg_satd_any_size = 0;
 cost_pixel_any_size_multi_func * uvg_satd_any_size_quad = 0;
 
 pixels_calc_ssd_func * uvg_pixels_calc_ssd = 0;
+pixels_calc_ssd_rect_func * uvg_pixels_calc_ssd_rect = 0;
+pixels_calc_ssim_rect_func * uvg_pixels_calc_ssim_rect = 0;
 
 inter_recon_bipred_func * uvg_bipred_average = 0;
 
@@ -125,6 +125,8 @@ typedef void (cost_pixel_nxn_multi_func)(const pred_buffer preds, const uvg_pixe
 typedef void (cost_pixel_any_size_multi_func)(int width, int height, const uvg_pixel **preds, const int stride, const uvg_pixel *orig, const int orig_stride, unsigned num_modes, unsigned *costs_out, int8_t *valid);
 
 typedef unsigned (pixels_calc_ssd_func)(const uvg_pixel *const ref, const uvg_pixel *const rec, const int ref_stride, const int rec_stride, const int width);
+typedef uint64_t (pixels_calc_ssd_rect_func)(const uvg_pixel *const ref, const uvg_pixel *const rec, const int ref_stride, const int rec_stride, const int width, const int height);
+typedef double (pixels_calc_ssim_rect_func)(const uvg_pixel *const ref, const uvg_pixel *const rec, const int ref_stride, const int rec_stride, const int width, const int height);
 typedef optimized_sad_func_ptr_t (get_optimized_sad_func)(int32_t);
 typedef uint32_t (ver_sad_func)(const uvg_pixel *pic_data, const uvg_pixel *ref_data,
                                 int32_t block_width, int32_t block_height,
@@ -182,6 +184,8 @@ extern cost_pixel_nxn_multi_func * uvg_satd_64x64_dual;
 extern cost_pixel_any_size_multi_func *uvg_satd_any_size_quad;
 
 extern pixels_calc_ssd_func *uvg_pixels_calc_ssd;
+extern pixels_calc_ssd_rect_func *uvg_pixels_calc_ssd_rect;
+extern pixels_calc_ssim_rect_func *uvg_pixels_calc_ssim_rect;
 
 extern inter_recon_bipred_func * uvg_bipred_average;
 
@@ -222,6 +226,8 @@ cost_pixel_nxn_multi_func * uvg_pixels_get_sad_dual_func(unsigned n);
   {"satd_64x64_dual", (void**) &uvg_satd_64x64_dual}, \
   {"satd_any_size_quad", (void**) &uvg_satd_any_size_quad}, \
   {"pixels_calc_ssd", (void**) &uvg_pixels_calc_ssd}, \
+  {"pixels_calc_ssd_rect", (void**) &uvg_pixels_calc_ssd_rect}, \
+  {"pixels_calc_ssim_rect", (void**) &uvg_pixels_calc_ssim_rect}, \
   {"bipred_average", (void**) &uvg_bipred_average}, \
   {"get_optimized_sad", (void**) &uvg_get_optimized_sad}, \
   {"ver_sad", (void**) &uvg_ver_sad}, \
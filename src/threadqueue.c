@@ -30,6 +30,11 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  ****************************************************************************/
 
+#ifdef __linux__
+// For cpu_set_t and sched_setaffinity.
+#define _GNU_SOURCE
+#endif
+
 #include "global.h"
 #include "threadqueue.h"
 
@@ -39,25 +44,107 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include "threads.h"
 
 
 /**
  * \file
  *
- * Lock acquisition order:
+ * Each worker thread owns a set of jobs that are ready to run. A worker
+ * adds the jobs it releases or submits to its own set and takes jobs from
+ * it, so a job that becomes ready usually runs on the same thread that
+ * completed its last dependency. An idle worker steals jobs from the sets
+ * of other workers. Jobs submitted from outside the worker threads are
+ * distributed to the workers in a round-robin fashion.
+ *
+ * The set is ordered by job priority. Of the jobs with equal priority,
+ * the one added last is taken first.
+ *
+ * Jobs have no locks. The number of unfinished dependencies of a job is
+ * an atomic counter and the reverse dependencies of a job are kept in
+ * a lock-free singly linked list. When a job is completed, its list is
+ * atomically replaced with a marker so that no more reverse dependencies
+ * can be added to it.
+ *
+ * The queue lock is only used for putting idle workers to sleep, waking
+ * them up and waking up threads in uvg_threadqueue_waitfor.
+ *
+ * Unless disabled, a thread waiting in uvg_threadqueue_waitfor runs ready
+ * jobs like a worker until the job it is waiting for is done.
  *
- * 1. When locking a job and its dependency, the dependecy must be locked
- * first and then the job depending on it.
+ * A worker that runs out of jobs first spins for a while looking for new
+ * jobs, then yields its time slice a few times and finally goes to sleep.
+ * Only one sleeping worker is woken up at a time. A woken worker wakes up
+ * the next one if there are still jobs left, and no workers are woken up
+ * while some worker is spinning.
  *
- * 2. When locking a job and the thread queue, the thread queue must be
- * locked first and then the job.
+ * Jobs and reverse dependency list elements are allocated from pools owned
+ * by the thread queue and returned there when freed. Workers keep small
+ * caches of free objects so that they can create and free jobs without
+ * locking the pool.
  *
- * 3. When accessing threadqueue_job_t.next, the thread queue must be
- * locked.
+ * Workers can be pinned to CPUs. When NUMA-aware scheduling is enabled,
+ * each worker belongs to a NUMA node and jobs can be given a preferred
+ * node. A job that becomes ready on a thread of another node is handed to
+ * a worker of its preferred node, and idle workers steal from the workers
+ * of their own node before the others.
+ *
+ * The number of active workers can be changed while the queue is running.
+ * Workers are created for the maximum number of threads when the active
+ * count grows past the threads created so far. Workers beyond the active
+ * count park on a condition variable after finishing their current job and
+ * receive no new jobs. The jobs left in their heaps are stolen by the
+ * active workers.
+ *
+ * Lock acquisition order:
+ *
+ * 1. The lock of a worker heap must be locked after the thread queue
+ * lock.
+ *
+ * 2. The thread queue lock must not be taken while holding the lock of
+ * a worker heap.
  */
 
-#define THREADQUEUE_LIST_REALLOC_SIZE 32
+#define THREADQUEUE_HEAP_INITIAL_SIZE 64
+
+/**
+ * \brief Number of pause instructions between checks for new jobs when
+ * spinning.
+ */
+#define THREADQUEUE_SPIN_PAUSES 32
+
+/**
+ * \brief Number of times an idle worker yields before going to sleep.
+ */
+#define THREADQUEUE_IDLE_YIELDS 4
+
+/**
+ * \brief Number of objects moved at a time between a pool and the cache of
+ * a worker.
+ */
+#define THREADQUEUE_POOL_BATCH 64
+
+/**
+ * \brief Minimum number of objects allocated at a time for a pool.
+ */
+#define THREADQUEUE_POOL_CHUNK 256
+
+/**
+ * \brief Maximum number of NUMA nodes supported.
+ */
+#define THREADQUEUE_MAX_NODES 64
+
+#ifdef __linux__
+// Memory policy constants from linux/mempolicy.h for the mbind system call.
+#define THREADQUEUE_MPOL_PREFERRED 1
+#define THREADQUEUE_MPOL_MF_MOVE (1 << 1)
+#endif
 
 #define PTHREAD_COND_SIGNAL(c) \
   if (pthread_cond_signal((c)) != 0) { \
@@ -124,38 +211,120 @@ typedef enum {
 } threadqueue_job_state;
 
 
-struct threadqueue_job_t {
+/**
+ * \brief Free object in a pool or a worker cache.
+ *
+ * Overlaps the beginning of the object while it is free.
+ */
+typedef struct threadqueue_free_t {
+  struct threadqueue_free_t *next;
+} threadqueue_free_t;
+
+
+/**
+ * \brief Pool of objects of one size.
+ */
+typedef struct threadqueue_pool_t {
   pthread_mutex_t lock;
 
-  threadqueue_job_state state;
+  /**
+   * \brief Size of the objects in bytes.
+   */
+  size_t object_size;
+
+  /**
+   * \brief List of free objects
+   */
+  threadqueue_free_t *free;
+
+  /**
+   * \brief Number of objects in free
+   */
+  int free_count;
+
+  /**
+   * \brief Blocks of memory allocated for the objects
+   */
+  void **chunks;
+
+  /**
+   * \brief Number of elements in chunks
+   */
+  int chunk_count;
+} threadqueue_pool_t;
+
+
+/**
+ * \brief Free objects of a pool owned by one worker.
+ */
+typedef struct threadqueue_cache_t {
+  threadqueue_free_t *free;
+  int count;
+} threadqueue_cache_t;
+
+
+/**
+ * \brief Element in the list of reverse dependencies of a job.
+ */
+typedef struct threadqueue_dep_t {
+  /**
+   * \brief Job that depends on the job owning the list.
+   */
+  struct threadqueue_job_t *job;
+
+  struct threadqueue_dep_t *next;
+} threadqueue_dep_t;
+
+
+struct threadqueue_job_t {
+  /**
+   * \brief The thread queue that owns the memory of the job.
+   */
+  struct threadqueue_queue_t *threadqueue;
+
+  /**
+   * \brief Current state, a threadqueue_job_state
+   *
+   * Accessed atomically.
+   */
+  int state;
 
   /**
    * \brief Number of dependencies that have not been completed yet.
+   *
+   * Accessed atomically. Contains one extra count until the job has been
+   * submitted so that the job is not started before that.
    */
   int ndepends;
 
   /**
    * \brief Reverse dependencies.
    *
-   * Array of pointers to jobs that depend on this one. They have to exist
-   * when the thread finishes, because they cannot be run before.
+   * List of jobs that depend on this one. They have to exist when the
+   * thread finishes, because they cannot be run before. The list is set to
+   * THREADQUEUE_RDEPENDS_DONE when the job has been completed.
    */
-  struct threadqueue_job_t **rdepends;
+  threadqueue_dep_t *rdepends;
 
   /**
-   * \brief Number of elements in rdepends.
+   * \brief Reference count
    */
-  int rdepends_count;
+  int refcount;
 
   /**
-   * \brief Allocated size of rdepends.
+   * \brief Scheduling priority. Ready jobs with higher priority run first.
    */
-  int rdepends_size;
+  int64_t priority;
 
   /**
-   * \brief Reference count
+   * \brief Preferred NUMA node of the job, or -1 for any node.
    */
-  int refcount;
+  int node;
+
+  /**
+   * \brief Order in which the job was added to the ready jobs of a worker.
+   */
+  uint64_t ready_order;
 
   /**
    * \brief Pointer to the function to execute.
@@ -167,12 +336,91 @@ struct threadqueue_job_t {
    */
   void *arg;
 
+};
+
+
+/**
+ * \brief Jobs that are ready to run and owned by one worker thread.
+ *
+ * Binary heap of jobs with the job that should run first at the root.
+ */
+typedef struct threadqueue_worker_t {
+  pthread_mutex_t lock;
+
   /**
-   * \brief Pointer to the next job in the queue.
+   * \brief Heap of ready jobs.
    */
-  struct threadqueue_job_t *next;
+  threadqueue_job_t **jobs;
 
-};
+  /**
+   * \brief Allocated size of jobs.
+   */
+  int size;
+
+  /**
+   * \brief Number of jobs in the heap.
+   *
+   * Modified only while holding the lock but may be read without it as
+   * a hint when looking for jobs to steal.
+   */
+  int count;
+
+  /**
+   * \brief Number of jobs added to the heap so far.
+   */
+  uint64_t push_count;
+
+  /**
+   * \brief Time spent looking for jobs in microseconds
+   *
+   * Updated atomically by the worker thread. Wraps around.
+   */
+  int idle_time;
+
+  /**
+   * \brief Free jobs of the pool of the thread queue.
+   */
+  threadqueue_cache_t job_cache;
+
+  /**
+   * \brief Free dependencies of the pool of the thread queue.
+   */
+  threadqueue_cache_t dep_cache;
+
+  /**
+   * \brief Index of the worker in threadqueue_queue_t.workers.
+   */
+  int id;
+
+  /**
+   * \brief Index of the NUMA node of the worker, 0 if NUMA-aware
+   * scheduling is not used.
+   */
+  int node;
+
+  /**
+   * \brief Indices of the other workers in the order they are tried when
+   * stealing jobs, the workers of the same node first.
+   */
+  int *steal_order;
+
+#ifdef __linux__
+  /**
+   * \brief If true, the worker thread is restricted to cpus.
+   */
+  bool pinned;
+
+  /**
+   * \brief CPUs the worker thread may run on.
+   */
+  cpu_set_t cpus;
+#endif
+
+  /**
+   * \brief The thread queue this worker belongs to.
+   */
+  struct threadqueue_queue_t *threadqueue;
+} threadqueue_worker_t;
 
 
 struct threadqueue_queue_t {
@@ -181,7 +429,7 @@ struct threadqueue_queue_t {
   /**
    * \brief Job available condition variable
    *
-   * Signalled when there is a new job to do.
+   * Signalled when there is a new job to do and some workers are sleeping.
    */
   pthread_cond_t job_available;
 
@@ -192,171 +440,966 @@ struct threadqueue_queue_t {
    */
   pthread_cond_t job_done;
 
+  /**
+   * \brief Active count condition variable
+   *
+   * Signalled when the number of active workers changes. Parked workers
+   * wait for it.
+   */
+  pthread_cond_t resized;
+
   /**
    * Array containing spawned threads
    */
   pthread_t *threads;
 
+  /**
+   * \brief Ready job heaps, one for each thread that may be created
+   */
+  threadqueue_worker_t *workers;
+
+  /**
+   * \brief Number of elements in workers
+   */
+  int worker_count;
+
   /**
    * \brief Number of threads spawned
    */
   int thread_count;
 
+  /**
+   * \brief Number of workers allowed to run jobs
+   *
+   * Workers with a smaller id than this are active. Modified only while
+   * holding the lock and read atomically.
+   */
+  int active_count;
+
   /**
    * \brief Number of threads running
    */
   int thread_running_count;
 
   /**
-   * \brief If true, threads should stop ASAP.
+   * \brief Number of threads waiting for job_available
+   */
+  int sleeping_count;
+
+  /**
+   * \brief Number of idle threads spinning before going to sleep
+   */
+  int spinning_count;
+
+  /**
+   * \brief Number of times an idle worker checks for new jobs before
+   * yielding and going to sleep
    */
-  bool stop;
+  int idle_spin;
 
   /**
-   * \brief Pointer to the first ready job
+   * \brief Number of threads waiting for job_done
    */
-  threadqueue_job_t *first;
+  int waiting_count;
 
   /**
-   * \brief Pointer to the last ready job
+   * \brief Worker that receives the next job submitted by a thread that
+   * is not a worker
    */
-  threadqueue_job_t *last;
+  int next_worker;
+
+  /**
+   * \brief Number of submitted jobs that have not been taken from the
+   * ready job heaps yet
+   */
+  int pending_count;
+
+  /**
+   * \brief Number of jobs each ready job heap has room for
+   *
+   * Kept at least pending_count by uvg_threadqueue_submit. Modified only
+   * while holding the lock.
+   */
+  int heap_size;
+
+  /**
+   * \brief Last number returned by uvg_threadqueue_next_sequence
+   *
+   * Modified only while holding the lock.
+   */
+  int64_t sequence;
+
+  /**
+   * \brief Number of NUMA nodes the workers are on, 1 if NUMA-aware
+   * scheduling is not used
+   */
+  int node_count;
+
+  /**
+   * \brief Operating system identifiers of the NUMA nodes
+   */
+  int node_ids[THREADQUEUE_MAX_NODES];
+
+  /**
+   * \brief Workers grouped by node
+   *
+   * The workers of node n are node_workers[node_first[n]] to
+   * node_workers[node_first[n + 1] - 1].
+   */
+  int *node_workers;
+
+  /**
+   * \brief Index of the first worker of each node in node_workers
+   */
+  int node_first[THREADQUEUE_MAX_NODES + 1];
+
+  /**
+   * \brief Pool of threadqueue_job_t
+   */
+  threadqueue_pool_t job_pool;
+
+  /**
+   * \brief Pool of threadqueue_dep_t
+   */
+  threadqueue_pool_t dep_pool;
+
+  /**
+   * \brief If true, uvg_threadqueue_waitfor runs ready jobs in the calling
+   * thread while waiting.
+   */
+  bool caller_runs;
+
+  /**
+   * \brief If true, threads should stop ASAP.
+   *
+   * Modified only while holding the lock.
+   */
+  int stop;
 };
 
 
+static threadqueue_dep_t threadqueue_rdepends_done;
+
+/**
+ * \brief Marker for the reverse dependency list of a completed job.
+ */
+#define THREADQUEUE_RDEPENDS_DONE (&threadqueue_rdepends_done)
+
+
+/**
+ * \brief Worker structure of the current thread, or NULL if the current
+ * thread is not a worker thread.
+ */
+static UVG_THREAD_LOCAL threadqueue_worker_t *threadqueue_current_worker = NULL;
+
+
+/**
+ * \brief Allocate memory for more objects and add them to the free list.
+ *
+ * The caller must have locked the pool.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_pool_grow(threadqueue_pool_t *pool, int count)
+{
+  void **chunks = realloc(pool->chunks, (pool->chunk_count + 1) * sizeof(void*));
+  if (!chunks) return 0;
+  pool->chunks = chunks;
+
+  uint8_t *chunk = malloc(count * pool->object_size);
+  if (!chunk) return 0;
+  pool->chunks[pool->chunk_count++] = chunk;
+
+  for (int i = 0; i < count; ++i) {
+    threadqueue_free_t *object = (threadqueue_free_t*)(chunk + i * pool->object_size);
+    object->next = pool->free;
+    pool->free = object;
+  }
+  pool->free_count += count;
+
+  return 1;
+}
+
+
+/**
+ * \brief Get an object from a pool.
+ *
+ * \param cache   cache of the calling worker or NULL
+ *
+ * \return the object, or NULL on failure
+ */
+static void * threadqueue_pool_alloc(threadqueue_pool_t *pool,
+                                     threadqueue_cache_t *cache)
+{
+  if (cache && cache->free) {
+    threadqueue_free_t *object = cache->free;
+    cache->free = object->next;
+    cache->count--;
+    return object;
+  }
+
+  PTHREAD_LOCK(&pool->lock);
+
+  const int wanted = cache ? THREADQUEUE_POOL_BATCH : 1;
+  if (pool->free_count < wanted &&
+      !threadqueue_pool_grow(pool, MAX(wanted, THREADQUEUE_POOL_CHUNK)))
+  {
+    PTHREAD_UNLOCK(&pool->lock);
+    return NULL;
+  }
+
+  threadqueue_free_t *object = pool->free;
+  pool->free = object->next;
+  pool->free_count--;
+
+  if (cache) {
+    // Move a batch of objects to the cache.
+    for (int i = 1; i < wanted; ++i) {
+      threadqueue_free_t *cached = pool->free;
+      pool->free = cached->next;
+      cached->next = cache->free;
+      cache->free = cached;
+    }
+    pool->free_count -= wanted - 1;
+    cache->count += wanted - 1;
+  }
+
+  PTHREAD_UNLOCK(&pool->lock);
+  return object;
+}
+
+
+/**
+ * \brief Return an object to a pool.
+ *
+ * \param cache   cache of the calling worker or NULL
+ */
+static void threadqueue_pool_free(threadqueue_pool_t *pool,
+                                  threadqueue_cache_t *cache,
+                                  void *ptr)
+{
+  threadqueue_free_t *object = ptr;
+
+  if (cache) {
+    object->next = cache->free;
+    cache->free = object;
+    cache->count++;
+    if (cache->count < 2 * THREADQUEUE_POOL_BATCH) return;
+
+    // Give a batch of objects back to the pool.
+    threadqueue_free_t *first = cache->free;
+    threadqueue_free_t *last = first;
+    for (int i = 1; i < THREADQUEUE_POOL_BATCH; ++i) {
+      last = last->next;
+    }
+    cache->free = last->next;
+    cache->count -= THREADQUEUE_POOL_BATCH;
+
+    pthread_mutex_lock(&pool->lock);
+    last->next = pool->free;
+    pool->free = first;
+    pool->free_count += THREADQUEUE_POOL_BATCH;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  object->next = pool->free;
+  pool->free = object;
+  pool->free_count++;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * \brief Initialize a pool.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_pool_init(threadqueue_pool_t *pool, size_t object_size)
+{
+  if (pthread_mutex_init(&pool->lock, NULL) != 0) return 0;
+
+  // A nonzero size marks the pool as initialized.
+  pool->object_size = MAX(object_size, sizeof(threadqueue_free_t));
+  pool->free        = NULL;
+  pool->free_count  = 0;
+  pool->chunks      = NULL;
+  pool->chunk_count = 0;
+
+  return 1;
+}
+
+
+/**
+ * \brief Free all memory of a pool.
+ */
+static void threadqueue_pool_destroy(threadqueue_pool_t *pool)
+{
+  for (int i = 0; i < pool->chunk_count; ++i) {
+    FREE_POINTER(pool->chunks[i]);
+  }
+  FREE_POINTER(pool->chunks);
+  pool->chunk_count = 0;
+  pool->free = NULL;
+  pool->free_count = 0;
+
+  pthread_mutex_destroy(&pool->lock);
+}
+
+
+/**
+ * \brief Worker of the current thread if it belongs to the thread queue.
+ */
+static INLINE threadqueue_worker_t * threadqueue_own_worker(const threadqueue_queue_t *threadqueue)
+{
+  threadqueue_worker_t *worker = threadqueue_current_worker;
+  return worker && worker->threadqueue == threadqueue ? worker : NULL;
+}
+
+
+/**
+ * \brief Check whether job a should run before job b.
+ */
+static INLINE bool threadqueue_job_before(const threadqueue_job_t *a,
+                                          const threadqueue_job_t *b)
+{
+  if (a->priority != b->priority) return a->priority > b->priority;
+  return a->ready_order > b->ready_order;
+}
+
+
+/**
+ * \brief Add a job to the ready jobs of a worker.
+ *
+ * The heap always has room for the job, see threadqueue_reserve_heaps.
+ */
+static void threadqueue_worker_push(threadqueue_worker_t *worker,
+                                    threadqueue_job_t *job)
+{
+  pthread_mutex_lock(&worker->lock);
+
+  assert(worker->count < worker->size);
+
+  job->ready_order = worker->push_count++;
+
+  // Sift up.
+  int i = worker->count;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!threadqueue_job_before(job, worker->jobs[parent])) break;
+    worker->jobs[i] = worker->jobs[parent];
+    i = parent;
+  }
+  worker->jobs[i] = job;
+  UVG_ATOMIC_STORE(&worker->count, worker->count + 1);
+
+  pthread_mutex_unlock(&worker->lock);
+}
+
+
+/**
+ * \brief Take the job that should run first from the ready jobs of a worker.
+ *
+ * \return the job, or NULL if there are no jobs
+ */
+static threadqueue_job_t * threadqueue_worker_pop(threadqueue_worker_t *worker)
+{
+  // Skip empty heaps without locking them.
+  if (UVG_ATOMIC_LOAD(&worker->count) == 0) return NULL;
+
+  PTHREAD_LOCK(&worker->lock);
+
+  threadqueue_job_t *job = NULL;
+  if (worker->count > 0) {
+    job = worker->jobs[0];
+
+    const int count = worker->count - 1;
+    UVG_ATOMIC_STORE(&worker->count, count);
+
+    // Sift down the last job from the root.
+    threadqueue_job_t *last = worker->jobs[count];
+    int i = 0;
+    for (;;) {
+      int child = 2 * i + 1;
+      if (child >= count) break;
+      if (child + 1 < count && threadqueue_job_before(worker->jobs[child + 1], worker->jobs[child])) {
+        child++;
+      }
+      if (!threadqueue_job_before(worker->jobs[child], last)) break;
+      worker->jobs[i] = worker->jobs[child];
+      i = child;
+    }
+    worker->jobs[i] = last;
+  }
+
+  PTHREAD_UNLOCK(&worker->lock);
+
+  if (job) {
+    UVG_ATOMIC_DEC(&worker->threadqueue->pending_count);
+  }
+  return job;
+}
+
+
+/**
+ * \brief Add a job to the jobs ready to run.
+ *
+ * When called from an active worker thread, the job is added to the heap
+ * of that worker. Otherwise the job is given to the active workers in
+ * turns. Sleeping workers are not woken up.
+ *
+ * This function takes the ownership of the job.
+ */
+static void threadqueue_push_job(threadqueue_queue_t * threadqueue,
+                                threadqueue_job_t *job)
+{
+  assert(UVG_ATOMIC_LOAD(&job->ndepends) == 0);
+  UVG_ATOMIC_STORE(&job->state, THREADQUEUE_JOB_STATE_READY);
+
+  const int node = threadqueue->node_count > 1 ? job->node : -1;
+  const int active_count = UVG_ATOMIC_LOAD(&threadqueue->active_count);
+
+  threadqueue_worker_t *worker = threadqueue_own_worker(threadqueue);
+  if (worker && worker->id >= active_count) {
+    // Parking workers do not take new jobs.
+    worker = NULL;
+  }
+
+  if (node >= 0 && (worker == NULL || worker->node != node)) {
+    // Give the job to an active worker of the preferred node.
+    const int first = threadqueue->node_first[node];
+    const int count = threadqueue->node_first[node + 1] - first;
+    const int i = UVG_ATOMIC_INC(&threadqueue->next_worker);
+    worker = NULL;
+    for (int j = 0; j < count; ++j) {
+      const int id = threadqueue->node_workers[first + ((unsigned)i + j) % count];
+      if (id < active_count) {
+        worker = &threadqueue->workers[id];
+        break;
+      }
+    }
+  }
+  if (worker == NULL) {
+    int id = UVG_ATOMIC_INC(&threadqueue->next_worker);
+    worker = &threadqueue->workers[(unsigned)id % active_count];
+  }
+
+  threadqueue_worker_push(worker, job);
+}
+
+
+/**
+ * \brief Retrieve a job from the jobs ready to run.
+ *
+ * Tries the heap of the given worker first and then steals from the other
+ * workers. The calling function receives the ownership of the job.
+ *
+ * \param worker  worker of the calling thread or NULL
+ *
+ * \return the job, or NULL if there are no jobs ready to run
+ */
+static threadqueue_job_t * threadqueue_pop_job(threadqueue_queue_t * threadqueue,
+                                               threadqueue_worker_t *worker)
+{
+  threadqueue_job_t *job = NULL;
+
+  if (worker) {
+    job = threadqueue_worker_pop(worker);
+    if (job) return job;
+
+    for (int i = 0; i < threadqueue->worker_count - 1; ++i) {
+      job = threadqueue_worker_pop(&threadqueue->workers[worker->steal_order[i]]);
+      if (job) return job;
+    }
+    return NULL;
+  }
+
+  for (int i = 0; i < threadqueue->worker_count; ++i) {
+    job = threadqueue_worker_pop(&threadqueue->workers[i]);
+    if (job) return job;
+  }
+
+  return NULL;
+}
+
+
+/**
+ * \brief Check whether any worker has jobs without locking anything.
+ */
+static bool threadqueue_has_jobs(const threadqueue_queue_t * threadqueue)
+{
+  for (int i = 0; i < threadqueue->worker_count; ++i) {
+    if (UVG_ATOMIC_LOAD(&threadqueue->workers[i].count) > 0) return true;
+  }
+  return false;
+}
+
+
+/**
+ * \brief Wake up a sleeping worker if needed.
+ *
+ * Must be called after pushing new jobs, without holding the lock of any
+ * job or worker heap.
+ *
+ * Only one worker is woken up. It wakes up the next one if there are more
+ * jobs left when it starts running a job.
+ *
+ * \param count   number of new jobs that other workers could run
+ */
+static void threadqueue_wake_workers(threadqueue_queue_t * threadqueue, int count)
+{
+  // The new jobs must be visible before checking for sleeping workers so
+  // that a worker going to sleep either sees the jobs or gets signalled.
+  UVG_MEMORY_BARRIER();
+
+  // Spinning workers will find the jobs soon without waking anyone up.
+  count -= UVG_ATOMIC_LOAD(&threadqueue->spinning_count);
+  if (count <= 0 || UVG_ATOMIC_LOAD(&threadqueue->sleeping_count) == 0) return;
+
+  pthread_mutex_lock(&threadqueue->lock);
+  pthread_cond_signal(&threadqueue->job_available);
+  pthread_mutex_unlock(&threadqueue->lock);
+}
+
+
+/**
+ * \brief Look for new jobs for a while before going to sleep.
+ *
+ * \return the job, or NULL if no job was found
+ */
+static threadqueue_job_t * threadqueue_spin_job(threadqueue_worker_t *worker)
+{
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
+  if (threadqueue->idle_spin <= 0) return NULL;
+
+  threadqueue_job_t *job = NULL;
+
+  UVG_ATOMIC_INC(&threadqueue->spinning_count);
+  for (int i = 0; i < threadqueue->idle_spin + THREADQUEUE_IDLE_YIELDS; ++i) {
+    if (UVG_ATOMIC_LOAD(&threadqueue->stop)) break;
+    if (worker->id >= UVG_ATOMIC_LOAD(&threadqueue->active_count)) break;
+
+    if (i < threadqueue->idle_spin) {
+      for (int j = 0; j < THREADQUEUE_SPIN_PAUSES; ++j) {
+        UVG_CPU_PAUSE();
+      }
+    } else {
+      UVG_THREAD_YIELD();
+    }
+
+    if (threadqueue_has_jobs(threadqueue)) {
+      job = threadqueue_pop_job(threadqueue, worker);
+      if (job) break;
+    }
+  }
+  UVG_ATOMIC_DEC(&threadqueue->spinning_count);
+
+  return job;
+}
+
+
+/**
+ * \brief Free a list of reverse dependencies without releasing the jobs.
+ */
+static void threadqueue_free_rdepends(threadqueue_queue_t * threadqueue,
+                                      threadqueue_dep_t *rdepends)
+{
+  if (rdepends == THREADQUEUE_RDEPENDS_DONE) return;
+
+  threadqueue_worker_t *worker = threadqueue_own_worker(threadqueue);
+  while (rdepends) {
+    threadqueue_dep_t *next = rdepends->next;
+    uvg_threadqueue_free_job(&rdepends->job);
+    threadqueue_pool_free(&threadqueue->dep_pool, worker ? &worker->dep_cache : NULL, rdepends);
+    rdepends = next;
+  }
+}
+
+
+/**
+ * \brief Mark a job as completed and release the jobs depending on it.
+ *
+ * \return number of jobs that became ready to run
+ */
+static int threadqueue_job_done(threadqueue_queue_t * threadqueue,
+                                threadqueue_job_t *job)
+{
+  assert(UVG_ATOMIC_LOAD(&job->state) == THREADQUEUE_JOB_STATE_RUNNING);
+  UVG_ATOMIC_STORE(&job->state, THREADQUEUE_JOB_STATE_DONE);
+
+  // Take the reverse dependencies and prevent adding new ones.
+  threadqueue_dep_t *rdepends = UVG_ATOMIC_XCHG_PTR(&job->rdepends, THREADQUEUE_RDEPENDS_DONE);
+
+  // The list is in reverse order of adding the dependencies.
+  threadqueue_dep_t *reversed = NULL;
+  while (rdepends) {
+    threadqueue_dep_t *next = rdepends->next;
+    rdepends->next = reversed;
+    reversed = rdepends;
+    rdepends = next;
+  }
+
+  // Go through all the jobs that depend on this one, decreasing their
+  // ndepends. Count how many jobs can now start executing so we know how
+  // many threads to wake up.
+  threadqueue_worker_t *worker = threadqueue_own_worker(threadqueue);
+  int num_new_jobs = 0;
+  while (reversed) {
+    threadqueue_dep_t *dep = reversed;
+    reversed = dep->next;
+
+    threadqueue_job_t *depjob = dep->job;
+    threadqueue_pool_free(&threadqueue->dep_pool, worker ? &worker->dep_cache : NULL, dep);
+
+    assert(UVG_ATOMIC_LOAD(&depjob->state) == THREADQUEUE_JOB_STATE_WAITING ||
+           UVG_ATOMIC_LOAD(&depjob->state) == THREADQUEUE_JOB_STATE_PAUSED);
+
+    if (UVG_ATOMIC_DEC(&depjob->ndepends) == 0) {
+      // Move the job to the heap of this worker. The reference of the
+      // list element is given to the heap. The heap has room for it
+      // because room was reserved when the job was submitted.
+      threadqueue_push_job(threadqueue, depjob);
+      num_new_jobs++;
+    } else {
+      // Clear this reference to the job.
+      uvg_threadqueue_free_job(&depjob);
+    }
+  }
+
+  // Wake up threads waiting for a job. They may also run the new jobs.
+  // The state must be visible before checking for waiting threads.
+  UVG_MEMORY_BARRIER();
+  if (UVG_ATOMIC_LOAD(&threadqueue->waiting_count) > 0) {
+    pthread_mutex_lock(&threadqueue->lock);
+    pthread_cond_broadcast(&threadqueue->job_done);
+    pthread_mutex_unlock(&threadqueue->lock);
+  }
+
+  return num_new_jobs;
+}
+
+
+/**
+ * \brief Run a job taken from the ready jobs.
+ *
+ * Releases the jobs depending on it and wakes up workers for them. The
+ * calling thread is expected to run one of the released jobs itself.
+ */
+static void threadqueue_run_job(threadqueue_queue_t * threadqueue,
+                                threadqueue_job_t *job)
+{
+  assert(UVG_ATOMIC_LOAD(&job->state) == THREADQUEUE_JOB_STATE_READY);
+  UVG_ATOMIC_STORE(&job->state, THREADQUEUE_JOB_STATE_RUNNING);
+
+  job->fptr(job->arg);
+
+  int num_new_jobs = threadqueue_job_done(threadqueue, job);
+  uvg_threadqueue_free_job(&job);
+
+  // The current thread will process one of the new jobs so we wake up
+  // one threads less than the the number of new jobs.
+  threadqueue_wake_workers(threadqueue, num_new_jobs - 1);
+}
+
+
 /**
- * \brief Add a job to the queue of jobs ready to run.
+ * \brief Sleep until there is a job to do, the queue is stopped or the
+ * worker is no longer active.
  *
- * The caller must have locked the thread queue and the job. This function
- * takes the ownership of the job.
+ * \return the job, or NULL if the worker should stop or park
  */
-static void threadqueue_push_job(threadqueue_queue_t * threadqueue,
-                                 threadqueue_job_t *job)
+static threadqueue_job_t * threadqueue_wait_job(threadqueue_worker_t *worker)
 {
-  assert(job->ndepends == 0);
-  job->state = THREADQUEUE_JOB_STATE_READY;
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
+  threadqueue_job_t *job = NULL;
+
+  PTHREAD_LOCK(&threadqueue->lock);
+  UVG_ATOMIC_INC(&threadqueue->sleeping_count);
+
+  while (!threadqueue->stop &&
+         worker->id < threadqueue->active_count &&
+         (job = threadqueue_pop_job(threadqueue, worker)) == NULL)
+  {
+    // Wait until there is something to do in the queue.
+    PTHREAD_COND_WAIT(&threadqueue->job_available, &threadqueue->lock);
+  }
 
-  if (threadqueue->first == NULL) {
-    threadqueue->first = job;
-  } else {
-    threadqueue->last->next = job;
+  UVG_ATOMIC_DEC(&threadqueue->sleeping_count);
+
+  // Pass the wakeup on if there is more to do. A worker that is going to
+  // park may have taken a wakeup meant for an active worker.
+  if (threadqueue->sleeping_count > 0 && threadqueue_has_jobs(threadqueue)) {
+    pthread_cond_signal(&threadqueue->job_available);
   }
+  PTHREAD_UNLOCK(&threadqueue->lock);
 
-  threadqueue->last = job;
-  job->next = NULL;
+  return job;
 }
 
 
 /**
- * \brief Retrieve a job from the queue of jobs ready to run.
- *
- * The caller must have locked the thread queue. The calling function
- * receives the ownership of the job.
+ * \brief Wait until the worker becomes active again or the queue is
+ * stopped.
  */
-static threadqueue_job_t * threadqueue_pop_job(threadqueue_queue_t * threadqueue)
+static void threadqueue_park_worker(threadqueue_worker_t *worker)
 {
-  assert(threadqueue->first != NULL);
-
-  threadqueue_job_t *job = threadqueue->first;
-  threadqueue->first = job->next;
-  job->next = NULL;
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
 
-  if (threadqueue->first == NULL) {
-    threadqueue->last = NULL;
+  // Make sure the jobs left in the heap of the worker get stolen.
+  const int count = UVG_ATOMIC_LOAD(&worker->count);
+  if (count > 0) {
+    threadqueue_wake_workers(threadqueue, count);
   }
 
-  return job;
+  pthread_mutex_lock(&threadqueue->lock);
+  while (!threadqueue->stop && worker->id >= threadqueue->active_count) {
+    pthread_cond_wait(&threadqueue->resized, &threadqueue->lock);
+  }
+  pthread_mutex_unlock(&threadqueue->lock);
 }
 
 
 /**
  * \brief Function executed by worker threads.
  */
-static void* threadqueue_worker(void* threadqueue_opaque)
+static void* threadqueue_worker(void* worker_opaque)
 {
-  threadqueue_queue_t * const threadqueue = (threadqueue_queue_t *) threadqueue_opaque;
+  threadqueue_worker_t * const worker = (threadqueue_worker_t *) worker_opaque;
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
 
-  PTHREAD_LOCK(&threadqueue->lock);
+  threadqueue_current_worker = worker;
+
+#ifdef __linux__
+  if (worker->pinned && sched_setaffinity(0, sizeof(worker->cpus), &worker->cpus) != 0) {
+    fprintf(stderr, "Could not set the CPU affinity of worker %d.\n", worker->id);
+  }
+#endif
 
   for (;;) {
-    while (!threadqueue->stop && threadqueue->first == NULL) {
-      // Wait until there is something to do in the queue.
-      PTHREAD_COND_WAIT(&threadqueue->job_available, &threadqueue->lock);
+    if (UVG_ATOMIC_LOAD(&threadqueue->stop)) {
+      break;
     }
 
-    if (threadqueue->stop) {
-      break;
+    if (worker->id >= UVG_ATOMIC_LOAD(&threadqueue->active_count)) {
+      threadqueue_park_worker(worker);
+      continue;
     }
 
     // Get a job and remove it from the queue.
-    threadqueue_job_t *job = threadqueue_pop_job(threadqueue);
+    threadqueue_job_t *job = threadqueue_pop_job(threadqueue, worker);
+    if (!job) {
+      UVG_CLOCK_T idle_start, idle_end;
+      UVG_GET_TIME(&idle_start);
+
+      job = threadqueue_spin_job(worker);
+      if (!job) {
+        job = threadqueue_wait_job(worker);
+      }
 
-    PTHREAD_LOCK(&job->lock);
-    assert(job->state == THREADQUEUE_JOB_STATE_READY);
-    job->state = THREADQUEUE_JOB_STATE_RUNNING;
-    PTHREAD_UNLOCK(&job->lock);
-    PTHREAD_UNLOCK(&threadqueue->lock);
+      UVG_GET_TIME(&idle_end);
+      UVG_ATOMIC_ADD(&worker->idle_time, (int32_t)(UVG_CLOCK_T_DIFF(idle_start, idle_end) * 1e6));
+      if (!job) {
+        continue;
+      }
+    }
 
-    job->fptr(job->arg);
+    threadqueue_run_job(threadqueue, job);
+  }
 
-    PTHREAD_LOCK(&threadqueue->lock);
-    PTHREAD_LOCK(&job->lock);
-    assert(job->state == THREADQUEUE_JOB_STATE_RUNNING);
-    job->state = THREADQUEUE_JOB_STATE_DONE;
-
-    PTHREAD_COND_SIGNAL(&threadqueue->job_done);
-
-    // Go through all the jobs that depend on this one, decreasing their
-    // ndepends. Count how many jobs can now start executing so we know how
-    // many threads to wake up.
-    int num_new_jobs = 0;
-    for (int i = 0; i < job->rdepends_count; ++i) {
-      threadqueue_job_t * const depjob = job->rdepends[i];
-      // The dependency (job) is locked before the job depending on it.
-      // This must be the same order as in uvg_threadqueue_job_dep_add.
-      PTHREAD_LOCK(&depjob->lock);
-
-      assert(depjob->state == THREADQUEUE_JOB_STATE_WAITING ||
-             depjob->state == THREADQUEUE_JOB_STATE_PAUSED);
-      assert(depjob->ndepends > 0);
-      depjob->ndepends--;
-
-      if (depjob->ndepends == 0 && depjob->state == THREADQUEUE_JOB_STATE_WAITING) {
-        // Move the job to ready jobs.
-        threadqueue_push_job(threadqueue, uvg_threadqueue_copy_ref(depjob));
-        num_new_jobs++;
+  PTHREAD_LOCK(&threadqueue->lock);
+  threadqueue->thread_running_count--;
+  PTHREAD_UNLOCK(&threadqueue->lock);
+  return NULL;
+}
+
+
+#ifdef __linux__
+/**
+ * \brief Find the NUMA node of a CPU.
+ *
+ * \return operating system identifier of the node, or -1 if not known
+ */
+static int threadqueue_cpu_node(int cpu)
+{
+  char path[64];
+  for (int node = 0; node < THREADQUEUE_MAX_NODES; ++node) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+    if (access(path, F_OK) == 0) return node;
+  }
+  return -1;
+}
+
+
+/**
+ * \brief Get the index of a NUMA node, adding it to the nodes of the
+ * thread queue if it is not there yet.
+ */
+static int threadqueue_node_index(threadqueue_queue_t *threadqueue, int os_node)
+{
+  os_node = MAX(0, os_node);
+  for (int i = 0; i < threadqueue->node_count; ++i) {
+    if (threadqueue->node_ids[i] == os_node) return i;
+  }
+  threadqueue->node_ids[threadqueue->node_count] = os_node;
+  return threadqueue->node_count++;
+}
+#endif
+
+
+/**
+ * \brief Choose the CPUs and NUMA nodes of the workers.
+ *
+ * Must be called before the worker threads are created.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_place_workers(threadqueue_queue_t *threadqueue,
+                                     const int32_t *cpus,
+                                     int cpu_count,
+                                     bool numa)
+{
+  const int worker_count = threadqueue->worker_count;
+  threadqueue_worker_t *workers = threadqueue->workers;
+
+  threadqueue->node_count = 0;
+
+#ifdef __linux__
+  if (cpu_count > 0) {
+    // Pin the workers to the given CPUs in order.
+    for (int i = 0; i < worker_count; ++i) {
+      const int cpu = cpus[i % cpu_count];
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "CPU %d is out of range.\n", cpu);
+        return 0;
       }
+      CPU_ZERO(&workers[i].cpus);
+      CPU_SET(cpu, &workers[i].cpus);
+      workers[i].pinned = true;
+      if (numa) {
+        workers[i].node = threadqueue_node_index(threadqueue, threadqueue_cpu_node(cpu));
+      }
+    }
+  } else if (numa) {
+    // Spread the workers over the nodes of the CPUs the process may use and
+    // let each of them run on any CPU of its node.
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+      CPU_ZERO(&allowed);
+    }
 
-      // Clear this reference to the job.
-      PTHREAD_UNLOCK(&depjob->lock);
-      uvg_threadqueue_free_job(&job->rdepends[i]);
+    int cpu_nodes[CPU_SETSIZE];
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      cpu_nodes[cpu] = CPU_ISSET(cpu, &allowed) ?
+        threadqueue_node_index(threadqueue, threadqueue_cpu_node(cpu)) : -1;
     }
-    job->rdepends_count = 0;
 
-    PTHREAD_UNLOCK(&job->lock);
-    uvg_threadqueue_free_job(&job);
+    // Only use as many nodes as there are workers.
+    threadqueue->node_count = MIN(threadqueue->node_count, worker_count);
 
-    // The current thread will process one of the new jobs so we wake up
-    // one threads less than the the number of new jobs.
-    for (int i = 0; i < num_new_jobs - 1; i++) {
-      pthread_cond_signal(&threadqueue->job_available);
+    for (int i = 0; i < worker_count && threadqueue->node_count > 0; ++i) {
+      workers[i].node = i % threadqueue->node_count;
+      CPU_ZERO(&workers[i].cpus);
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (cpu_nodes[cpu] == workers[i].node) CPU_SET(cpu, &workers[i].cpus);
+      }
+      workers[i].pinned = true;
     }
   }
+#else
+  if (cpu_count > 0 || numa) {
+    fprintf(stderr, "CPU affinity is not supported on this platform.\n");
+  }
+#endif
 
-  threadqueue->thread_running_count--;
-  PTHREAD_UNLOCK(&threadqueue->lock);
-  return NULL;
+  if (threadqueue->node_count == 0) {
+    threadqueue->node_count = 1;
+    threadqueue->node_ids[0] = 0;
+  }
+
+  // Group the workers by node.
+  threadqueue->node_workers = MALLOC(int, MAX(1, worker_count));
+  if (!threadqueue->node_workers) return 0;
+
+  int num_grouped = 0;
+  for (int node = 0; node < threadqueue->node_count; ++node) {
+    threadqueue->node_first[node] = num_grouped;
+    for (int i = 0; i < worker_count; ++i) {
+      if (workers[i].node == node) threadqueue->node_workers[num_grouped++] = i;
+    }
+  }
+  threadqueue->node_first[threadqueue->node_count] = num_grouped;
+
+  // Steal from the workers of the same node first, starting from the next
+  // worker to spread the stealing over the workers.
+  for (int w = 0; w < worker_count; ++w) {
+    workers[w].steal_order = MALLOC(int, MAX(1, worker_count - 1));
+    if (!workers[w].steal_order) return 0;
+
+    int num_ordered = 0;
+    for (int same_node = 1; same_node >= 0; --same_node) {
+      for (int i = 1; i < worker_count; ++i) {
+        const int other = (w + i) % worker_count;
+        if ((workers[other].node == workers[w].node) == same_node) {
+          workers[w].steal_order[num_ordered++] = other;
+        }
+      }
+    }
+  }
+
+  return 1;
+}
+
+
+/**
+ * \brief Create the thread of the next worker that does not have one.
+ *
+ * The caller must have locked the queue.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_spawn_worker(threadqueue_queue_t *threadqueue)
+{
+  const int i = threadqueue->thread_count;
+  assert(i < threadqueue->worker_count);
+
+  if (pthread_create(&threadqueue->threads[i], NULL, threadqueue_worker, &threadqueue->workers[i]) != 0) {
+    fprintf(stderr, "pthread_create failed!\n");
+    return 0;
+  }
+  threadqueue->thread_count++;
+  threadqueue->thread_running_count++;
+  return 1;
 }
 
 
 /**
  * \brief Initialize the queue.
  *
+ * Workers are set up for max_thread_count threads but only thread_count
+ * of them are created and active. The rest can be activated with
+ * uvg_threadqueue_set_thread_count.
+ *
+ * \param thread_count  number of worker threads
+ * \param max_thread_count  maximum number of worker threads
+ * \param caller_runs   run jobs in threads waiting in uvg_threadqueue_waitfor
+ * \param idle_spin     number of times an idle worker checks for new jobs
+ *                      before going to sleep
+ * \param cpus          CPUs to pin the workers to in order, or NULL
+ * \param cpu_count     number of elements in cpus
+ * \param numa          group the workers by NUMA node
+ *
  * \return 1 on success, 0 on failure
  */
-threadqueue_queue_t * uvg_threadqueue_init(int thread_count)
+threadqueue_queue_t * uvg_threadqueue_init(int thread_count,
+                                           int max_thread_count,
+                                           bool caller_runs,
+                                           int idle_spin,
+                                           const int32_t *cpus,
+                                           int cpu_count,
+                                           bool numa)
 {
-  threadqueue_queue_t *threadqueue = MALLOC(threadqueue_queue_t, 1);
+  threadqueue_queue_t *threadqueue = calloc(1, sizeof(threadqueue_queue_t));
   if (!threadqueue) {
     goto failed;
   }
@@ -376,28 +1419,81 @@ threadqueue_queue_t * uvg_threadqueue_init(int thread_count)
     goto failed;
   }
 
-  threadqueue->threads = MALLOC(pthread_t, thread_count);
+  if (pthread_cond_init(&threadqueue->resized, NULL) != 0) {
+    fprintf(stderr, "pthread_cond_init failed!\n");
+    goto failed;
+  }
+
+  // Without threads the jobs are run immediately and threads can not be
+  // added later.
+  const int worker_count = thread_count > 0 ? MAX(thread_count, max_thread_count) : 0;
+
+  if (!threadqueue_pool_init(&threadqueue->job_pool, sizeof(threadqueue_job_t)) ||
+      !threadqueue_pool_init(&threadqueue->dep_pool, sizeof(threadqueue_dep_t)))
+  {
+    fprintf(stderr, "Could not initialize job pools!\n");
+    goto failed;
+  }
+
+  threadqueue->threads = MALLOC(pthread_t, MAX(1, worker_count));
   if (!threadqueue->threads) {
     fprintf(stderr, "Could not malloc threadqueue->threads!\n");
     goto failed;
   }
   threadqueue->thread_count = 0;
+  threadqueue->active_count = thread_count;
   threadqueue->thread_running_count = 0;
+  threadqueue->sleeping_count = 0;
+  threadqueue->waiting_count = 0;
+  threadqueue->spinning_count = 0;
+  threadqueue->idle_spin = idle_spin;
+  threadqueue->next_worker = 0;
+  threadqueue->pending_count = 0;
+  threadqueue->heap_size = THREADQUEUE_HEAP_INITIAL_SIZE;
+  threadqueue->sequence = 0;
+
+  threadqueue->caller_runs = caller_runs;
+  threadqueue->stop = 0;
+
+  threadqueue->workers = calloc(MAX(1, worker_count), sizeof(threadqueue_worker_t));
+  if (!threadqueue->workers) {
+    fprintf(stderr, "Could not malloc threadqueue->workers!\n");
+    goto failed;
+  }
+  threadqueue->worker_count = worker_count;
+  for (int i = 0; i < worker_count; i++) {
+    threadqueue_worker_t *worker = &threadqueue->workers[i];
+    worker->jobs = MALLOC(threadqueue_job_t*, THREADQUEUE_HEAP_INITIAL_SIZE);
+    if (!worker->jobs || pthread_mutex_init(&worker->lock, NULL) != 0) {
+      fprintf(stderr, "Could not initialize worker heap!\n");
+      goto failed;
+    }
+    worker->size        = THREADQUEUE_HEAP_INITIAL_SIZE;
+    worker->count       = 0;
+    worker->job_cache.free  = NULL;
+    worker->job_cache.count = 0;
+    worker->dep_cache.free  = NULL;
+    worker->dep_cache.count = 0;
+    worker->push_count  = 0;
+    worker->idle_time   = 0;
+    worker->id          = i;
+    worker->node        = 0;
+    worker->steal_order = NULL;
+    worker->threadqueue = threadqueue;
+  }
 
-  threadqueue->stop = false;
-
-  threadqueue->first              = NULL;
-  threadqueue->last               = NULL;
+  if (!threadqueue_place_workers(threadqueue, cpus, cpu_count, numa)) {
+    fprintf(stderr, "Could not place workers!\n");
+    goto failed;
+  }
 
   // Lock the queue before creating threads, to ensure they all have correct information.
   PTHREAD_LOCK(&threadqueue->lock);
   for (int i = 0; i < thread_count; i++) {
-    if (pthread_create(&threadqueue->threads[i], NULL, threadqueue_worker, threadqueue) != 0) {
-        fprintf(stderr, "pthread_create failed!\n");
-        goto failed;
+    if (!threadqueue_spawn_worker(threadqueue)) {
+      PTHREAD_UNLOCK(&threadqueue->lock);
+      goto failed;
     }
-    threadqueue->thread_count++;
-    threadqueue->thread_running_count++;
   }
   PTHREAD_UNLOCK(&threadqueue->lock);
 
@@ -409,33 +1505,72 @@ failed:
 }
 
 
+/**
+ * \brief Allocate memory for jobs and dependencies in advance.
+ *
+ * Makes sure that the pools of the thread queue have room for at least the
+ * given number of jobs and dependencies so that creating them does not
+ * need to allocate memory.
+ *
+ * \param job_count   number of jobs
+ * \param dep_count   number of dependencies between the jobs
+ *
+ * \return 1 on success, 0 on failure
+ */
+int uvg_threadqueue_reserve(threadqueue_queue_t * threadqueue,
+                            int job_count,
+                            int dep_count)
+{
+  threadqueue_pool_t *pools[2] = { &threadqueue->job_pool, &threadqueue->dep_pool };
+  const int counts[2] = { job_count, dep_count };
+
+  for (int i = 0; i < 2; ++i) {
+    PTHREAD_LOCK(&pools[i]->lock);
+    const int missing = counts[i] - pools[i]->free_count;
+    if (missing > 0 && !threadqueue_pool_grow(pools[i], missing)) {
+      fprintf(stderr, "Could not reserve jobs!\n");
+      PTHREAD_UNLOCK(&pools[i]->lock);
+      return 0;
+    }
+    PTHREAD_UNLOCK(&pools[i]->lock);
+  }
+
+  return 1;
+}
+
+
 /**
  * \brief Create a job and return a pointer to it.
  *
  * The job is g_created in a paused state. Function uvg_threadqueue_submit
  * must be called on the job in order to have it run.
  *
+ * The memory of the job is taken from the pool of the thread queue, so the
+ * job must be freed before the thread queue.
+ *
  * \return pointer to the job, or NULL on failure
  */
-threadqueue_job_t * uvg_threadqueue_job_create(void (*fptr)(void *arg), void *arg)
+threadqueue_job_t * uvg_threadqueue_job_create(threadqueue_queue_t * threadqueue,
+                                               void (*fptr)(void *arg),
+                                               void *arg)
 {
-  threadqueue_job_t *job = MALLOC(threadqueue_job_t, 1);
+  threadqueue_worker_t *worker = threadqueue_own_worker(threadqueue);
+  threadqueue_job_t *job = threadqueue_pool_alloc(&threadqueue->job_pool,
+                                                  worker ? &worker->job_cache : NULL);
   if (!job) {
     fprintf(stderr, "Could not alloc job!\n");
     return NULL;
   }
 
-  if (pthread_mutex_init(&job->lock, NULL) != 0) {
-    fprintf(stderr, "pthread_mutex_init(job) failed!\n");
-    return NULL;
-  }
-
-  job->state = THREADQUEUE_JOB_STATE_PAUSED;
-  job->ndepends       = 0;
+  job->threadqueue    = threadqueue;
+  job->state          = THREADQUEUE_JOB_STATE_PAUSED;
+  // The extra dependency is removed when the job is submitted.
+  job->ndepends       = 1;
   job->rdepends       = NULL;
-  job->rdepends_count = 0;
-  job->rdepends_size  = 0;
   job->refcount       = 1;
+  job->priority       = 0;
+  job->node           = -1;
+  job->ready_order    = 0;
   job->fptr           = fptr;
   job->arg            = arg;
 
@@ -443,24 +1578,256 @@ threadqueue_job_t * uvg_threadqueue_job_create(void (*fptr)(void *arg), void *ar
 }
 
 
-int uvg_threadqueue_submit(threadqueue_queue_t * const threadqueue, threadqueue_job_t *job)
+/**
+ * \brief Count a submitted job and make room for it in every ready job heap.
+ *
+ * A job may be added to the heap of any worker, when it is submitted or
+ * later when its dependencies are done. Growing the heaps here means that
+ * adding a job to a heap never fails, so threadqueue_job_done can not
+ * lose a released job.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_reserve_heaps(threadqueue_queue_t *threadqueue)
 {
+  const int pending = UVG_ATOMIC_INC(&threadqueue->pending_count);
+  if (pending <= UVG_ATOMIC_LOAD(&threadqueue->heap_size)) return 1;
+
+  int success = 1;
   PTHREAD_LOCK(&threadqueue->lock);
-  PTHREAD_LOCK(&job->lock);
-  assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
+  if (pending > threadqueue->heap_size) {
+    int new_size = threadqueue->heap_size * 2;
+    while (new_size < pending) new_size *= 2;
+
+    for (int i = 0; success && i < threadqueue->worker_count; ++i) {
+      threadqueue_worker_t *worker = &threadqueue->workers[i];
+      PTHREAD_LOCK(&worker->lock);
+      if (worker->size < new_size) {
+        threadqueue_job_t **jobs = realloc(worker->jobs, new_size * sizeof(threadqueue_job_t*));
+        if (jobs) {
+          worker->jobs = jobs;
+          worker->size = new_size;
+        } else {
+          success = 0;
+        }
+      }
+      PTHREAD_UNLOCK(&worker->lock);
+    }
+
+    if (success) {
+      UVG_ATOMIC_STORE(&threadqueue->heap_size, new_size);
+    } else {
+      fprintf(stderr, "Could not grow worker heaps!\n");
+      UVG_ATOMIC_DEC(&threadqueue->pending_count);
+    }
+  }
+  PTHREAD_UNLOCK(&threadqueue->lock);
+
+  return success;
+}
 
-  if (threadqueue->thread_count == 0) {
-    // When not using threads, run the job immediately.
+
+int uvg_threadqueue_submit(threadqueue_queue_t * const threadqueue, threadqueue_job_t *job)
+{
+  assert(UVG_ATOMIC_LOAD(&job->state) == THREADQUEUE_JOB_STATE_PAUSED);
+
+  if (threadqueue->worker_count == 0) {
+    // When not using threads, run the job immediately. All of the
+    // dependencies have been run already.
+    UVG_ATOMIC_STORE(&job->state, THREADQUEUE_JOB_STATE_RUNNING);
     job->fptr(job->arg);
-    job->state = THREADQUEUE_JOB_STATE_DONE;
-  } else if (job->ndepends == 0) {
+    UVG_ATOMIC_STORE(&job->state, THREADQUEUE_JOB_STATE_DONE);
+
+    threadqueue_dep_t *rdepends = UVG_ATOMIC_XCHG_PTR(&job->rdepends, THREADQUEUE_RDEPENDS_DONE);
+    threadqueue_free_rdepends(threadqueue, rdepends);
+    return 1;
+  }
+
+  if (!threadqueue_reserve_heaps(threadqueue)) {
+    return 0;
+  }
+
+  UVG_ATOMIC_STORE(&job->state, THREADQUEUE_JOB_STATE_WAITING);
+
+  // Remove the extra dependency added in uvg_threadqueue_job_create.
+  if (UVG_ATOMIC_DEC(&job->ndepends) == 0) {
     threadqueue_push_job(threadqueue, uvg_threadqueue_copy_ref(job));
-    pthread_cond_signal(&threadqueue->job_available);
-  } else {
-    job->state = THREADQUEUE_JOB_STATE_WAITING;
+    threadqueue_wake_workers(threadqueue, 1);
   }
-  PTHREAD_UNLOCK(&job->lock);
-  PTHREAD_UNLOCK(&threadqueue->lock);
+
+  return 1;
+}
+
+
+/**
+ * \brief Set the scheduling priority of a job.
+ *
+ * Of the jobs that are ready to run, the ones with higher priority are run
+ * first. Jobs have priority zero by default. The priority must be set
+ * before the job is submitted.
+ */
+void uvg_threadqueue_job_set_priority(threadqueue_job_t *job, int64_t priority)
+{
+  assert(UVG_ATOMIC_LOAD(&job->state) == THREADQUEUE_JOB_STATE_PAUSED);
+  job->priority = priority;
+}
+
+
+/**
+ * \brief Set the preferred NUMA node of a job.
+ *
+ * The job is run on a worker of the node unless a worker of another node
+ * steals it. Has no effect unless the thread queue uses NUMA-aware
+ * scheduling. The node must be set before the job is submitted.
+ *
+ * \param node   index of the node, less than uvg_threadqueue_node_count,
+ *               or -1 for any node
+ */
+void uvg_threadqueue_job_set_node(threadqueue_job_t *job, int node)
+{
+  assert(UVG_ATOMIC_LOAD(&job->state) == THREADQUEUE_JOB_STATE_PAUSED);
+  job->node = node;
+}
+
+
+/**
+ * \brief Get the number of active worker threads.
+ */
+int uvg_threadqueue_thread_count(const threadqueue_queue_t *threadqueue)
+{
+  return UVG_ATOMIC_LOAD(&threadqueue->active_count);
+}
+
+
+/**
+ * \brief Get the maximum number of worker threads.
+ */
+int uvg_threadqueue_max_thread_count(const threadqueue_queue_t *threadqueue)
+{
+  return threadqueue->worker_count;
+}
+
+
+/**
+ * \brief Change the number of active worker threads.
+ *
+ * Threads are created when needed. Workers beyond the new count finish
+ * the jobs they are running and then park until they are activated again.
+ * The count is limited to between one and the maximum number of threads.
+ * Has no effect on a queue without threads.
+ *
+ * \return the new number of active threads, or -1 on failure
+ */
+int uvg_threadqueue_set_thread_count(threadqueue_queue_t *threadqueue, int thread_count)
+{
+  if (threadqueue->worker_count == 0) return 0;
+
+  thread_count = CLIP(1, threadqueue->worker_count, thread_count);
+
+  pthread_mutex_lock(&threadqueue->lock);
+  if (threadqueue->stop) {
+    pthread_mutex_unlock(&threadqueue->lock);
+    return -1;
+  }
+
+  while (threadqueue->thread_count < thread_count) {
+    if (!threadqueue_spawn_worker(threadqueue)) {
+      thread_count = threadqueue->thread_count;
+      break;
+    }
+  }
+
+  UVG_ATOMIC_STORE(&threadqueue->active_count, thread_count);
+  pthread_cond_broadcast(&threadqueue->resized);
+  // Let sleeping workers that are no longer active park.
+  pthread_cond_broadcast(&threadqueue->job_available);
+  pthread_mutex_unlock(&threadqueue->lock);
+
+  return thread_count;
+}
+
+
+/**
+ * \brief Get the total time the worker threads have been idle.
+ *
+ * The time of each worker is counted from when it runs out of jobs until
+ * it finds a new one. Parked workers are not idle. The counter wraps
+ * around so only differences over short intervals are meaningful.
+ *
+ * \return idle time in microseconds
+ */
+uint32_t uvg_threadqueue_idle_time(const threadqueue_queue_t *threadqueue)
+{
+  uint32_t idle_time = 0;
+  for (int i = 0; i < threadqueue->worker_count; ++i) {
+    idle_time += (uint32_t)UVG_ATOMIC_LOAD(&threadqueue->workers[i].idle_time);
+  }
+  return idle_time;
+}
+
+
+/**
+ * \brief Get the next number of a sequence shared by all users of the
+ * thread queue.
+ *
+ * Encoders sharing the thread queue number their frames with it so that
+ * the priorities of their jobs can be compared with each other.
+ *
+ * \return the number, or -1 on failure
+ */
+int64_t uvg_threadqueue_next_sequence(threadqueue_queue_t *threadqueue)
+{
+  if (pthread_mutex_lock(&threadqueue->lock) != 0) return -1;
+  const int64_t sequence = ++threadqueue->sequence;
+  pthread_mutex_unlock(&threadqueue->lock);
+  return sequence;
+}
+
+
+/**
+ * \brief Get the number of NUMA nodes the workers are on.
+ *
+ * \return the number of nodes, 1 if NUMA-aware scheduling is not used
+ */
+int uvg_threadqueue_node_count(const threadqueue_queue_t *threadqueue)
+{
+  return threadqueue->node_count;
+}
+
+
+/**
+ * \brief Move memory to a NUMA node.
+ *
+ * Only the pages completely inside the memory area are moved. Does nothing
+ * unless the thread queue uses NUMA-aware scheduling.
+ *
+ * \param node   index of the node or -1 for any node
+ *
+ * \return 1 on success, 0 on failure
+ */
+int uvg_threadqueue_bind_memory(const threadqueue_queue_t *threadqueue,
+                                void *ptr,
+                                size_t size,
+                                int node)
+{
+  if (node < 0 || threadqueue->node_count <= 1) return 1;
+
+#if defined(__linux__) && defined(SYS_mbind)
+  const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t begin = ((uintptr_t)ptr + page_size - 1) & ~(page_size - 1);
+  const uintptr_t end   = ((uintptr_t)ptr + size) & ~(page_size - 1);
+  if (end <= begin) return 1;
+
+  const int bits = 8 * sizeof(unsigned long);
+  unsigned long mask[THREADQUEUE_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+  const int os_node = threadqueue->node_ids[node % threadqueue->node_count];
+  mask[os_node / bits] |= 1UL << (os_node % bits);
+
+  if (syscall(SYS_mbind, (void*)begin, end - begin, THREADQUEUE_MPOL_PREFERRED,
+              mask, THREADQUEUE_MAX_NODES + 1, THREADQUEUE_MPOL_MF_MOVE) != 0) {
+    return 0;
+  }
+#endif
 
   return 1;
 }
@@ -477,31 +1844,37 @@ int uvg_threadqueue_submit(threadqueue_queue_t * const threadqueue, threadqueue_
  */
 int uvg_threadqueue_job_dep_add(threadqueue_job_t *job, threadqueue_job_t *dependency)
 {
-  // Lock the dependency first and then the job depending on it.
-  // This must be the same order as in threadqueue_worker.
-  PTHREAD_LOCK(&dependency->lock);
-
-  if (dependency->state == THREADQUEUE_JOB_STATE_DONE) {
-    // The dependency has been completed already so there is nothing to do.
-    PTHREAD_UNLOCK(&dependency->lock);
-    return 1;
+  // Dependencies must be added before the job is submitted so that the
+  // extra dependency keeps ndepends above zero.
+  threadqueue_queue_t *threadqueue = job->threadqueue;
+  threadqueue_worker_t *worker = threadqueue_own_worker(threadqueue);
+  threadqueue_cache_t *cache = worker ? &worker->dep_cache : NULL;
+
+  threadqueue_dep_t *dep = threadqueue_pool_alloc(&threadqueue->dep_pool, cache);
+  if (!dep) {
+    fprintf(stderr, "Could not alloc dependency!\n");
+    return 0;
   }
+  dep->job = uvg_threadqueue_copy_ref(job);
 
-  PTHREAD_LOCK(&job->lock);
-  job->ndepends++;
-  PTHREAD_UNLOCK(&job->lock);
-
-  // Add the reverse dependency
-  if (dependency->rdepends_count >= dependency->rdepends_size) {
-    dependency->rdepends_size += THREADQUEUE_LIST_REALLOC_SIZE;
-    size_t bytes = dependency->rdepends_size * sizeof(threadqueue_job_t*);
-    dependency->rdepends = realloc(dependency->rdepends, bytes);
-  }
-  dependency->rdepends[dependency->rdepends_count++] = uvg_threadqueue_copy_ref(job);
+  UVG_ATOMIC_INC(&job->ndepends);
 
-  PTHREAD_UNLOCK(&dependency->lock);
+  // Add the reverse dependency unless the dependency has been completed.
+  for (;;) {
+    threadqueue_dep_t *head = UVG_ATOMIC_LOAD_PTR(&dependency->rdepends);
+    if (head == THREADQUEUE_RDEPENDS_DONE) {
+      // The dependency has been completed already so there is nothing to do.
+      UVG_ATOMIC_DEC(&job->ndepends);
+      uvg_threadqueue_free_job(&dep->job);
+      threadqueue_pool_free(&threadqueue->dep_pool, cache, dep);
+      return 1;
+    }
 
-  return 1;
+    dep->next = head;
+    if (UVG_ATOMIC_CAS_PTR(&dependency->rdepends, head, dep)) {
+      return 1;
+    }
+  }
 }
 
 
@@ -542,29 +1915,47 @@ void uvg_threadqueue_free_job(threadqueue_job_t **job_ptr)
 
   assert(new_refcount == 0);
 
-  for (int i = 0; i < job->rdepends_count; i++) {
-    uvg_threadqueue_free_job(&job->rdepends[i]);
-  }
-  job->rdepends_count = 0;
+  threadqueue_queue_t *threadqueue = job->threadqueue;
+  threadqueue_free_rdepends(threadqueue, job->rdepends);
+  job->rdepends = NULL;
 
-  FREE_POINTER(job->rdepends);
-  pthread_mutex_destroy(&job->lock);
-  FREE_POINTER(job);
+  threadqueue_worker_t *worker = threadqueue_own_worker(threadqueue);
+  threadqueue_pool_free(&threadqueue->job_pool, worker ? &worker->job_cache : NULL, job);
 }
 
 
 /**
  * \brief Wait for a job to be completed.
  *
+ * If caller_runs was set in uvg_threadqueue_init, the calling thread runs
+ * jobs that are ready until the job is done. Otherwise the thread sleeps.
+ *
  * \return 1 on success, 0 on failure
  */
 int uvg_threadqueue_waitfor(threadqueue_queue_t * threadqueue, threadqueue_job_t * job)
 {
-  PTHREAD_LOCK(&job->lock);
-  while (job->state != THREADQUEUE_JOB_STATE_DONE) {
-    PTHREAD_COND_WAIT(&threadqueue->job_done, &job->lock);
+  // Worker threads are busy running jobs already.
+  const bool caller_runs = threadqueue->caller_runs &&
+                           threadqueue_current_worker == NULL;
+
+  while (UVG_ATOMIC_LOAD(&job->state) != THREADQUEUE_JOB_STATE_DONE) {
+    if (caller_runs) {
+      threadqueue_job_t *ready_job = threadqueue_pop_job(threadqueue, NULL);
+      if (ready_job) {
+        threadqueue_run_job(threadqueue, ready_job);
+        continue;
+      }
+    }
+
+    // Sleep until some job is completed.
+    PTHREAD_LOCK(&threadqueue->lock);
+    UVG_ATOMIC_INC(&threadqueue->waiting_count);
+    if (UVG_ATOMIC_LOAD(&job->state) != THREADQUEUE_JOB_STATE_DONE) {
+      PTHREAD_COND_WAIT(&threadqueue->job_done, &threadqueue->lock);
+    }
+    UVG_ATOMIC_DEC(&threadqueue->waiting_count);
+    PTHREAD_UNLOCK(&threadqueue->lock);
   }
-  PTHREAD_UNLOCK(&job->lock);
 
   return 1;
 }
@@ -589,8 +1980,9 @@ int uvg_threadqueue_stop(threadqueue_queue_t * const threadqueue)
   }
 
   // Tell all threads to stop.
-  threadqueue->stop = true;
+  UVG_ATOMIC_STORE(&threadqueue->stop, 1);
   PTHREAD_COND_BROADCAST(&threadqueue->job_available);
+  PTHREAD_COND_BROADCAST(&threadqueue->resized);
   PTHREAD_UNLOCK(&threadqueue->lock);
 
   // Wait for them to stop.
@@ -617,16 +2009,32 @@ void uvg_threadqueue_free(threadqueue_queue_t *threadqueue)
   uvg_threadqueue_stop(threadqueue);
 
   // Free all jobs.
-  while (threadqueue->first) {
-    threadqueue_job_t *next = threadqueue->first->next;
-    uvg_threadqueue_free_job(&threadqueue->first);
-    threadqueue->first = next;
+  if (threadqueue->workers) {
+    for (int i = 0; i < threadqueue->worker_count; i++) {
+      threadqueue_worker_t *worker = &threadqueue->workers[i];
+      threadqueue_job_t *job;
+      while ((job = threadqueue_worker_pop(worker)) != NULL) {
+        uvg_threadqueue_free_job(&job);
+      }
+      FREE_POINTER(worker->jobs);
+      FREE_POINTER(worker->steal_order);
+      pthread_mutex_destroy(&worker->lock);
+    }
+    FREE_POINTER(threadqueue->workers);
   }
-  threadqueue->last = NULL;
+  FREE_POINTER(threadqueue->node_workers);
 
   FREE_POINTER(threadqueue->threads);
   threadqueue->thread_count = 0;
 
+  // The objects in the caches of the workers are freed with the pools.
+  if (threadqueue->job_pool.object_size) {
+    threadqueue_pool_destroy(&threadqueue->job_pool);
+  }
+  if (threadqueue->dep_pool.object_size) {
+    threadqueue_pool_destroy(&threadqueue->dep_pool);
+  }
+
   if (pthread_mutex_destroy(&threadqueue->lock) != 0) {
     fprintf(stderr, "pthread_mutex_destroy failed!\n");
   }
@@ -639,5 +2047,9 @@ void uvg_threadqueue_free(threadqueue_queue_t *threadqueue)
     fprintf(stderr, "pthread_cond_destroy failed!\n");
   }
 
+  if (pthread_cond_destroy(&threadqueue->resized) != 0) {
+    fprintf(stderr, "pthread_cond_destroy failed!\n");
+  }
+
   FREE_POINTER(threadqueue);
 }
@@ -44,9 +44,21 @@
 typedef struct threadqueue_job_t threadqueue_job_t;
 typedef struct threadqueue_queue_t threadqueue_queue_t;
 
-threadqueue_queue_t * uvg_threadqueue_init(int thread_count);
+threadqueue_queue_t * uvg_threadqueue_init(int thread_count,
+                                           int max_thread_count,
+                                           bool caller_runs,
+                                           int idle_spin,
+                                           const int32_t *cpus,
+                                           int cpu_count,
+                                           bool numa);
 
-threadqueue_job_t * uvg_threadqueue_job_create(void (*fptr)(void *arg), void *arg);
+int uvg_threadqueue_reserve(threadqueue_queue_t * threadqueue, int job_count, int dep_count);
+
+threadqueue_job_t * uvg_threadqueue_job_create(threadqueue_queue_t * threadqueue,
+                                               void (*fptr)(void *arg),
+                                               void *arg);
+void uvg_threadqueue_job_set_priority(threadqueue_job_t *job, int64_t priority);
+void uvg_threadqueue_job_set_node(threadqueue_job_t *job, int node);
 int uvg_threadqueue_submit(threadqueue_queue_t * threadqueue, threadqueue_job_t *job);
 
 int uvg_threadqueue_job_dep_add(threadqueue_job_t *job, threadqueue_job_t *dependency);
@@ -58,3 +70,11 @@ void uvg_threadqueue_free_job(threadqueue_job_t **job_ptr);
 int uvg_threadqueue_waitfor(threadqueue_queue_t * threadqueue, threadqueue_job_t * job);
 int uvg_threadqueue_stop(threadqueue_queue_t * threadqueue);
 void uvg_threadqueue_free(threadqueue_queue_t * threadqueue);
+
+int uvg_threadqueue_thread_count(const threadqueue_queue_t * threadqueue);
+int uvg_threadqueue_max_thread_count(const threadqueue_queue_t * threadqueue);
+int uvg_threadqueue_set_thread_count(threadqueue_queue_t * threadqueue, int thread_count);
+uint32_t uvg_threadqueue_idle_time(const threadqueue_queue_t * threadqueue);
+int64_t uvg_threadqueue_next_sequence(threadqueue_queue_t * threadqueue);
+int uvg_threadqueue_node_count(const threadqueue_queue_t * threadqueue);
+int uvg_threadqueue_bind_memory(const threadqueue_queue_t * threadqueue, void *ptr, size_t size, int node);
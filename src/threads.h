@@ -45,6 +45,7 @@
 #if defined(__GNUC__) && !defined(__MINGW32__) 
 #include <unistd.h> // IWYU pragma: export
 #include <time.h> // IWYU pragma: export
+#include <sched.h> // IWYU pragma: export
 
 #define UVG_CLOCK_T struct timespec
 
@@ -67,6 +68,29 @@
 
 #define UVG_ATOMIC_INC(ptr)                     __sync_add_and_fetch((volatile int32_t*)ptr, 1)
 #define UVG_ATOMIC_DEC(ptr)                     __sync_add_and_fetch((volatile int32_t*)ptr, -1)
+#define UVG_ATOMIC_ADD(ptr, val)                __sync_add_and_fetch((volatile int32_t*)ptr, (val))
+#define UVG_ATOMIC_LOAD(ptr)                    __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define UVG_ATOMIC_STORE(ptr, val)              __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define UVG_ATOMIC_LOAD_PTR(ptr)                __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define UVG_ATOMIC_CAS_PTR(ptr, oldval, newval) __sync_bool_compare_and_swap((ptr), (oldval), (newval))
+#define UVG_ATOMIC_XCHG_PTR(ptr, val)           __atomic_exchange_n((ptr), (val), __ATOMIC_ACQ_REL)
+#define UVG_ATOMIC_ADD64(ptr, val)              __sync_add_and_fetch((volatile int64_t*)ptr, (val))
+#define UVG_ATOMIC_LOAD64(ptr)                  __atomic_load_n((volatile int64_t*)(ptr), __ATOMIC_ACQUIRE)
+#define UVG_ATOMIC_CAS64(ptr, oldval, newval)   __sync_bool_compare_and_swap((volatile int64_t*)(ptr), (oldval), (newval))
+
+#define UVG_MEMORY_BARRIER()                    __sync_synchronize()
+
+#define UVG_THREAD_LOCAL                        __thread
+
+#define UVG_THREAD_YIELD()                      sched_yield()
+
+#if defined(__i386__) || defined(__x86_64__)
+#  define UVG_CPU_PAUSE()                       __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#  define UVG_CPU_PAUSE()                       __asm__ __volatile__("yield")
+#else
+#  define UVG_CPU_PAUSE()
+#endif
 
 #else //__GNUC__
 //TODO: we assume !GCC => Windows... this may be bad
@@ -81,6 +105,24 @@
 
 #define UVG_ATOMIC_INC(ptr)                     InterlockedIncrement((volatile LONG*)ptr)
 #define UVG_ATOMIC_DEC(ptr)                     InterlockedDecrement((volatile LONG*)ptr)
+#define UVG_ATOMIC_ADD(ptr, val)                (InterlockedExchangeAdd((volatile LONG*)ptr, (val)) + (val))
+// Volatile accesses have acquire and release semantics in Visual Studio.
+#define UVG_ATOMIC_LOAD(ptr)                    (*(volatile const int32_t*)(ptr))
+#define UVG_ATOMIC_STORE(ptr, val)              (*(volatile int32_t*)(ptr) = (val))
+#define UVG_ATOMIC_LOAD_PTR(ptr)                (*(void * volatile const *)(ptr))
+#define UVG_ATOMIC_CAS_PTR(ptr, oldval, newval) (InterlockedCompareExchangePointer((PVOID volatile*)(ptr), (newval), (oldval)) == (PVOID)(oldval))
+#define UVG_ATOMIC_XCHG_PTR(ptr, val)           InterlockedExchangePointer((PVOID volatile*)(ptr), (val))
+#define UVG_ATOMIC_ADD64(ptr, val)              (InterlockedExchangeAdd64((volatile LONG64*)ptr, (val)) + (val))
+#define UVG_ATOMIC_LOAD64(ptr)                  (*(volatile const int64_t*)(ptr))
+#define UVG_ATOMIC_CAS64(ptr, oldval, newval)   (InterlockedCompareExchange64((volatile LONG64*)(ptr), (newval), (oldval)) == (oldval))
+
+#define UVG_MEMORY_BARRIER()                    MemoryBarrier()
+
+#define UVG_THREAD_LOCAL                        __declspec(thread)
+
+#define UVG_THREAD_YIELD()                      SwitchToThread()
+
+#define UVG_CPU_PAUSE()                         YieldProcessor()
 
 #endif //__GNUC__
 
@@ -32,6 +32,7 @@
 
 #include "uvg266.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,18 +50,60 @@
 #include "uvg266_internal.h"
 #include "strategyselector.h"
 #include "threadqueue.h"
+#include "threads.h"
 #include "videoframe.h"
 #include "rate_control.h"
 
 
+/**
+ * \brief Minimum number of frames in a window for adapting the number of
+ * frames encoded in parallel.
+ */
+#define OWF_ADAPT_MIN_WINDOW 4
+
+/**
+ * \brief Fraction of worker time spent idle above which more frames are
+ * encoded in parallel.
+ */
+#define OWF_ADAPT_IDLE_HIGH 0.10
+
+/**
+ * \brief Fraction of worker time spent idle below which fewer frames are
+ * encoded in parallel.
+ */
+#define OWF_ADAPT_IDLE_LOW 0.02
+
+/**
+ * \brief Relative increase in frame rate required to keep an additional
+ * parallel frame.
+ */
+#define OWF_ADAPT_MIN_GAIN 0.02
+
+/**
+ * \brief Number of windows without changes after undoing a change.
+ */
+#define OWF_ADAPT_HOLD 8
+
+
 static void uvg266_close(uvg_encoder *encoder)
 {
   if (encoder) {
     // The threadqueue must be stopped before freeing states.
-    if (encoder->control) {
+    if (encoder->control && !encoder->control->threadqueue_shared) {
       uvg_threadqueue_stop(encoder->control->threadqueue);
     }
 
+    // A shared threadqueue keeps running the jobs of other encoders so
+    // wait for the frames of this encoder to be completed instead.
+    if (encoder->control && encoder->control->threadqueue_shared && encoder->states) {
+      for (unsigned i = 0; i < encoder->num_encoder_states; ++i) {
+        if (encoder->states[i].tqj_bitstream_written) {
+          uvg_threadqueue_waitfor(encoder->control->threadqueue,
+                                  encoder->states[i].tqj_bitstream_written);
+        }
+      }
+    }
+
     if (encoder->states) {
       // Flush input frame buffer.
       uvg_picture *pic = NULL;
@@ -77,8 +120,10 @@ static void uvg266_close(uvg_encoder *encoder)
       }
     }
     FREE_POINTER(encoder->states);
+    FREE_POINTER(encoder->adaptive_tiles.ctu_bits[0]);
+    FREE_POINTER(encoder->adaptive_tiles.ctu_bits[1]);
+    FREE_POINTER(encoder->adaptive_tiles.state_layout);
 
-    uvg_free_rc_data();
     // Discard const from the pointer.
     uvg_encoder_control_free((void*) encoder->control);
     encoder->control = NULL;
@@ -87,13 +132,15 @@ static void uvg266_close(uvg_encoder *encoder)
 }
 
 
-static uvg_encoder * uvg266_open(const uvg_config *cfg)
+static uvg_encoder * uvg266_open_with_pool(const uvg_config *cfg, uvg_thread_pool *pool)
 {
   uvg_encoder *encoder = NULL;
 
   //Initialize strategies
   // TODO: Make strategies non-global
-  if (!uvg_strategyselector_init(cfg->cpuid, UVG_BIT_DEPTH)) {
+  // Strategies of encoders sharing a pool are initialized with the pool
+  // because other encoders may already be using them.
+  if (!pool && !uvg_strategyselector_init(cfg->cpuid, UVG_BIT_DEPTH)) {
     fprintf(stderr, "Failed to initialize strategies.\n");
     goto uvg266_open_failure;
   }
@@ -103,7 +150,7 @@ static uvg_encoder * uvg266_open(const uvg_config *cfg)
     goto uvg266_open_failure;
   }
 
-  encoder->control = uvg_encoder_control_init(cfg);
+  encoder->control = uvg_encoder_control_init(cfg, pool ? pool->threadqueue : NULL);
   if (!encoder->control) {
     goto uvg266_open_failure;
   }
@@ -113,10 +160,25 @@ static uvg_encoder * uvg266_open(const uvg_config *cfg)
   encoder->out_state_num = 0;
   encoder->frames_started = 0;
   encoder->frames_done = 0;
+  encoder->frames_in_flight = encoder->num_encoder_states;
 
-  // Assure that the rc data allocation was successful
-  if(!uvg_get_rc_data(encoder->control)) {
-    goto uvg266_open_failure;
+  encoder->owf_adapt.enabled = cfg->adaptive_owf &&
+                               encoder->num_encoder_states > 1 &&
+                               uvg_threadqueue_thread_count(encoder->control->threadqueue) > 0;
+
+  if (cfg->adaptive_tiles > 0 && !encoder->control->tiles_enable) {
+    fprintf(stderr, "--adaptive-tiles has no effect with a single tile.\n");
+  }
+  if (cfg->adaptive_tiles > 0 && encoder->control->tiles_enable) {
+    const int num_lcus = encoder->control->in.width_in_lcu * encoder->control->in.height_in_lcu;
+    encoder->adaptive_tiles.ctu_bits[0] = calloc(num_lcus, sizeof(uint64_t));
+    encoder->adaptive_tiles.ctu_bits[1] = calloc(num_lcus, sizeof(uint64_t));
+    encoder->adaptive_tiles.state_layout = calloc(encoder->num_encoder_states, sizeof(unsigned));
+    if (!encoder->adaptive_tiles.ctu_bits[0] ||
+        !encoder->adaptive_tiles.ctu_bits[1] ||
+        !encoder->adaptive_tiles.state_layout) {
+      goto uvg266_open_failure;
+    }
   }
 
   uvg_init_input_frame_buffer(&encoder->input_buffer);
@@ -133,6 +195,10 @@ static uvg_encoder * uvg266_open(const uvg_config *cfg)
     }
 
     encoder->states[i].frame->QP = (int8_t)cfg->qp;
+
+    // Each parallel frame runs on its own NUMA node if there are several.
+    const int num_nodes = uvg_threadqueue_node_count(encoder->control->threadqueue);
+    encoder->states[i].frame->numa_node = num_nodes > 1 ? (int)(i % num_nodes) : -1;
   }
 
   for (uint32_t i = 0; i < encoder->num_encoder_states; ++i) {
@@ -154,6 +220,88 @@ uvg266_open_failure:
 }
 
 
+static uvg_encoder * uvg266_open(const uvg_config *cfg)
+{
+  return uvg266_open_with_pool(cfg, NULL);
+}
+
+
+static uvg_thread_pool * uvg266_thread_pool_alloc(const uvg_config *cfg)
+{
+  // Strategies are initialized for detecting the number of CPUs.
+  if (!uvg_strategyselector_init(cfg->cpuid, UVG_BIT_DEPTH)) {
+    fprintf(stderr, "Failed to initialize strategies.\n");
+    return NULL;
+  }
+
+  uvg_thread_pool *pool = calloc(1, sizeof(uvg_thread_pool));
+  if (!pool) {
+    return NULL;
+  }
+
+  pool->threadqueue = uvg_encoder_threadqueue_init(cfg, cfg->threads);
+  if (!pool->threadqueue) {
+    FREE_POINTER(pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
+
+static int32_t uvg266_set_threads(uvg_encoder *encoder, int32_t threads)
+{
+  return uvg_threadqueue_set_thread_count(encoder->control->threadqueue, threads);
+}
+
+
+static void uvg266_thread_pool_free(uvg_thread_pool *pool)
+{
+  if (pool) {
+    uvg_threadqueue_free(pool->threadqueue);
+  }
+  FREE_POINTER(pool);
+}
+
+
+/**
+ * \brief Value that is reported instead of PSNR when SSE is zero.
+ */
+static const double MAX_PSNR = 999.99;
+
+/**
+ * \brief Combine the PSNR and SSIM of the LCU rows of a frame.
+ */
+static void set_frame_quality(uvg_frame_info *const info, const encoder_state_t *const state)
+{
+  const uvg_picture *const src = state->tile->frame->source;
+  const double max_squared_error = (double)PIXEL_MAX * (double)PIXEL_MAX;
+  const int colors = src->chroma_format == UVG_CSP_400 ? 1 : 3;
+
+  memset(info->psnr, 0, sizeof(info->psnr));
+  memset(info->ssim, 0, sizeof(info->ssim));
+
+  for (int c = 0; c < colors && state->stats_rows; ++c) {
+    uint64_t sse = 0;
+    double ssim = 0.0;
+    uint32_t ssim_blocks = 0;
+    for (int row = 0; row < state->stats_row_count; ++row) {
+      sse += state->stats_rows[row].sse[c];
+      ssim += state->stats_rows[row].ssim[c];
+      ssim_blocks += state->stats_rows[row].ssim_blocks[c];
+    }
+
+    if (state->encoder_control->cfg.calc_psnr) {
+      const int32_t num_pixels = (src->width * src->height) >> (c == COLOR_Y ? 0 : 2);
+      // Avoid division by zero
+      info->psnr[c] = sse == 0 ? MAX_PSNR : 10.0 * log10(num_pixels * max_squared_error / sse);
+    }
+    if (state->encoder_control->cfg.calc_ssim && ssim_blocks > 0) {
+      info->ssim[c] = ssim / ssim_blocks;
+    }
+  }
+}
+
 static void set_frame_info(uvg_frame_info *const info, const encoder_state_t *const state)
 {
   info->poc = state->frame->poc,
@@ -174,6 +322,8 @@ static void set_frame_info(uvg_frame_info *const info, const encoder_state_t *co
 
   info->ref_list_len[0] = state->frame->ref_LX_size[0];
   info->ref_list_len[1] = state->frame->ref_LX_size[1];
+
+  set_frame_quality(info, state);
 }
 
 
@@ -241,6 +391,181 @@ static int yuv_io_extract_field(const uvg_picture *frame_in, unsigned source_sca
 }
 
 
+/**
+ * \brief Start a new window for measuring the parallel efficiency.
+ */
+static void owf_adapt_start_window(uvg_encoder *enc)
+{
+  UVG_CLOCK_T now;
+  UVG_GET_TIME(&now);
+  enc->owf_adapt.start_time = UVG_CLOCK_T_AS_DOUBLE(now);
+  enc->owf_adapt.start_idle_time = uvg_threadqueue_idle_time(enc->control->threadqueue);
+  enc->owf_adapt.start_frames = enc->frames_done;
+}
+
+
+/**
+ * \brief Adapt the number of frames encoded in parallel.
+ *
+ * Called after a frame has been output. At the end of each window of at
+ * least frames_in_flight frames, one frame is added if the workers were
+ * idle for a significant part of the window and one is removed if they
+ * were busy nearly all the time. A change that made the frame rate or the
+ * idle time worse is undone and followed by a few windows without
+ * changes, so the number settles at the smallest value that keeps the
+ * workers busy.
+ */
+static void owf_adapt_frame_done(uvg_encoder *enc)
+{
+  if (enc->frames_done == 1) {
+    // Skip the first frame, which has nothing to run in parallel with.
+    owf_adapt_start_window(enc);
+    return;
+  }
+
+  const unsigned frames = enc->frames_done - enc->owf_adapt.start_frames;
+  if (frames < MAX(OWF_ADAPT_MIN_WINDOW, enc->frames_in_flight)) return;
+
+  UVG_CLOCK_T now;
+  UVG_GET_TIME(&now);
+  const double time = UVG_CLOCK_T_AS_DOUBLE(now) - enc->owf_adapt.start_time;
+  if (time <= 0) return;
+
+  const int threads = uvg_threadqueue_thread_count(enc->control->threadqueue);
+  const uint32_t idle_time = uvg_threadqueue_idle_time(enc->control->threadqueue) -
+                             enc->owf_adapt.start_idle_time;
+  const double idle = idle_time / (time * 1e6 * threads);
+  const double fps = frames / time;
+
+  int step = 0;
+  bool undo = false;
+  if (enc->owf_adapt.last_step < 0 && idle > OWF_ADAPT_IDLE_HIGH) {
+    // Too few frames to keep the workers busy.
+    step = 1;
+    undo = true;
+  } else if (enc->owf_adapt.last_step > 0 &&
+             fps < enc->owf_adapt.last_fps * (1 + OWF_ADAPT_MIN_GAIN)) {
+    // The additional frame did not help.
+    step = -1;
+    undo = true;
+  } else if (enc->owf_adapt.hold > 0) {
+    enc->owf_adapt.hold--;
+  } else if (idle > OWF_ADAPT_IDLE_HIGH) {
+    step = 1;
+  } else if (idle < OWF_ADAPT_IDLE_LOW) {
+    step = -1;
+  }
+
+  const unsigned old_frames_in_flight = enc->frames_in_flight;
+  enc->frames_in_flight = CLIP(1, (int)enc->num_encoder_states,
+                               (int)enc->frames_in_flight + step);
+
+  // Undoing a change is not checked again.
+  enc->owf_adapt.last_step = undo ? 0 : (int)enc->frames_in_flight - (int)old_frames_in_flight;
+  enc->owf_adapt.last_fps = fps;
+  if (undo) {
+    enc->owf_adapt.hold = OWF_ADAPT_HOLD;
+  }
+
+  owf_adapt_start_window(enc);
+}
+
+
+/**
+ * \brief Add the bits spent on each CTU of the next frame to the adaptive
+ * tiles cost.
+ *
+ * \param state  state holding the frame after its bitstream has been written
+ */
+static void adaptive_tiles_add_frame(uvg_encoder *enc, const encoder_state_t *state)
+{
+  const int num_lcus = enc->control->in.width_in_lcu * enc->control->in.height_in_lcu;
+  const unsigned block = enc->adaptive_tiles.frames_added / enc->control->cfg.adaptive_tiles;
+  uint64_t *const ctu_bits = enc->adaptive_tiles.ctu_bits[block % 2];
+
+  for (int lcu = 0; lcu < num_lcus; ++lcu) {
+    ctu_bits[lcu] += state->frame->lcu_stats[lcu].bits;
+  }
+  enc->adaptive_tiles.frames_added += 1;
+}
+
+
+/**
+ * \brief Move the tile boundaries to balance the work between the tiles.
+ *
+ * Called before starting a frame whose number is a multiple of the
+ * interval N, and at least 2N. The tiles are balanced by the bits spent on
+ * each CTU in the frames from 2N to N frames back. Bits are used instead of
+ * time so that the result does not depend on the threads. Only the frames
+ * more than N frames back are waited for if they are still being encoded,
+ * so the latest N frames keep running. The new layout is used by the frames
+ * started after this.
+ */
+static void adaptive_tiles_rebalance(uvg_encoder *enc, encoder_state_t *state)
+{
+  encoder_control_t *const control = (encoder_control_t*)enc->control;
+  const int num_lcus = control->in.width_in_lcu * control->in.height_in_lcu;
+  const unsigned interval = control->cfg.adaptive_tiles;
+  uint64_t *const ctu_cost = enc->adaptive_tiles.ctu_bits[enc->frames_started / interval % 2];
+
+  while (enc->adaptive_tiles.frames_added < enc->frames_started - interval) {
+    const unsigned num = enc->adaptive_tiles.frames_added;
+    const encoder_state_t *const other = &enc->states[num % enc->num_encoder_states];
+    if (other->tqj_bitstream_written) {
+      uvg_threadqueue_waitfor(control->threadqueue, other->tqj_bitstream_written);
+    }
+    adaptive_tiles_add_frame(enc, other);
+  }
+
+  uint64_t total = 0;
+  for (int lcu = 0; lcu < num_lcus; ++lcu) {
+    total += ctu_cost[lcu];
+  }
+  // Every CTU takes some time to search even if it takes few bits.
+  const uint64_t base_cost = total / num_lcus / 2 + 1;
+  for (int lcu = 0; lcu < num_lcus; ++lcu) {
+    ctu_cost[lcu] += base_cost;
+  }
+
+  const int changed = uvg_encoder_control_balance_tiles(control, ctu_cost);
+  memset(ctu_cost, 0, num_lcus * sizeof(uint64_t));
+  if (changed) {
+    enc->adaptive_tiles.layout += 1;
+    state->frame->new_tile_layout = true;
+  }
+}
+
+
+/**
+ * \brief Recreate the child states of a state that starts a frame if the
+ * tile layout has changed since its previous frame.
+ *
+ * The previous frame of the state is done, so its children are not used
+ * any more. The children of the next state, which may still be encoding,
+ * are linked to the new children.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int adaptive_tiles_update_state(uvg_encoder *enc, encoder_state_t *state)
+{
+  const unsigned state_num = state - enc->states;
+  if (enc->adaptive_tiles.state_layout[state_num] == enc->adaptive_tiles.layout) {
+    return 1;
+  }
+
+  if (!uvg_encoder_state_rebuild_children(state)) {
+    fprintf(stderr, "Could not recreate the tile encoder states.\n");
+    return 0;
+  }
+  uvg_encoder_state_match_children_of_previous_frame(state);
+  uvg_encoder_state_match_children_of_previous_frame(
+    &enc->states[(state_num + 1) % enc->num_encoder_states]);
+  enc->adaptive_tiles.state_layout[state_num] = enc->adaptive_tiles.layout;
+
+  return 1;
+}
+
+
 static int uvg266_encode(uvg_encoder *enc,
                           uvg_picture *pic_in,
                           uvg_data_chunk **data_out,
@@ -257,7 +582,11 @@ static int uvg266_encode(uvg_encoder *enc,
   encoder_state_t *state = &enc->states[enc->cur_state_num];
 
   if (!state->frame->prepared) {
+    UVG_CLOCK_T start, end;
+    UVG_GET_TIME(&start);
     uvg_encoder_prepare(state);
+    UVG_GET_TIME(&end);
+    enc->setup_stats.prepare_time += UVG_CLOCK_T_DIFF(start, end);
   }
 
   if (pic_in != NULL) {
@@ -271,8 +600,48 @@ static int uvg266_encode(uvg_encoder *enc,
   );
   if (frame) {
     assert(state->frame->num == enc->frames_started);
-    // Start encoding.
-    uvg_encode_one_frame(state, frame);
+
+    // Wait for a frame to be completed if too many are being encoded.
+    const unsigned in_flight = enc->frames_started - enc->frames_done;
+    if (in_flight >= enc->frames_in_flight) {
+      const unsigned oldest = enc->out_state_num + in_flight - enc->frames_in_flight;
+      uvg_threadqueue_waitfor(enc->control->threadqueue,
+                              enc->states[oldest % enc->num_encoder_states].tqj_bitstream_written);
+    }
+
+    if (enc->adaptive_tiles.state_layout) {
+      const unsigned interval = enc->control->cfg.adaptive_tiles;
+      // The previous frame of this state is done. Its bits are added unless
+      // they already were when the tiles were balanced.
+      if (enc->frames_started >= enc->num_encoder_states &&
+          enc->adaptive_tiles.frames_added == enc->frames_started - enc->num_encoder_states) {
+        adaptive_tiles_add_frame(enc, state);
+      }
+      if (enc->frames_started >= 2 * interval && enc->frames_started % interval == 0) {
+        adaptive_tiles_rebalance(enc, state);
+      }
+      if (!adaptive_tiles_update_state(enc, state)) {
+        uvg_image_free(frame);
+        return 0;
+      }
+      memcpy(state->frame->tile_col_width, enc->control->tiles_col_width,
+             sizeof(int32_t) * enc->control->cfg.tiles_width_count);
+      memcpy(state->frame->tile_row_height, enc->control->tiles_row_height,
+             sizeof(int32_t) * enc->control->cfg.tiles_height_count);
+    }
+
+    // Start encoding. Without worker threads the jobs run as soon as they
+    // are created, so the setup can not be timed separately.
+    if (uvg_threadqueue_thread_count(enc->control->threadqueue) > 0) {
+      UVG_CLOCK_T start, end;
+      UVG_GET_TIME(&start);
+      uvg_encode_one_frame(state, frame);
+      UVG_GET_TIME(&end);
+      enc->setup_stats.start_time += UVG_CLOCK_T_DIFF(start, end);
+      enc->setup_stats.frames += 1;
+    } else {
+      uvg_encode_one_frame(state, frame);
+    }
     enc->frames_started += 1;
   }
 
@@ -308,6 +677,10 @@ static int uvg266_encode(uvg_encoder *enc,
     enc->frames_done += 1;
 
     enc->out_state_num = (enc->out_state_num + 1) % (enc->num_encoder_states);
+
+    if (enc->owf_adapt.enabled) {
+      owf_adapt_frame_done(enc);
+    }
   }
 
   return 1;
@@ -336,11 +709,11 @@ static int uvg266_field_encoding_adapter(uvg_encoder *enc,
   } first = { 0, 0 }, second = { 0, 0 };
 
   if (pic_in != NULL) {
-    first_field = uvg_image_alloc(state->encoder_control->chroma_format, state->encoder_control->in.width, state->encoder_control->in.height);
+    first_field = uvg_picture_pool_acquire(state->encoder_control->picture_pool);
     if (first_field == NULL) {
       goto uvg266_field_encoding_adapter_failure;
     }
-    second_field = uvg_image_alloc(state->encoder_control->chroma_format, state->encoder_control->in.width, state->encoder_control->in.height);
+    second_field = uvg_picture_pool_acquire(state->encoder_control->picture_pool);
     if (second_field == NULL) {
       goto uvg266_field_encoding_adapter_failure;
     }
@@ -415,6 +788,15 @@ static const uvg_api uvg_8bit_api = {
   .encoder_encode = uvg266_field_encoding_adapter,
 
   .picture_alloc_csp = uvg_image_alloc,
+
+  .thread_pool_alloc = uvg266_thread_pool_alloc,
+  .thread_pool_free = uvg266_thread_pool_free,
+  .encoder_open_with_pool = uvg266_open_with_pool,
+  .encoder_set_threads = uvg266_set_threads,
+
+  .picture_pool_alloc = uvg_picture_pool_alloc,
+  .picture_pool_free = uvg_picture_pool_free,
+  .picture_pool_acquire = uvg_picture_pool_acquire,
 };
 
 
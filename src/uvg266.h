@@ -103,6 +103,17 @@ typedef int16_t uvg_pixel_im;  // For intermediate precision (interpolation/bipr
  */
 typedef struct uvg_encoder uvg_encoder;
 
+/**
+ * \brief Opaque data structure representing worker threads shared by
+ * several encoders.
+ */
+typedef struct uvg_thread_pool uvg_thread_pool;
+
+/**
+ * \brief Opaque data structure holding pictures of one size for reuse.
+ */
+typedef struct uvg_picture_pool uvg_picture_pool;
+
 /**
  * \brief Integer motion estimation algorithms.
  */
@@ -259,6 +270,12 @@ enum uvg_file_format
   UVG_FORMAT_YUV = 2
 };
 
+enum uvg_parallel_layout
+{
+  UVG_PARALLEL_LAYOUT_MANUAL = 0,
+  UVG_PARALLEL_LAYOUT_AUTO = 1,
+};
+
 enum uvg_amvr_resolution
 {
   UVG_IMV_OFF     = 0,
@@ -388,7 +405,7 @@ typedef struct uvg_config
   int32_t target_bitrate;
 
   int8_t mv_rdo;            /*!< \brief MV RDO calculation in search (0: estimation, 1: RDO). */
-  int8_t calc_psnr;         /*!< \since 3.1.0 \brief Print PSNR in CLI. */
+  int8_t calc_psnr;         /*!< \since 3.1.0 \brief Calculate PSNR for frames. */
 
   enum uvg_mv_constraint mv_constraint;  /*!< \since 3.3.0 \brief Constrain movement vectors. */
   enum uvg_hash hash;  /*!< \since 3.5.0 \brief What hash algorithm to use. */
@@ -543,6 +560,37 @@ typedef struct uvg_config
   uint8_t dual_tree;
 
   uint8_t intra_rough_search_levels;
+
+  /** \brief Run encoding jobs in the thread calling encoder_encode while it waits for a frame. */
+  uint8_t caller_runs;
+
+  /** \brief Number of times an idle worker thread checks for new jobs before it sleeps. */
+  int32_t idle_spin;
+
+  /** \brief CPUs to pin the worker threads to in order (dimension: cpu_affinity_count) */
+  int32_t *cpu_affinity;
+  int32_t cpu_affinity_count;
+
+  /** \brief Schedule each parallel frame on one NUMA node and allocate its buffers there. */
+  uint8_t numa;
+
+  /** \brief Adjust the number of frames encoded in parallel up to owf + 1 to keep the threads busy. */
+  uint8_t adaptive_owf;
+
+  /** \brief Encode each frame of all-intra coding in one job, without WPP, with owf + 1 frames in parallel. */
+  uint8_t intra_frame_parallel;
+
+  /** \brief Move the tile boundaries every this many frames to balance the tiles, 0 to disable. */
+  int32_t adaptive_tiles;
+
+  /** \brief Select WPP or tiles, the tile grid and OWF from the resolution and threads. */
+  enum uvg_parallel_layout parallel_layout;
+
+  /** \brief Search the split of CUs of depth below this in another thread, 0 to disable. */
+  int32_t parallel_cu_search;
+
+  /** \brief Calculate SSIM for frames. */
+  int8_t calc_ssim;
 } uvg_config;
 
 /**
@@ -582,6 +630,8 @@ typedef struct uvg_picture {
     int8_t *roi_array;
   } roi;
 
+  struct uvg_picture_pool *pool; //!< \since 0.5.0 \brief Pool the picture is returned to when freed, or NULL (only used in the base_image)
+
 } uvg_picture;
 
 /**
@@ -611,6 +661,7 @@ enum uvg_nal_unit_type {
   UVG_NAL_PPS_NUT = 16,
   NAL_UNIT_PREFIX_APS = 17,
   NAL_UNIT_SUFFIX_APS = 18,
+  UVG_NAL_PH_NUT = 19,
 
   UVG_NAL_AUD_NUT = 20,
 
@@ -673,6 +724,23 @@ typedef struct uvg_frame_info {
    */
   int ref_list_len[2];
 
+  /**
+   * \since 0.5.0
+   * \brief PSNR of each color of the reconstruction
+   *
+   * Zero if PSNR is not calculated (uvg_config.calc_psnr).
+   */
+  double psnr[3];
+
+  /**
+   * \since 0.5.0
+   * \brief SSIM of each color of the reconstruction
+   *
+   * Mean SSIM of the 8x8 blocks of the picture. Zero if SSIM is not
+   * calculated (uvg_config.calc_ssim).
+   */
+  double ssim[3];
+
 } uvg_frame_info;
 
 /**
@@ -765,7 +833,8 @@ typedef struct uvg_api {
    *
    * The returned encoder should be closed by calling encoder_close.
    *
-   * Only one encoder may be open at a time.
+   * Only one encoder may be open at a time, unless the encoders share
+   * a thread pool (see encoder_open_with_pool).
    *
    * \param cfg   encoder configuration
    * \return      g_created encoder, or NULL if creation failed.
@@ -853,6 +922,109 @@ typedef struct uvg_api {
    * \return        allocated picture, or NULL if allocation failed.
    */
   uvg_picture * (*picture_alloc_csp)(enum uvg_chroma_format chroma_fomat, int32_t width, int32_t height);
+
+  /**
+   * \brief Create a pool of worker threads for encoders.
+   *
+   * The threading options of the configuration (threads, caller_runs,
+   * idle_spin, cpu_affinity and numa) are used for the pool.
+   *
+   * The returned pool should be deallocated by calling thread_pool_free
+   * after closing all encoders using it.
+   *
+   * \since 0.5.0
+   * \param cfg   configuration with the threading options
+   * \return      created pool, or NULL if creation failed.
+   */
+  uvg_thread_pool * (*thread_pool_alloc)(const uvg_config *cfg);
+
+  /**
+   * \brief Deallocate a pool of worker threads.
+   *
+   * If pool is NULL, do nothing.
+   *
+   * \since 0.5.0
+   */
+  void (*thread_pool_free)(uvg_thread_pool *pool);
+
+  /**
+   * \brief Create an encoder that runs its jobs in a thread pool.
+   *
+   * Works like encoder_open but instead of starting threads of its own the
+   * encoder uses the threads of the pool. Several encoders can share the
+   * same pool. The frames of all the encoders are scheduled in the order
+   * they were started, so an encoder that is waiting for input leaves the
+   * threads to the others.
+   *
+   * The threading options and cpuid of cfg are ignored. Encoders sharing
+   * a pool must be opened and closed from one thread at a time.
+   *
+   * \since 0.5.0
+   * \param cfg   encoder configuration
+   * \param pool  thread pool returned by thread_pool_alloc
+   * \return      created encoder, or NULL if creation failed.
+   */
+  uvg_encoder * (*encoder_open_with_pool)(const uvg_config *cfg, uvg_thread_pool *pool);
+
+  /**
+   * \brief Change the number of worker threads of a running encoder.
+   *
+   * Can be called between calls to encoder_encode. Threads beyond the new
+   * count finish their current jobs and then stay idle until the count is
+   * raised again. The count is limited to between one and the number of
+   * logical CPUs or the initial number of threads, whichever is larger.
+   *
+   * For an encoder using a thread pool, the threads of the pool are
+   * changed for all encoders sharing it. Encoders opened with threads 0
+   * have no worker threads and can not be changed.
+   *
+   * \since 0.5.0
+   * \param encoder   encoder
+   * \param threads   new number of worker threads
+   * \return          number of worker threads in use, or -1 on failure
+   */
+  int32_t (*encoder_set_threads)(uvg_encoder *encoder, int32_t threads);
+
+  /**
+   * \brief Allocate a pool of pictures.
+   *
+   * Pictures taken from the pool with picture_pool_acquire are deallocated
+   * with picture_free as usual, but instead of being freed they are kept in
+   * the pool once the last reference to them is gone. Reading input into
+   * pooled pictures avoids allocating a new picture for every frame.
+   *
+   * The returned pool should be deallocated by calling picture_pool_free.
+   *
+   * \since 0.5.0
+   * \param chroma_format  chroma subsampling of the pictures
+   * \param width          width of luma pixel array of the pictures
+   * \param height         height of luma pixel array of the pictures
+   * \return               allocated pool, or NULL if allocation failed.
+   */
+  uvg_picture_pool * (*picture_pool_alloc)(enum uvg_chroma_format chroma_format, int32_t width, int32_t height);
+
+  /**
+   * \brief Deallocate a pool of pictures.
+   *
+   * If pool is NULL, do nothing. Pictures still in use are freed when the
+   * last reference to them is gone.
+   *
+   * \since 0.5.0
+   */
+  void (*picture_pool_free)(uvg_picture_pool *pool);
+
+  /**
+   * \brief Take a picture from a pool.
+   *
+   * Returns a picture kept in the pool or allocates a new one if the pool
+   * is empty. The pixels of a reused picture are not cleared. The picture
+   * should be deallocated by calling picture_free.
+   *
+   * \since 0.5.0
+   * \param pool   pool returned by picture_pool_alloc
+   * \return       picture, or NULL if allocation failed.
+   */
+  uvg_picture * (*picture_pool_acquire)(uvg_picture_pool *pool);
 } uvg_api;
 
 
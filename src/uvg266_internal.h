@@ -47,6 +47,7 @@
 // Forward declarations.
 struct encoder_state_t;
 struct encoder_control_t;
+struct threadqueue_queue_t;
 
 struct uvg_encoder {
   const struct encoder_control_t* control;
@@ -73,6 +74,102 @@ struct uvg_encoder {
 
   unsigned frames_started;
   unsigned frames_done;
+
+  /**
+   * \brief Maximum number of frames encoded at the same time.
+   *
+   * Equal to num_encoder_states unless adaptive_owf is enabled.
+   */
+  unsigned frames_in_flight;
+
+  /**
+   * \brief Measurements for adapting frames_in_flight.
+   */
+  struct {
+    bool enabled;
+
+    /**
+     * \brief Time, worker idle time and number of frames done at the start
+     * of the current measurement window.
+     */
+    double start_time;
+    uint32_t start_idle_time;
+    unsigned start_frames;
+
+    /**
+     * \brief Frames per second in the previous window.
+     */
+    double last_fps;
+
+    /**
+     * \brief Change of frames_in_flight after the previous window.
+     */
+    int last_step;
+
+    /**
+     * \brief Number of windows to wait before changing frames_in_flight.
+     */
+    int hold;
+  } owf_adapt;
+
+  /**
+   * \brief Time spent setting up frames in the thread calling encoder_encode.
+   *
+   * The setup is serial and delays the start of the jobs of the frame.
+   */
+  struct {
+    /**
+     * \brief Time spent releasing the previous frame of the encoder state
+     * and updating the reference lists.
+     */
+    double prepare_time;
+
+    /**
+     * \brief Time spent initializing the frame and creating its jobs.
+     */
+    double start_time;
+
+    /**
+     * \brief Number of frames whose setup was timed.
+     *
+     * Frames are not timed without worker threads.
+     */
+    unsigned frames;
+  } setup_stats;
+
+  /**
+   * \brief Bits spent on each CTU, summed over blocks of --adaptive-tiles
+   * frames.
+   *
+   * The tiles are balanced by the block that ended a block ago, so that
+   * the frames still being encoded need not be waited for. The bits of a
+   * frame are added when its encoder state is reused, or when the tiles are
+   * balanced if the state still holds the frame.
+   */
+  struct {
+    uint64_t *ctu_bits[2];
+
+    /**
+     * \brief Number of frames whose bits have been added.
+     */
+    unsigned frames_added;
+
+    /**
+     * \brief Number of times the tile layout has changed.
+     */
+    unsigned layout;
+
+    /**
+     * \brief Tile layout of the child states of each encoder state.
+     *
+     * The child states are recreated when the state starts a frame.
+     */
+    unsigned *state_layout;
+  } adaptive_tiles;
+};
+
+struct uvg_thread_pool {
+  struct threadqueue_queue_t *threadqueue;
 };
 
 #endif // UVG266_INTERNAL_H_
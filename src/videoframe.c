@@ -76,11 +76,15 @@ videoframe_t * uvg_videoframe_alloc(int32_t width,
  */
 int uvg_videoframe_free(videoframe_t * const frame)
 {
-  if (frame->source_lmcs_mapped) {
+  // The LMCS pictures are separate from the source and reconstruction
+  // whenever LMCS is enabled, even if the frame was not mapped.
+  if (frame->source_lmcs != frame->source) {
     uvg_image_free(frame->source_lmcs);
+  }
+  if (frame->rec_lmcs != frame->rec) {
     uvg_image_free(frame->rec_lmcs);
-    frame->source_lmcs_mapped = false;
   }
+  frame->source_lmcs_mapped = false;
   if(frame->cclm_luma_rec) {
     FREE_POINTER(frame->cclm_luma_rec);
   }
@@ -99,6 +103,10 @@ int uvg_videoframe_free(videoframe_t * const frame)
   uvg_cu_array_free(&frame->cu_array);
   uvg_cu_array_free(&frame->chroma_cu_array);
 
+  uvg_image_free(frame->spare.rec);
+  uvg_image_free(frame->spare.rec_lmcs);
+  uvg_image_free(frame->spare.source_lmcs);
+
   FREE_POINTER(frame->sao_luma);
   FREE_POINTER(frame->sao_chroma);
 
@@ -83,6 +83,18 @@ typedef struct videoframe
   bool source_lmcs_mapped; //!< \brief Indicate if source_lmcs is available and mapped to LMCS
   bool lmcs_top_level; //!< \brief Indicate that in this level the LMCS images are allocated
   bool rec_lmcs_mapped; //!< \brief Indicate if rec_lmcs is available and mapped to LMCS
+
+  /**
+   * \brief Buffers of the previous frame kept for the next one.
+   *
+   * Only buffers that nothing else referred to when the frame was released
+   * are kept. NULL if there is nothing to reuse.
+   */
+  struct {
+    uvg_picture *rec;
+    uvg_picture *rec_lmcs;
+    uvg_picture *source_lmcs;
+  } spare;
 } videoframe_t;
 
 
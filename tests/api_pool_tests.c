@@ -0,0 +1,277 @@
+/*****************************************************************************
+ * This file is part of uvg266 VVC encoder.
+ *
+ * Copyright (c) 2021, Tampere University, ITU/ISO/IEC, project contributors
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * * Neither the name of the Tampere University or ITU/ISO/IEC nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ ****************************************************************************/
+
+
+#include "greatest/greatest.h"
+
+#include "image.h"
+#include "uvg266.h"
+
+#include <string.h>
+
+#define WIDTH 64
+#define HEIGHT 64
+#define NUM_FRAMES 4
+#define MAX_OUTPUT_SIZE (1 << 16)
+
+static const uvg_api *api;
+
+/**
+ * \brief Bitstream written by an encoder.
+ */
+typedef struct {
+  uint8_t data[MAX_OUTPUT_SIZE];
+  size_t size;
+} output_t;
+
+static uvg_config * alloc_config(int threads)
+{
+  char threads_str[16];
+  sprintf(threads_str, "%d", threads);
+
+  uvg_config *cfg = api->config_alloc();
+  if (!cfg ||
+      !api->config_init(cfg) ||
+      !api->config_parse(cfg, "preset", "ultrafast") ||
+      !api->config_parse(cfg, "input-res", "64x64") ||
+      !api->config_parse(cfg, "threads", threads_str) ||
+      !api->config_parse(cfg, "owf", "1")) {
+    api->config_destroy(cfg);
+    return NULL;
+  }
+  return cfg;
+}
+
+/**
+ * \brief Pass frame i of NUM_FRAMES, or NULL after them, to the encoder.
+ *
+ * \param output   output to append the bitstream to, or NULL
+ *
+ * \return 1 if a frame was output, 0 if not and -1 on failure
+ */
+static int encode_output_step(uvg_encoder *encoder, int i, output_t *output)
+{
+  uvg_picture *pic_in = NULL;
+  if (i < NUM_FRAMES) {
+    pic_in = api->picture_alloc(WIDTH, HEIGHT);
+    if (!pic_in) return -1;
+    // Texture moving to the right, so that the frames are not trivial.
+    for (int y = 0; y < HEIGHT; ++y) {
+      for (int x = 0; x < WIDTH; ++x) {
+        pic_in->y[y * pic_in->stride + x] = (uvg_pixel)((x - 4 * i) * (y + 3) ^ (x * 7));
+      }
+    }
+    memset(pic_in->u, 128, WIDTH * HEIGHT / 4 * sizeof(uvg_pixel));
+    memset(pic_in->v, 128, WIDTH * HEIGHT / 4 * sizeof(uvg_pixel));
+  }
+
+  uvg_data_chunk *data = NULL;
+  uvg_picture *recon = NULL;
+  uvg_picture *src = NULL;
+  int success = api->encoder_encode(encoder, pic_in, &data, NULL, &recon, &src, NULL);
+  int frame_out = data != NULL;
+
+  for (uvg_data_chunk *chunk = data; output && chunk; chunk = chunk->next) {
+    if (output->size + chunk->len > MAX_OUTPUT_SIZE) {
+      success = 0;
+      break;
+    }
+    memcpy(&output->data[output->size], chunk->data, chunk->len);
+    output->size += chunk->len;
+  }
+
+  api->picture_free(pic_in);
+  api->chunk_free(data);
+  api->picture_free(recon);
+  api->picture_free(src);
+  return success ? frame_out : -1;
+}
+
+static int encode_step(uvg_encoder *encoder, int i)
+{
+  return encode_output_step(encoder, i, NULL);
+}
+
+/**
+ * \brief Encode NUM_FRAMES frames and return the number of frames output.
+ */
+static int encode_frames(uvg_encoder *encoder, output_t *output)
+{
+  int frames_out = 0;
+  for (int i = 0; i < NUM_FRAMES * 2; ++i) {
+    int result = encode_output_step(encoder, i, output);
+    if (result < 0) return -1;
+    frames_out += result;
+  }
+  return frames_out;
+}
+
+static output_t outputs[4];
+
+TEST shared_thread_pool(void)
+{
+  // Rate control with different bitrates, so that the encoders produce
+  // different streams and mixing up their state would show.
+  uvg_config *cfg1 = alloc_config(2);
+  uvg_config *cfg2 = alloc_config(2);
+  ASSERT(cfg1);
+  ASSERT(cfg2);
+  ASSERT(api->config_parse(cfg1, "bitrate", "100000"));
+  ASSERT(api->config_parse(cfg2, "bitrate", "400000"));
+
+  uvg_thread_pool *pool = api->thread_pool_alloc(cfg1);
+  ASSERT(pool);
+
+  // Each encoder alone.
+  memset(outputs, 0, sizeof(outputs));
+  uvg_encoder *enc1 = api->encoder_open_with_pool(cfg1, pool);
+  ASSERT(enc1);
+  ASSERT_EQ(NUM_FRAMES, encode_frames(enc1, &outputs[0]));
+  api->encoder_close(enc1);
+
+  uvg_encoder *enc2 = api->encoder_open_with_pool(cfg2, pool);
+  ASSERT(enc2);
+  ASSERT_EQ(NUM_FRAMES, encode_frames(enc2, &outputs[1]));
+  api->encoder_close(enc2);
+
+  // Both encoders in turns, with frames of both in flight at once.
+  enc1 = api->encoder_open_with_pool(cfg1, pool);
+  enc2 = api->encoder_open_with_pool(cfg2, pool);
+  ASSERT(enc1);
+  ASSERT(enc2);
+  int frames_out1 = 0;
+  int frames_out2 = 0;
+  for (int i = 0; i < NUM_FRAMES * 2; ++i) {
+    int result1 = encode_output_step(enc1, i, &outputs[2]);
+    int result2 = encode_output_step(enc2, i, &outputs[3]);
+    ASSERT(result1 >= 0);
+    ASSERT(result2 >= 0);
+    frames_out1 += result1;
+    frames_out2 += result2;
+  }
+  ASSERT_EQ(NUM_FRAMES, frames_out1);
+  ASSERT_EQ(NUM_FRAMES, frames_out2);
+  api->encoder_close(enc1);
+  api->encoder_close(enc2);
+
+  ASSERT(outputs[0].size != outputs[1].size ||
+         memcmp(outputs[0].data, outputs[1].data, outputs[0].size));
+  ASSERT_EQ(outputs[0].size, outputs[2].size);
+  ASSERT_EQ(0, memcmp(outputs[0].data, outputs[2].data, outputs[0].size));
+  ASSERT_EQ(outputs[1].size, outputs[3].size);
+  ASSERT_EQ(0, memcmp(outputs[1].data, outputs[3].data, outputs[1].size));
+
+  api->thread_pool_free(pool);
+  api->config_destroy(cfg1);
+  api->config_destroy(cfg2);
+  PASS();
+}
+
+TEST set_threads(void)
+{
+  uvg_config *cfg = alloc_config(2);
+  ASSERT(cfg);
+  uvg_encoder *encoder = api->encoder_open(cfg);
+  ASSERT(encoder);
+
+  // Change the number of threads between frames.
+  int frames_out = 0;
+  for (int i = 0; i < NUM_FRAMES * 2; ++i) {
+    int32_t threads = i % 2 ? 2 : 1;
+    ASSERT_EQ(threads, api->encoder_set_threads(encoder, threads));
+    int result = encode_step(encoder, i);
+    ASSERT(result >= 0);
+    frames_out += result;
+  }
+  ASSERT_EQ(NUM_FRAMES, frames_out);
+
+  // The count is limited to at least one thread.
+  ASSERT_EQ(1, api->encoder_set_threads(encoder, 0));
+
+  api->encoder_close(encoder);
+  api->config_destroy(cfg);
+
+  // Encoders without worker threads keep running without them.
+  cfg = alloc_config(0);
+  ASSERT(cfg);
+  encoder = api->encoder_open(cfg);
+  ASSERT(encoder);
+
+  ASSERT_EQ(0, api->encoder_set_threads(encoder, 2));
+  ASSERT_EQ(NUM_FRAMES, encode_frames(encoder, NULL));
+
+  api->encoder_close(encoder);
+  api->config_destroy(cfg);
+  PASS();
+}
+
+TEST picture_pool(void)
+{
+  uvg_picture_pool *pool = api->picture_pool_alloc(UVG_CSP_420, WIDTH, HEIGHT);
+  ASSERT(pool);
+
+  uvg_picture *pic1 = api->picture_pool_acquire(pool);
+  uvg_picture *pic2 = api->picture_pool_acquire(pool);
+  ASSERT(pic1);
+  ASSERT(pic2);
+  ASSERT(pic1 != pic2);
+  ASSERT_EQ(WIDTH, pic1->width);
+  ASSERT_EQ(HEIGHT, pic1->height);
+  ASSERT_EQ(UVG_CSP_420, pic1->chroma_format);
+
+  // A freed picture is reused.
+  api->picture_free(pic1);
+  uvg_picture *pic3 = api->picture_pool_acquire(pool);
+  ASSERT_EQ(pic1, pic3);
+
+  // A picture with references left is not reused.
+  uvg_picture *copy = uvg_image_copy_ref(pic3);
+  api->picture_free(pic3);
+  uvg_picture *pic4 = api->picture_pool_acquire(pool);
+  ASSERT(pic4 != pic3);
+  api->picture_free(copy);
+
+  // Pictures still in use outlive the pool.
+  api->picture_pool_free(pool);
+  memset(pic2->fulldata, 0, WIDTH * HEIGHT * 3 / 2 * sizeof(uvg_pixel));
+  api->picture_free(pic2);
+  api->picture_free(pic4);
+  PASS();
+}
+
+SUITE(api_pool_tests)
+{
+  api = uvg_api_get(8);
+  RUN_TEST(shared_thread_pool);
+  RUN_TEST(set_threads);
+  RUN_TEST(picture_pool);
+}
@@ -0,0 +1,171 @@
+/*****************************************************************************
+ * This file is part of uvg266 VVC encoder.
+ *
+ * Copyright (c) 2021, Tampere University, ITU/ISO/IEC, project contributors
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * * Neither the name of the Tampere University or ITU/ISO/IEC nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * INCLUDING NEGLIGENCE OR OTHERWISE ARISING IN ANY WAY OUT OF THE USE OF THIS
+ ****************************************************************************/
+
+#include "greatest/greatest.h"
+
+#include "test_strategies.h"
+
+#include "src/strategies/strategies-nal.h"
+
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+// MACROS
+// Wider than 256 so that the high bits of the checksum masks are used.
+#define PIC_WIDTH 300
+#define PIC_HEIGHT 70
+#define PIC_STRIDE 320
+
+//////////////////////////////////////////////////////////////////////////
+// GLOBALS
+static uvg_pixel pic_buf[PIC_STRIDE * PIC_HEIGHT];
+
+// Row ranges that together cover the picture, in order.
+static const int row_splits[] = { 0, 1, 8, 9, 40, 64, PIC_HEIGHT };
+#define NUM_ROW_RANGES (sizeof(row_splits) / sizeof(row_splits[0]) - 1)
+
+static struct {
+  array_checksum_func checksum_generic;
+  void *tested_func;
+} picture_hash_test_env;
+
+
+//////////////////////////////////////////////////////////////////////////
+// SETUP, TEARDOWN AND HELPER FUNCTIONS
+static void setup_tests()
+{
+  uint32_t seed = 54321;
+  for (int i = 0; i < PIC_STRIDE * PIC_HEIGHT; ++i) {
+    seed = seed * 1103515245 + 12345;
+    pic_buf[i] = (seed >> 16) & PIXEL_MAX;
+  }
+
+  for (unsigned i = 0; i < strategies.count; ++i) {
+    if (strcmp(strategies.strategies[i].type, "array_checksum") == 0 &&
+        strcmp(strategies.strategies[i].strategy_name, "generic") == 0)
+    {
+      picture_hash_test_env.checksum_generic = strategies.strategies[i].fptr;
+    }
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TESTS
+
+TEST checksum_matches_generic(void)
+{
+  array_checksum_func tested = picture_hash_test_env.tested_func;
+  ASSERT(picture_hash_test_env.checksum_generic != NULL);
+
+  for (unsigned i = 0; i < NUM_ROW_RANGES; ++i) {
+    const uint32_t expected = picture_hash_test_env.checksum_generic(pic_buf, row_splits[i], row_splits[i + 1],
+                                                                     PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH);
+    const uint32_t actual = tested(pic_buf, row_splits[i], row_splits[i + 1],
+                                   PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH);
+    ASSERT_EQ(expected, actual);
+  }
+
+  PASS();
+}
+
+TEST checksum_of_row_ranges_adds_up(void)
+{
+  array_checksum_func tested = picture_hash_test_env.tested_func;
+
+  const uint32_t whole = tested(pic_buf, 0, PIC_HEIGHT, PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH);
+  uint32_t sum = 0;
+  for (unsigned i = 0; i < NUM_ROW_RANGES; ++i) {
+    sum += tested(pic_buf, row_splits[i], row_splits[i + 1], PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH);
+  }
+  ASSERT_EQ(whole, sum);
+
+  // An empty range adds nothing.
+  ASSERT_EQ(tested(pic_buf, 5, 5, PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH), 0);
+
+  PASS();
+}
+
+TEST md5_of_row_ranges_matches_whole(void)
+{
+  array_md5_func tested = picture_hash_test_env.tested_func;
+
+  context_md5_t whole_ctx;
+  unsigned char whole[16];
+  uvg_md5_init(&whole_ctx);
+  tested(&whole_ctx, pic_buf, 0, PIC_HEIGHT, PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH);
+  uvg_md5_final(whole, &whole_ctx);
+
+  context_md5_t rows_ctx;
+  unsigned char rows[16];
+  uvg_md5_init(&rows_ctx);
+  for (unsigned i = 0; i < NUM_ROW_RANGES; ++i) {
+    tested(&rows_ctx, pic_buf, row_splits[i], row_splits[i + 1], PIC_WIDTH, PIC_STRIDE, UVG_BIT_DEPTH);
+  }
+  uvg_md5_final(rows, &rows_ctx);
+
+  ASSERT_EQ(memcmp(whole, rows, sizeof(whole)), 0);
+
+  // The hash covers only the rows and not the padding of the stride.
+  context_md5_t packed_ctx;
+  unsigned char packed[16];
+  uvg_md5_init(&packed_ctx);
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    uvg_md5_update(&packed_ctx, (const unsigned char *)&pic_buf[y * PIC_STRIDE], PIC_WIDTH * sizeof(uvg_pixel));
+  }
+  uvg_md5_final(packed, &packed_ctx);
+
+  ASSERT_EQ(memcmp(whole, packed, sizeof(whole)), 0);
+
+  PASS();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TEST FIXTURES
+SUITE(picture_hash_tests)
+{
+  setup_tests();
+
+  for (volatile unsigned i = 0; i < strategies.count; ++i) {
+    const char *type = strategies.strategies[i].type;
+    picture_hash_test_env.tested_func = strategies.strategies[i].fptr;
+
+    if (strcmp(type, "array_checksum") == 0) {
+      RUN_TEST(checksum_matches_generic);
+      RUN_TEST(checksum_of_row_ranges_adds_up);
+    } else if (strcmp(type, "array_md5") == 0) {
+      RUN_TEST(md5_of_row_ranges_matches_whole);
+    }
+  }
+}
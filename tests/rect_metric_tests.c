@@ -0,0 +1,169 @@
+/*****************************************************************************
+ * This file is part of uvg266 VVC encoder.
+ *
+ * Copyright (c) 2021, Tampere University, ITU/ISO/IEC, project contributors
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * * Neither the name of the Tampere University or ITU/ISO/IEC nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * INCLUDING NEGLIGENCE OR OTHERWISE ARISING IN ANY WAY OUT OF THE USE OF THIS
+ ****************************************************************************/
+
+#include "greatest/greatest.h"
+
+#include "test_strategies.h"
+
+#include "src/strategies/strategies-picture.h"
+
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+// MACROS
+#define BUF_WIDTH 80
+#define BUF_HEIGHT 40
+#define BUF_STRIDE 96
+
+//////////////////////////////////////////////////////////////////////////
+// GLOBALS
+static uvg_pixel ref_buf[BUF_STRIDE * BUF_HEIGHT];
+static uvg_pixel rec_buf[BUF_STRIDE * BUF_HEIGHT];
+
+// Rectangles of the buffers, including ones that are not multiples of the
+// SIMD width or of the 8x8 SSIM blocks.
+static const int rect_sizes[][2] = {
+  { 80, 40 }, { 64, 8 }, { 16, 16 }, { 79, 37 }, { 33, 9 }, { 7, 5 }, { 1, 1 },
+};
+#define NUM_RECT_SIZES (sizeof(rect_sizes) / sizeof(rect_sizes[0]))
+
+static struct {
+  pixels_calc_ssd_rect_func *ssd_generic;
+  pixels_calc_ssim_rect_func *ssim_generic;
+  void *tested_func;
+} rect_metric_test_env;
+
+
+//////////////////////////////////////////////////////////////////////////
+// SETUP, TEARDOWN AND HELPER FUNCTIONS
+static void setup_tests()
+{
+  // Reconstruction that differs from the reference by a small pseudo
+  // random amount, with some samples at the extremes.
+  uint32_t seed = 12345;
+  for (int i = 0; i < BUF_STRIDE * BUF_HEIGHT; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const int value = (seed >> 16) & PIXEL_MAX;
+    const int noise = (int)((seed >> 8) & 0x1f) - 16;
+    ref_buf[i] = value;
+    rec_buf[i] = CLIP(0, PIXEL_MAX, value + noise);
+  }
+  for (int i = 0; i < BUF_WIDTH; ++i) {
+    ref_buf[i] = 0;
+    rec_buf[i] = PIXEL_MAX;
+  }
+
+  for (unsigned i = 0; i < strategies.count; ++i) {
+    if (strcmp(strategies.strategies[i].strategy_name, "generic") != 0) continue;
+
+    if (strcmp(strategies.strategies[i].type, "pixels_calc_ssd_rect") == 0) {
+      rect_metric_test_env.ssd_generic = strategies.strategies[i].fptr;
+    } else if (strcmp(strategies.strategies[i].type, "pixels_calc_ssim_rect") == 0) {
+      rect_metric_test_env.ssim_generic = strategies.strategies[i].fptr;
+    }
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TESTS
+
+TEST ssd_rect_matches_generic(void)
+{
+  pixels_calc_ssd_rect_func *const tested = rect_metric_test_env.tested_func;
+  ASSERT(rect_metric_test_env.ssd_generic != NULL);
+
+  for (unsigned i = 0; i < NUM_RECT_SIZES; ++i) {
+    const int width = rect_sizes[i][0];
+    const int height = rect_sizes[i][1];
+    const uint64_t expected = rect_metric_test_env.ssd_generic(ref_buf, rec_buf, BUF_STRIDE, BUF_STRIDE, width, height);
+    const uint64_t actual = tested(ref_buf, rec_buf, BUF_STRIDE, BUF_STRIDE, width, height);
+    ASSERT_EQ(expected, actual);
+
+    // Different strides for the two pictures.
+    const uint64_t expected_strides = rect_metric_test_env.ssd_generic(ref_buf, rec_buf, BUF_STRIDE, BUF_WIDTH, width, height);
+    const uint64_t actual_strides = tested(ref_buf, rec_buf, BUF_STRIDE, BUF_WIDTH, width, height);
+    ASSERT_EQ(expected_strides, actual_strides);
+  }
+
+  // Identical pictures.
+  ASSERT_EQ(tested(ref_buf, ref_buf, BUF_STRIDE, BUF_STRIDE, BUF_WIDTH, BUF_HEIGHT), 0);
+
+  PASS();
+}
+
+TEST ssim_rect_matches_generic(void)
+{
+  pixels_calc_ssim_rect_func *const tested = rect_metric_test_env.tested_func;
+  ASSERT(rect_metric_test_env.ssim_generic != NULL);
+
+  for (unsigned i = 0; i < NUM_RECT_SIZES; ++i) {
+    const int width = rect_sizes[i][0];
+    const int height = rect_sizes[i][1];
+    // Both versions compute the same integer sums for each block, so the
+    // results are equal exactly.
+    const double expected = rect_metric_test_env.ssim_generic(ref_buf, rec_buf, BUF_STRIDE, BUF_STRIDE, width, height);
+    const double actual = tested(ref_buf, rec_buf, BUF_STRIDE, BUF_STRIDE, width, height);
+    ASSERT_EQ(expected, actual);
+
+    const double expected_strides = rect_metric_test_env.ssim_generic(ref_buf, rec_buf, BUF_STRIDE, BUF_WIDTH, width, height);
+    const double actual_strides = tested(ref_buf, rec_buf, BUF_STRIDE, BUF_WIDTH, width, height);
+    ASSERT_EQ(expected_strides, actual_strides);
+  }
+
+  // Identical pictures have an SSIM of one in every 8x8 block.
+  const int blocks = (BUF_WIDTH / 8) * (BUF_HEIGHT / 8);
+  const double ssim = tested(ref_buf, ref_buf, BUF_STRIDE, BUF_STRIDE, BUF_WIDTH, BUF_HEIGHT);
+  ASSERT(ssim > blocks - 1e-9 && ssim < blocks + 1e-9);
+
+  PASS();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TEST FIXTURES
+SUITE(rect_metric_tests)
+{
+  setup_tests();
+
+  for (volatile unsigned i = 0; i < strategies.count; ++i) {
+    const char *type = strategies.strategies[i].type;
+    rect_metric_test_env.tested_func = strategies.strategies[i].fptr;
+
+    if (strcmp(type, "pixels_calc_ssd_rect") == 0) {
+      RUN_TEST(ssd_rect_matches_generic);
+    } else if (strcmp(type, "pixels_calc_ssim_rect") == 0) {
+      RUN_TEST(ssim_rect_matches_generic);
+    }
+  }
+}
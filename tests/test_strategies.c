@@ -62,4 +62,9 @@ void init_test_strategies()
     fprintf(stderr, "strategy_register_quant failed!\n");
     return;
   }
+
+  if (!uvg_strategy_register_nal(&strategies, UVG_BIT_DEPTH)) {
+    fprintf(stderr, "strategy_register_nal failed!\n");
+    return;
+  }
 }
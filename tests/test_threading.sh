@@ -0,0 +1,41 @@
+#!/bin/sh
+
+# Test the threading and parallel encoding options.
+
+set -eu
+. "${0%/*}/util.sh"
+
+common_args='-p0 -r1 --preset=ultrafast --gop=0 --no-info'
+serial_args="${common_args} --threads=0"
+
+identical_test 264x130 10 yuv420p "${serial_args}" ${common_args} --threads=4 --owf=2 --idle-spin=0
+identical_test 264x130 10 yuv420p "${serial_args}" ${common_args} --threads=4 --owf=2 --idle-spin=1000
+identical_test 264x130 10 yuv420p "${serial_args}" ${common_args} --threads=2 --owf=1 --cpu-affinity=0
+identical_test 264x130 10 yuv420p "${serial_args}" ${common_args} --threads=3 --owf=2 --cpu-affinity=0,0-1 --numa
+identical_test 264x130 10 yuv420p "${serial_args}" ${common_args} --threads=4 --owf=4 --adaptive-owf
+# Frame-parallel intra disables WPP.
+identical_test 264x130 10 yuv420p "${serial_args} -p1 --no-wpp" ${common_args} -p1 --threads=3 --owf=3 --intra-frame-parallel
+valgrind_test 264x130 10 yuv420p ${common_args} -p1 --threads=3 --owf=3 --intra-frame-parallel --alf=full
+identical_test 264x130 10 yuv420p "${serial_args} --segment-length=4" ${common_args} --threads=4 --segment-length=4 --segment-parallel=3
+encode_test 264x130 10 yuv420p 1 ${common_args} --segment-length=4 --roi=roi.txt
+stitch_test 264x130 10 yuv420p 4 ${common_args} --threads=2 --owf=1
+encode_test 264x130 10 yuv420p 1 ${common_args} --segment-length=4 --owf=0 --cabac-debug-file=cabac.txt
+# Rate control depends on the number of frames in flight, so the reference
+# uses the same threads.
+segment_args="${common_args} --threads=4 --bitrate=200000 --segment-length=4 --segment-parallel=3"
+identical_test 264x130 10 yuv420p "${segment_args}" ${segment_args} --segment-weights=1,1
+valgrind_test 264x130 10 yuv420p ${segment_args} --segment-weights=2,1
+partial_coding_test 512x256 10 yuv420p 2x2 ${common_args}
+partial_coding_test 256x256 10 yuv420p 2x4 ${common_args} --threads=2
+
+# The tile boundaries are moved, so a new picture parameter set is written.
+pps_test 2 512x256 10 yuv420p ${common_args} --threads=4 --tiles=4x1 --no-wpp --adaptive-tiles=2
+# The frames in flight are not waited for, so the tiles do not depend on them.
+identical_test 512x256 10 yuv420p "${serial_args} --tiles=4x1 --no-wpp --adaptive-tiles=2" ${common_args} --threads=4 --owf=3 --tiles=4x1 --no-wpp --adaptive-tiles=2
+# WPP is selected for the small frame and 4x2 tiles for the larger one.
+identical_test 264x130 10 yuv420p "${serial_args}" ${common_args} --threads=4 --owf=auto --parallel-layout=auto
+identical_test 512x256 10 yuv420p "${serial_args} --tiles=4x2 --no-wpp" ${common_args} --threads=8 --owf=2 --parallel-layout=auto
+search_args="${common_args} --rd=2 --pu-depth-intra=0-4 --pu-depth-inter=0-3"
+identical_test 264x130 10 yuv420p "${search_args} --threads=0" ${search_args} --threads=4 --parallel-cu-search=2
+identical_test 264x130 10 yuv420p "${serial_args} --ssim --hash=md5" ${common_args} --threads=4 --ssim --hash=md5
+identical_test 264x130 10 yuv420p "${serial_args} --ssim --hash=checksum --tiles=2x2 --no-wpp" ${common_args} --threads=4 --ssim --hash=checksum --tiles=2x2 --no-wpp
@@ -42,11 +42,14 @@ extern SUITE(satd_tests);
 extern SUITE(speed_tests);
 extern SUITE(dct_tests);
 extern SUITE(mts_tests);
+extern SUITE(rect_metric_tests);
+extern SUITE(picture_hash_tests);
 #endif //UVG_BIT_DEPTH == 8
 
 extern SUITE(coeff_sum_tests);
 extern SUITE(mv_cand_tests);
 extern SUITE(inter_recon_bipred_tests);
+extern SUITE(api_pool_tests);
 
 int main(int argc, char **argv)
 {
@@ -59,6 +62,8 @@ int main(int argc, char **argv)
   RUN_SUITE(satd_tests);
   RUN_SUITE(dct_tests);
   RUN_SUITE(mts_tests);
+  RUN_SUITE(rect_metric_tests);
+  RUN_SUITE(picture_hash_tests);
 
   if (greatest_info.suite_filter &&
       greatest_name_match("speed", greatest_info.suite_filter))
@@ -73,6 +78,8 @@ int main(int argc, char **argv)
 
   RUN_SUITE(mv_cand_tests);
 
+  RUN_SUITE(api_pool_tests);
+
   // Doesn't work in git
   //RUN_SUITE(inter_recon_bipred_tests);
 
@@ -7,12 +7,26 @@ set -eu${BASH+o pipefail}
 # Temporary files for encoder input and output.
 yuvfile="$(mktemp)"
 vvcfile="$(mktemp)"
+reffile="$(mktemp)"
+logfile="$(mktemp)"
+reflogfile="$(mktemp)"
+recfile="$(mktemp)"
+refrecfile="$(mktemp)"
 
 cleanup() {
-    rm -rf "${yuvfile}" "${vvcfile}"
+    rm -rf "${yuvfile}" "${vvcfile}" "${reffile}" "${logfile}" "${reflogfile}" \
+        "${recfile}" "${refrecfile}" "${vvcfile}".*
 }
 trap cleanup EXIT
 
+# If $UVG_TEST_VALGRIND is defined and equal to "1", run the tests with
+# valgrind. Otherwise, run without valgrind.
+if [ "${UVG_TEST_VALGRIND:-0}" = '1' ]; then
+    valgrind='valgrind --leak-check=full --error-exitcode=1 --'
+else
+    valgrind=''
+fi
+
 print_and_run() {
     printf '\n\n$ %s\n' "$*"
     "$@"
@@ -36,16 +50,192 @@ valgrind_test() {
 
     prepare "${dimensions}" "${frames}" "${format}"
 
-    # If $UVG_TEST_VALGRIND is defined and equal to "1", run the test with
-    # valgrind. Otherwise, run without valgrind.
-    if [ "${UVG_TEST_VALGRIND:-0}" = '1' ]; then
-        valgrind='valgrind --leak-check=full --error-exitcode=1 --'
-    else
-        valgrind=''
+    # No quotes for $valgrind because it expands to multiple (or zero)
+    # arguments.
+    print_and_run \
+        $valgrind \
+            ../bin/uvg266 -i "${yuvfile}" "--input-res=${dimensions}" -o "${vvcfile}" "$@"
+
+    print_and_run \
+        DecoderAppStatic -b "${vvcfile}"
+
+    cleanup
+}
+
+# Encode with the reference arguments given as a single string and with the
+# rest of the arguments. Check that the bitstreams and the frame statistics
+# are identical and decode the bitstream.
+identical_test() {
+    dimensions="$1"
+    shift
+    frames="$1"
+    shift
+    format="$1"
+    shift
+    reference_args="$1"
+    shift
+
+    prepare "${dimensions}" "${frames}" "${format}"
+
+    # No quotes for $reference_args because it expands to multiple
+    # arguments.
+    print_and_run \
+        ../bin/uvg266 -i "${yuvfile}" "--input-res=${dimensions}" -o "${reffile}" $reference_args \
+        2> "${reflogfile}"
+
+    set +e
+    print_and_run \
+        $valgrind \
+            ../bin/uvg266 -i "${yuvfile}" "--input-res=${dimensions}" -o "${vvcfile}" "$@" \
+        2> "${logfile}"
+    status="$?"
+    set -e
+    cat "${logfile}" >&2
+    [ ${status} -eq 0 ]
+
+    print_and_run \
+        cmp "${reffile}" "${vvcfile}"
+
+    refstats="$(grep -E '^(POC| Processed)' "${reflogfile}")"
+    stats="$(grep -E '^(POC| Processed)' "${logfile}")"
+    if [ "${refstats}" != "${stats}" ]; then
+        printf 'Frame statistics differ from the reference:\n%s\n\n%s\n' \
+            "${refstats}" "${stats}" >&2
+        return 1
     fi
 
-    # No quotes for $valgrind because it expands to multiple (or zero)
+    print_and_run \
+        DecoderAppStatic -b "${vvcfile}"
+
+    cleanup
+}
+
+# Encode each segment of --segment-length frames in a separate process and
+# join the segments with stitch-segments.py. Check that the segments are
+# identical to the ones of a single encode and that the joined stream
+# decodes to the same pictures.
+stitch_test() {
+    dimensions="$1"
+    shift
+    frames="$1"
+    shift
+    format="$1"
+    shift
+    segment_length="$1"
+    shift
+
+    prepare "${dimensions}" "${frames}" "${format}"
+
+    print_and_run \
+        ../bin/uvg266 -i "${yuvfile}" "--input-res=${dimensions}" -o "${reffile}" \
+            "--segment-length=${segment_length}" "$@"
+
+    segment=0
+    segment_files=''
+    while [ $((segment * segment_length)) -lt ${frames} ]; do
+        print_and_run \
+            $valgrind \
+                ../bin/uvg266 -i "${yuvfile}" "--input-res=${dimensions}" -o "${vvcfile}.${segment}" \
+                "--segment-length=${segment_length}" "--segment-index=${segment}" "$@"
+        segment_files="${segment_files} ${vvcfile}.${segment}"
+        segment=$((segment + 1))
+    done
+
+    # No quotes for $segment_files because it expands to multiple
     # arguments.
+    cat ${segment_files} > "${vvcfile}"
+    print_and_run \
+        cmp "${reffile}" "${vvcfile}"
+
+    print_and_run \
+        python3 ../tools/stitch-segments.py -o "${vvcfile}" ${segment_files}
+
+    print_and_run \
+        DecoderAppStatic -b "${reffile}" -o "${refrecfile}"
+    print_and_run \
+        DecoderAppStatic -b "${vvcfile}" -o "${recfile}"
+    print_and_run \
+        cmp "${refrecfile}" "${recfile}"
+
+    cleanup
+}
+
+# Encode each tile of a uniform tile grid of the full picture in a separate
+# process with --partial-coding, merge the tiles with merge-tiles.py and
+# decode the result. The dimensions of the full picture must be divisible
+# by the grid and give tiles of whole CTUs.
+partial_coding_test() {
+    dimensions="$1"
+    shift
+    frames="$1"
+    shift
+    format="$1"
+    shift
+    tiles="$1"
+    shift
+
+    width="${dimensions%x*}"
+    height="${dimensions#*x}"
+    columns="${tiles%x*}"
+    rows="${tiles#*x}"
+    tile_width=$((width / columns))
+    tile_height=$((height / rows))
+
+    # Every tile is encoded from the same input.
+    prepare "${tile_width}x${tile_height}" "${frames}" "${format}"
+
+    tile_files=''
+    row=0
+    while [ ${row} -lt ${rows} ]; do
+        column=0
+        while [ ${column} -lt ${columns} ]; do
+            tile_file="${vvcfile}.${row}.${column}"
+            print_and_run \
+                $valgrind \
+                    ../bin/uvg266 -i "${yuvfile}" "--input-res=${tile_width}x${tile_height}" -o "${tile_file}" \
+                    "--tiles=${tiles}" \
+                    "--partial-coding=$((column * tile_width / 64))!$((row * tile_height / 64))!${width}!${height}" \
+                    "$@"
+            tile_files="${tile_files} ${tile_file}"
+            column=$((column + 1))
+        done
+        row=$((row + 1))
+    done
+
+    # No quotes for $tile_files because it expands to multiple arguments.
+    print_and_run \
+        python3 ../tools/merge-tiles.py -o "${vvcfile}" ${tile_files}
+
+    print_and_run \
+        DecoderAppStatic -b "${vvcfile}"
+
+    cleanup
+}
+
+# Print the distinct picture parameter sets of a VVC bitstream as hex, one
+# per line.
+list_pps() {
+    od -An -v -tx1 "$1" | tr -s ' \n' '  ' |
+        sed 's/ 00 00 01 /\
+/g' |
+        sed -n 's/\( 00\)* *$//; /^00 81 /p' |
+        sort -u
+}
+
+# Encode and decode like valgrind_test and check that the bitstream has at
+# least the given number of distinct picture parameter sets.
+pps_test() {
+    min_pps="$1"
+    shift
+    dimensions="$1"
+    shift
+    frames="$1"
+    shift
+    format="$1"
+    shift
+
+    prepare "${dimensions}" "${frames}" "${format}"
+
     print_and_run \
         $valgrind \
             ../bin/uvg266 -i "${yuvfile}" "--input-res=${dimensions}" -o "${vvcfile}" "$@"
@@ -53,7 +243,10 @@ valgrind_test() {
     print_and_run \
         DecoderAppStatic -b "${vvcfile}"
 
+    pps_count="$(list_pps "${vvcfile}" | wc -l)"
+    printf 'Distinct picture parameter sets: %s\n' "${pps_count}"
     cleanup
+    [ ${pps_count} -ge ${min_pps} ]
 }
 
 encode_test() {
@@ -0,0 +1,170 @@
+"""
+/*****************************************************************************
+ * This file is part of uvg266 VVC encoder.
+ *
+ * Copyright (c) 2021, Tampere University, ITU/ISO/IEC, project contributors
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * * Neither the name of the Tampere University or ITU/ISO/IEC nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ ****************************************************************************/
+"""
+
+
+"""
+Merge VVC bitstreams of the tiles of a picture into one bitstream.
+
+Each input must be encoded from one tile of the full picture with
+uvg266 --partial-coding and the same settings, including --tiles for
+the tile grid of the full picture. The parameter sets, picture headers
+and SEI messages are taken from the first input, and the slices of all
+the inputs are put in the order of their slice addresses.
+
+Usage: merge-tiles.py -o OUTPUT TILE [TILE ...]
+"""
+
+import argparse
+import sys
+
+NAL_PH = 19
+# NAL unit types that start a new access unit when they follow a slice.
+NAL_AU_START = (13, 14, 15, 16, 17, 19, 20, 23)
+
+
+def split_nal_units(data):
+    """Split an Annex B byte stream into (start code, NAL unit) pairs."""
+    units = []
+    pos = data.find(b"\x00\x00\x01")
+    while pos >= 0:
+        start = pos
+        # Include the zero_byte of a four byte start code.
+        if start > 0 and data[start - 1] == 0:
+            start -= 1
+        nal_start = pos + 3
+        next_pos = data.find(b"\x00\x00\x01", nal_start)
+        nal_end = len(data) if next_pos < 0 else next_pos
+        if next_pos >= 0 and data[next_pos - 1] == 0:
+            nal_end -= 1
+        units.append((data[start:nal_start], data[nal_start:nal_end]))
+        pos = next_pos
+    return units
+
+
+def nal_type(nal):
+    return nal[1] >> 3
+
+
+def is_vcl(nal):
+    return nal_type(nal) < 12
+
+
+def split_access_units(units):
+    """Group NAL units into access units."""
+    access_units = []
+    current = []
+    seen_vcl = False
+    for unit in units:
+        if seen_vcl and nal_type(unit[1]) in NAL_AU_START:
+            access_units.append(current)
+            current = []
+            seen_vcl = False
+        current.append(unit)
+        seen_vcl = seen_vcl or is_vcl(unit[1])
+    if current:
+        access_units.append(current)
+    return access_units
+
+
+def slice_address(nal, address_bits):
+    """Read sh_slice_address of a slice with the picture header in a PH NAL unit."""
+    payload = nal[2:10].replace(b"\x00\x00\x03", b"\x00\x00")
+    bits = int.from_bytes(payload[:4].ljust(4, b"\x00"), "big")
+    if bits >> 31:
+        raise ValueError("Slice has the picture header in the slice header. "
+                         "Encode the tiles with --partial-coding.")
+    return (bits >> (31 - address_bits)) & ((1 << address_bits) - 1)
+
+
+def merge(inputs, output):
+    streams = []
+    for filename in inputs:
+        with open(filename, "rb") as f:
+            streams.append(split_access_units(split_nal_units(f.read())))
+
+    num_pictures = len(streams[0])
+    if any(len(aus) != num_pictures for aus in streams):
+        raise ValueError("The inputs have different numbers of pictures.")
+
+    num_slices = len(inputs)
+    address_bits = (num_slices - 1).bit_length()
+
+    for picture in range(num_pictures):
+        slices = []
+        for aus in streams:
+            vcl = [unit for unit in aus[picture] if is_vcl(unit[1])]
+            if len(vcl) != 1:
+                raise ValueError("Picture {} of a tile does not have exactly one slice.".format(picture))
+            address = slice_address(vcl[0][1], address_bits) if num_slices > 1 else 0
+            slices.append((address, vcl[0]))
+
+        slices.sort(key=lambda s: s[0])
+        if [s[0] for s in slices] != list(range(num_slices)):
+            raise ValueError("Picture {} does not have the slices of all tiles. "
+                             "Check the --tiles and --partial-coding options.".format(picture))
+
+        # Non-VCL NAL units of the first input before and after its slice.
+        first = streams[0][picture]
+        vcl_index = next(i for i, unit in enumerate(first) if is_vcl(unit[1]))
+        if not any(nal_type(unit[1]) == NAL_PH for unit in first[:vcl_index]):
+            raise ValueError("Picture {} has no picture header.".format(picture))
+
+        for start_code, nal in first[:vcl_index]:
+            output.write(start_code)
+            output.write(nal)
+        for _, (start_code, nal) in slices:
+            output.write(start_code)
+            output.write(nal)
+        for start_code, nal in first[vcl_index + 1:]:
+            output.write(start_code)
+            output.write(nal)
+
+    return num_pictures
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Merge VVC bitstreams of the tiles of a picture into one bitstream.")
+    parser.add_argument("-o", "--output", required=True, help="output file")
+    parser.add_argument("tiles", nargs="+", help="bitstreams of the tiles")
+    args = parser.parse_args()
+
+    with open(args.output, "wb") as output:
+        num_pictures = merge(args.tiles, output)
+    print("Merged {} pictures of {} tiles.".format(num_pictures, len(args.tiles)),
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
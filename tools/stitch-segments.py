@@ -0,0 +1,168 @@
+"""
+/*****************************************************************************
+ * This file is part of uvg266 VVC encoder.
+ *
+ * Copyright (c) 2021, Tampere University, ITU/ISO/IEC, project contributors
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * * Neither the name of the Tampere University or ITU/ISO/IEC nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ ****************************************************************************/
+"""
+
+
+"""
+Join VVC bitstreams of consecutive segments into one stream.
+
+Each segment must start with an IDR picture, as the segments written by
+uvg266 --segment-length --segment-index do. Parameter sets at the start
+of a segment that are identical to the ones already in effect are
+dropped. Changed parameter sets are kept, so the stream stays valid even
+if the segments were encoded with different settings.
+
+Usage: stitch-segments.py -o OUTPUT SEGMENT [SEGMENT ...]
+"""
+
+import argparse
+import sys
+
+NAL_VPS = 14
+NAL_SPS = 15
+NAL_PPS = 16
+NAL_AUD = 20
+NAL_PREFIX_SEI = 23
+NAL_IDR_W_RADL = 7
+NAL_IDR_N_LP = 8
+
+
+def split_nal_units(data):
+    """Split an Annex B byte stream into (start code, NAL unit) pairs."""
+    units = []
+    pos = data.find(b"\x00\x00\x01")
+    while pos >= 0:
+        start = pos
+        # Include the zero_byte of a four byte start code.
+        if start > 0 and data[start - 1] == 0:
+            start -= 1
+        nal_start = pos + 3
+        next_pos = data.find(b"\x00\x00\x01", nal_start)
+        nal_end = len(data) if next_pos < 0 else next_pos
+        if next_pos >= 0 and data[next_pos - 1] == 0:
+            nal_end -= 1
+        units.append((data[start:nal_start], data[nal_start:nal_end]))
+        pos = next_pos
+    return units
+
+
+def remove_emulation_prevention(payload):
+    return payload.replace(b"\x00\x00\x03", b"\x00\x00")
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def u(self, bits):
+        value = 0
+        for _ in range(bits):
+            byte = self.data[self.pos >> 3]
+            value = (value << 1) | ((byte >> (7 - (self.pos & 7))) & 1)
+            self.pos += 1
+        return value
+
+
+def nal_type(nal):
+    return nal[1] >> 3
+
+
+def parameter_set_key(nal):
+    """Return (type, id) of a VPS, SPS or PPS, or None for other NAL units."""
+    type = nal_type(nal)
+    if type not in (NAL_VPS, NAL_SPS, NAL_PPS):
+        return None
+    reader = BitReader(remove_emulation_prevention(nal[2:]))
+    if type == NAL_PPS:
+        # pps_pic_parameter_set_id is u(6).
+        return (type, reader.u(6))
+    # vps_video_parameter_set_id and sps_seq_parameter_set_id are u(4).
+    return (type, reader.u(4))
+
+
+def stitch(segments, output):
+    # Parameter sets in effect, by type and id.
+    parameter_sets = {}
+    dropped = 0
+
+    for index, filename in enumerate(segments):
+        with open(filename, "rb") as f:
+            units = split_nal_units(f.read())
+        if not units:
+            print("Segment {} is empty, skipping.".format(filename), file=sys.stderr)
+            continue
+
+        first_vcl = next((nal for _, nal in units if nal_type(nal) < 12), None)
+        if first_vcl is None or nal_type(first_vcl) not in (NAL_IDR_W_RADL, NAL_IDR_N_LP):
+            raise ValueError("Segment {} does not start with an IDR picture.".format(filename))
+
+        in_header = True
+        for start_code, nal in units:
+            type = nal_type(nal)
+            if type < 12:
+                in_header = False
+
+            key = parameter_set_key(nal)
+            if in_header and key is not None:
+                if parameter_sets.get(key) == nal:
+                    dropped += 1
+                    continue
+                parameter_sets[key] = nal
+            elif key is not None:
+                parameter_sets[key] = nal
+
+            # The stream must start with a four byte start code.
+            if output.tell() == 0 and len(start_code) == 3:
+                start_code = b"\x00" + start_code
+            output.write(start_code)
+            output.write(nal)
+
+    return dropped
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Join VVC bitstreams of consecutive closed GOP segments.")
+    parser.add_argument("-o", "--output", required=True, help="output file")
+    parser.add_argument("segments", nargs="+", help="segment files in order")
+    args = parser.parse_args()
+
+    with open(args.output, "wb") as output:
+        dropped = stitch(args.segments, output)
+    print("Joined {} segments, dropped {} duplicate parameter sets.".format(
+        len(args.segments), dropped), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()